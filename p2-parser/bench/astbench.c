@@ -0,0 +1,505 @@
+/**
+ * @file astbench.c
+ * @brief AST allocation benchmark
+ *
+ * Builds the same synthetic AST (functions full of assignments and
+ * conditionals, with two integer attributes on every node, as the driver's
+ * parent and depth passes add) once with every node, list, and attribute
+ * record coming from @c calloc and once from an arena installed with @ref
+ * ASTNode_use_arena. Reports the time to build and to free the tree, per
+ * node, and how many separate blocks each path allocates.
+ *
+ * It also parses the benchmark corpus and reports the memory the resulting
+ * AST occupies per node (node structures plus lists, parameters, and string
+ * literals, all of which come from the tree's arena), then flattens it with
+ * @ref FlatAST_new and compares the flat footprint and the time of a simple
+ * pass (summing integer literals) over the pointer tree, over the flat array
+ * directly, and over the flat tree's node views through @ref FlatAST_traverse.
+ * Finally it times a four-pass pipeline (parent links, depths, literal sum,
+ * node count) run as separate traversals and fused into one traversal with a
+ * composite visitor, the fused pipeline run by @ref
+ * NodeVisitor_traverse_parallel with one to eight threads, the debug print
+ * and DOT graph output (written to @c /dev/null), and a per-function query
+ * ("does this function call anything?") answered with and without stopping
+ * at the first call.
+ *
+ * Usage: <tt>astbench [statements]</tt>
+ */
+
+#include <unistd.h>
+
+#include "p1-lexer.h"
+#include "p2-parser.h"
+#include "visitor.h"
+#include "flatast.h"
+#include "corpus.h"
+
+/**
+ * @brief Data structure used by @c setjmp / @c longjmp for exception handling
+ */
+jmp_buf decaf_error;
+
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    longjmp(decaf_error, 1);
+}
+
+/**
+ * @brief Number of nodes built so far (for reporting)
+ */
+static size_t nodes_built = 0;
+
+/**
+ * @brief Number of separate blocks the tree built so far needs on the heap
+ */
+static size_t heap_blocks = 0;
+
+/**
+ * @brief Allocate a node list (counting it)
+ */
+static NodeList* new_list (void)
+{
+    heap_blocks++;
+    return NodeList_new();
+}
+
+/**
+ * @brief Add the attributes that the driver's passes add to every node
+ */
+static ASTNode* tag (ASTNode* node, int depth)
+{
+    ASTNode_set_int_attribute(node, "parent", depth - 1);
+    ASTNode_set_int_attribute(node, "depth", depth);
+    nodes_built++;
+    heap_blocks++;
+    return node;
+}
+
+/**
+ * @brief Build <tt>a = b + i;</tt> at the given depth
+ */
+static ASTNode* build_assignment (int i, int depth)
+{
+    ASTNode* left = tag(LocationNode_new("b", NULL, i), depth + 2);
+    ASTNode* right = tag(LiteralNode_new_int(i, i), depth + 2);
+    ASTNode* sum = tag(BinaryOpNode_new(ADDOP, left, right, i), depth + 1);
+    return tag(AssignmentNode_new(tag(LocationNode_new("a", NULL, i), depth + 1), sum, i), depth);
+}
+
+/**
+ * @brief Build <tt>if (a < i) { return a; }</tt> at the given depth
+ */
+static ASTNode* build_conditional (int i, int depth)
+{
+    ASTNode* cond = tag(BinaryOpNode_new(LTOP, tag(LocationNode_new("a", NULL, i), depth + 2),
+                                         tag(LiteralNode_new_int(i, i), depth + 2), i), depth + 1);
+    NodeList* stmts = new_list();
+    NodeList_add(stmts, tag(ReturnNode_new(tag(LocationNode_new("a", NULL, i), depth + 3), i), depth + 2));
+    ASTNode* body = tag(BlockNode_new(new_list(), stmts, i), depth + 1);
+    return tag(ConditionalNode_new(cond, body, NULL, i), depth);
+}
+
+/**
+ * @brief Build a program with the given number of statements (100 per
+ * function)
+ */
+static ASTNode* build_program (int statements)
+{
+    NodeList* funcs = new_list();
+    for (int f = 0; f < statements; f += 100) {
+        NodeList* vars = new_list();
+        NodeList_add(vars, tag(VarDeclNode_new("a", INT, false, 1, f), 3));
+        NodeList_add(vars, tag(VarDeclNode_new("b", INT, false, 1, f), 3));
+        NodeList* stmts = new_list();
+        for (int i = f; i < f + 100 && i < statements; i++) {
+            NodeList_add(stmts, (i % 2 == 0 ? build_assignment(i, 3) : build_conditional(i, 3)));
+        }
+        ParameterList* params = ParameterList_new();
+        ParameterList_add_new(params, "x", INT);
+        heap_blocks += 2;
+        ASTNode* body = tag(BlockNode_new(vars, stmts, f), 2);
+        NodeList_add(funcs, tag(FuncDeclNode_new("f", INT, params, body, f), 1));
+    }
+    return tag(ProgramNode_new(new_list(), funcs), 0);
+}
+
+/**
+ * @brief Build and free the tree repeatedly and report the best times
+ */
+static void bench (const char* label, bool use_arena, int statements, int reps)
+{
+    double best_build = 1e9, best_free = 1e9;
+    size_t blocks = 0;
+    for (int r = 0; r < reps; r++) {
+        Arena* arena = (use_arena ? Arena_new() : NULL);
+        nodes_built = 0;
+        heap_blocks = 0;
+        double start = Corpus_now();
+        ASTNode_use_arena(arena);
+        ASTNode* tree = build_program(statements);
+        ASTNode_use_arena(NULL);
+        double built = Corpus_now();
+        blocks = (use_arena ? arena->chunks : heap_blocks);
+        ASTNode_free(tree);
+        double freed = Corpus_now();
+        best_build = (built - start < best_build ? built - start : best_build);
+        best_free = (freed - built < best_free ? freed - built : best_free);
+    }
+    printf("  %-6s build %7.1f ns/node  free %6.1f ns/node  %10.1fM nodes/sec  %9zu blocks\n",
+           label, best_build * 1e9 / nodes_built, best_free * 1e9 / nodes_built,
+           nodes_built / (best_build + best_free) / 1e6, blocks);
+}
+
+/**
+ * @brief Count every node in a tree (previsit hook)
+ */
+static void count_node (NodeVisitor* visitor, ASTNode* node)
+{
+    (*(size_t*)visitor->data)++;
+}
+
+/**
+ * @brief Add up integer literals (previsit hook)
+ */
+static void sum_literal (NodeVisitor* visitor, ASTNode* node)
+{
+    if (node->literal.type == INT) {
+        *(long*)visitor->data += node->literal.integer;
+    }
+}
+
+/**
+ * @brief Run the literal-summing pass over a pointer tree (or a flat tree's
+ * views) and return the best time per node
+ */
+static double time_visitor_pass (ASTNode* tree, FlatAST* flat, size_t nodes, long* sum)
+{
+    double best = 1e9;
+    NodeVisitor* summer = NodeVisitor_new();
+    summer->data = sum;
+    summer->previsit_literal = sum_literal;
+    for (int r = 0; r < 10; r++) {
+        *sum = 0;
+        double start = Corpus_now();
+        if (flat != NULL) {
+            FlatAST_traverse(summer, flat);
+        } else {
+            NodeVisitor_traverse(summer, tree);
+        }
+        double elapsed = Corpus_now() - start;
+        best = (elapsed < best ? elapsed : best);
+    }
+    NodeVisitor_free(summer);
+    return best * 1e9 / nodes;
+}
+
+/**
+ * @brief Run the literal-summing pass as a scan of the flat node array and
+ * return the best time per node
+ */
+static double time_flat_scan (FlatAST* flat, long* sum)
+{
+    double best = 1e9;
+    for (int r = 0; r < 10; r++) {
+        *sum = 0;
+        double start = Corpus_now();
+        for (FlatIndex i = 0; i < flat->count; i++) {
+            if (flat->nodes[i].type == LITERAL && flat->nodes[i].literal_type == INT) {
+                *sum += (int)flat->nodes[i].payload;
+            }
+        }
+        double elapsed = Corpus_now() - start;
+        best = (elapsed < best ? elapsed : best);
+    }
+    return best * 1e9 / flat->count;
+}
+
+/**
+ * @brief Flatten a parsed tree and compare footprint and pass times
+ */
+static void measure_flat (ASTNode* tree, size_t nodes)
+{
+    double start = Corpus_now();
+    FlatAST* flat = FlatAST_new(tree);
+    double flattened = Corpus_now() - start;
+    size_t bytes = flat->count * sizeof(FlatNode) + flat->vardecl_count * sizeof(FlatVarDecl) +
+                   flat->funcdecl_count * sizeof(FlatFuncDecl) + flat->param_count * sizeof(FlatParam) +
+                   flat->string_count * sizeof(char*) + flat->arena->allocated;
+    printf("flat AST (%u nodes, flattened in %.1f ns/node)\n", flat->count, flattened * 1e9 / nodes);
+    printf("  node struct %4zu bytes\n", sizeof(FlatNode));
+    printf("  flat total  %6.1f bytes/node\n", (double)bytes / flat->count);
+    printf("  view buffer %6.1f bytes/node (largest function: %u nodes)\n",
+           (double)(flat->body_capacity * sizeof(ASTNode) + flat->list_capacity * sizeof(NodeList)) / flat->count,
+           flat->body_capacity);
+
+    long expected = 0, sum = 0;
+    double pointer_time = time_visitor_pass(tree, NULL, nodes, &expected);
+    printf("  pass: pointer tree %6.2f ns/node\n", pointer_time);
+    double scan_time = time_flat_scan(flat, &sum);
+    printf("  pass: flat scan    %6.2f ns/node%s\n", scan_time, (sum == expected ? "" : "  ** MISMATCH **"));
+    double view_time = time_visitor_pass(NULL, flat, nodes, &sum);
+    printf("  pass: flat views   %6.2f ns/node%s\n", view_time, (sum == expected ? "" : "  ** MISMATCH **"));
+    FlatAST_free(flat);
+}
+
+/**
+ * @brief Allocate the visitors of the four-pass pipeline
+ */
+static void pipeline_passes (NodeVisitor** passes, long* sum, size_t* count)
+{
+    passes[0] = SetParentVisitor_new();
+    passes[1] = CalcDepthVisitor_new();
+    passes[2] = NodeVisitor_new();
+    passes[2]->data = sum;
+    passes[2]->previsit_literal = sum_literal;
+    passes[3] = NodeVisitor_new();
+    passes[3]->data = count;
+    passes[3]->previsit_default = count_node;
+}
+
+/**
+ * @brief Time the pipeline as separate traversals and as one fused traversal
+ */
+static void measure_fusion (ASTNode* tree, size_t nodes)
+{
+    double best_separate = 1e9, best_fused = 1e9;
+    long sum = 0;
+    size_t count = 0;
+    for (int r = 0; r < 10; r++) {
+        NodeVisitor* passes[4];
+        pipeline_passes(passes, &sum, &count);
+        double start = Corpus_now();
+        for (int i = 0; i < 4; i++) {
+            NodeVisitor_traverse_and_free(passes[i], tree);
+        }
+        double separate = Corpus_now() - start;
+
+        NodeVisitor* fused = CompositeVisitor_new();
+        pipeline_passes(passes, &sum, &count);
+        for (int i = 0; i < 4; i++) {
+            CompositeVisitor_add(fused, passes[i]);
+        }
+        start = Corpus_now();
+        NodeVisitor_traverse_and_free(fused, tree);
+        double together = Corpus_now() - start;
+
+        best_separate = (separate < best_separate ? separate : best_separate);
+        best_fused = (together < best_fused ? together : best_fused);
+    }
+    printf("pipeline (4 passes)\n");
+    printf("  separate %7.1f ns/node\n", best_separate * 1e9 / nodes);
+    printf("  fused    %7.1f ns/node  (%.2fx)\n", best_fused * 1e9 / nodes, best_separate / best_fused);
+}
+
+/**
+ * @brief Give a worker copy of the literal sum pass its own total (fork callback)
+ */
+static NodeVisitor* fork_sum (NodeVisitor* visitor)
+{
+    NodeVisitor* part = NodeVisitor_fork_shared(visitor);
+    part->data = calloc(1, sizeof(long));
+    part->dtor = free;
+    return part;
+}
+
+static void join_sum (NodeVisitor* visitor, NodeVisitor* part)
+{
+    *(long*)visitor->data += *(long*)part->data;
+}
+
+/**
+ * @brief Give a worker copy of the node count pass its own count (fork callback)
+ */
+static NodeVisitor* fork_count (NodeVisitor* visitor)
+{
+    NodeVisitor* part = NodeVisitor_fork_shared(visitor);
+    part->data = calloc(1, sizeof(size_t));
+    part->dtor = free;
+    return part;
+}
+
+static void join_count (NodeVisitor* visitor, NodeVisitor* part)
+{
+    *(size_t*)visitor->data += *(size_t*)part->data;
+}
+
+/**
+ * @brief Time the fused pipeline traversing the functions on several threads
+ */
+static void measure_parallel (ASTNode* tree, size_t nodes)
+{
+    printf("parallel pipeline (%d functions, %ld processors online)\n",
+           NodeList_size(tree->program.functions), sysconf(_SC_NPROCESSORS_ONLN));
+    double serial = 0;
+    for (int workers = 1; workers <= 8; workers *= 2) {
+        double best = 1e9;
+        long sum = 0;
+        size_t count = 0;
+        for (int r = 0; r < 5; r++) {
+            NodeVisitor* passes[4];
+            sum = 0;
+            count = 0;
+            pipeline_passes(passes, &sum, &count);
+            passes[2]->fork = fork_sum;
+            passes[2]->join = join_sum;
+            passes[3]->fork = fork_count;
+            passes[3]->join = join_count;
+            NodeVisitor* fused = CompositeVisitor_new();
+            for (int i = 0; i < 4; i++) {
+                CompositeVisitor_add(fused, passes[i]);
+            }
+            double start = Corpus_now();
+            NodeVisitor_traverse_parallel(fused, tree, workers);
+            double elapsed = Corpus_now() - start;
+            NodeVisitor_free(fused);
+            best = (elapsed < best ? elapsed : best);
+        }
+        if (workers == 1) {
+            serial = best;
+        }
+        printf("  %d thread%s %7.1f ns/node  (%.2fx, %zu nodes counted)\n", workers, (workers == 1 ? " " : "s"),
+               best * 1e9 / nodes, serial / best, count);
+    }
+}
+
+/**
+ * @brief Time the debug print and DOT graph visitors
+ */
+static void measure_output (ASTNode* tree, size_t nodes)
+{
+    FILE* sink = fopen("/dev/null", "w");
+    if (sink == NULL) {
+        return;
+    }
+    double best_print = 1e9, best_graph = 1e9, best_image = 1e9;
+    for (int r = 0; r < 5; r++) {
+        double start = Corpus_now();
+        NodeVisitor_traverse_and_free(PrintVisitor_new(sink), tree);
+        fflush(sink);
+        double print = Corpus_now() - start;
+        start = Corpus_now();
+        NodeVisitor_traverse_and_free(GenerateASTGraph_new(sink), tree);
+        fflush(sink);
+        double graph = Corpus_now() - start;
+        start = Corpus_now();
+        NodeVisitor_traverse_and_free(GenerateASTImage_new(sink), tree);
+        fflush(sink);
+        double image = Corpus_now() - start;
+        best_print = (print < best_print ? print : best_print);
+        best_graph = (graph < best_graph ? graph : best_graph);
+        best_image = (image < best_image ? image : best_image);
+    }
+    fclose(sink);
+    printf("output\n");
+    printf("  print    %7.1f ns/node\n", best_print * 1e9 / nodes);
+    printf("  graph    %7.1f ns/node\n", best_graph * 1e9 / nodes);
+    printf("  image    %7.1f ns/node\n", best_image * 1e9 / nodes);
+}
+
+/**
+ * @brief State of the "does this function call anything?" query
+ */
+typedef struct CallQuery {
+    bool found;         /**< @brief True once a function call has been seen */
+    bool stop;          /**< @brief True if the query stops at the first call */
+    size_t visited;     /**< @brief Number of nodes visited */
+} CallQuery;
+
+static void query_visit (NodeVisitor* visitor, ASTNode* node)
+{
+    ((CallQuery*)visitor->data)->visited++;
+}
+
+static void query_funccall (NodeVisitor* visitor, ASTNode* node)
+{
+    CallQuery* query = (CallQuery*)visitor->data;
+    query->visited++;
+    query->found = true;
+    if (query->stop) {
+        visitor->control = TRAVERSE_STOP;
+    }
+}
+
+/**
+ * @brief Time the call query over every function, with and without stopping
+ * at the first call
+ */
+static void measure_query (ASTNode* tree)
+{
+    printf("call query (per function)\n");
+    for (int stop = 0; stop <= 1; stop++) {
+        CallQuery query = { false, stop, 0 };
+        NodeVisitor* visitor = NodeVisitor_new();
+        visitor->data = &query;
+        visitor->previsit_default = query_visit;
+        visitor->previsit_funccall = query_funccall;
+        double best = 1e9;
+        size_t calling = 0, visited = 0;
+        for (int r = 0; r < 10; r++) {
+            calling = 0;
+            query.visited = 0;
+            double start = Corpus_now();
+            FOR_EACH(ASTNode*, func, tree->program.functions) {
+                query.found = false;
+                NodeVisitor_traverse(visitor, func);
+                calling += query.found;
+            }
+            double elapsed = Corpus_now() - start;
+            best = (elapsed < best ? elapsed : best);
+            visited = query.visited;
+        }
+        NodeVisitor_free(visitor);
+        printf("  %-8s %7.2f ms  (%zu nodes visited, %zu of %d functions call)\n",
+               stop ? "stop" : "full", best * 1e3, visited, calling, NodeList_size(tree->program.functions));
+    }
+}
+
+/**
+ * @brief Parse the benchmark corpus and report AST bytes per node
+ */
+static void measure_corpus (size_t size)
+{
+    char* text = Corpus_generate(size, 42);
+    TokenQueue* tokens = lex_padded(text);
+    size_t ntokens = TokenQueue_size(tokens);
+    ASTNode* tree = parse(tokens);
+
+    size_t nodes = 0;
+    NodeVisitor* counter = NodeVisitor_new();
+    counter->data = &nodes;
+    counter->previsit_default = count_node;
+    NodeVisitor_traverse_and_free(counter, tree);
+
+    printf("corpus AST (%zu bytes, %zu tokens, %zu nodes)\n", strlen(text), ntokens, nodes);
+    printf("  node struct %4zu bytes\n", sizeof(ASTNode));
+    printf("  arena total %6.1f bytes/node  (%zu bytes in %zu chunks)\n",
+           (double)tree->arena->allocated / nodes, tree->arena->allocated, tree->arena->chunks);
+    measure_flat(tree, nodes);
+    measure_fusion(tree, nodes);
+    measure_parallel(tree, nodes);
+    measure_output(tree, nodes);
+    measure_query(tree);
+
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+    free(text);
+}
+
+int main (int argc, char** argv)
+{
+    int statements = (argc > 1 ? atoi(argv[1]) : 200000);
+    if (setjmp(decaf_error) != 0) {
+        return EXIT_FAILURE;
+    }
+    ASTNode_free(build_program(100));   /* warm up the allocator and interner */
+    printf("synthetic AST (%d statements)\n", statements);
+    bench("calloc", false, statements, 5);
+    bench("arena", true, statements, 5);
+    measure_corpus(4 * 1024 * 1024);
+    intern_free_all();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+/**
+ * @file corpus.c
+ * @brief Synthetic Decaf source generator for benchmarks
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+
+#include "corpus.h"
+#include "scan.h"
+
+/**
+ * @brief Growable output text
+ */
+typedef struct Text {
+    char* data;
+    size_t len;
+    size_t cap;
+} Text;
+
+static void Text_printf (Text* text, const char* format, ...)
+{
+    va_list args;
+    for (;;) {
+        va_start(args, format);
+        int n = vsnprintf(text->data + text->len, text->cap - text->len, format, args);
+        va_end(args);
+        if (text->len + n < text->cap) {
+            text->len += n;
+            return;
+        }
+        text->cap = (text->cap + n) * 2;
+        text->data = (char*)realloc(text->data, text->cap);
+        CHECK_MALLOC_PTR(text->data)
+    }
+}
+
+/**
+ * @brief Move generated text into a padded buffer (see @ref SCAN_PADDING), so
+ * that the benchmarks can lex it with the vector kernels
+ */
+static char* Text_finish (Text* text)
+{
+    char* padded = scan_buffer_alloc(text->len);
+    memcpy(padded, text->data, text->len);
+    free(text->data);
+    return padded;
+}
+
+static const char* const names[] = {
+    "a", "b", "count", "total", "index", "value", "flag", "result", "x1", "y_2", "tmp", "limit"
+};
+#define NUM_NAMES (sizeof(names)/sizeof(names[0]))
+
+static const char* const binops[] = {
+    "+", "-", "*", "/", "%", "<", "<=", ">=", ">", "==", "!=", "&&", "||"
+};
+#define NUM_BINOPS (sizeof(binops)/sizeof(binops[0]))
+
+static void gen_operand (Text* text)
+{
+    switch (rand() % 5) {
+        case 0:  Text_printf(text, "%d", rand() % 1000); break;
+        case 1:  Text_printf(text, "0x%X", rand() % 4096 + 1); break;
+        case 2:  Text_printf(text, "%s", rand() % 2 ? "true" : "false"); break;
+        default: Text_printf(text, "%s", names[rand() % NUM_NAMES]); break;
+    }
+}
+
+static void gen_expr (Text* text)
+{
+    if (rand() % 4 == 0) {
+        Text_printf(text, "-");
+    }
+    gen_operand(text);
+    if (rand() % 3 != 0) {
+        Text_printf(text, " %s ", binops[rand() % NUM_BINOPS]);
+        gen_operand(text);
+    }
+}
+
+static void gen_block (Text* text, int depth);
+
+static void gen_stmt (Text* text, int depth)
+{
+    int indent = 4 * depth;
+    switch (rand() % (depth < 4 ? 8 : 5)) {
+        case 0:
+            Text_printf(text, "%*sprint_str(\"value:\\t%d\\n\");\n", indent, "", rand() % 100);
+            break;
+        case 1:
+            Text_printf(text, "%*sprint_int(", indent, "");
+            gen_expr(text);
+            Text_printf(text, ");\n");
+            break;
+        case 2:
+            Text_printf(text, "%*sreturn ", indent, "");
+            gen_expr(text);
+            Text_printf(text, ";\n");
+            break;
+        case 5:
+            Text_printf(text, "%*sif (", indent, "");
+            gen_expr(text);
+            Text_printf(text, ")\n");
+            gen_block(text, depth);
+            if (rand() % 2) {
+                Text_printf(text, "%*selse\n", indent, "");
+                gen_block(text, depth);
+            }
+            break;
+        case 6:
+            Text_printf(text, "%*swhile (", indent, "");
+            gen_expr(text);
+            Text_printf(text, ")\n");
+            gen_block(text, depth);
+            break;
+        default:
+            Text_printf(text, "%*s%s = ", indent, "", names[rand() % NUM_NAMES]);
+            gen_expr(text);
+            Text_printf(text, ";   // update\n");
+            break;
+    }
+}
+
+static void gen_block (Text* text, int depth)
+{
+    Text_printf(text, "%*s{\n", 4 * depth, "");
+    int nvars = rand() % 3;
+    for (int i = 0; i < nvars; i++) {
+        Text_printf(text, "%*s%s %s;\n", 4 * (depth + 1), "",
+                rand() % 2 ? "int" : "bool", names[rand() % NUM_NAMES]);
+    }
+    int nstmts = rand() % 5 + 1;
+    for (int i = 0; i < nstmts; i++) {
+        gen_stmt(text, depth + 1);
+    }
+    Text_printf(text, "%*s}\n", 4 * depth, "");
+}
+
+char* Corpus_generate (size_t target_size, unsigned seed)
+{
+    Text text = { NULL, 0, 0 };
+    srand(seed);
+    Text_printf(&text, "// generated benchmark program (seed %u)\n", seed);
+    for (int i = 0; i < 16; i++) {
+        Text_printf(&text, "int g%d;\nbool h%d[%d];\n", i, i, rand() % 100 + 1);
+    }
+    for (int f = 0; text.len < target_size; f++) {
+        Text_printf(&text, "\ndef %s func%d(int a, bool flag)\n",
+                rand() % 2 ? "int" : "void", f);
+        gen_block(&text, 0);
+    }
+    return Text_finish(&text);
+}
+
+/**
+ * @brief Generate an expression of a given number of operands, with random
+ * binary operators, some unary operators, and some parenthesized groups
+ */
+static void gen_long_expr (Text* text, int terms)
+{
+    int open = 0;
+    for (int i = 0; i < terms; i++) {
+        if (i > 0) {
+            Text_printf(text, " %s ", binops[rand() % NUM_BINOPS]);
+        }
+        if (rand() % 8 == 0) {
+            Text_printf(text, rand() % 2 ? "-" : "!");
+        }
+        if (i + 1 < terms && open < 32 && rand() % 8 == 0) {
+            Text_printf(text, "(");
+            open++;
+        }
+        gen_operand(text);
+        if (open > 0 && rand() % 4 == 0) {
+            Text_printf(text, ")");
+            open--;
+        }
+    }
+    Text_printf(text, "%.*s", open, "))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))");
+}
+
+char* Corpus_generate_expressions (size_t target_size, unsigned seed, int terms)
+{
+    Text text = { NULL, 0, 0 };
+    srand(seed);
+    Text_printf(&text, "// generated expression benchmark program (seed %u, %d terms)\n", seed, terms);
+    for (int f = 0; text.len < target_size; f++) {
+        Text_printf(&text, "\ndef int func%d(int a, bool flag)\n{\n", f);
+        for (int i = 0; i < 8 && text.len < target_size; i++) {
+            Text_printf(&text, "    %s = ", names[rand() % NUM_NAMES]);
+            gen_long_expr(&text, terms);
+            Text_printf(&text, ";\n");
+        }
+        Text_printf(&text, "}\n");
+    }
+    return Text_finish(&text);
+}
+
+char* Corpus_read_file (const char* filename)
+{
+    FILE* input = fopen(filename, "rb");
+    if (input == NULL) {
+        return NULL;
+    }
+    fseek(input, 0, SEEK_END);
+    long size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    char* text = scan_buffer_alloc(size);
+    size_t nread = fread(text, 1, size, input);
+    text[nread] = '\0';
+    fclose(input);
+    return text;
+}
+
+double Corpus_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
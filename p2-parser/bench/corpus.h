@@ -0,0 +1,57 @@
+/**
+ * @file corpus.h
+ * @brief Synthetic Decaf source generator for benchmarks
+ */
+
+#ifndef __CORPUS_H
+#define __CORPUS_H
+
+#include "common.h"
+
+/**
+ * @brief Generate a syntactically valid Decaf program
+ *
+ * The output is deterministic for a given seed and size, so runs can be
+ * compared across builds. The program mixes global variables and functions
+ * whose bodies contain declarations, assignments, calls, conditionals, loops,
+ * and returns.
+ *
+ * @param target_size Approximate size (in bytes) of the generated text
+ * @param seed Random seed
+ * @returns Newly-allocated program text in a padded buffer (see @ref
+ * SCAN_PADDING; caller must free)
+ */
+char* Corpus_generate (size_t target_size, unsigned seed);
+
+/**
+ * @brief Generate a Decaf program made up almost entirely of expressions
+ *
+ * Every function body is a series of assignments whose right-hand sides have
+ * the given number of operands, joined by randomly-chosen binary operators
+ * and mixed with unary operators and parenthesized groups. Like @ref
+ * Corpus_generate, the output is deterministic for a given seed, size, and
+ * number of operands.
+ *
+ * @param target_size Approximate size (in bytes) of the generated text
+ * @param seed Random seed
+ * @param terms Number of operands in each expression
+ * @returns Newly-allocated program text in a padded buffer (see @ref
+ * SCAN_PADDING; caller must free)
+ */
+char* Corpus_generate_expressions (size_t target_size, unsigned seed, int terms);
+
+/**
+ * @brief Read a whole file into a newly-allocated padded buffer (see @ref
+ * SCAN_PADDING)
+ *
+ * @param filename Name of file to read
+ * @returns File contents (caller must free) or @c NULL if it cannot be read
+ */
+char* Corpus_read_file (const char* filename);
+
+/**
+ * @brief Look up a monotonic timestamp in seconds (for timing runs)
+ */
+double Corpus_now (void);
+
+#endif
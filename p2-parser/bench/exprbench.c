@@ -0,0 +1,115 @@
+/**
+ * @file exprbench.c
+ * @brief Expression parsing benchmark
+ *
+ * Parses generated programs that consist almost entirely of long expressions
+ * (see @ref Corpus_generate_expressions), from two operands per expression
+ * up to chains of a thousand, and reports parse time per token and
+ * throughput in MB of source per second, for both the recursive parser and
+ * the explicit-stack one (see @ref ParserMode). The programs are lexed in
+ * full beforehand, so only the parser is timed. The operators in each tree are
+ * counted and checked against the number of operator tokens, so a parser
+ * that drops or misplaces operands cannot look fast.
+ *
+ * Usage: <tt>exprbench [size-in-MB]</tt>
+ */
+
+#include "p1-lexer.h"
+#include "p2-parser.h"
+#include "visitor.h"
+#include "corpus.h"
+
+/**
+ * @brief Data structure used by @c setjmp / @c longjmp for exception handling
+ */
+jmp_buf decaf_error;
+
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    longjmp(decaf_error, 1);
+}
+
+static void count_operator (NodeVisitor* visitor, ASTNode* node)
+{
+    (*(size_t*)visitor->data)++;
+}
+
+/**
+ * @brief Count the unary and binary operators in a tree
+ */
+static size_t count_operators (ASTNode* tree)
+{
+    size_t count = 0;
+    NodeVisitor* counter = NodeVisitor_new();
+    counter->data = &count;
+    counter->previsit_binaryop = count_operator;
+    counter->previsit_unaryop = count_operator;
+    NodeVisitor_traverse_and_free(counter, tree);
+    return count;
+}
+
+/**
+ * @brief Count the operator tokens in a token queue
+ */
+static size_t count_operator_tokens (TokenQueue* tokens)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < TokenQueue_size(tokens); i++) {
+        TokenKind kind = TokenQueue_peek_ahead(tokens, i).kind;
+        count += (kind >= TK_OR && kind <= TK_BANG);
+    }
+    return count;
+}
+
+/**
+ * @brief Time parsing programs whose expressions have a given number of
+ * operands
+ */
+static bool bench (int terms, ParserMode mode, size_t size, int runs)
+{
+    char* text = Corpus_generate_expressions(size, 7, terms);
+    double best = 1e9;
+    size_t ntokens = 0, operators = 0, expected = 0;
+    for (int r = 0; r < runs; r++) {
+        TokenQueue* tokens = lex_padded(text);
+        ntokens = TokenQueue_size(tokens);
+        expected = count_operator_tokens(tokens);
+        double start = Corpus_now();
+        ASTNode* tree = parse_with_mode(tokens, mode);
+        double elapsed = Corpus_now() - start;
+        best = (elapsed < best ? elapsed : best);
+        operators = count_operators(tree);
+        ASTNode_free(tree);
+        TokenQueue_free(tokens);
+    }
+    printf("  %-9s %5d terms  %9zu tokens  %6.1f ns/token  %7.1f MB/s\n",
+           (mode == PARSER_STACK ? "stack" : "recursive"), terms, ntokens,
+           best * 1e9 / ntokens, strlen(text) / best / 1e6);
+    free(text);
+    if (operators != expected) {
+        fprintf(stderr, "operator count mismatch: %zu in tree, %zu in tokens\n", operators, expected);
+        return false;
+    }
+    return true;
+}
+
+int main (int argc, char** argv)
+{
+    size_t size = (size_t)((argc > 1 ? atof(argv[1]) : 4.0) * 1024 * 1024);
+    if (setjmp(decaf_error) != 0) {
+        return EXIT_FAILURE;
+    }
+    printf("expression parsing (%zu bytes per program)\n", size);
+    static const int terms[] = { 2, 8, 64, 1024 };
+    for (size_t i = 0; i < sizeof(terms) / sizeof(terms[0]); i++) {
+        if (!bench(terms[i], PARSER_RECURSIVE, size, 5) || !bench(terms[i], PARSER_STACK, size, 5)) {
+            return EXIT_FAILURE;
+        }
+    }
+    intern_free_all();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file lexbench.c
+ * @brief Lexer throughput benchmark
+ *
+ * Compares the table-driven DFA lexer in @c src/p1-lexer.c against the
+ * original regex-based lexer (the precompiled @c obj/p1-lexer.o, linked here
+ * with its entry point renamed to @c lex_regex). Both lexers are run over the
+ * same input, their token streams are checked for equality, and throughput is
+ * reported in tokens per second. The DFA lexer is timed both with the scalar
+ * scanning kernels and with the kernels selected for this CPU. Finally, the
+ * token storage of an eagerly-lexed queue is compared with that of a
+ * streaming queue whose tokens are taken one at a time, as the parser does.
+ *
+ * Usage: <tt>lexbench [file.decaf ...]</tt> (with no files, a synthetic
+ * program is generated instead).
+ */
+
+#include "p1-lexer.h"
+#include "corpus.h"
+
+/**
+ * @brief Original regex-based lexer (renamed copy of @c obj/p1-lexer.o)
+ */
+TokenQueue* lex_regex (const char* text);
+
+/**
+ * @brief Error message buffer
+ */
+char decaf_error_msg[MAX_ERROR_LEN];
+
+/**
+ * @brief Data structure used by @c setjmp / @c longjmp for exception handling
+ */
+jmp_buf decaf_error;
+
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(decaf_error_msg, MAX_ERROR_LEN, format, args);
+    va_end(args);
+    longjmp(decaf_error, 1);
+}
+
+/**
+ * @brief Check two token queues for identical type, text, and line sequences
+ */
+static bool same_tokens (TokenQueue* a, TokenQueue* b)
+{
+    size_t n = TokenQueue_size(a);
+    if (n != TokenQueue_size(b)) {
+        fprintf(stderr, "token count mismatch: %zu vs %zu\n", n, TokenQueue_size(b));
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        Token ta = TokenQueue_peek_ahead(a, i);
+        Token tb = TokenQueue_peek_ahead(b, i);
+        if (ta.type != tb.type || ta.kind != tb.kind || ta.line != tb.line || ta.span.length != tb.span.length ||
+                memcmp(Token_text(&ta), Token_text(&tb), ta.span.length) != 0) {
+            fprintf(stderr, "token mismatch on line %d: '%.*s' vs '%.*s'\n", ta.line,
+                    (int)ta.span.length, Token_text(&ta), (int)tb.span.length, Token_text(&tb));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Time repeated runs of one lexer and report tokens per second
+ */
+static double time_lexer (const char* label, TokenQueue* (*lexer)(const char*),
+                          const char* text, int reps, size_t* ntokens)
+{
+    double start = Corpus_now();
+    for (int i = 0; i < reps; i++) {
+        TokenQueue* tokens = lexer(text);
+        *ntokens = TokenQueue_size(tokens);
+        TokenQueue_free(tokens);
+    }
+    double elapsed = (Corpus_now() - start) / reps;
+    printf("  %-8s %10.3f ms  %12.0f tokens/sec\n", label, elapsed * 1e3, *ntokens / elapsed);
+    return elapsed;
+}
+
+/**
+ * @brief Report the token storage of an eager queue and the largest token
+ * storage of a streaming queue for the same text
+ */
+static void measure_token_storage (const char* text)
+{
+    size_t per_token = 2 * sizeof(uint8_t) + sizeof(int) + sizeof(TokenSpan);
+    TokenQueue* eager = lex_padded(text);
+    size_t eager_bytes = eager->capacity * per_token;
+    TokenQueue_free(eager);
+
+    TokenQueue* stream = lex_stream_padded(text);
+    while (!TokenQueue_is_empty(stream)) {
+        TokenQueue_remove(stream);
+    }
+    size_t stream_bytes = stream->capacity * per_token;
+    TokenQueue_free(stream);
+    printf("  storage  %10zu bytes eager, %zu bytes streaming\n", eager_bytes, stream_bytes);
+}
+
+/**
+ * @brief Largest input that is also run through the regex lexer
+ *
+ * The regex lexer hands the whole remaining input to @c regexec for every
+ * token, which makes it quadratic in the input size; beyond this size only the
+ * DFA lexer is timed.
+ */
+#define MAX_REGEX_INPUT (256 * 1024)
+
+static int bench_text (const char* name, const char* text)
+{
+    if (setjmp(decaf_error) != 0) {
+        fprintf(stderr, "%s: %s", name, decaf_error_msg);
+        return EXIT_FAILURE;
+    }
+    size_t size = strlen(text);
+    size_t ntokens = 0;
+    if (size > MAX_REGEX_INPUT) {
+        printf("%s (%zu bytes, too large for the regex lexer)\n", name, size);
+        time_lexer("scalar", lex, text, 20, &ntokens);
+        time_lexer(ScanKernels_select()->name, lex_padded, text, 20, &ntokens);
+        measure_token_storage(text);
+        return EXIT_SUCCESS;
+    }
+
+    TokenQueue* expected = lex_regex(text);
+    TokenQueue* actual = lex_padded(text);
+    bool same = same_tokens(expected, actual);
+    TokenQueue_free(expected);
+    TokenQueue_free(actual);
+
+    printf("%s (%zu bytes)%s\n", name, size, same ? "" : "  ** TOKEN MISMATCH **");
+    double regex_time = time_lexer("regex", lex_regex, text, 1,  &ntokens);
+    time_lexer("scalar", lex, text, 20, &ntokens);
+    double dfa_time   = time_lexer(ScanKernels_select()->name, lex_padded, text, 20, &ntokens);
+    printf("  speedup  %10.1fx\n", regex_time / dfa_time);
+    measure_token_storage(text);
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main (int argc, char** argv)
+{
+    int status = EXIT_SUCCESS;
+    if (argc < 2) {
+        /* keep the synthetic input near the old 64 KiB source size limit */
+        char* text = Corpus_generate(64 * 1024, 42);
+        status = bench_text("synthetic", text);
+        free(text);
+    }
+    for (int i = 1; i < argc; i++) {
+        char* text = Corpus_read_file(argv[i]);
+        if (text == NULL) {
+            fprintf(stderr, "Could not read file: %s\n", argv[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        if (bench_text(argv[i], text) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+        }
+        free(text);
+    }
+    return status;
+}
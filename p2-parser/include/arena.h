@@ -0,0 +1,167 @@
+/**
+ * @file arena.h
+ * @brief Region-based memory allocation
+ *
+ * An arena hands out memory from large chunks and releases it all at once, so
+ * allocation is usually just a pointer bump and deallocation takes time
+ * proportional to the number of chunks rather than the number of objects.
+ */
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include "common.h"
+
+/**
+ * @brief Block of memory owned by an arena
+ */
+typedef struct ArenaChunk
+{
+    /**
+     * @brief Previously-allocated chunk (or @c NULL for the first one)
+     */
+    struct ArenaChunk* next;
+
+    /**
+     * @brief Usable size of the chunk in bytes
+     */
+    size_t size;
+
+    /**
+     * @brief Number of bytes already handed out
+     */
+    size_t used;
+
+    /**
+     * @brief Start of the usable memory
+     */
+    max_align_t data[];
+
+} ArenaChunk;
+
+/**
+ * @brief Function registered with @ref Arena_defer
+ */
+typedef struct ArenaCleanup
+{
+    void (*fn) (void* data);        /**< @brief Function to call */
+    void* data;                     /**< @brief Argument to pass */
+    struct ArenaCleanup* next;      /**< @brief Previously-registered cleanup */
+} ArenaCleanup;
+
+/**
+ * @brief Memory arena
+ *
+ * Every block returned by @ref Arena_alloc stays valid until the arena is
+ * deallocated; there is no way to free a single block.
+ *
+ * Allocate with @ref Arena_new and de-allocate with @ref Arena_free.
+ *
+ * Methods:
+ * - @ref Arena_alloc
+ * - @ref Arena_calloc
+ * - @ref Arena_strndup
+ * - @ref Arena_defer
+ */
+typedef struct Arena
+{
+    /**
+     * @brief Chunk that allocations are currently taken from
+     */
+    ArenaChunk* head;
+
+    /**
+     * @brief Size of newly-allocated chunks in bytes
+     */
+    size_t chunk_size;
+
+    /**
+     * @brief Total number of bytes handed out
+     */
+    size_t allocated;
+
+    /**
+     * @brief Total number of blocks handed out
+     */
+    size_t allocations;
+
+    /**
+     * @brief Number of chunks owned by the arena
+     */
+    size_t chunks;
+
+    /**
+     * @brief Functions to call when the arena is deallocated (most recent
+     * first)
+     */
+    ArenaCleanup* cleanups;
+
+    /**
+     * @brief Data that the arena's client associates with it (the AST keeps
+     * its attribute tables here)
+     */
+    void* data;
+
+} Arena;
+
+/**
+ * @brief Allocate and initialize a new, empty arena
+ *
+ * @returns Newly-created arena
+ */
+Arena* Arena_new (void);
+
+/**
+ * @brief Allocate a block of memory from an arena
+ *
+ * The block is suitably aligned for any type. Requests larger than the chunk
+ * size are given a chunk of their own.
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the block in bytes
+ * @returns Uninitialized block of memory
+ */
+void* Arena_alloc (Arena* arena, size_t size);
+
+/**
+ * @brief Allocate a zero-filled block of memory from an arena
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the block in bytes
+ * @returns Zero-filled block of memory
+ */
+void* Arena_calloc (Arena* arena, size_t size);
+
+/**
+ * @brief Copy text into a new NUL-terminated string allocated from an arena
+ *
+ * @param arena Arena to allocate from
+ * @param text Text to copy (need not be NUL-terminated)
+ * @param length Number of characters to copy
+ * @returns Copy of the text
+ */
+char* Arena_strndup (Arena* arena, const char* text, size_t length);
+
+/**
+ * @brief Register a function to be called when an arena is deallocated
+ *
+ * This is how objects in the arena that own memory outside of it (e.g., heap
+ * attribute values in AST nodes) release that memory.
+ *
+ * @param arena Arena to register with
+ * @param fn Function to call
+ * @param data Argument to pass to the function
+ */
+void Arena_defer (Arena* arena, void (*fn) (void* data), void* data);
+
+/**
+ * @brief Deallocate an arena and every block allocated from it
+ *
+ * Functions registered with @ref Arena_defer are called first, in the reverse
+ * order of registration.
+ *
+ * @param arena Arena to deallocate
+ */
+void Arena_free (Arena* arena);
+
+#endif
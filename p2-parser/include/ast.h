@@ -11,6 +11,8 @@
 #define __AST_H
 
 #include "common.h"
+#include "arena.h"
+#include "intern.h"
 
 /**
  * @brief Function pointer used to store references to custom DOT output routines
@@ -49,15 +51,65 @@ void dummy_print(void*, FILE*);
 void int_attr_print(void*, FILE*);
 
 
+/**
+ * @brief Table of AST node kinds
+ *
+ * Everything that needs one entry per kind of node is generated from this
+ * table: the @ref NodeType tags, @ref NodeType_to_string, the callbacks of a
+ * @c NodeVisitor, and the code that walks the children of a node (traversal,
+ * deallocation, and parent links). Each entry has the form
+ * <tt>X(TYPE, name, label, CHILDREN)</tt>:
+ *
+ * - @c TYPE is the @ref NodeType tag
+ * - @c name is the suffix of the node's visitor callbacks (@c previsit_name
+ *   and @c postvisit_name)
+ * - @c label is the string returned by @ref NodeType_to_string
+ * - @c CHILDREN lists the node's children in traversal order, each one as
+ *   <tt>AST_CHILD(field)</tt>, <tt>AST_OPTIONAL_CHILD(field)</tt> (may be
+ *   @c NULL), or <tt>AST_CHILD_LIST(field)</tt> (a @c NodeList), where @c
+ *   field is the path to the child within the node; @c AST_INVISIT marks the
+ *   point between the operands of a binary operation
+ *
+ * Code that walks children defines the @c AST_CHILD family of macros before
+ * expanding the table (and undefines them afterwards); other code ignores the
+ * last column. Adding a kind of node means adding an entry here, a structure
+ * to the union in @ref ASTNode, and a constructor.
+ */
+#define AST_NODE_KINDS(X) \
+    X(PROGRAM,      program,     "Program",     AST_CHILD_LIST(program.variables) AST_CHILD_LIST(program.functions)) \
+    X(VARDECL,      vardecl,     "VarDecl",     ) \
+    X(FUNCDECL,     funcdecl,    "FuncDecl",    AST_CHILD(funcdecl.body)) \
+    X(BLOCK,        block,       "Block",       AST_CHILD_LIST(block.variables) AST_CHILD_LIST(block.statements)) \
+    X(ASSIGNMENT,   assignment,  "Assignment",  AST_CHILD(assignment.location) AST_CHILD(assignment.value)) \
+    X(CONDITIONAL,  conditional, "Conditional", AST_CHILD(conditional.condition) AST_CHILD(conditional.if_block) \
+                                                AST_OPTIONAL_CHILD(conditional.else_block)) \
+    X(WHILELOOP,    whileloop,   "WhileLoop",   AST_CHILD(whileloop.condition) AST_CHILD(whileloop.body)) \
+    X(RETURNSTMT,   return,      "Return",      AST_OPTIONAL_CHILD(funcreturn.value)) \
+    X(BREAKSTMT,    break,       "Break",       ) \
+    X(CONTINUESTMT, continue,    "Continue",    ) \
+    X(BINARYOP,     binaryop,    "BinaryOp",    AST_CHILD(binaryop.left) AST_INVISIT AST_CHILD(binaryop.right)) \
+    X(UNARYOP,      unaryop,     "UnaryOp",     AST_CHILD(unaryop.child)) \
+    X(LOCATION,     location,    "Location",    AST_OPTIONAL_CHILD(location.index)) \
+    X(FUNCCALL,     funccall,    "FuncCall",    AST_CHILD_LIST(funccall.arguments)) \
+    X(LITERAL,      literal,     "Literal",     )
+
+#ifndef SKIP_IN_DOXYGEN
+#define AST_NODE_TYPE_TAG(TYPE, name, label, CHILDREN)      TYPE,
+#define AST_NODE_TYPE_COUNT(TYPE, name, label, CHILDREN)    + 1
+#endif
+
 /**
  * @brief AST node type tag
  */
 typedef enum NodeType {
-    PROGRAM, VARDECL, FUNCDECL, BLOCK,
-    ASSIGNMENT, CONDITIONAL, WHILELOOP, RETURNSTMT, BREAKSTMT, CONTINUESTMT,
-    BINARYOP, UNARYOP, LOCATION, FUNCCALL, LITERAL
+    AST_NODE_KINDS(AST_NODE_TYPE_TAG)
 } NodeType;
 
+/**
+ * @brief Number of node types
+ */
+#define NUM_NODE_TYPES (0 AST_NODE_KINDS(AST_NODE_TYPE_COUNT))
+
 /**
  * @brief Return a string representation of a node type
  *
@@ -89,7 +141,7 @@ struct ASTNode* ProgramNode_new (struct NodeList* vars, struct NodeList* funcs);
  * @brief AST variable structure
  */
 typedef struct VarDeclNode {
-    char name[MAX_ID_LEN];      /**< @brief Variable name */
+    const char* name;           /**< @brief Variable name (interned) */
     DecafType type;             /**< @brief Variable type */
     bool is_array;              /**< @brief True if the variable is an array, false if it's a scalar */
     int array_length;           /**< @brief Length of array (should be 1 if not an array) */
@@ -112,7 +164,7 @@ struct ASTNode* VarDeclNode_new (const char* name, DecafType type,
  * @brief AST parameter (used in function declarations)
  */
 typedef struct Parameter {
-    char name[MAX_ID_LEN];      /**< @brief Parameter formal name */
+    const char* name;           /**< @brief Parameter formal name (interned) */
     DecafType type;             /**< @brief Parameter type */
     struct Parameter* next;     /**< @brief Pointer to next parameter (if in a list) */
 } Parameter;
@@ -136,7 +188,7 @@ void ParameterList_add_new (ParameterList* list, const char* name, DecafType typ
  * @brief AST function structure
  */
 typedef struct FuncDeclNode {
-    char name[MAX_ID_LEN];      /**< @brief Function name */
+    const char* name;           /**< @brief Function name (interned) */
     DecafType return_type;      /**< @brief Function return type */
     ParameterList* parameters;  /**< @brief List of formal parameters */
     struct ASTNode* body;       /**< @brief Function body block */
@@ -345,7 +397,7 @@ struct ASTNode* UnaryOpNode_new (UnaryOpType operator, struct ASTNode* child, in
  * @c index can be @c NULL for non-array locations.
  */
 typedef struct LocationNode {
-    char name[MAX_ID_LEN];      /**< @brief Location/variable name */
+    const char* name;           /**< @brief Location/variable name (interned) */
     struct ASTNode* index;      /**< @brief Index expression (can be @c NULL for non-array locations) */
 } LocationNode;
 
@@ -363,7 +415,7 @@ struct ASTNode* LocationNode_new (const char* name, struct ASTNode* index, int s
  * @brief AST function call expression structure
  */
 typedef struct FuncCallNode {
-    char name[MAX_ID_LEN];      /**< @brief Function name */
+    const char* name;           /**< @brief Function name (interned) */
     struct NodeList* arguments; /**< @brief List of actual parameters/arguments */
 } FuncCallNode;
 
@@ -385,7 +437,7 @@ typedef struct LiteralNode {
     union {
         int integer;                /**< @brief Integer value (if @c type is @c INT) */
         bool boolean;               /**< @brief Boolean value (if @c type is @c BOOL) */
-        char string[MAX_LINE_LEN];  /**< @brief String value (if @c type is @c STR) */
+        char* string;               /**< @brief String value (if @c type is @c STR) */
     };
 } LiteralNode;
 
@@ -417,18 +469,62 @@ struct ASTNode* LiteralNode_new_bool (bool value, int source_line);
 struct ASTNode* LiteralNode_new_string (const char* value, int source_line);
 
 /**
- * @brief AST attribute (basically a key-value store for nodes)
+ * @brief Attribute key (a small integer ID; see @ref AttributeKey_lookup)
+ */
+typedef uint16_t AttributeKey;
+
+/**
+ * @brief Keys of the attributes that nearly every pass uses
+ *
+ * These are always registered (under the names "parent", "depth", "type", and
+ * "dotid") and their values are kept in dense per-tree tables indexed by node
+ * ID rather than in per-node attribute records.
+ */
+enum {
+    ATTR_PARENT,            /**< @brief Uptree parent @ref ASTNode reference */
+    ATTR_DEPTH,             /**< @brief Tree depth (@c int) */
+    ATTR_TYPE,              /**< @brief @ref DecafType of an expression */
+    ATTR_DOTID,             /**< @brief Node ID in the DOT graph output */
+    NUM_DENSE_ATTRIBUTES
+};
+
+/**
+ * @brief Maximum number of distinct attribute keys
+ */
+#define MAX_ATTRIBUTE_KEYS 64
+
+/**
+ * @brief Look up the key of an attribute name, registering it if it is new
+ *
+ * Passes should look up the keys they use once and then use the keyed
+ * accessors (e.g., @ref ASTNode_get_keyed_attribute); the string-keyed
+ * accessors call this on every access.
+ *
+ * @param name Attribute name (should be a static string)
+ * @returns Attribute key
+ */
+AttributeKey AttributeKey_lookup (const char* name);
+
+/**
+ * @brief Look up the name an attribute key was registered under
+ *
+ * @param key Attribute key
+ * @returns Attribute name
+ */
+const char* AttributeKey_name (AttributeKey key);
+
+/**
+ * @brief AST attribute (one entry of a node's key-value store)
  */
 typedef struct Attribute
 {
-    const char* key;        /**< @brief Attribute key */
+    AttributeKey key;       /**< @brief Attribute key */
     void* value;            /**< @brief Attribute value (integral value or pointer to heap) */
     AttributeValueDOTPrinter dot_printer;   /**< @brief Pointer to DOT-printing function
                                                         (can be @c NULL if not printable) */
     Destructor dtor;        /**< @brief Pointer to destructor function that should
                                         be called to deallocate the attribute value
                                         (should be @c NULL if it's an integral value) */
-    struct Attribute* next; /**< @brief Next attribute (if stored in a list) */
 } Attribute;
 
 /**
@@ -439,9 +535,13 @@ typedef struct Attribute
  * using a tagged union of the other *Node structures declared earlier in this
  * file.
  *
- * AST nodes are designed to be semi-mutable even after parsing by means of the
- * @c attributes key-value mapping that is stored in every node. List of
- * potential attributes (not exhaustive, and most are irrelevant to Project 2):
+ * AST nodes are designed to be semi-mutable even after parsing by means of a
+ * key-value mapping of attributes for every node. The mapping is kept outside
+ * the node in tables that belong to the tree (or, for nodes on the heap, in a
+ * table shared by every thread behind a lock) and are indexed by the node's
+ * @c id: the attributes with keys below @ref NUM_DENSE_ATTRIBUTES live in
+ * dense arrays, and any others in a small per-node table. List of potential
+ * attributes (not exhaustive, and most are irrelevant to Project 2):
  *
  * <table border="1">
  * <tr><th>Key</th><th>Description</th></tr>
@@ -459,6 +559,11 @@ typedef struct Attribute
  * should be used to ensure that all of the node-specific data members are
  * initialized correctly. Node structures must be explicitly freed using @ref
  * ASTNode_free.
+ *
+ * Nodes, lists, parameters, and attribute records are allocated from the
+ * arena installed by @ref ASTNode_use_arena if there is one (the parser
+ * installs one for every parse), and from the heap otherwise. An arena-backed
+ * tree is released all at once when its root @ref ProgramNode is freed.
  * 
  * Methods:
  * - @ref ASTNode_set_attribute
@@ -466,13 +571,18 @@ typedef struct Attribute
  * - @ref ASTNode_set_printable_attribute
  * - @ref ASTNode_has_attribute
  * - @ref ASTNode_get_attribute
+ * - @ref ASTNode_set_keyed_attribute
+ * - @ref ASTNode_has_keyed_attribute
+ * - @ref ASTNode_get_keyed_attribute
+ * - @ref ASTNode_for_each_attribute
  */
 typedef struct ASTNode
 {
     NodeType type;          /**< @brief Node type (discriminator/tag for the anonymous union) */
     int source_line;        /**< @brief Source code line number */
-    Attribute* attributes;  /**< @brief Attribute list (not a formal list because of the provided accessor methods) */
+    uint32_t id;            /**< @brief Index of the node in its attribute tables */
     struct ASTNode* next;   /**< @brief Next node (if stored in a list) */
+    Arena* arena;           /**< @brief Arena that owns the node (or @c NULL if it is on the heap) */
 
     /* anonymous union of type-specific node data (C polymorphism) */
     union {
@@ -492,6 +602,26 @@ typedef struct ASTNode
     };
 } ASTNode;
 
+/*
+ * Size budgets: names are interned and string literals are stored out of line,
+ * so no node-specific structure needs more than a few words and the union
+ * stays small. Growing any of these should be a deliberate decision.
+ */
+_Static_assert(sizeof(struct ProgramNode)     <= 16, "ProgramNode exceeds its size budget");
+_Static_assert(sizeof(struct VarDeclNode)     <= 24, "VarDeclNode exceeds its size budget");
+_Static_assert(sizeof(struct FuncDeclNode)    <= 32, "FuncDeclNode exceeds its size budget");
+_Static_assert(sizeof(struct BlockNode)       <= 16, "BlockNode exceeds its size budget");
+_Static_assert(sizeof(struct AssignmentNode)  <= 16, "AssignmentNode exceeds its size budget");
+_Static_assert(sizeof(struct ConditionalNode) <= 24, "ConditionalNode exceeds its size budget");
+_Static_assert(sizeof(struct WhileLoopNode)   <= 16, "WhileLoopNode exceeds its size budget");
+_Static_assert(sizeof(struct ReturnNode)      <=  8, "ReturnNode exceeds its size budget");
+_Static_assert(sizeof(struct BinaryOpNode)    <= 24, "BinaryOpNode exceeds its size budget");
+_Static_assert(sizeof(struct UnaryOpNode)     <= 16, "UnaryOpNode exceeds its size budget");
+_Static_assert(sizeof(struct LocationNode)    <= 16, "LocationNode exceeds its size budget");
+_Static_assert(sizeof(struct FuncCallNode)    <= 16, "FuncCallNode exceeds its size budget");
+_Static_assert(sizeof(struct LiteralNode)     <= 16, "LiteralNode exceeds its size budget");
+_Static_assert(sizeof(ASTNode)                <= 64, "ASTNode exceeds its size budget");
+
 /*
  * Declare NodeList to be a linked list of ASTNode* elements.
  */
@@ -515,6 +645,52 @@ DECL_LIST_TYPE(Node, struct ASTNode*)
  */
 ASTNode* ASTNode_new (NodeType type, int line);
 
+/**
+ * @brief Initialize an AST node in memory allocated by the caller
+ *
+ * This is what @ref ASTNode_new does after allocating the node; it is useful
+ * for building many nodes in one block. The node's attributes belong to the
+ * arena installed by @ref ASTNode_use_arena (if any), so it must stay
+ * installed while the node is initialized.
+ *
+ * @param node Zero-filled node structure
+ * @param type Node type
+ * @param line Source line (debug info)
+ */
+void ASTNode_init (ASTNode* node, NodeType type, int line);
+
+/**
+ * @brief Initialize an AST node that stands in for a record of another
+ * structure (such as a node of a @ref FlatAST)
+ *
+ * The node keeps its attributes in the tables of @p arena under the given ID
+ * instead of a newly-assigned one, so a node initialized later with the same
+ * ID sees every attribute set through this one. The arena stays with its
+ * owner: freeing the node with @ref ASTNode_free never deallocates it, even
+ * for a @ref ProgramNode.
+ *
+ * @param node Node structure
+ * @param type Node type
+ * @param line Source line (debug info)
+ * @param arena Arena that holds the attributes
+ * @param id ID of the node in the arena's attribute tables
+ */
+void ASTNode_init_view (ASTNode* node, NodeType type, int line, Arena* arena, uint32_t id);
+
+/**
+ * @brief Direct all AST allocations on the calling thread to an arena
+ *
+ * Nodes, lists, parameters, string literals, and attribute records created
+ * while an arena is installed belong to it. The @ref ProgramNode at the root
+ * of the tree owns the arena: freeing it with @ref ASTNode_free deallocates
+ * the arena (and with it every node of the tree) in time proportional to the
+ * number of arena chunks.
+ *
+ * @param arena Arena to allocate from (or @c NULL to allocate from the heap)
+ * @returns Previously-installed arena (or @c NULL if there was none)
+ */
+Arena* ASTNode_use_arena (Arena* arena);
+
 /**
  * @brief Add or change an attribute for an AST node
  * 
@@ -595,11 +771,101 @@ void* ASTNode_get_attribute (ASTNode* node, const char* key);
  */
 int ASTNode_get_int_attribute (ASTNode* node, const char* key);
 
+/**
+ * @brief Add or change an attribute for an AST node by key
+ *
+ * This is the form of @ref ASTNode_set_printable_attribute that the other
+ * attribute setters are built on; it does not look up the key by name. Values
+ * with a destructor are always kept in the node's own table, even if the key
+ * is one of the dense ones.
+ *
+ * @param node Node to add the attribute to
+ * @param key Attribute key
+ * @param value Attribute value (may be a pointer)
+ * @param dot_printer Pointer to printing function for DOT graph output
+ * @param dtor Pointer to destructor/deallocator function (or @c NULL)
+ */
+void ASTNode_set_keyed_attribute (ASTNode* node, AttributeKey key, void* value,
+                                  AttributeValueDOTPrinter dot_printer, Destructor dtor);
+
+/**
+ * @brief Check to see if a node has a particular attribute by key
+ *
+ * @param node Node to check
+ * @param key Key to check for
+ * @returns True if the node has the requested attribute, false if not
+ */
+bool ASTNode_has_keyed_attribute (ASTNode* node, AttributeKey key);
+
+/**
+ * @brief Retrieve a particular attribute from a node by key
+ *
+ * @param node Node to access
+ * @param key Key to retrieve
+ * @returns Attribute value (or @c NULL if the node does not have it)
+ */
+void* ASTNode_get_keyed_attribute (ASTNode* node, AttributeKey key);
+
+/**
+ * @brief Call a function for every attribute of a node
+ *
+ * Attributes in dense columns come first (in key order), followed by the
+ * node's other attributes.
+ *
+ * @param node Node to access
+ * @param fn Function to call for every attribute
+ * @param data Argument to pass through to @c fn
+ */
+void ASTNode_for_each_attribute (ASTNode* node, void (*fn) (Attribute* attr, void* data), void* data);
+
+/**
+ * @brief Allow (or stop allowing) several threads to use the attributes of a
+ * tree at once
+ *
+ * While a tree is shared, threads may set and look up attributes concurrently
+ * as long as no two of them use the same node's attributes at the same time
+ * and no thread allocates nodes in the tree's arena. Attribute keys can be
+ * looked up and registered from any thread at any time.
+ *
+ * @param root Root of an arena-allocated tree
+ * @param shared True to start sharing the tree, false to stop
+ */
+void ASTNode_share_attributes (ASTNode* root, bool shared);
+
+/**
+ * @brief Record a node as the @c parent attribute of each of its children
+ *
+ * Called by the parser right after it builds each interior node (children
+ * are always built before their parent).
+ *
+ * @param node Node whose children should be linked to it
+ */
+void ASTNode_set_child_parents (ASTNode* node);
+
+/**
+ * @brief Compute the @c depth attribute of every node of an arena-backed tree
+ *
+ * Depths are derived from the @c parent attributes with one backwards sweep
+ * over the tree's attribute table, which relies on every node having been
+ * created before its parent (as the parser does); no tree traversal is
+ * involved. Nodes that are not connected to the root get no depth.
+ *
+ * @param root Root of the tree (depth 0)
+ */
+void ASTNode_set_tree_depths (ASTNode* root);
+
 /**
  * @brief Deallocate an AST node structure
  * 
- * This will recursively free any children, so it is sufficient to free the
- * root of a tree in order to free the entire tree.
+ * This will also free any children, so it is sufficient to free the root of
+ * a tree in order to free the entire tree. Children are freed iteratively
+ * (through the nodes' own @c next fields), so trees of any depth can be freed
+ * without growing the call stack.
+ *
+ * For an arena-backed tree, freeing the root @ref ProgramNode deallocates the
+ * arena (after calling the destructors of any attributes); freeing any other
+ * arena-backed node does nothing, since its memory belongs to the arena.
+ * Freeing a node initialized with @ref ASTNode_init_view does nothing either.
  * 
  * It is highly recommended that you subsequently set the pointer to @c NULL so
  * that you do not unintentionally dereference an invalid pointer.
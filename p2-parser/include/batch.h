@@ -0,0 +1,108 @@
+/**
+ * @file batch.h
+ * @brief Batch compilation of many source files
+ *
+ * The driver can compile many files in one process instead of being run once
+ * per file. The files to compile are collected from the command line (see
+ * @ref Batch_add), ordered largest first so that a big file started late does
+ * not hold up the end of the batch, and handed out to a pool of worker
+ * threads as they become free (see @ref Batch_run).
+ */
+
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include "common.h"
+
+/**
+ * @brief Source file in a batch
+ */
+typedef struct BatchFile
+{
+    char* filename;     /**< @brief Name of the file */
+    size_t size;        /**< @brief Size of the file in bytes (zero if unknown, e.g., for standard input) */
+    size_t position;    /**< @brief Position of the file in the order it was added */
+    bool succeeded;     /**< @brief True if the file was compiled successfully */
+} BatchFile;
+
+/**
+ * @brief List of source files to compile
+ *
+ * Allocate with @ref Batch_new and de-allocate with @ref Batch_free.
+ */
+typedef struct Batch
+{
+    BatchFile* files;   /**< @brief Files to compile */
+    size_t count;       /**< @brief Number of files */
+    size_t capacity;    /**< @brief Allocated length of @c files */
+} Batch;
+
+/**
+ * @brief Summary of a batch run
+ */
+typedef struct BatchStats
+{
+    size_t files;       /**< @brief Number of files compiled */
+    size_t failed;      /**< @brief Number of files that failed to compile */
+    size_t bytes;       /**< @brief Total size of the files in bytes */
+    double seconds;     /**< @brief Wall-clock time for the whole batch */
+} BatchStats;
+
+/**
+ * @brief Function that compiles one file of a batch
+ *
+ * Jobs for different files run concurrently on different threads.
+ *
+ * @param filename Name of the file
+ * @param data Data passed to @ref Batch_run
+ * @returns True if the file was compiled successfully
+ */
+typedef bool (*BatchJob) (const char* filename, void* data);
+
+/**
+ * @brief Allocate a new, empty batch
+ *
+ * @returns Pointer to the allocated batch
+ */
+Batch* Batch_new (void);
+
+/**
+ * @brief Add a command-line argument to a batch
+ *
+ * An argument of the form <tt>\@file</tt> is a response file: it lists more
+ * arguments, separated by whitespace, which are added in turn (they may name
+ * further response files). Any other argument is the name of a source file.
+ *
+ * @param batch Batch to add to
+ * @param argument Source file name or response file reference
+ * @returns True if the argument was added, false if a response file could not
+ * be read (after printing a message to @c stderr)
+ */
+bool Batch_add (Batch* batch, const char* argument);
+
+/**
+ * @brief Compile every file in a batch on a pool of threads
+ *
+ * The files are sorted by size, largest first (files of the same size keep
+ * the order they were added in), and each thread takes the next file from
+ * the list whenever it finishes one. The outcome for each file is recorded in
+ * its @c succeeded member.
+ *
+ * @param batch Batch to compile
+ * @param workers Number of threads to use, including the calling thread (if
+ * zero or negative, the value of the @c DECAF_THREADS environment variable or
+ * else the number of online processors)
+ * @param job Function that compiles one file
+ * @param data Data to pass to @p job
+ * @returns Summary of the run
+ */
+BatchStats Batch_run (Batch* batch, int workers, BatchJob job, void* data);
+
+/**
+ * @brief Deallocate a batch
+ *
+ * @param batch Batch to deallocate
+ */
+void Batch_free (Batch* batch);
+
+#endif
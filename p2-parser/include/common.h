@@ -26,16 +26,12 @@
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/**
- * @brief Maximum size (in bytes) of any Decaf source file
- */
-#define MAX_FILE_SIZE 65536
-
 /**
  * @brief Maximum length (in characters) of any single line of input
  */
@@ -75,6 +71,30 @@ typedef enum DecafType{
  */
 const char* DecafType_to_string(DecafType type);
 
+/**
+ * @brief Allocate a copy of a string
+ *
+ * @param string String to copy
+ * @returns Newly-allocated copy (caller must free)
+ */
+char* copy_string(const char* string);
+
+/**
+ * @brief Look up the number of threads that parallel work should use by
+ * default
+ *
+ * @returns The value of the @c DECAF_THREADS environment variable if it is a
+ * positive number, or else the number of online processors
+ */
+int default_thread_count (void);
+
+/**
+ * @brief Read a monotonic clock
+ *
+ * @returns Time in seconds (from an arbitrary starting point)
+ */
+double monotonic_seconds (void);
+
 /**
  * @brief Print a Decaf string literal, inserting escape codes as necessary.
  * 
@@ -109,6 +129,68 @@ void print_doubly_escaped_string(const char* string, FILE* output);
  */
 void Error_throw_printf (const char* format, ...);
 
+/**
+ * @brief Exception handler target used by @ref Error_throw_printf
+ *
+ * Like @ref Error_throw_printf, this is defined in the compiler or test
+ * driver. It is declared here so that phases that must clean up after a
+ * failure can intercept an exception and pass it on.
+ */
+extern jmp_buf decaf_error;
+
+/**
+ * @brief Exception handler installed on one thread (see @ref Error_throw)
+ *
+ * Handlers let several threads (or nested phases on one thread) catch errors
+ * independently of each other and of @c decaf_error. A handler is installed
+ * with @ref ErrorHandler_push, armed by calling @c setjmp on its @c target,
+ * and removed again with @ref ErrorHandler_pop on both the normal and the
+ * error path:
+ *
+ *     ErrorHandler handler;
+ *     ErrorHandler_push(&handler);
+ *     if (setjmp(handler.target) == 0) {
+ *         tokens = lex(text);
+ *         ErrorHandler_pop(&handler);
+ *     } else {
+ *         ErrorHandler_pop(&handler);
+ *         fprintf(stderr, "%s", handler.message);
+ *     }
+ */
+typedef struct ErrorHandler
+{
+    jmp_buf target;                 /**< @brief Where errors on this thread jump to */
+    char message[MAX_ERROR_LEN];    /**< @brief Message of the error that was caught */
+    struct ErrorHandler* previous;  /**< @brief Handler that was installed before this one */
+} ErrorHandler;
+
+/**
+ * @brief Install an exception handler on the calling thread
+ *
+ * @param handler Handler to install (stays installed until the matching
+ * @ref ErrorHandler_pop)
+ */
+void ErrorHandler_push (ErrorHandler* handler);
+
+/**
+ * @brief Remove the most recently installed exception handler from the
+ * calling thread
+ *
+ * @param handler Handler to remove (must be the one installed last)
+ */
+void ErrorHandler_pop (ErrorHandler* handler);
+
+/**
+ * @brief Throw an exception with an error message using @c printf syntax from
+ * inside the compiler
+ *
+ * The front end phases report errors through this function. If the calling
+ * thread has an @ref ErrorHandler installed, the message is stored in the
+ * handler and control jumps to its target; otherwise the error is passed on
+ * to @ref Error_throw_printf (i.e., to the driver's @c decaf_error).
+ */
+void Error_throw (const char* format, ...);
+
 /**
  * @brief Check a pointer for NULL and terminate with an out-of-memory error
  * 
@@ -166,9 +248,30 @@ void Error_throw_printf (const char* format, ...);
  * @param FREEFUNC Name of the function to call to deallocate each element
  */
 #define DEF_LIST_IMPL(NAME, ELEMTYPE, FREEFUNC) \
+    DEF_LIST_IMPL_ALLOC(NAME, ELEMTYPE, LIST_CALLOC, FREEFUNC)
+
+/**
+ * @brief Default list structure allocator for @ref DEF_LIST_IMPL
+ */
+#define LIST_CALLOC(SIZE) calloc(1, (SIZE))
+
+/**
+ * @brief Define a list implementation with a custom allocator for the list
+ * structure itself
+ *
+ * Lists allocated with something other than @c calloc (e.g., from an arena)
+ * must not be passed to the generated @c NAMEList_free function.
+ *
+ * @param NAME Prefix for the list struct name (actual name will be @c NAMEList)
+ * @param ELEMTYPE Type of the elements to be stored (must be a struct pointer)
+ * @param ALLOCFUNC Name of a function (or macro) that returns a zero-filled
+ * block of the given size
+ * @param FREEFUNC Name of the function to call to deallocate each element
+ */
+#define DEF_LIST_IMPL_ALLOC(NAME, ELEMTYPE, ALLOCFUNC, FREEFUNC) \
     NAME ## List* NAME ## List_new (void) \
     { \
-        NAME ## List* list = (NAME ## List*)calloc(1, sizeof(NAME ## List)); \
+        NAME ## List* list = (NAME ## List*)ALLOCFUNC(sizeof(NAME ## List)); \
         CHECK_MALLOC_PTR(list); \
         list->head = NULL; \
         list->tail = NULL; \
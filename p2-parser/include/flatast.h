@@ -0,0 +1,181 @@
+/**
+ * @file flatast.h
+ * @brief Flat, index-based AST representation
+ *
+ * A @ref FlatAST stores a whole tree in one array of fixed-size @ref FlatNode
+ * records laid out in pre-order, so a pass that visits every node walks
+ * memory sequentially. Children are reached through 32-bit first-child and
+ * next-sibling indices instead of pointers, and the few node kinds that need
+ * more than one word of data keep it in per-kind side arrays.
+ *
+ * Flat trees are built from a pointer-based tree with @ref FlatAST_new. The
+ * existing visitors can run over them unchanged through @ref FlatAST_traverse,
+ * which hands the visitor @ref ASTNode views of the flat nodes. Views of a
+ * function body only exist while that function is being visited, so a
+ * traversal never holds more than one function's worth of them.
+ */
+#ifndef __FLATAST_H
+#define __FLATAST_H
+
+#include "ast.h"
+
+struct NodeVisitor;
+
+/**
+ * @brief Index of a node in a @ref FlatAST
+ */
+typedef uint32_t FlatIndex;
+
+/**
+ * @brief Index value meaning "no node"
+ */
+#define FLAT_NONE UINT32_MAX
+
+/**
+ * @brief Flat AST node
+ *
+ * The children of a node are listed in the same order that @ref
+ * NodeVisitor_traverse visits them. The meaning of @c payload depends on the
+ * node type:
+ *
+ * <table border="1">
+ * <tr><th>Type</th><th>Payload</th><th>Children</th></tr>
+ * <tr><td>@c PROGRAM</td><td>Number of global variables</td><td>Variables, then functions</td></tr>
+ * <tr><td>@c VARDECL</td><td>Index into @c vardecls</td><td>None</td></tr>
+ * <tr><td>@c FUNCDECL</td><td>Index into @c funcdecls</td><td>Body</td></tr>
+ * <tr><td>@c BLOCK</td><td>Number of local variables</td><td>Variables, then statements</td></tr>
+ * <tr><td>@c ASSIGNMENT</td><td>Unused</td><td>Location, value</td></tr>
+ * <tr><td>@c CONDITIONAL</td><td>1 if there is an else-block</td><td>Condition, if-block, else-block</td></tr>
+ * <tr><td>@c WHILELOOP</td><td>Unused</td><td>Condition, body</td></tr>
+ * <tr><td>@c RETURNSTMT</td><td>Unused</td><td>Value (if any)</td></tr>
+ * <tr><td>@c BREAKSTMT, @c CONTINUESTMT</td><td>Unused</td><td>None</td></tr>
+ * <tr><td>@c BINARYOP</td><td>@ref BinaryOpType</td><td>Left, right</td></tr>
+ * <tr><td>@c UNARYOP</td><td>@ref UnaryOpType</td><td>Child</td></tr>
+ * <tr><td>@c LOCATION</td><td>Interned name ID</td><td>Index (if any)</td></tr>
+ * <tr><td>@c FUNCCALL</td><td>Interned name ID</td><td>Arguments</td></tr>
+ * <tr><td>@c LITERAL</td><td>Integer or boolean value, or index into @c strings</td><td>None</td></tr>
+ * </table>
+ */
+typedef struct FlatNode {
+    uint16_t type;              /**< @brief @ref NodeType */
+    uint16_t literal_type;      /**< @brief @ref DecafType of a literal (zero otherwise) */
+    int32_t source_line;        /**< @brief Source code line number */
+    FlatIndex first_child;      /**< @brief First child (or @ref FLAT_NONE) */
+    FlatIndex next_sibling;     /**< @brief Next sibling (or @ref FLAT_NONE) */
+    uint32_t payload;           /**< @brief Type-specific data (see above) */
+} FlatNode;
+
+_Static_assert(sizeof(FlatNode) <= 20, "FlatNode exceeds its size budget");
+
+/**
+ * @brief Side record for a variable declaration
+ */
+typedef struct FlatVarDecl {
+    uint32_t name;              /**< @brief Interned name ID */
+    uint16_t type;              /**< @brief @ref DecafType of the variable */
+    bool is_array;              /**< @brief True if the variable is an array */
+    int32_t array_length;       /**< @brief Length of array (1 if not an array) */
+} FlatVarDecl;
+
+/**
+ * @brief Side record for a function declaration
+ */
+typedef struct FlatFuncDecl {
+    uint32_t name;              /**< @brief Interned name ID */
+    uint32_t return_type;       /**< @brief @ref DecafType of the return value */
+    uint32_t first_param;       /**< @brief Index of the first parameter in @c params */
+    uint32_t param_count;       /**< @brief Number of parameters */
+} FlatFuncDecl;
+
+/**
+ * @brief Side record for a function parameter
+ */
+typedef struct FlatParam {
+    uint32_t name;              /**< @brief Interned name ID */
+    uint32_t type;              /**< @brief @ref DecafType of the parameter */
+} FlatParam;
+
+/**
+ * @brief Flat AST (nodes in pre-order plus per-kind side arrays)
+ *
+ * The root is always node 0. Every array is owned by the structure and is
+ * released by @ref FlatAST_free, and so is the arena, which also holds the
+ * attributes of the node views (see @ref FlatAST_traverse).
+ */
+typedef struct FlatAST {
+    FlatNode* nodes;            /**< @brief Nodes in pre-order */
+    uint32_t count;             /**< @brief Number of nodes */
+    FlatVarDecl* vardecls;      /**< @brief Variable declaration records */
+    uint32_t vardecl_count;     /**< @brief Number of variable declaration records */
+    FlatFuncDecl* funcdecls;    /**< @brief Function declaration records */
+    uint32_t funcdecl_count;    /**< @brief Number of function declaration records */
+    FlatParam* params;          /**< @brief Parameter records */
+    uint32_t param_count;       /**< @brief Number of parameter records */
+    const char** strings;       /**< @brief String literal values (stored in @c arena) */
+    uint32_t string_count;      /**< @brief Number of string literals */
+    Arena* arena;               /**< @brief Storage for string literals, top-level views, and attributes */
+    ASTNode* top_views;         /**< @brief Views of a @ref ProgramNode root and of its children (in
+                                            order), or @c NULL if the root is something else */
+    ASTNode* body_views;        /**< @brief Views of the subtree being visited (reused for each one) */
+    uint32_t body_capacity;     /**< @brief Allocated length of @c body_views (the largest subtree) */
+    FlatIndex body_base;        /**< @brief Index of the node whose view is @c body_views[0] */
+    NodeList* body_lists;       /**< @brief Child lists of the views in @c body_views */
+    uint32_t list_capacity;     /**< @brief Allocated length of @c body_lists */
+} FlatAST;
+
+/**
+ * @brief Build a flat copy of a pointer-based AST
+ *
+ * The original tree is not modified and can be freed independently.
+ * Attributes are not copied.
+ *
+ * @param root Root of the tree to flatten (normally a @ref ProgramNode)
+ * @returns Allocated flat tree
+ */
+FlatAST* FlatAST_new (ASTNode* root);
+
+/**
+ * @brief Perform a traversal of a flat tree using the given visitor
+ *
+ * The visitor sees exactly the same sequence of calls as it would with @ref
+ * NodeVisitor_traverse on the original tree, but on @ref ASTNode views of the
+ * flat nodes. The views of a @ref ProgramNode root, its global variables, and
+ * its functions are kept in @c top_views for the life of the flat tree. The
+ * views of a function's body are built in @c body_views just before the
+ * function is visited, and the @c body of the function's view is @c NULL at
+ * any other time (including while the program node is visited). If the root
+ * is not a program node, the views of the whole tree are built in @c
+ * body_views for each traversal.
+ *
+ * The ID of a view is the index of its flat node, and its attributes are kept
+ * in the flat tree's arena (see @ref ASTNode_init_view), so attributes set by
+ * one traversal are visible to the next. A body is always rebuilt at the same
+ * addresses, so a node pointer stored as an attribute of a node in the same
+ * function (such as a parent pointer) stays valid in later traversals, but
+ * other pointers into a body are only valid while its function is visited.
+ * The views belong to the flat tree: freeing one with @ref ASTNode_free does
+ * nothing.
+ *
+ * @param visitor Visitor structure
+ * @param flat Flat tree to traverse
+ */
+void FlatAST_traverse (struct NodeVisitor* visitor, FlatAST* flat);
+
+/**
+ * @brief Look up the name of a node that has one
+ *
+ * @param flat Flat tree
+ * @param index Index of a variable, function, location, or function call node
+ * @returns Interned name
+ */
+const char* FlatAST_name (FlatAST* flat, FlatIndex index);
+
+/**
+ * @brief Deallocate a flat tree (including its arena, node views, and their
+ * attributes)
+ *
+ * @param flat Flat tree to deallocate
+ */
+void FlatAST_free (FlatAST* flat);
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * @file intern.h
+ * @brief Global identifier table
+ *
+ * Every distinct identifier is stored exactly once, so interned names can be
+ * compared by pointer (or by their small integer IDs) instead of with @c
+ * strcmp, and later phases can index tables by name ID.
+ */
+
+#ifndef __INTERN_H
+#define __INTERN_H
+
+#include "common.h"
+
+/**
+ * @brief Look up (or add) a name in the identifier table
+ *
+ * The returned string is NUL-terminated and stays valid until @ref
+ * intern_free_all is called. Interning equal text always returns the same
+ * pointer.
+ *
+ * @param text Text of the name (need not be NUL-terminated)
+ * @param length Length of the name
+ * @returns Interned copy of the name
+ */
+const char* intern (const char* text, size_t length);
+
+/**
+ * @brief Look up (or add) a NUL-terminated name in the identifier table
+ *
+ * @param string Name to intern
+ * @returns Interned copy of the name
+ */
+const char* intern_string (const char* string);
+
+/**
+ * @brief Look up the ID of an interned name
+ *
+ * IDs are assigned consecutively from zero in the order names are first
+ * interned.
+ *
+ * @param name Name previously returned by @ref intern or @ref intern_string
+ * @returns ID of the name
+ */
+uint32_t intern_id (const char* name);
+
+/**
+ * @brief Look up an interned name by its ID
+ *
+ * @param id ID of the name (must be less than @ref intern_count)
+ * @returns Interned name
+ */
+const char* intern_name (uint32_t id);
+
+/**
+ * @brief Count the names in the identifier table
+ *
+ * @returns Number of distinct names interned so far
+ */
+size_t intern_count (void);
+
+/**
+ * @brief Deallocate every interned name
+ *
+ * Any names (or ASTs that refer to them) must not be used afterwards, and no
+ * other thread may be using the table at the time. The table starts out
+ * empty again, so names can be interned afterwards (with new IDs).
+ */
+void intern_free_all (void);
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file outbuf.h
+ * @brief Buffered text output
+ *
+ * An output buffer collects formatted text in memory and writes it to its
+ * stream in large blocks, so producing a line of output is a few copies into
+ * the buffer rather than a series of @c fprintf calls. It also provides the
+ * formatting that the AST printers need (integers, indentation, and escaped
+ * string literals and markup) without going through a format string.
+ */
+
+#ifndef __OUTBUF_H
+#define __OUTBUF_H
+
+#include "common.h"
+
+/**
+ * @brief Size that a buffer with a stream is flushed at rather than grown
+ * beyond (1 MiB)
+ */
+#define OUTPUT_BUFFER_LIMIT (1024 * 1024)
+
+/**
+ * @brief Growable output buffer
+ *
+ * Allocate with @ref OutputBuffer_new and de-allocate with @ref
+ * OutputBuffer_free.
+ *
+ * Methods:
+ * - @ref OutputBuffer_write
+ * - @ref OutputBuffer_puts
+ * - @ref OutputBuffer_putc
+ * - @ref OutputBuffer_int
+ * - @ref OutputBuffer_indent
+ * - @ref OutputBuffer_escaped
+ * - @ref OutputBuffer_doubly_escaped
+ * - @ref OutputBuffer_xml_escaped
+ * - @ref OutputBuffer_append
+ * - @ref OutputBuffer_flush
+ */
+typedef struct OutputBuffer
+{
+    /**
+     * @brief Buffered text (not NUL-terminated)
+     */
+    char* text;
+
+    /**
+     * @brief Number of buffered bytes
+     */
+    size_t length;
+
+    /**
+     * @brief Allocated size of @c text in bytes
+     */
+    size_t capacity;
+
+    /**
+     * @brief Stream that the text is written to (or @c NULL to keep all of it
+     * in memory)
+     */
+    FILE* output;
+
+} OutputBuffer;
+
+/**
+ * @brief Allocate a new, empty output buffer
+ *
+ * @param output Stream to write the text to (or @c NULL to keep all of it in
+ * memory, e.g. for later use with @ref OutputBuffer_append)
+ * @returns Newly-created buffer
+ */
+OutputBuffer* OutputBuffer_new (FILE* output);
+
+/**
+ * @brief Add text to a buffer
+ *
+ * The buffer grows as needed. A buffer with a stream is flushed instead of
+ * growing past @ref OUTPUT_BUFFER_LIMIT, so output smaller than that is
+ * written with a single call when the buffer is flushed or deallocated.
+ *
+ * @param buffer Buffer to add to
+ * @param text Text to add (need not be NUL-terminated)
+ * @param length Number of bytes to add
+ */
+void OutputBuffer_write (OutputBuffer* buffer, const char* text, size_t length);
+
+/**
+ * @brief Add a NUL-terminated string to a buffer
+ *
+ * @param buffer Buffer to add to
+ * @param text String to add
+ */
+void OutputBuffer_puts (OutputBuffer* buffer, const char* text);
+
+/**
+ * @brief Add a character to a buffer
+ *
+ * @param buffer Buffer to add to
+ * @param c Character to add
+ */
+void OutputBuffer_putc (OutputBuffer* buffer, char c);
+
+/**
+ * @brief Add the decimal representation of an integer to a buffer
+ *
+ * @param buffer Buffer to add to
+ * @param value Integer to add
+ */
+void OutputBuffer_int (OutputBuffer* buffer, long value);
+
+/**
+ * @brief Add indentation (two spaces per level) to a buffer
+ *
+ * @param buffer Buffer to add to
+ * @param levels Number of indentation levels
+ */
+void OutputBuffer_indent (OutputBuffer* buffer, long levels);
+
+/**
+ * @brief Add a Decaf string literal to a buffer, inserting escape codes as
+ * necessary (see @ref print_escaped_string)
+ *
+ * @param buffer Buffer to add to
+ * @param string String literal to add
+ */
+void OutputBuffer_escaped (OutputBuffer* buffer, const char* string);
+
+/**
+ * @brief Add a Decaf string literal to a buffer, inserting double escape
+ * codes as necessary (see @ref print_doubly_escaped_string)
+ *
+ * @param buffer Buffer to add to
+ * @param string String literal to add
+ */
+void OutputBuffer_doubly_escaped (OutputBuffer* buffer, const char* string);
+
+/**
+ * @brief Add text to a buffer, replacing the characters that are special in
+ * XML and HTML with entity references
+ *
+ * @param buffer Buffer to add to
+ * @param string Text to add
+ */
+void OutputBuffer_xml_escaped (OutputBuffer* buffer, const char* string);
+
+/**
+ * @brief Move the contents of one buffer to the end of another
+ *
+ * @param buffer Buffer to add to
+ * @param other Buffer to take the text from (left empty)
+ */
+void OutputBuffer_append (OutputBuffer* buffer, OutputBuffer* other);
+
+/**
+ * @brief Write the buffered text to the buffer's stream (if it has one)
+ *
+ * @param buffer Buffer to flush
+ */
+void OutputBuffer_flush (OutputBuffer* buffer);
+
+/**
+ * @brief Flush and deallocate a buffer (without closing its stream)
+ *
+ * @param buffer Buffer to deallocate
+ */
+void OutputBuffer_free (OutputBuffer* buffer);
+
+#endif
@@ -7,14 +7,74 @@
 #define __P1_LEXER_H
 
 #include "common.h"
+#include "scan.h"
 #include "token.h"
 
 /**
  * @brief Convert a string containing a Decaf program into a queue of tokens.
  *
+ * Tokens refer to their text in place, so the string must not be modified or
+ * deallocated while the tokens are in use. The string may be any
+ * NUL-terminated string, so it is scanned with the scalar kernels; use
+ * @ref lex_padded for text in a padded buffer.
+ *
  * @param text String to lex
  * @returns Newly-created queue of tokens
  */
 TokenQueue* lex(const char* text);
 
+/**
+ * @brief Convert a Decaf program in a padded buffer (see @ref SCAN_PADDING)
+ * into a queue of tokens.
+ *
+ * This is the same as @ref lex, but scans with the kernels returned by
+ * @ref ScanKernels_select.
+ *
+ * @param text Program to lex, in a padded buffer
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* lex_padded(const char* text);
+
+/**
+ * @brief Convert a string containing a Decaf program into a queue of tokens
+ * using a specific set of scanning kernels.
+ *
+ * This variant exists so that the kernels can be tested against each other.
+ *
+ * @param text String to lex (in a padded buffer unless @p kernels are the
+ * scalar ones)
+ * @param kernels Scanning kernels to use
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* lex_with_kernels(const char* text, const ScanKernels* kernels);
+
+/**
+ * @brief Create a queue that lexes a Decaf program on demand.
+ *
+ * Tokens are produced only as the queue is peeked at or drained (e.g., by
+ * the parser), so only the current lookahead window is ever held in memory
+ * and lexing interleaves with parsing. Lexing errors are thrown from the
+ * queue operation that needed the offending token; the queue itself is not
+ * deallocated in that case.
+ *
+ * Like @ref lex, this scans with the scalar kernels.
+ *
+ * @param text String to lex (must stay valid until the queue is deallocated)
+ * @returns Newly-created streaming queue of tokens
+ */
+TokenQueue* lex_stream(const char* text);
+
+/**
+ * @brief Create a queue that lexes a Decaf program in a padded buffer (see
+ * @ref SCAN_PADDING) on demand.
+ *
+ * This is the same as @ref lex_stream, but scans with the kernels returned by
+ * @ref ScanKernels_select.
+ *
+ * @param text Program to lex, in a padded buffer (must stay valid until the
+ * queue is deallocated)
+ * @returns Newly-created streaming queue of tokens
+ */
+TokenQueue* lex_stream_padded(const char* text);
+
 #endif
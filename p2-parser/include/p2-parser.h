@@ -11,12 +11,138 @@
 #include "ast.h"
 #include "visitor.h"
 
+/**
+ * @brief How the parser keeps track of nested constructs
+ *
+ * Both modes build identical trees and report the same errors.
+ */
+typedef enum ParserMode
+{
+    /**
+     * @brief Recursive descent (one C stack frame per level of nesting, so
+     * very deeply nested programs can overflow the stack of a thread)
+     */
+    PARSER_RECURSIVE,
+
+    /**
+     * @brief State machine driven by an explicit, heap-backed stack (no limit
+     * on nesting depth)
+     */
+    PARSER_STACK
+
+} ParserMode;
+
+/**
+ * @brief State of one parser
+ *
+ * A context carries everything a parse needs besides its input: where errors
+ * go, the allocator for the tree, and the options. Each thread can parse with
+ * its own context independently of the others (and of the driver's @c
+ * decaf_error), so a long-lived process can run many parses at once; the
+ * identifier table (see intern.h) is the only state they share. A context
+ * can be reused for any number of parses, one at a time.
+ */
+typedef struct ParserContext
+{
+    /**
+     * @brief Error state: errors raised while parsing with this context
+     * (including lexer errors from a streaming token queue) end the parse, and
+     * the message of the last one is kept here
+     */
+    ErrorHandler error;
+
+    /**
+     * @brief Arena that the tree being parsed is allocated from (created for
+     * each parse and owned by the finished tree's program node; @c NULL
+     * outside of a parse)
+     */
+    Arena* arena;
+
+    /**
+     * @brief Parser mode (see @ref ParserMode)
+     */
+    ParserMode mode;
+
+} ParserContext;
+
+/**
+ * @brief Set up a parser context with the default options
+ *
+ * The parser mode is taken from the @c DECAF_PARSER environment variable
+ * ("stack" or "recursive", the default); it can be changed afterwards.
+ *
+ * @param context Context to initialize
+ */
+void ParserContext_init (ParserContext* context);
+
+/**
+ * @brief Convert a queue of tokens into an abstract syntax tree (AST) using a
+ * parser context
+ *
+ * Unlike @ref parse, this does not throw: errors are caught by the context,
+ * and everything the parse allocated is released before it returns.
+ *
+ * @param context Parser context (not in use by another parse)
+ * @param input Tokens to parse
+ * @returns Root of abstract syntax tree (see @ref parse), or @c NULL if there
+ * was an error (the message is in @c context->error.message)
+ */
+ASTNode* ParserContext_parse (ParserContext* context, TokenQueue* input);
+
+/**
+ * @brief Lex and parse a program using a parser context
+ *
+ * The tokens are produced as the parser asks for them (see @c lex_stream), so
+ * lexer errors are reported like parser errors.
+ *
+ * @param context Parser context (not in use by another parse)
+ * @param text Source code to parse
+ * @returns Root of abstract syntax tree, or @c NULL if there was an error
+ * (see @ref ParserContext_parse)
+ */
+ASTNode* ParserContext_parse_text (ParserContext* context, const char* text);
+
+/**
+ * @brief Lex and parse a program in a padded buffer (see @ref SCAN_PADDING)
+ * using a parser context
+ *
+ * This is the same as @ref ParserContext_parse_text, but the lexer can use the
+ * vector scanning kernels (see @c lex_stream_padded).
+ *
+ * @param context Parser context (not in use by another parse)
+ * @param text Source code to parse, in a padded buffer
+ * @returns Root of abstract syntax tree, or @c NULL if there was an error
+ * (see @ref ParserContext_parse)
+ */
+ASTNode* ParserContext_parse_padded (ParserContext* context, const char* text);
+
 /**
  * @brief Convert a queue of tokens into an abstract syntax tree (AST)
  *
+ * The tree comes with its @c parent and @c depth attributes already set (every
+ * node except the root has a parent), so the driver does not need separate
+ * passes for them.
+ *
+ * The parser mode is taken from the @c DECAF_PARSER environment variable
+ * ("stack" or "recursive", the default); see @ref parse_with_mode.
+ *
+ * Errors are thrown with @ref Error_throw after everything the parse
+ * allocated has been released. This is a shortcut for parsing with a fresh
+ * @ref ParserContext.
+ *
  * @param input Tokens to parse
  * @returns Root of abstract syntax tree
  */
 ASTNode* parse (TokenQueue* input);
 
+/**
+ * @brief Convert a queue of tokens into an abstract syntax tree (AST) using
+ * a given parser mode
+ *
+ * @param input Tokens to parse
+ * @param mode Parser mode
+ * @returns Root of abstract syntax tree (see @ref parse)
+ */
+ASTNode* parse_with_mode (TokenQueue* input, ParserMode mode);
+
 #endif
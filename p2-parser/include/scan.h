@@ -0,0 +1,125 @@
+/**
+ * @file scan.h
+ * @brief Character-run scanning kernels used by the lexer
+ *
+ * Most bytes of a Decaf program belong to long runs of whitespace, identifier
+ * characters, digits, comment text, or string literal bodies. These kernels
+ * find the end of such a run many bytes at a time. There is a portable scalar
+ * implementation and, on x86, SSE2 and AVX2 implementations; the best one
+ * supported by the running CPU is picked at runtime (see
+ * @ref ScanKernels_select).
+ *
+ * All kernels take a pointer into a NUL-terminated buffer and return a pointer
+ * to the first byte that ends the run (the NUL terminator always ends a run).
+ * The vector kernels load whole aligned blocks, which may begin before the
+ * start of the run and end after the terminator, so they may only be used on
+ * padded buffers (see @ref SCAN_PADDING); the scalar kernels work on any
+ * NUL-terminated string.
+ */
+
+#ifndef __SCAN_H
+#define __SCAN_H
+
+#include "common.h"
+
+/**
+ * @brief Alignment and padding of a buffer that the vector kernels may scan
+ *
+ * A padded buffer starts at an address that is a multiple of this value, and
+ * its text (which may begin anywhere in the buffer) is followed by at least
+ * this many zero bytes (the first of which is the terminator), so every block
+ * a vector kernel loads lies inside it. Allocate one with @ref
+ * scan_buffer_alloc.
+ */
+#define SCAN_PADDING 32
+
+/**
+ * @brief Set of scanning kernels
+ *
+ * Obtain with @ref ScanKernels_select (or one of the specific accessors); the
+ * structures are static and must not be freed.
+ */
+typedef struct ScanKernels
+{
+    /**
+     * @brief Name of the implementation ("scalar", "sse2", or "avx2")
+     */
+    const char* name;
+
+    /**
+     * @brief Skip spaces, tabs, carriage returns, and line feeds
+     *
+     * The number of line feeds skipped is added to @c *lines.
+     */
+    const char* (*skip_whitespace) (const char* text, int* lines);
+
+    /**
+     * @brief Skip identifier characters (<tt>[a-zA-Z0-9_]</tt>)
+     */
+    const char* (*skip_ident) (const char* text);
+
+    /**
+     * @brief Skip decimal digits (<tt>[0-9]</tt>)
+     */
+    const char* (*skip_digits) (const char* text);
+
+    /**
+     * @brief Skip hexadecimal digits (<tt>[0-9a-fA-F]</tt>)
+     */
+    const char* (*skip_hex) (const char* text);
+
+    /**
+     * @brief Skip string literal body characters
+     *
+     * Stops at a quote, backslash, carriage return, line feed, or NUL.
+     */
+    const char* (*skip_string_body) (const char* text);
+
+    /**
+     * @brief Skip comment text (stops at a line feed or NUL)
+     */
+    const char* (*skip_comment) (const char* text);
+
+} ScanKernels;
+
+/**
+ * @brief Allocate a padded buffer (see @ref SCAN_PADDING)
+ *
+ * @param length Number of bytes of text the buffer must hold
+ * @returns Aligned buffer with room for @p length bytes of text, followed by
+ * (at least) @ref SCAN_PADDING zero bytes (caller must free)
+ */
+char* scan_buffer_alloc (size_t length);
+
+/**
+ * @brief Look up the portable scalar kernels
+ *
+ * @returns Scalar kernel set (always available)
+ */
+const ScanKernels* ScanKernels_scalar (void);
+
+/**
+ * @brief Look up the SSE2 kernels
+ *
+ * @returns SSE2 kernel set, or @c NULL if not supported on this machine
+ */
+const ScanKernels* ScanKernels_sse2 (void);
+
+/**
+ * @brief Look up the AVX2 kernels
+ *
+ * @returns AVX2 kernel set, or @c NULL if not supported on this machine
+ */
+const ScanKernels* ScanKernels_avx2 (void);
+
+/**
+ * @brief Select the fastest kernel set supported by the running CPU
+ *
+ * The choice is made using CPUID and can be overridden by setting the
+ * @c DECAF_SCAN environment variable to @c scalar, @c sse2, or @c avx2.
+ *
+ * @returns Selected kernel set (which may only be used on padded buffers)
+ */
+const ScanKernels* ScanKernels_select (void);
+
+#endif
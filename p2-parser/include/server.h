@@ -0,0 +1,249 @@
+/**
+ * @file server.h
+ * @brief Compile server
+ *
+ * A long-lived process that compiles programs on request, so that callers do
+ * not pay for starting the compiler every time, and the identifier table
+ * stays warm between requests. Clients connect to a Unix domain socket and
+ * send any number of requests, each of which gets one reply, over the same
+ * connection.
+ *
+ * Every distinct name in every request stays in the identifier table (see
+ * intern.h), so the table grows with the variety of programs compiled. Once
+ * it holds more names than the limit in @ref ServerOptions, the server
+ * empties it the next time no request is being compiled. A running server
+ * must therefore be the only user of the identifier table in its process.
+ *
+ * Every message is a frame: a four-byte length in network byte order,
+ * followed by that many bytes of body. A request body is a source byte (see
+ * @ref ServerSource), the number of outputs as a decimal digit, that many
+ * output bytes (see @ref ServerOutput), and then the data (the path of a
+ * source file, or the source text itself). The program is compiled once,
+ * however many outputs the request asks for. The server answers with one
+ * reply per output, in the order they were asked for, and stops at the first
+ * reply that does not carry output (the program has an error, or the request
+ * could not be carried out). A reply body is a status byte (see @ref
+ * ServerStatus) followed by the output text or an error message. All of the
+ * protocol bytes are printable characters, so a conversation can be read in a
+ * hex dump.
+ *
+ * Connections wait in a bounded queue for one of the server's worker threads;
+ * when the queue is full, a new connection gets a failure reply ("Server
+ * busy") right away. A connection that waited longer than the timeout gets a
+ * failure reply instead of service, and a connection is closed when reading
+ * a request (or waiting for the next one) or writing a reply takes longer
+ * than the timeout. A connection is also closed once it has been served for
+ * longer than the connection limit, however busy the client keeps it, so
+ * that a few clients cannot hold on to every worker. The compilation itself
+ * is not interrupted (it takes time proportional to the size of the
+ * program).
+ */
+
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include "common.h"
+
+/**
+ * @brief Where the program in a request comes from (or what else the
+ * request asks for)
+ */
+typedef enum ServerSource
+{
+    SERVER_PATH     = 'P',  /**< @brief The data is the path of a source file (as seen by the server) */
+    SERVER_TEXT     = 'T',  /**< @brief The data is the source text */
+    SERVER_SHUTDOWN = 'Q'   /**< @brief Stop the server (no data; see @ref Server_stop) */
+} ServerSource;
+
+/**
+ * @brief What a request asks for
+ */
+typedef enum ServerOutput
+{
+    SERVER_AST = 'A',       /**< @brief AST debug output (see @ref PrintVisitor_new) */
+    SERVER_DOT = 'D',       /**< @brief Graph in DOT format (see @ref GenerateASTGraph_new) */
+    SERVER_SVG = 'S'        /**< @brief Image of the tree (see @ref GenerateASTImage_new) */
+} ServerOutput;
+
+/**
+ * @brief Outcome of a request
+ */
+typedef enum ServerStatus
+{
+    SERVER_OK     = 'O',    /**< @brief Compiled; the reply holds the output */
+    SERVER_ERROR  = 'E',    /**< @brief The program has an error; the reply holds the message */
+    SERVER_FAILED = 'F'     /**< @brief The request was not carried out; the reply says why */
+} ServerStatus;
+
+/**
+ * @brief Default number of connections that can wait for a worker
+ */
+#define SERVER_QUEUE_CAPACITY 64
+
+/**
+ * @brief Default timeout in milliseconds (see @ref ServerOptions)
+ */
+#define SERVER_TIMEOUT_MS 5000
+
+/**
+ * @brief Default longest time in milliseconds that a worker serves one
+ * connection (see @ref ServerOptions)
+ */
+#define SERVER_CONNECTION_MS 60000
+
+/**
+ * @brief Default number of names the identifier table may hold before the
+ * server empties it (see @ref ServerOptions)
+ */
+#define SERVER_NAME_LIMIT (256u * 1024)
+
+/**
+ * @brief Largest request body the server accepts, in bytes
+ */
+#define SERVER_MAX_REQUEST (256u * 1024 * 1024)
+
+/**
+ * @brief Most outputs that one request can ask for
+ */
+#define SERVER_MAX_OUTPUTS 3
+
+/**
+ * @brief Largest path or source text that a request can carry, in bytes
+ */
+#define SERVER_MAX_DATA (SERVER_MAX_REQUEST - 2 - SERVER_MAX_OUTPUTS)
+
+/**
+ * @brief Server settings
+ */
+typedef struct ServerOptions
+{
+    /**
+     * @brief Number of worker threads (if zero or negative, the value of the
+     * @c DECAF_THREADS environment variable or else the number of online
+     * processors)
+     */
+    int workers;
+
+    /**
+     * @brief Number of connections that can wait for a worker
+     */
+    int queue_capacity;
+
+    /**
+     * @brief Longest time in milliseconds that a connection may wait for a
+     * worker, and that reading one request or writing one reply may take
+     */
+    int timeout_ms;
+
+    /**
+     * @brief Longest time in milliseconds that a worker serves one connection
+     * before closing it (if zero or negative, @ref SERVER_CONNECTION_MS); the
+     * request being read when the time runs out is not served
+     */
+    int connection_ms;
+
+    /**
+     * @brief Number of distinct names the identifier table may hold before
+     * the server empties it, between requests (if zero, @ref
+     * SERVER_NAME_LIMIT)
+     */
+    size_t name_limit;
+
+} ServerOptions;
+
+/**
+ * @brief Compile server (see @ref Server_open)
+ */
+typedef struct Server Server;
+
+/**
+ * @brief Reply to a request
+ */
+typedef struct ServerReply
+{
+    ServerStatus status;    /**< @brief Outcome of the request */
+    char* text;             /**< @brief NUL-terminated output or message (caller must free) */
+    size_t length;          /**< @brief Length of @c text */
+} ServerReply;
+
+/**
+ * @brief Set up a compile server listening on a Unix domain socket
+ *
+ * A stale socket file left at @p socket_path (by a server that did not shut
+ * down cleanly) is replaced, but a socket that a running server is listening
+ * on is not.
+ *
+ * @param socket_path Path of the socket
+ * @param options Settings (or @c NULL for the defaults)
+ * @returns Newly-allocated server, or @c NULL if it could not be set up
+ * (after printing a message to @c stderr)
+ */
+Server* Server_open (const char* socket_path, const ServerOptions* options);
+
+/**
+ * @brief Serve requests until the server is stopped
+ *
+ * Once stopped, the server accepts no more connections, but finishes with
+ * the ones already accepted before returning.
+ *
+ * @param server Server to run
+ */
+void Server_run (Server* server);
+
+/**
+ * @brief Stop a running server
+ *
+ * This only sets a flag, so it can be called from any thread and from a
+ * signal handler; @ref Server_run notices within a fraction of a second.
+ *
+ * @param server Server to stop
+ */
+void Server_stop (Server* server);
+
+/**
+ * @brief Close a server, remove its socket file, and deallocate it
+ *
+ * @param server Server to deallocate
+ */
+void Server_free (Server* server);
+
+/**
+ * @brief Send a request for one output to a compile server and wait for the
+ * reply
+ *
+ * @param socket_path Path of the server's socket
+ * @param source Kind of request
+ * @param output Output to ask for
+ * @param data Path or source text (see @ref ServerSource)
+ * @param length Length of @p data
+ * @param[out] reply Reply from the server
+ * @returns True if a reply was received, false if the server could not be
+ * reached or closed the connection without replying (or @p length is more
+ * than @ref SERVER_MAX_DATA)
+ */
+bool Server_request (const char* socket_path, ServerSource source, ServerOutput output,
+        const char* data, size_t length, ServerReply* reply);
+
+/**
+ * @brief Send a request for several outputs of the same program to a compile
+ * server and wait for the replies
+ *
+ * The server compiles the program only once. If a reply is not @c SERVER_OK
+ * (e.g., the program has an error), it is the last one; the replies after it
+ * are left with a @c NULL text.
+ *
+ * @param socket_path Path of the server's socket
+ * @param source Kind of request
+ * @param outputs Outputs to ask for
+ * @param count Number of outputs (at most @ref SERVER_MAX_OUTPUTS)
+ * @param data Path or source text (see @ref ServerSource)
+ * @param length Length of @p data
+ * @param[out] replies Reply for each output
+ * @returns True if every reply that the server owes was received, false if
+ * the server could not be reached or closed the connection early (or @p count
+ * or @p length is out of range)
+ */
+bool Server_request_outputs (const char* socket_path, ServerSource source, const ServerOutput* outputs,
+        int count, const char* data, size_t length, ServerReply* replies);
+
+#endif
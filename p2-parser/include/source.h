@@ -0,0 +1,73 @@
+/**
+ * @file source.h
+ * @brief Decaf source file input
+ *
+ * Regular files are memory-mapped read-only and lexed directly from the
+ * mapping; pipes and standard input are read into a heap buffer instead.
+ * Either way there is no limit on the size of the input, and the text is
+ * always in a padded buffer (see @ref SCAN_PADDING), so it can be lexed with
+ * the vector scanning kernels (see @ref lex_padded).
+ */
+
+#ifndef __SOURCE_H
+#define __SOURCE_H
+
+#include "common.h"
+
+/**
+ * @brief Contents of a Decaf source file
+ *
+ * Allocate with @ref SourceFile_open and de-allocate with @ref SourceFile_free.
+ */
+typedef struct SourceFile
+{
+    /**
+     * @brief Source text in a padded buffer (read-only)
+     */
+    const char* text;
+
+    /**
+     * @brief Length of the source text in bytes (not counting the terminator)
+     */
+    size_t size;
+
+    /**
+     * @brief Length of the memory mapping, or zero if @c text is on the heap
+     */
+    size_t mapped_size;
+
+} SourceFile;
+
+/**
+ * @brief Open and load a Decaf source file
+ *
+ * The filename @c "-" refers to standard input.
+ *
+ * @param filename Name of file to read
+ * @returns Newly-allocated source file, or @c NULL if the file could not be
+ * read (with @c errno set accordingly)
+ */
+SourceFile* SourceFile_open (const char* filename);
+
+/**
+ * @brief Load a Decaf source file into a heap buffer
+ *
+ * This is the same as @ref SourceFile_open, except that the file is never
+ * memory-mapped. Use it when the file might be changed while its text is in
+ * use (e.g., by a long-lived process): a mapped file that is truncated raises
+ * @c SIGBUS when the missing part is read, while a copy is unaffected.
+ *
+ * @param filename Name of file to read
+ * @returns Newly-allocated source file, or @c NULL if the file could not be
+ * read (with @c errno set accordingly)
+ */
+SourceFile* SourceFile_read (const char* filename);
+
+/**
+ * @brief Unmap or deallocate a source file
+ *
+ * @param source Source file to deallocate
+ */
+void SourceFile_free (SourceFile* source);
+
+#endif
@@ -70,10 +70,84 @@ typedef enum TokenType {
     ID, DECLIT, HEXLIT, STRLIT, KEY, SYM
 } TokenType;
 
+/**
+ * @brief Specific keyword or symbol represented by a token
+ *
+ * Every @c KEY and @c SYM token is classified by the lexer into one of these
+ * kinds, so the parser can dispatch on an integer instead of comparing text.
+ * All other tokens (identifiers and literals) have the kind @c TK_NONE.
+ * @c TK_RESERVED stands for any of the reserved words, which are rejected by
+ * the lexer and never appear in a token.
+ */
+typedef enum TokenKind {
+    TK_NONE,
+
+    /* keywords */
+    TK_DEF, TK_IF, TK_ELSE, TK_WHILE, TK_RETURN, TK_BREAK, TK_CONTINUE,
+    TK_INT, TK_BOOL, TK_VOID, TK_TRUE, TK_FALSE,
+    TK_RESERVED,
+
+    /* symbols */
+    TK_LPAREN, TK_RPAREN, TK_LBRACE, TK_RBRACE, TK_LBRACKET, TK_RBRACKET,
+    TK_COMMA, TK_SEMICOLON, TK_ASSIGN,
+    TK_OR, TK_AND, TK_EQ, TK_NE, TK_LT, TK_LE, TK_GE, TK_GT,
+    TK_PLUS, TK_MINUS, TK_STAR, TK_SLASH, TK_PERCENT, TK_BANG,
+
+    NUM_TOKEN_KINDS
+} TokenKind;
+
+/**
+ * @brief Classify a keyword, reserved word, or symbol
+ *
+ * Uses a perfect hash on the first character, last character, and length of
+ * the text, so each lookup is a single table probe and one comparison.
+ *
+ * @param text Text to classify (need not be NUL-terminated)
+ * @param length Length of the text
+ * @returns Kind of the keyword or symbol (or @c TK_NONE if the text is
+ * neither)
+ */
+TokenKind TokenKind_lookup (const char* text, size_t length);
+
+/**
+ * @brief Convert a token kind to the text of its keyword or symbol
+ *
+ * @param kind Kind to convert
+ * @returns Static const string spelling of the given kind
+ */
+const char* TokenKind_to_string (TokenKind kind);
+
+/**
+ * @brief Location of a token's text in the source buffer
+ *
+ * Token text is never copied out of the source; a span just records where it
+ * is. Source buffers are limited to 4 GiB.
+ */
+typedef struct TokenSpan
+{
+    /**
+     * @brief Offset of the first character from the start of the source
+     */
+    uint32_t offset;
+
+    /**
+     * @brief Length of the text in characters
+     */
+    uint32_t length;
+
+} TokenSpan;
+
 /**
  * @brief Single token
- * 
- * Allocate with @ref Token_new and de-allocate with @ref Token_free.
+ *
+ * The token's text is a view (see @ref TokenSpan) into a source buffer that
+ * must outlive the token; it is not NUL-terminated. Use the @c Token_text
+ * helpers to examine it, and @ref Token_text_dup for an owned copy.
+ *
+ * Tokens in a @ref TokenQueue are not stored as @c Token structures; the
+ * queue hands out @c Token values that describe them. Stand-alone tokens can
+ * be allocated with @ref Token_new or @ref Token_new_span and de-allocated
+ * with @ref Token_free.
  */
 typedef struct Token
 {
@@ -83,9 +157,9 @@ typedef struct Token
     TokenType type;
 
     /**
-     * @brief Raw text of the token
+     * @brief Keyword or symbol kind (@c TK_NONE for other token types)
      */
-    char text[MAX_TOKEN_LEN];
+    TokenKind kind;
 
     /**
      * @brief Source line number
@@ -93,9 +167,14 @@ typedef struct Token
     int line;
 
     /**
-     * @brief Pointer to next token (used to store in a list)
+     * @brief Source buffer that contains the token's text
+     */
+    const char* source;
+
+    /**
+     * @brief Location of the token's text in @c source
      */
-    struct Token* next;
+    TokenSpan span;
 
 } Token;
 
@@ -108,27 +187,57 @@ typedef struct Token
 const char* TokenType_to_string(TokenType type);
 
 /**
- * @brief Check string equality for tokens. Limits comparison to @c
- * MAX_TOKEN_LEN for safety.
+ * @brief Allocate and initialize a new token with its own copy of the text
+ *
+ * The text is stored in the same allocation as the token (so it acts as its
+ * own source buffer). @c KEY and @c SYM tokens are classified with @ref
+ * TokenKind_lookup. Make sure Token_free() is called to deallocate the
+ * token, otherwise there will be a memory leak.
  *
- * @param str1 First string to compare
- * @param str2 Second string to compare
- * @return True if strings are equal; false otherwise
+ * @param type Type of new token
+ * @param text Raw text for new token
+ * @param line Line number of new token
+ * @returns Newly-created token
  */
-bool token_str_eq(const char* str1, const char* str2);
+Token* Token_new (TokenType type, const char* text, int line);
 
 /**
- * @brief Allocate and initialize a new token
- *
- * Make sure Token_free() is called to deallocate the token, otherwise there
- * will be a memory leak.
+ * @brief Allocate and initialize a new token that refers to text in a source
+ * buffer (no text is copied)
  *
  * @param type Type of new token
- * @param text Raw text for new token
+ * @param source Source buffer (must outlive the token)
+ * @param offset Offset of the token's text in the source buffer
+ * @param length Length of the token's text
  * @param line Line number of new token
  * @returns Newly-created token
  */
-Token* Token_new (TokenType type, const char* text, int line);
+Token* Token_new_span (TokenType type, const char* source, uint32_t offset, uint32_t length, int line);
+
+/**
+ * @brief Look up the start of a token's text (not NUL-terminated)
+ *
+ * @param token Token to examine
+ * @returns Pointer to the first character of the token's text
+ */
+const char* Token_text (const Token* token);
+
+/**
+ * @brief Check whether a token's text is equal to a string
+ *
+ * @param token Token to examine
+ * @param str NUL-terminated string to compare against
+ * @returns True if and only if the text and the string are identical
+ */
+bool Token_text_eq (const Token* token, const char* str);
+
+/**
+ * @brief Copy a token's text into a new NUL-terminated string
+ *
+ * @param token Token to copy from
+ * @returns Newly-allocated string (caller must free)
+ */
+char* Token_text_dup (const Token* token);
 
 /**
  * @brief Deallocate a token
@@ -137,13 +246,52 @@ Token* Token_new (TokenType type, const char* text, int line);
  */
 void Token_free (Token* token);
 
+struct TokenQueue;
+
 /**
- * @brief Linked list of tokens
+ * @brief Producer of tokens for a streaming @ref TokenQueue
+ *
+ * A token source is embedded as the first member of a producer's own state
+ * structure (e.g., the lexer's), so the callbacks can cast the pointer back
+ * to the full state.
+ */
+typedef struct TokenSource
+{
+    /**
+     * @brief Append at least one more token to the queue
+     *
+     * @returns False if there are no more tokens (end of input)
+     */
+    bool (*produce) (struct TokenSource* source, struct TokenQueue* queue);
+
+    /**
+     * @brief Deallocate the source (called by @ref TokenQueue_free)
+     */
+    void (*free) (struct TokenSource* source);
+
+} TokenSource;
+
+/**
+ * @brief Queue of tokens
+ *
+ * Tokens are stored in parallel growable arrays (types, kinds, lines, and
+ * text spans) with a cursor marking the next token, so looking ahead any distance,
+ * removing a token, and calculating the size all take constant time, and
+ * deallocation is a handful of @c free calls. All spans refer to a single
+ * source buffer (@c text).
+ *
+ * The queue either holds every token up front (as built by @ref lex) or is
+ * refilled on demand from a @ref TokenSource, in which case removed tokens
+ * are discarded as the buffer is refilled, so only the current lookahead
+ * window is held in memory. All of the methods below behave the same in both
+ * cases.
  * 
- * Allocate with @ref TokenQueue_new and de-allocate with @ref TokenQueue_free.
+ * Allocate with @ref TokenQueue_new, @ref TokenQueue_new_for_text, or
+ * @ref TokenQueue_new_streaming and de-allocate with @ref TokenQueue_free.
  * 
  * Methods:
  * - @ref TokenQueue_peek
+ * - @ref TokenQueue_peek_ahead
  * - @ref TokenQueue_remove
  * - @ref TokenQueue_is_empty
  * - @ref TokenQueue_size
@@ -152,48 +300,160 @@ void Token_free (Token* token);
 typedef struct TokenQueue
 {
     /**
-     * @brief Front of list (or <tt>NULL</tt> if list is empty)
+     * @brief Source buffer that all token spans refer to
+     */
+    const char* text;
+
+    /**
+     * @brief Text buffer owned by the queue (used only by @ref TokenQueue_add)
+     */
+    char* owned_text;
+
+    /**
+     * @brief Length of @c owned_text in use
+     */
+    size_t owned_length;
+
+    /**
+     * @brief Allocated size of @c owned_text
+     */
+    size_t owned_capacity;
+
+    /**
+     * @brief Token types
      */
-    Token* head;
+    uint8_t* types;
 
     /**
-     * @brief Back of list (or <tt>NULL</tt> if list is empty)
+     * @brief Token keyword or symbol kinds
      */
-    Token* tail;
+    uint8_t* kinds;
+
+    /**
+     * @brief Token source lines
+     */
+    int* lines;
+
+    /**
+     * @brief Token text spans (in @c text)
+     */
+    TokenSpan* spans;
+
+    /**
+     * @brief Index of the next token (the cursor)
+     */
+    size_t head;
+
+    /**
+     * @brief Index one past the last buffered token
+     */
+    size_t count;
+
+    /**
+     * @brief Allocated length of the arrays
+     */
+    size_t capacity;
+
+    /**
+     * @brief Source of further tokens (or <tt>NULL</tt> if every token is
+     * already buffered)
+     */
+    TokenSource* source;
 
 } TokenQueue;
 
 /**
  * @brief Allocate and initialize a new, empty queue of tokens
  *
+ * Tokens can be added to this queue with @ref TokenQueue_add, which copies
+ * their text into a buffer owned by the queue.
+ *
  * @returns Newly-created queue of tokens
  */
 TokenQueue* TokenQueue_new (void);
 
 /**
- * @brief Add a token to a queue
+ * @brief Allocate and initialize a new, empty queue of tokens whose text
+ * lives in the given source buffer
+ *
+ * Tokens are added to this queue with @ref TokenQueue_push.
+ *
+ * @param text Source buffer (must outlive the queue)
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* TokenQueue_new_for_text (const char* text);
+
+/**
+ * @brief Allocate and initialize a new queue that pulls tokens from a source
+ * as they are needed
+ *
+ * @param text Source buffer (must outlive the queue)
+ * @param source Token source (the queue takes ownership of it)
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* TokenQueue_new_streaming (const char* text, TokenSource* source);
+
+/**
+ * @brief Add a stand-alone token to a queue created by @ref TokenQueue_new
+ *
+ * The token's text is copied into the queue and the token is deallocated.
+ * Any @c Token values previously returned by the queue must not be used
+ * afterwards (their text may have moved).
  *
  * @param queue Queue to add to
- * @param token Token to add
+ * @param token Token to add (the queue takes ownership of it)
  */
 void TokenQueue_add (TokenQueue* queue, Token* token);
 
+/**
+ * @brief Add a token to a queue by its location in the queue's source buffer
+ *
+ * @param queue Queue to add to
+ * @param type Type of the token
+ * @param kind Keyword or symbol kind of the token
+ * @param offset Offset of the token's text in the source buffer
+ * @param length Length of the token's text
+ * @param line Line number of the token
+ */
+void TokenQueue_push (TokenQueue* queue, TokenType type, TokenKind kind, uint32_t offset, uint32_t length, int line);
+
 /**
  * @brief Return the next token from a queue without removing it
  * (first-in-first-out)
  *
  * @param queue Queue to look at
- * @returns Token extracted
+ * @returns Token extracted (a token with empty text if the queue is empty)
  */
-Token* TokenQueue_peek (TokenQueue* queue);
+Token TokenQueue_peek (TokenQueue* queue);
+
+/**
+ * @brief Return a token further along in the queue without removing anything
+ *
+ * @param queue Queue to look at
+ * @param k Number of tokens to look past (zero is the same as @ref
+ * TokenQueue_peek)
+ * @returns Token extracted (a token with empty text if there are not enough
+ * tokens)
+ */
+Token TokenQueue_peek_ahead (TokenQueue* queue, size_t k);
+
+/**
+ * @brief Check whether a queue holds more than @c k tokens
+ *
+ * @param queue Queue to check
+ * @param k Number of tokens to look past
+ * @returns True if and only if @ref TokenQueue_peek_ahead would return a real
+ * token for @c k
+ */
+bool TokenQueue_has_ahead (TokenQueue* queue, size_t k);
 
 /**
  * @brief Remove a token from a queue (first-in-first-out)
  *
  * @param queue Queue to remove from
- * @returns Token removed
+ * @returns Token removed (a token with empty text if the queue is empty)
  */
-Token* TokenQueue_remove (TokenQueue* queue);
+Token TokenQueue_remove (TokenQueue* queue);
 
 /**
  * @brief Check whether a queue is empty
@@ -206,6 +466,8 @@ bool TokenQueue_is_empty (TokenQueue* queue);
 /**
  * @brief Calculate size of the queue
  *
+ * For a streaming queue, this pulls every remaining token from the source.
+ *
  * @param queue Queue to check
  * @returns Number of tokens in the queue
  */
@@ -222,7 +484,7 @@ void TokenQueue_print (TokenQueue* queue, FILE* out);
 /**
  * @brief Deallocate a token queue
  *
- * Also deallocates any remaining tokens
+ * Also deallocates the token source (if any)
  *
  * @param queue Queue to deallocate
  */
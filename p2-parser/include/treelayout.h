@@ -0,0 +1,111 @@
+/**
+ * @file treelayout.h
+ * @brief Tidy tree layout
+ *
+ * Computes where to draw the nodes of a tree, level by level, in the style of
+ * Reingold and Tilford: every parent is centred over its children, subtrees
+ * are pushed apart just far enough that they do not overlap on any level, and
+ * the smaller subtrees between two pushed-apart ones are spaced out evenly.
+ * The implementation follows the linear-time formulation of Walker's
+ * algorithm by Buchheim, Jünger, and Leipert, and works without recursion, so
+ * trees of any size and depth can be laid out in time proportional to the
+ * number of nodes.
+ */
+
+#ifndef __TREELAYOUT_H
+#define __TREELAYOUT_H
+
+#include "common.h"
+
+/**
+ * @brief Index of a node in a @ref TreeLayout
+ */
+typedef uint32_t LayoutIndex;
+
+/**
+ * @brief Index value meaning "no node"
+ */
+#define LAYOUT_NONE UINT32_MAX
+
+/**
+ * @brief Node of a tree being laid out
+ *
+ * Only @c x and @c level are meaningful to clients (after @ref
+ * TreeLayout_compute); the other members are links and the working state of
+ * the layout.
+ */
+typedef struct LayoutNode
+{
+    LayoutIndex parent;         /**< @brief Parent (or @ref LAYOUT_NONE for the root) */
+    LayoutIndex first_child;    /**< @brief Leftmost child (or @ref LAYOUT_NONE) */
+    LayoutIndex last_child;     /**< @brief Rightmost child (or @ref LAYOUT_NONE) */
+    LayoutIndex prev_sibling;   /**< @brief Sibling to the left (or @ref LAYOUT_NONE) */
+    LayoutIndex next_sibling;   /**< @brief Sibling to the right (or @ref LAYOUT_NONE) */
+    uint32_t number;            /**< @brief Position among its siblings (starting at zero) */
+    uint32_t level;             /**< @brief Depth of the node (the root is on level zero) */
+    LayoutIndex thread;         /**< @brief Next node on the subtree contour (if it has no children) */
+    LayoutIndex ancestor;       /**< @brief Ancestor used to find the subtree to move when apportioning */
+    LayoutIndex default_ancestor;   /**< @brief Default ancestor used while apportioning the children */
+    double width;               /**< @brief Horizontal space the node takes up */
+    double prelim;              /**< @brief Preliminary position relative to its left siblings */
+    double mod;                 /**< @brief Offset to apply to the whole subtree below the node */
+    double shift;               /**< @brief Pending shift of the subtree */
+    double change;              /**< @brief Pending change in the shift of later siblings */
+    double x;                   /**< @brief Horizontal position of the node's centre */
+} LayoutNode;
+
+/**
+ * @brief Tree to be laid out (nodes in the order they were added)
+ *
+ * Allocate with @ref TreeLayout_new and de-allocate with @ref TreeLayout_free.
+ */
+typedef struct TreeLayout
+{
+    LayoutNode* nodes;          /**< @brief Nodes (the root comes first) */
+    uint32_t count;             /**< @brief Number of nodes */
+    uint32_t capacity;          /**< @brief Allocated length of @c nodes */
+    double gap;                 /**< @brief Minimum horizontal space between neighbouring nodes */
+    double extent;              /**< @brief Width of the whole layout (after @ref TreeLayout_compute) */
+    uint32_t levels;            /**< @brief Number of levels (after @ref TreeLayout_compute) */
+} TreeLayout;
+
+/**
+ * @brief Allocate a new, empty tree layout
+ *
+ * @param gap Minimum horizontal space between neighbouring nodes on a level
+ * @returns Newly-created layout
+ */
+TreeLayout* TreeLayout_new (double gap);
+
+/**
+ * @brief Add a node to a tree layout
+ *
+ * The root must be added first, every other node after its parent, and
+ * siblings from left to right (e.g., in pre-order).
+ *
+ * @param layout Layout to add to
+ * @param parent Parent node (or @ref LAYOUT_NONE for the root)
+ * @param width Horizontal space the node takes up
+ * @returns Index of the new node
+ */
+LayoutIndex TreeLayout_add (TreeLayout* layout, LayoutIndex parent, double width);
+
+/**
+ * @brief Lay out a tree
+ *
+ * Sets the @c x member of every node to the position of its centre, with the
+ * leftmost edge of the layout at zero, and the @c extent and @c levels of the
+ * layout.
+ *
+ * @param layout Layout to compute (must contain at least the root)
+ */
+void TreeLayout_compute (TreeLayout* layout);
+
+/**
+ * @brief Deallocate a tree layout
+ *
+ * @param layout Layout to deallocate
+ */
+void TreeLayout_free (TreeLayout* layout);
+
+#endif
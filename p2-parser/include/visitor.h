@@ -18,6 +18,33 @@
  * AST TRAVERSAL (VISITOR PATTERN)
  */
 
+/**
+ * @brief Traversal control requested by a visitor callback
+ *
+ * A callback requests something other than the default by storing a value in
+ * the @c control member of its visitor before returning; the traversal
+ * consumes the request and resets the member to @c TRAVERSE_CONTINUE.
+ */
+typedef enum TraversalControl {
+    TRAVERSE_CONTINUE,          /**< @brief Keep going (the default) */
+    TRAVERSE_SKIP_CHILDREN,     /**< @brief Do not visit the children of this node (only honored by previsit
+                                            callbacks; the node's postvisit callback still runs) */
+    TRAVERSE_STOP               /**< @brief End the traversal now, without any further callbacks */
+} TraversalControl;
+
+struct NodeVisitor;
+
+/**
+ * @brief Visitor callback (invoked with the visitor and the node being visited)
+ */
+typedef void (*VisitorHook) (struct NodeVisitor* visitor, ASTNode* node);
+
+#ifndef SKIP_IN_DOXYGEN
+#define NODE_VISITOR_HOOKS(TYPE, name, label, CHILDREN) \
+    VisitorHook  previsit_ ## name; \
+    VisitorHook postvisit_ ## name;
+#endif
+
 /**
  * @brief Node visitor structure
  * 
@@ -36,45 +63,36 @@ typedef struct NodeVisitor
      */
     Destructor dtor;
 
+    /**
+     * @brief Traversal control requested by the current callback (see @ref
+     * TraversalControl)
+     */
+    TraversalControl control;
+
+    /**
+     * @brief Pointer to a function that creates a worker copy of the visitor
+     * (or @c NULL if the visitor cannot run in parallel; see @ref
+     * NodeVisitor_traverse_parallel)
+     */
+    struct NodeVisitor* (*fork) (struct NodeVisitor* visitor);
+
+    /**
+     * @brief Pointer to a function that merges the results of a worker copy
+     * into the visitor (or @c NULL if there is nothing to merge)
+     */
+    void (*join) (struct NodeVisitor* visitor, struct NodeVisitor* part);
+
     /*
      * Traversal routines; each of these is called at the appropriate time as
-     * the visitor traverses the AST.
+     * the visitor traverses the AST. A NULL previsit or postvisit routine
+     * means that the corresponding default routine is called instead.
      */
 
     #ifndef SKIP_IN_DOXYGEN
-    void (* previsit_default)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_default)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_program)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_program)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_vardecl)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_vardecl)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_funcdecl)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_funcdecl)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_block)       (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_block)       (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_assignment)  (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_assignment)  (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_conditional) (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_conditional) (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_whileloop)   (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_whileloop)   (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_return)      (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_return)      (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_break)       (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_break)       (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_continue)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_continue)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_binaryop)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (*  invisit_binaryop)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_binaryop)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_unaryop)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_unaryop)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_location)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_location)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_funccall)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_funccall)    (struct NodeVisitor* visitor, ASTNode* node);
-    void (* previsit_literal)     (struct NodeVisitor* visitor, ASTNode* node);
-    void (*postvisit_literal)     (struct NodeVisitor* visitor, ASTNode* node);
+    VisitorHook previsit_default;
+    VisitorHook postvisit_default;
+    AST_NODE_KINDS(NODE_VISITOR_HOOKS)
+    VisitorHook invisit_binaryop;
     #endif
 
 } NodeVisitor;
@@ -89,11 +107,93 @@ NodeVisitor* NodeVisitor_new(void);
 /**
  * @brief Perform an AST traversal using the given visitor
  * 
+ * Each node is pre-visited, then its children are traversed in order, then it
+ * is post-visited; the in-visit hook of a binary operation runs between its
+ * two operands. The traversal keeps pending nodes on an explicit stack (reused
+ * by later traversals on the same thread) instead of recursing, so trees of
+ * any depth can be traversed without growing the call stack. Visitor hooks may
+ * start nested traversals.
+ *
+ * The visitor's callbacks (with the defaults standing in for missing ones)
+ * are looked up once when the traversal starts, so each visit is a single
+ * indirect call; changing them takes effect at the next traversal.
+ *
+ * Callbacks can prune the traversal through the visitor's @c control member
+ * (see @ref TraversalControl). For example, this previsit callback makes a
+ * search for function calls stop at the first one:
+ *
+ *     void find_call (NodeVisitor* visitor, ASTNode* node)
+ *     {
+ *         visitor->data = node;
+ *         visitor->control = TRAVERSE_STOP;
+ *     }
+ *
  * @param visitor Visitor structure containing function pointers that will be
  * invoked during the traversal
  * @param node Root of AST structure to traverse
+ * @returns True if a callback stopped the traversal
+ */
+bool NodeVisitor_traverse (NodeVisitor* visitor, ASTNode* node);
+
+/**
+ * @brief Perform an AST traversal using the given visitor, visiting the
+ * functions of a program on several threads
+ *
+ * The program node and its global variables are visited first, on the calling
+ * thread, exactly as by @ref NodeVisitor_traverse. The functions are then
+ * split into runs of consecutive functions (several per thread, so that the
+ * load evens out), each run is traversed in order by its own copy of the
+ * visitor, made with the visitor's @c fork callback (on the calling thread,
+ * after the globals have been visited), and the runs are handed out to the
+ * threads as they become free. Once every run is done, the visitor's @c join
+ * callback merges the copies into the visitor in program order, so the
+ * combined results do not depend on the scheduling, and the copies are
+ * deallocated. Finally the program node is post-visited.
+ *
+ * A visitor declares that it is safe to run this way by providing a @c fork
+ * callback (which can still decline by returning @c NULL, in which case the
+ * functions are visited serially); the traversal falls back to @ref
+ * NodeVisitor_traverse for any other visitor, for a single worker, for
+ * programs with fewer than two functions, and for trees that are not
+ * arena-allocated. The copies traverse concurrently, so their callbacks must
+ * only set attributes of nodes inside the function being visited (see @ref
+ * ASTNode_share_attributes), must not allocate nodes in the tree's arena, and
+ * must not share mutable state without synchronizing it. Visitors that keep no
+ * state of their own can use @ref NodeVisitor_fork_shared.
+ *
+ * A copy that stops its traversal (see @ref TraversalControl) ends the
+ * traversal as it would have serially: it is the last copy joined, the copies
+ * for later functions are discarded (those functions may or may not have been
+ * visited), and the program node is not post-visited. A @c join callback can
+ * request the same by setting the visitor's @c control member to @c
+ * TRAVERSE_STOP.
+ *
+ * An error raised by a callback of a copy (see @ref Error_throw) is caught on
+ * the thread that raised it and stops the traversal in the same way, except
+ * that the copy that raised it is not joined either. Once all of the threads
+ * have finished, the error is raised again on the calling thread. If copies
+ * for several functions raise errors, the one for the earliest function is
+ * raised.
+ *
+ * @param visitor Visitor structure containing function pointers that will be
+ * invoked during the traversal
+ * @param tree Root of AST structure to traverse (normally a @ref ProgramNode)
+ * @param workers Number of threads to use, including the calling thread (if
+ * zero or negative, the value of the @c DECAF_THREADS environment variable or
+ * else the number of online processors)
  */
-void NodeVisitor_traverse (NodeVisitor* visitor, ASTNode* node);
+void NodeVisitor_traverse_parallel (NodeVisitor* visitor, ASTNode* tree, int workers);
+
+/**
+ * @brief Create a worker copy of a visitor that shares the visitor's data
+ *
+ * This is a @c fork callback for visitors whose callbacks do not modify their
+ * visitor's data. The copy does not own the data and needs no @c join.
+ *
+ * @param visitor Visitor to copy
+ * @returns Pointer to the copy
+ */
+NodeVisitor* NodeVisitor_fork_shared (NodeVisitor* visitor);
 
 /**
  * @brief Perform an AST traversal using the given visitor and then deallocate the visitor
@@ -109,6 +209,18 @@ void NodeVisitor_traverse (NodeVisitor* visitor, ASTNode* node);
  */
 void NodeVisitor_traverse_and_free (NodeVisitor* visitor, ASTNode* node);
 
+/**
+ * @brief Deallocate the calling thread's traversal stack
+ *
+ * Threads that run traversals and then exit call this first, since the stack
+ * is otherwise kept for later traversals on the same thread (see @ref
+ * NodeVisitor_traverse). So does code that catches an error thrown out of a
+ * traversal (see @ref Error_throw), outside of any other traversal, since the
+ * abandoned steps would otherwise stay on the stack. It is safe to traverse
+ * again afterwards.
+ */
+void NodeVisitor_release_stack (void);
+
 /**
  * @brief Deallocate a visitor structure
  * 
@@ -116,6 +228,48 @@ void NodeVisitor_traverse_and_free (NodeVisitor* visitor, ASTNode* node);
  */
 void NodeVisitor_free (NodeVisitor* visitor);
 
+/**
+ * @brief Allocate a new composite visitor that runs several visitors in one
+ * traversal
+ *
+ * Members are added with @ref CompositeVisitor_add and are invoked in the
+ * order they were added: at every node, each member's previsit callback runs
+ * (falling back to its @c previsit_default as usual) before the next member's,
+ * and likewise for @c invisit_binaryop and the postvisit callbacks. A member
+ * can therefore rely on anything an earlier member did in the same callback
+ * for the same node, and on anything any member did for the nodes visited
+ * before this one (e.g., parent links that an earlier member set on a node's
+ * children while visiting its parent). It cannot rely on anything a member
+ * does later in the traversal, even if that member comes first; such
+ * visitors still need separate traversals.
+ *
+ * Traversal control requests are tracked per member. A member that skips the
+ * children of a node receives no callbacks until that node's postvisit, and a
+ * member that stops receives no further callbacks from the composite at all;
+ * the other members are unaffected. The composite itself skips the children
+ * of a node when every member still running skips them, and stops when every
+ * member has stopped.
+ *
+ * The composite owns its members: deallocating it with @ref NodeVisitor_free
+ * deallocates them too. It can run in parallel (see @ref
+ * NodeVisitor_traverse_parallel) if all of its members can; each worker copy
+ * holds a copy of every member, and joining it joins the members one by one.
+ *
+ * @returns Pointer to the allocated visitor
+ */
+NodeVisitor* CompositeVisitor_new (void);
+
+/**
+ * @brief Add a visitor to the end of a composite visitor
+ *
+ * The member's callbacks are looked up when it is added, so it must be set up
+ * completely beforehand.
+ *
+ * @param composite Visitor allocated with @ref CompositeVisitor_new
+ * @param member Visitor to add (owned by the composite from now on)
+ */
+void CompositeVisitor_add (NodeVisitor* composite, NodeVisitor* member);
+
 
 /*
  * VISITORS
@@ -143,10 +297,23 @@ NodeVisitor* PrintVisitor_new (FILE* output);
  */
 NodeVisitor* GenerateASTGraph_new (FILE* output);
 
+/**
+ * @brief Create a new AST image output visitor
+ *
+ * The output is an SVG drawing of the tree, laid out directly (see
+ * treelayout.h) without any external tools. Each node is drawn as a box with
+ * the same label as in the graph output (without the attributes).
+ *
+ * @param output File stream for the SVG output
+ * @returns Pointer to visitor structure
+ */
+NodeVisitor* GenerateASTImage_new (FILE* output);
+
 /**
  * @brief Create a new visitor that sets up parent pointers as attributes
  * 
- * These parent pointers are used in other visitors.
+ * These parent pointers are used in other visitors. The visitor can run in
+ * parallel (see @ref NodeVisitor_traverse_parallel).
  * 
  * @returns Pointer to visitor structure
  */
@@ -155,10 +322,25 @@ NodeVisitor* SetParentVisitor_new(void);
 /**
  * @brief Create a new visitor that calculates node depths as attributes
  * 
- * These depths are used during debug output.
+ * These depths are used during debug output. The visitor can run in parallel
+ * (see @ref NodeVisitor_traverse_parallel).
  * 
  * @returns Pointer to visitor structure
  */
 NodeVisitor* CalcDepthVisitor_new (void);
 
+/**
+ * @brief Check the parent links and depths recorded by the parser
+ *
+ * The parser sets the @c parent and @c depth attributes as it builds the
+ * tree; this recomputes them with @ref SetParentVisitor_new and @ref
+ * CalcDepthVisitor_new (replacing the recorded values) and reports every node
+ * where the two disagree.
+ *
+ * @param tree Root of the tree to check
+ * @param report File stream for a description of each mismatch
+ * @returns Number of nodes whose parent or depth differed
+ */
+int verify_parent_and_depth (ASTNode* tree, FILE* report);
+
 #endif
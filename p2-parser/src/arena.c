@@ -0,0 +1,107 @@
+/**
+ * @file arena.c
+ * @brief Region-based memory allocation
+ */
+
+#include "arena.h"
+
+/**
+ * @brief Default usable size of an arena chunk (64 KiB)
+ */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Round a size up to the alignment of @c max_align_t
+ */
+#define ARENA_ALIGN(SIZE) \
+    (((SIZE) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+
+/**
+ * @brief Allocate a new chunk and make it the arena's current chunk
+ */
+static ArenaChunk* Arena_add_chunk (Arena* arena, size_t size)
+{
+    ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + size);
+    CHECK_MALLOC_PTR(chunk)
+    chunk->next = arena->head;
+    chunk->size = size;
+    chunk->used = 0;
+    arena->head = chunk;
+    arena->chunks++;
+    return chunk;
+}
+
+Arena* Arena_new (void)
+{
+    Arena* arena = (Arena*)calloc(1, sizeof(Arena));
+    CHECK_MALLOC_PTR(arena)
+    arena->chunk_size = ARENA_CHUNK_SIZE;
+    return arena;
+}
+
+void* Arena_alloc (Arena* arena, size_t size)
+{
+    size = ARENA_ALIGN(size == 0 ? 1 : size);
+    ArenaChunk* chunk = arena->head;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        if (size > arena->chunk_size / 4) {
+            /* large block: give it a dedicated chunk behind the current one so
+             * the rest of the current chunk is not wasted */
+            ArenaChunk* current = arena->head;
+            ArenaChunk* own = Arena_add_chunk(arena, size);
+            if (current != NULL) {
+                arena->head = current;
+                own->next = current->next;
+                current->next = own;
+            }
+            own->used = size;
+            arena->allocated += size;
+            arena->allocations++;
+            return own->data;
+        }
+        chunk = Arena_add_chunk(arena, arena->chunk_size);
+    }
+    void* block = (char*)chunk->data + chunk->used;
+    chunk->used += size;
+    arena->allocated += size;
+    arena->allocations++;
+    return block;
+}
+
+void* Arena_calloc (Arena* arena, size_t size)
+{
+    void* block = Arena_alloc(arena, size);
+    memset(block, 0, size);
+    return block;
+}
+
+char* Arena_strndup (Arena* arena, const char* text, size_t length)
+{
+    char* copy = (char*)Arena_alloc(arena, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+void Arena_defer (Arena* arena, void (*fn) (void* data), void* data)
+{
+    ArenaCleanup* cleanup = (ArenaCleanup*)Arena_alloc(arena, sizeof(ArenaCleanup));
+    cleanup->fn = fn;
+    cleanup->data = data;
+    cleanup->next = arena->cleanups;
+    arena->cleanups = cleanup;
+}
+
+void Arena_free (Arena* arena)
+{
+    for (ArenaCleanup* cleanup = arena->cleanups; cleanup != NULL; cleanup = cleanup->next) {
+        cleanup->fn(cleanup->data);
+    }
+    ArenaChunk* chunk = arena->head;
+    while (chunk != NULL) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
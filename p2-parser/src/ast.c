@@ -1,3 +1,8 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "ast.h"
 
 void dummy_print(void* data, FILE* output)
@@ -19,115 +24,516 @@ void dummy_free(void* data)
 const char* NodeType_to_string(NodeType type)
 {
     switch (type) {
-        case PROGRAM:       return "Program";
-        case VARDECL:       return "VarDecl";
-        case FUNCDECL:      return "FuncDecl";
-        case BLOCK:         return "Block";
-        case ASSIGNMENT:    return "Assignment";
-        case CONDITIONAL:   return "Conditional";
-        case WHILELOOP:     return "WhileLoop";
-        case RETURNSTMT:    return "Return";
-        case BREAKSTMT:     return "Break";
-        case CONTINUESTMT:  return "Continue";
-        case BINARYOP:      return "BinaryOp";
-        case UNARYOP:       return "UnaryOp";
-        case LOCATION:      return "Location";
-        case FUNCCALL:      return "FuncCall";
-        case LITERAL:       return "Literal";
+#define NODE_TYPE_LABEL(TYPE, name, label, CHILDREN) case TYPE: return label;
+        AST_NODE_KINDS(NODE_TYPE_LABEL)
+#undef NODE_TYPE_LABEL
     }
     return "???";
 }
 
+/**
+ * @brief Arena that AST allocations on this thread come from (if any)
+ */
+static _Thread_local Arena* current_arena = NULL;
+
+Arena* ASTNode_use_arena (Arena* arena)
+{
+    Arena* previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
+
+/**
+ * @brief Allocate a zero-filled block for AST data from the current arena (or
+ * from the heap if no arena is installed)
+ */
+static void* ast_calloc (size_t size)
+{
+    if (current_arena != NULL) {
+        return Arena_calloc(current_arena, size);
+    }
+    return calloc(1, size);
+}
+
 /*
  * use macros defined in common.h to implement lists for nodes and parameters
  */
-DEF_LIST_IMPL(Node, struct ASTNode*, ASTNode_free)
-DEF_LIST_IMPL(Parameter, struct Parameter*, free)
+static void Parameter_free (Parameter* param)
+{
+    free(param);
+}
+
+DEF_LIST_IMPL_ALLOC(Node, struct ASTNode*, ast_calloc, ASTNode_free)
+DEF_LIST_IMPL_ALLOC(Parameter, struct Parameter*, ast_calloc, Parameter_free)
 
 /*
  * this custom add-parameter method handles allocation as well
  */
 void ParameterList_add_new (ParameterList* list, const char* name, DecafType type)
 {
-    Parameter* param = (Parameter*)calloc(1, sizeof(Parameter));
+    Parameter* param = (Parameter*)ast_calloc(sizeof(Parameter));
     CHECK_MALLOC_PTR(param)
-    snprintf(param->name, MAX_ID_LEN, "%s", name);
+    param->name = intern_string(name);
     param->type = type;
     ParameterList_add(list, param);
 }
 
-ASTNode* ASTNode_new (NodeType type, int source_line)
+/*
+ * ATTRIBUTES
+ */
+
+/**
+ * @brief Names of the registered attribute keys (indexed by key)
+ */
+static const char* key_names[MAX_ATTRIBUTE_KEYS] = { "parent", "depth", "type", "dotid" };
+
+/**
+ * @brief Number of registered attribute keys
+ *
+ * Names are stored before the count is published, so lookups can scan the
+ * registered keys without locking; only registration takes @ref key_lock.
+ */
+static _Atomic AttributeKey key_count = NUM_DENSE_ATTRIBUTES;
+
+/**
+ * @brief Serializes the registration of new attribute keys
+ */
+static pthread_mutex_t key_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Search the first @c count registered keys for a name
+ *
+ * @returns Attribute key (or @ref MAX_ATTRIBUTE_KEYS if the name is not there)
+ */
+static AttributeKey find_key (const char* name, AttributeKey count)
 {
-    ASTNode* node = (ASTNode*)calloc(1, sizeof(ASTNode));
-    CHECK_MALLOC_PTR(node)
+    /* names are normally string literals, so most lookups match by address */
+    for (AttributeKey key = 0; key < count; key++) {
+        if (key_names[key] == name) {
+            return key;
+        }
+    }
+    for (AttributeKey key = 0; key < count; key++) {
+        if (strcmp(key_names[key], name) == 0) {
+            return key;
+        }
+    }
+    return MAX_ATTRIBUTE_KEYS;
+}
+
+AttributeKey AttributeKey_lookup (const char* name)
+{
+    AttributeKey key = find_key(name, atomic_load_explicit(&key_count, memory_order_acquire));
+    if (key != MAX_ATTRIBUTE_KEYS) {
+        return key;
+    }
+
+    /* another thread may have registered the name in the meantime */
+    pthread_mutex_lock(&key_lock);
+    AttributeKey count = atomic_load_explicit(&key_count, memory_order_relaxed);
+    key = find_key(name, count);
+    if (key == MAX_ATTRIBUTE_KEYS && count < MAX_ATTRIBUTE_KEYS) {
+        key_names[count] = name;
+        atomic_store_explicit(&key_count, count + 1, memory_order_release);
+        key = count;
+    }
+    pthread_mutex_unlock(&key_lock);
+    if (key == MAX_ATTRIBUTE_KEYS) {
+        Error_throw("ERROR: Too many attribute keys (registering '%s')\n", name);
+    }
+    return key;
+}
+
+const char* AttributeKey_name (AttributeKey key)
+{
+    return key_names[key];
+}
+
+/**
+ * @brief Attributes of one node that are not stored in a dense column
+ */
+typedef struct AttributeSet
+{
+    uint32_t count;         /**< @brief Number of attributes */
+    uint32_t capacity;      /**< @brief Number of entries allocated */
+    Attribute entries[];    /**< @brief Attributes (in the order they were first set) */
+} AttributeSet;
+
+/**
+ * @brief Initial number of entries in a node's attribute set
+ */
+#define ATTRIBUTE_SET_INITIAL 2
+
+/**
+ * @brief Attribute storage for the nodes of one arena (or for all
+ * heap-allocated nodes), indexed by node ID
+ */
+typedef struct AttributeTable
+{
+    Arena* arena;           /**< @brief Arena that attribute sets come from (or @c NULL for the heap) */
+    uint32_t count;         /**< @brief Number of node IDs handed out */
+    uint32_t capacity;      /**< @brief Number of rows allocated */
+    uint8_t* present;       /**< @brief Bit @c k of row @c i is set if node @c i has dense attribute @c k */
+    void** dense[NUM_DENSE_ATTRIBUTES];     /**< @brief Dense value columns (allocated on first use) */
+    _Atomic(AttributeValueDOTPrinter) printers[NUM_DENSE_ATTRIBUTES];   /**< @brief DOT printer of each dense key */
+    AttributeSet** sets;    /**< @brief Attribute set of each node (or @c NULL if it has none) */
+    uint32_t* free_ids;     /**< @brief IDs of deallocated heap nodes, for reuse */
+    uint32_t free_count;    /**< @brief Number of IDs in @c free_ids */
+    uint32_t free_capacity; /**< @brief Allocated length of @c free_ids */
+    bool shared;            /**< @brief True while several threads may use the table (see @ref
+                                        ASTNode_share_attributes) */
+    bool borrowed;          /**< @brief True if the arena belongs to the structure that its nodes are
+                                        views of (see @ref ASTNode_init_view) */
+    pthread_mutex_t lock;   /**< @brief Serializes arena allocations while the table is shared
+                                        (and every use of the heap table) */
+} AttributeTable;
+
+/**
+ * @brief Attribute storage for nodes allocated on the heap (by any thread)
+ */
+static AttributeTable heap_attributes;
+
+static pthread_once_t heap_attributes_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Set up the lock of the heap table (once per process)
+ *
+ * The lock is recursive because attribute destructors and the callback of
+ * @ref ASTNode_for_each_attribute run while it is held, and may use the
+ * attributes of heap-allocated nodes themselves.
+ */
+static void init_heap_attributes (void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&heap_attributes.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/**
+ * @brief Check whether an attribute destructor actually releases anything
+ */
+static bool has_destructor (Destructor dtor)
+{
+    return dtor != NULL && dtor != dummy_free;
+}
+
+/**
+ * @brief Call the destructors of every attribute in a set
+ */
+static void release_set (AttributeSet* set)
+{
+    for (uint32_t i = 0; i < set->count; i++) {
+        if (set->entries[i].dtor != NULL) {
+            set->entries[i].dtor(set->entries[i].value);
+        }
+    }
+}
+
+/**
+ * @brief Release an arena's attribute table (registered with @ref Arena_defer)
+ */
+static void release_table (void* data)
+{
+    AttributeTable* table = (AttributeTable*)data;
+    if (table->sets != NULL) {
+        for (uint32_t i = 0; i < table->capacity; i++) {
+            if (table->sets[i] != NULL) {
+                release_set(table->sets[i]);
+            }
+        }
+    }
+    for (int k = 0; k < NUM_DENSE_ATTRIBUTES; k++) {
+        free(table->dense[k]);
+    }
+    free(table->present);
+    free(table->sets);
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
+
+/**
+ * @brief Look up the attribute table of the nodes in an arena (or on the
+ * heap), optionally creating it
+ *
+ * The heap table is shared by every thread, so it is returned locked; release
+ * it with @ref unlock_table when done.
+ */
+static AttributeTable* table_of (Arena* arena, bool create)
+{
+    if (arena == NULL) {
+        pthread_once(&heap_attributes_once, init_heap_attributes);
+        pthread_mutex_lock(&heap_attributes.lock);
+        return &heap_attributes;
+    }
+    if (arena->data == NULL && create) {
+        AttributeTable* table = (AttributeTable*)calloc(1, sizeof(AttributeTable));
+        CHECK_MALLOC_PTR(table)
+        table->arena = arena;
+        pthread_mutex_init(&table->lock, NULL);
+        arena->data = table;
+        Arena_defer(arena, release_table, table);
+    }
+    return (AttributeTable*)arena->data;
+}
+
+/**
+ * @brief Release a table returned by @ref table_of
+ */
+static void unlock_table (AttributeTable* table)
+{
+    if (table == &heap_attributes) {
+        pthread_mutex_unlock(&heap_attributes.lock);
+    }
+}
+
+/**
+ * @brief Grow a zero-filled column to a new number of rows
+ */
+static void* grow_column (void* column, size_t old_rows, size_t new_rows, size_t size)
+{
+    column = realloc(column, new_rows * size);
+    CHECK_MALLOC_PTR(column)
+    memset((char*)column + old_rows * size, 0, (new_rows - old_rows) * size);
+    return column;
+}
+
+/**
+ * @brief Make sure a table has rows for every node ID handed out so far
+ */
+static void reserve_rows (AttributeTable* table)
+{
+    if (table->count <= table->capacity) {
+        return;
+    }
+    uint32_t capacity = (table->capacity == 0 ? 256 : table->capacity);
+    while (capacity < table->count) {
+        capacity *= 2;
+    }
+    table->present = (uint8_t*)grow_column(table->present, table->capacity, capacity, sizeof(uint8_t));
+    for (int k = 0; k < NUM_DENSE_ATTRIBUTES; k++) {
+        if (table->dense[k] != NULL) {
+            table->dense[k] = (void**)grow_column(table->dense[k], table->capacity, capacity, sizeof(void*));
+        }
+    }
+    if (table->sets != NULL) {
+        table->sets = (AttributeSet**)grow_column(table->sets, table->capacity, capacity, sizeof(AttributeSet*));
+    }
+    table->capacity = capacity;
+}
+
+/**
+ * @brief Look up an entry in a node's attribute set (or @c NULL if missing)
+ */
+static Attribute* find_entry (AttributeTable* table, uint32_t id, AttributeKey key)
+{
+    if (table->sets == NULL || id >= table->capacity || table->sets[id] == NULL) {
+        return NULL;
+    }
+    AttributeSet* set = table->sets[id];
+    for (uint32_t i = 0; i < set->count; i++) {
+        if (set->entries[i].key == key) {
+            return &set->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Add an entry to a node's attribute set (growing it if necessary)
+ */
+static Attribute* add_entry (AttributeTable* table, uint32_t id)
+{
+    if (table->sets == NULL) {
+        table->sets = (AttributeSet**)calloc(table->capacity, sizeof(AttributeSet*));
+        CHECK_MALLOC_PTR(table->sets)
+    }
+    AttributeSet* set = table->sets[id];
+    if (set == NULL || set->count == set->capacity) {
+        uint32_t capacity = (set == NULL ? ATTRIBUTE_SET_INITIAL : set->capacity * 2);
+        size_t size = sizeof(AttributeSet) + capacity * sizeof(Attribute);
+        AttributeSet* grown = NULL;
+        if (table->arena != NULL) {
+            if (table->shared) {
+                pthread_mutex_lock(&table->lock);
+            }
+            grown = (AttributeSet*)Arena_alloc(table->arena, size);
+            if (table->shared) {
+                pthread_mutex_unlock(&table->lock);
+            }
+            if (set != NULL) {
+                memcpy(grown, set, sizeof(AttributeSet) + set->count * sizeof(Attribute));
+            }
+        } else {
+            grown = (AttributeSet*)realloc(set, size);
+            CHECK_MALLOC_PTR(grown)
+        }
+        grown->count = (set == NULL ? 0 : grown->count);
+        grown->capacity = capacity;
+        table->sets[id] = set = grown;
+    }
+    return &set->entries[set->count++];
+}
+
+/**
+ * @brief Remove a dense attribute that has been replaced by an entry in the
+ * node's attribute set (or vice versa)
+ */
+static void remove_entry (AttributeTable* table, uint32_t id, AttributeKey key)
+{
+    Attribute* entry = find_entry(table, id, key);
+    if (entry != NULL) {
+        AttributeSet* set = table->sets[id];
+        if (entry->dtor != NULL) {
+            entry->dtor(entry->value);
+        }
+        *entry = set->entries[--set->count];
+    }
+}
+
+/**
+ * @brief Release the attributes of a heap-allocated node and recycle its ID
+ */
+static void release_node_attributes (ASTNode* node)
+{
+    AttributeTable* table = table_of(NULL, false);
+    if (node->id < table->capacity) {
+        table->present[node->id] = 0;
+        if (table->sets != NULL && table->sets[node->id] != NULL) {
+            release_set(table->sets[node->id]);
+            free(table->sets[node->id]);
+            table->sets[node->id] = NULL;
+        }
+    }
+    if (table->free_count == table->free_capacity) {
+        table->free_capacity = (table->free_capacity == 0 ? 256 : table->free_capacity * 2);
+        table->free_ids = (uint32_t*)realloc(table->free_ids, table->free_capacity * sizeof(uint32_t));
+        CHECK_MALLOC_PTR(table->free_ids)
+    }
+    table->free_ids[table->free_count++] = node->id;
+    unlock_table(table);
+}
+
+void ASTNode_init (ASTNode* node, NodeType type, int source_line)
+{
+    AttributeTable* table = table_of(current_arena, true);
     node->type = type;
     node->source_line = source_line;
-    node->attributes = NULL;
+    node->id = (table->free_count > 0 ? table->free_ids[--table->free_count] : table->count++);
+    unlock_table(table);
     node->next = NULL;
+    node->arena = current_arena;
+}
+
+void ASTNode_init_view (ASTNode* node, NodeType type, int source_line, Arena* arena, uint32_t id)
+{
+    AttributeTable* table = table_of(arena, true);
+    table->borrowed = true;
+    if (id >= table->count) {
+        table->count = id + 1;
+    }
+    node->type = type;
+    node->source_line = source_line;
+    node->id = id;
+    node->next = NULL;
+    node->arena = arena;
+}
+
+ASTNode* ASTNode_new (NodeType type, int source_line)
+{
+    ASTNode* node = (ASTNode*)ast_calloc(sizeof(ASTNode));
+    CHECK_MALLOC_PTR(node)
+    ASTNode_init(node, type, source_line);
     return node;
 }
 
 void ASTNode_set_attribute (ASTNode* node, const char* key, void* value, Destructor dtor)
 {
-    ASTNode_set_printable_attribute(node, key, value, dummy_print, dtor);
+    ASTNode_set_keyed_attribute(node, AttributeKey_lookup(key), value, dummy_print, dtor);
 }
 
 void ASTNode_set_int_attribute (ASTNode* node, const char* key, int value)
 {
-    ASTNode_set_printable_attribute(node, key, (void*)(long)value, int_attr_print, dummy_free);
+    ASTNode_set_keyed_attribute(node, AttributeKey_lookup(key), (void*)(long)value, int_attr_print, dummy_free);
 }
 
 void ASTNode_set_printable_attribute (ASTNode* node, const char* key, void* value,
                                       AttributeValueDOTPrinter dot_printer, Destructor dtor)
+{
+    ASTNode_set_keyed_attribute(node, AttributeKey_lookup(key), value, dot_printer, dtor);
+}
+
+void ASTNode_set_keyed_attribute (ASTNode* node, AttributeKey key, void* value,
+                                  AttributeValueDOTPrinter dot_printer, Destructor dtor)
 {
     if (node == NULL) {
-        Error_throw_printf("ERROR: Tried to set attribute '%s' without a node pointer\n", key);
+        Error_throw("ERROR: Tried to set attribute '%s' without a node pointer\n",
+                AttributeKey_name(key));
+    }
+    AttributeTable* table = table_of(node->arena, true);
+    reserve_rows(table);
+    uint32_t id = node->id;
+
+    /* integral values and plain pointers of the common keys go in dense columns */
+    if (key < NUM_DENSE_ATTRIBUTES && !has_destructor(dtor)) {
+        if (table->dense[key] == NULL) {
+            table->dense[key] = (void**)calloc(table->capacity, sizeof(void*));
+            CHECK_MALLOC_PTR(table->dense[key])
+        }
+        remove_entry(table, id, key);
+        table->dense[key][id] = value;
+        if (atomic_load_explicit(&table->printers[key], memory_order_relaxed) != dot_printer) {
+            atomic_store_explicit(&table->printers[key], dot_printer, memory_order_relaxed);
+        }
+        table->present[id] |= (uint8_t)(1u << key);
+        unlock_table(table);
+        return;
+    }
+    if (key < NUM_DENSE_ATTRIBUTES) {
+        table->present[id] &= (uint8_t)~(1u << key);
     }
 
-    /* allocate new attribute */
-    Attribute* attr = (Attribute*)calloc(1, sizeof(Attribute));
-    CHECK_MALLOC_PTR(attr)
-    attr->key = key;
+    /* search existing keys */
+    Attribute* attr = find_entry(table, id, key);
+    if (attr != NULL) {
+        /* key present; replace with new value */
+        if (attr->dtor != NULL) {
+            attr->dtor(attr->value);
+        }
+    } else {
+        /* key not present; add a new entry */
+        attr = add_entry(table, id);
+        attr->key = key;
+    }
     attr->value = value;
     attr->dot_printer = dot_printer;
     attr->dtor = dtor;
-    attr->next = NULL;
-
-    if (node->attributes == NULL) {
-        /* first attribute */
-        node->attributes = attr;
-    } else {
-
-        /* search existing keys */
-        for (Attribute* a = node->attributes; a != NULL; a = a->next) {
-            if (strncmp(key, a->key, MAX_ID_LEN) == 0) {
-
-                /* key present; replace with new value */
-                a->dtor(a->value);
-                a->value = value;
-                a->dtor = dtor;
-                free(attr);
-                return;
-            }
-        }
+    unlock_table(table);
+}
 
-        /* key not present; insert at beginning */
-        attr->next = node->attributes;
-        node->attributes = attr;
+bool ASTNode_has_attribute (ASTNode* node, const char* key)
+{
+    if (node == NULL) {
+        Error_throw("ERROR: Tried to get attribute '%s' without a node pointer\n", key);
     }
+    return ASTNode_has_keyed_attribute(node, AttributeKey_lookup(key));
 }
 
-bool ASTNode_has_attribute (ASTNode* node, const char* key)
+bool ASTNode_has_keyed_attribute (ASTNode* node, AttributeKey key)
 {
     if (node == NULL) {
-        Error_throw_printf("ERROR: Tried to get attribute '%s' without a node pointer\n", key);
+        Error_throw("ERROR: Tried to get attribute '%s' without a node pointer\n",
+                AttributeKey_name(key));
     }
-    for (Attribute* a = node->attributes; a != NULL; a = a->next) {
-        if (strncmp(key, a->key, MAX_ID_LEN) == 0) {
-            return true;
-        }
+    AttributeTable* table = table_of(node->arena, false);
+    bool found = false;
+    if (table != NULL && node->id < table->capacity) {
+        found = ((key < NUM_DENSE_ATTRIBUTES && (table->present[node->id] & (1u << key))) ||
+                 find_entry(table, node->id, key) != NULL);
     }
-    return false;
+    unlock_table(table);
+    return found;
 }
 
 int ASTNode_get_int_attribute (ASTNode* node, const char* key)
@@ -138,85 +544,230 @@ int ASTNode_get_int_attribute (ASTNode* node, const char* key)
 void* ASTNode_get_attribute (ASTNode* node, const char* key)
 {
     if (node == NULL) {
-        Error_throw_printf("ERROR: Tried to get attribute '%s' without a node pointer\n", key);
+        Error_throw("ERROR: Tried to get attribute '%s' without a node pointer\n", key);
+    }
+    return ASTNode_get_keyed_attribute(node, AttributeKey_lookup(key));
+}
+
+void* ASTNode_get_keyed_attribute (ASTNode* node, AttributeKey key)
+{
+    if (node == NULL) {
+        Error_throw("ERROR: Tried to get attribute '%s' without a node pointer\n",
+                AttributeKey_name(key));
     }
-    for (Attribute* a = node->attributes; a != NULL; a = a->next) {
-        if (strncmp(key, a->key, MAX_ID_LEN) == 0) {
-            return a->value;
+    AttributeTable* table = table_of(node->arena, false);
+    if (table != NULL && node->id < table->capacity) {
+        void* value = NULL;
+        bool found = false;
+        if (key < NUM_DENSE_ATTRIBUTES && (table->present[node->id] & (1u << key))) {
+            value = table->dense[key][node->id];
+            found = true;
+        } else {
+            Attribute* attr = find_entry(table, node->id, key);
+            if (attr != NULL) {
+                value = attr->value;
+                found = true;
+            }
+        }
+        if (found) {
+            unlock_table(table);
+            return value;
         }
     }
-    printf("ERROR: No '%s' attribute\n", key);
+    unlock_table(table);
+    printf("ERROR: No '%s' attribute\n", AttributeKey_name(key));
     return NULL;
 }
 
-void ASTNode_free (ASTNode* node)
+void ASTNode_for_each_attribute (ASTNode* node, void (*fn) (Attribute* attr, void* data), void* data)
 {
-    /* clean up attributes */
-    Attribute* next = node->attributes;
-    while (next != NULL) {
-        Attribute* cur = next;
-        next = cur->next;
-        if (cur->dtor != NULL) {
-            cur->dtor(cur->value);
+    AttributeTable* table = table_of(node->arena, false);
+    if (table == NULL || node->id >= table->capacity) {
+        unlock_table(table);
+        return;
+    }
+    for (AttributeKey key = 0; key < NUM_DENSE_ATTRIBUTES; key++) {
+        if (table->present[node->id] & (1u << key)) {
+            Attribute attr = { key, table->dense[key][node->id],
+                atomic_load_explicit(&table->printers[key], memory_order_relaxed), NULL };
+            fn(&attr, data);
         }
-        free(cur);
     }
+    if (table->sets != NULL && table->sets[node->id] != NULL) {
+        AttributeSet* set = table->sets[node->id];
+        for (uint32_t i = 0; i < set->count; i++) {
+            fn(&set->entries[i], data);
+        }
+    }
+    unlock_table(table);
+}
 
-    /* clean up node-specific data */
-    switch (node->type) {
-        case PROGRAM:
-            NodeList_free(node->program.variables);
-            NodeList_free(node->program.functions);
-            break;
-        case FUNCDECL:
-            ParameterList_free(node->funcdecl.parameters);
-            ASTNode_free(node->funcdecl.body);
-            break;
-        case BLOCK:
-            NodeList_free(node->block.variables);
-            NodeList_free(node->block.statements);
-            break;
-        case ASSIGNMENT:
-            ASTNode_free(node->assignment.location);
-            ASTNode_free(node->assignment.value);
-            break;
-        case CONDITIONAL:
-            ASTNode_free(node->conditional.condition);
-            ASTNode_free(node->conditional.if_block);
-            if (node->conditional.else_block != NULL) {
-                ASTNode_free(node->conditional.else_block);
-            }
-            break;
-        case WHILELOOP:
-            ASTNode_free(node->whileloop.condition);
-            ASTNode_free(node->whileloop.body);
-            break;
-        case RETURNSTMT:
-            if (node->funcreturn.value != NULL) {
-                ASTNode_free(node->funcreturn.value);
-            }
-            break;
-        case BINARYOP:
-            ASTNode_free(node->binaryop.left);
-            ASTNode_free(node->binaryop.right);
-            break;
-        case UNARYOP:
-            ASTNode_free(node->unaryop.child);
-            break;
-        case LOCATION:
-            if (node->location.index != NULL) {
-                ASTNode_free(node->location.index);
+void ASTNode_share_attributes (ASTNode* root, bool shared)
+{
+    if (root->arena == NULL) {
+        Error_throw("ERROR: Only arena-allocated trees can share attributes between threads\n");
+    }
+    AttributeTable* table = table_of(root->arena, true);
+    if (shared) {
+        /* allocate up front everything that is normally allocated on first use */
+        reserve_rows(table);
+        for (int k = 0; k < NUM_DENSE_ATTRIBUTES; k++) {
+            if (table->dense[k] == NULL) {
+                table->dense[k] = (void**)calloc(table->capacity, sizeof(void*));
+                CHECK_MALLOC_PTR(table->dense[k])
             }
-            break;
-        case FUNCCALL:
-            NodeList_free(node->funccall.arguments);
-            break;
+        }
+        if (table->sets == NULL) {
+            table->sets = (AttributeSet**)calloc(table->capacity, sizeof(AttributeSet*));
+            CHECK_MALLOC_PTR(table->sets)
+        }
+    }
+    table->shared = shared;
+}
+
+/**
+ * @brief Set the parent of a child node (if there is one)
+ */
+static void set_parent (ASTNode* child, ASTNode* parent)
+{
+    if (child != NULL) {
+        ASTNode_set_keyed_attribute(child, ATTR_PARENT, parent, dummy_print, NULL);
+    }
+}
+
+/**
+ * @brief Set the parent of every node in a list
+ */
+static void set_list_parent (NodeList* list, ASTNode* parent)
+{
+    FOR_EACH(ASTNode*, child, list) {
+        set_parent(child, parent);
+    }
+}
+
+void ASTNode_set_child_parents (ASTNode* node)
+{
+#define AST_CHILD(FIELD)            set_parent(node->FIELD, node);
+#define AST_OPTIONAL_CHILD(FIELD)   set_parent(node->FIELD, node);
+#define AST_CHILD_LIST(FIELD)       set_list_parent(node->FIELD, node);
+#define AST_INVISIT
+#define SET_CHILD_PARENTS(TYPE, name, label, CHILDREN) case TYPE: CHILDREN break;
+    switch (node->type) {
+        AST_NODE_KINDS(SET_CHILD_PARENTS)
         default:
             break;
     }
+#undef SET_CHILD_PARENTS
+#undef AST_INVISIT
+#undef AST_CHILD_LIST
+#undef AST_OPTIONAL_CHILD
+#undef AST_CHILD
+}
+
+void ASTNode_set_tree_depths (ASTNode* root)
+{
+    if (root->arena == NULL) {
+        Error_throw("ERROR: Tree depths can only be derived for arena-backed trees\n");
+    }
+    ASTNode_set_keyed_attribute(root, ATTR_DEPTH, (void*)0L, int_attr_print, NULL);
+    AttributeTable* table = table_of(root->arena, true);
+    const uint8_t has_parent = 1u << ATTR_PARENT;
+    const uint8_t has_depth = 1u << ATTR_DEPTH;
+    if (table->dense[ATTR_PARENT] == NULL) {
+        return;
+    }
+
+    /* parents have higher IDs than their children, so they are done first */
+    for (uint32_t id = table->count; id-- > 0; ) {
+        if ((table->present[id] & (has_parent | has_depth)) != has_parent) {
+            continue;
+        }
+        ASTNode* parent = (ASTNode*)table->dense[ATTR_PARENT][id];
+        if (table->present[parent->id] & has_depth) {
+            table->dense[ATTR_DEPTH][id] = (void*)((long)table->dense[ATTR_DEPTH][parent->id] + 1);
+            table->present[id] |= has_depth;
+        }
+    }
+}
+
+/**
+ * @brief Add a node to the chain of nodes waiting to be freed
+ *
+ * The chain is threaded through the @c next fields of the nodes themselves, so
+ * freeing a tree needs no extra memory however deep it is.
+ */
+static void defer_free (ASTNode** pending, ASTNode* node)
+{
+    if (node != NULL) {
+        node->next = *pending;
+        *pending = node;
+    }
+}
+
+/**
+ * @brief Add every node in a list to the chain of nodes waiting to be freed
+ * and deallocate the list structure
+ */
+static void defer_free_list (ASTNode** pending, NodeList* list)
+{
+    if (list->head != NULL) {
+        list->tail->next = *pending;
+        *pending = list->head;
+    }
+    free(list);
+}
+
+void ASTNode_free (ASTNode* node)
+{
+    /* arena-backed trees are released all at once by their root (unless the
+     * arena belongs to the structure that the nodes are views of) */
+    if (node->arena != NULL) {
+        AttributeTable* table = table_of(node->arena, false);
+        if (node->type == PROGRAM && (table == NULL || !table->borrowed)) {
+            Arena_free(node->arena);
+        }
+        return;
+    }
+
+    ASTNode* pending = NULL;
+    defer_free(&pending, node);
+    while (pending != NULL) {
+        node = pending;
+        pending = node->next;
+        if (node->arena != NULL) {
+            continue;
+        }
 
-    /* clean up node itself */
-    free(node);
+        /* clean up attributes */
+        release_node_attributes(node);
+
+        /* queue up children */
+#define AST_CHILD(FIELD)            defer_free(&pending, node->FIELD);
+#define AST_OPTIONAL_CHILD(FIELD)   defer_free(&pending, node->FIELD);
+#define AST_CHILD_LIST(FIELD)       defer_free_list(&pending, node->FIELD);
+#define AST_INVISIT
+#define DEFER_CHILDREN(TYPE, name, label, CHILDREN) case TYPE: CHILDREN break;
+        switch (node->type) {
+            AST_NODE_KINDS(DEFER_CHILDREN)
+            default:
+                break;
+        }
+#undef DEFER_CHILDREN
+#undef AST_INVISIT
+#undef AST_CHILD_LIST
+#undef AST_OPTIONAL_CHILD
+#undef AST_CHILD
+
+        /* clean up other node-specific data */
+        if (node->type == FUNCDECL) {
+            ParameterList_free(node->funcdecl.parameters);
+        } else if (node->type == LITERAL && node->literal.type == STR) {
+            free(node->literal.string);
+        }
+
+        /* clean up node itself */
+        free(node);
+    }
 }
 
 ASTNode* ProgramNode_new (NodeList* vars, NodeList* funcs)
@@ -230,7 +781,7 @@ ASTNode* ProgramNode_new (NodeList* vars, NodeList* funcs)
 ASTNode* VarDeclNode_new (const char* name, DecafType type, bool is_array, int array_length, int source_line)
 {
     ASTNode* node = ASTNode_new(VARDECL, source_line);
-    snprintf(node->vardecl.name, MAX_ID_LEN, "%s", name);
+    node->vardecl.name = intern_string(name);
     node->vardecl.type = type;
     node->vardecl.is_array = is_array;
     node->vardecl.array_length = array_length;
@@ -240,7 +791,7 @@ ASTNode* VarDeclNode_new (const char* name, DecafType type, bool is_array, int a
 ASTNode* FuncDeclNode_new (const char* name, DecafType return_type, ParameterList* parameters, ASTNode* body, int source_line)
 {
     ASTNode* node = ASTNode_new(FUNCDECL, source_line);
-    snprintf(node->funcdecl.name, MAX_ID_LEN, "%s", name);
+    node->funcdecl.name = intern_string(name);
     node->funcdecl.return_type = return_type;
     node->funcdecl.parameters = parameters;
     node->funcdecl.body = body;
@@ -346,7 +897,7 @@ ASTNode* UnaryOpNode_new (UnaryOpType operator, struct ASTNode* child, int sourc
 ASTNode* LocationNode_new (const char* name, struct ASTNode* index, int source_line)
 {
     ASTNode* node = ASTNode_new(LOCATION, source_line);
-    snprintf(node->location.name, MAX_ID_LEN, "%s", name);
+    node->location.name = intern_string(name);
     node->location.index = index;
     return node;
 }
@@ -354,7 +905,7 @@ ASTNode* LocationNode_new (const char* name, struct ASTNode* index, int source_l
 ASTNode* FuncCallNode_new (const char* name, NodeList* args, int source_line)
 {
     ASTNode* node = ASTNode_new(FUNCCALL, source_line);
-    snprintf(node->funccall.name, MAX_ID_LEN, "%s", name);
+    node->funccall.name = intern_string(name);
     node->funccall.arguments = args;
     return node;
 }
@@ -379,6 +930,10 @@ ASTNode* LiteralNode_new_string (const char* value, int source_line)
 {
     ASTNode* node = ASTNode_new(LITERAL, source_line);
     node->literal.type = STR;
-    snprintf(node->literal.string, MAX_LINE_LEN, "%s", value);
+    if (node->arena != NULL) {
+        node->literal.string = Arena_strndup(node->arena, value, strlen(value));
+    } else {
+        node->literal.string = copy_string(value);
+    }
     return node;
 }
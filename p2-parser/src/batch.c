@@ -0,0 +1,206 @@
+/**
+ * @file batch.c
+ * @brief Batch compilation of many source files
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "source.h"
+#include "visitor.h"
+
+/**
+ * @brief Maximum depth of response files that name other response files
+ * (which also stops a response file that names itself)
+ */
+#define BATCH_MAX_NESTING 16
+
+Batch* Batch_new (void)
+{
+    Batch* batch = (Batch*)calloc(1, sizeof(Batch));
+    CHECK_MALLOC_PTR(batch)
+    return batch;
+}
+
+/**
+ * @brief Add a source file to a batch
+ */
+static void add_file (Batch* batch, const char* filename, size_t length)
+{
+    if (batch->count == batch->capacity) {
+        batch->capacity = (batch->capacity == 0 ? 64 : batch->capacity * 2);
+        batch->files = (BatchFile*)realloc(batch->files, batch->capacity * sizeof(BatchFile));
+        CHECK_MALLOC_PTR(batch->files)
+    }
+    BatchFile* file = &batch->files[batch->count];
+    file->filename = (char*)malloc(length + 1);
+    CHECK_MALLOC_PTR(file->filename)
+    memcpy(file->filename, filename, length);
+    file->filename[length] = '\0';
+    file->size = 0;
+    file->position = batch->count++;
+    file->succeeded = false;
+}
+
+/**
+ * @brief Add an argument (see @ref Batch_add) that is part of a response file
+ * nested @p depth levels deep
+ */
+static bool add_argument (Batch* batch, const char* argument, size_t length, int depth)
+{
+    if (length == 0 || argument[0] != '@') {
+        add_file(batch, argument, length);
+        return true;
+    }
+
+    char* filename = (char*)malloc(length);
+    CHECK_MALLOC_PTR(filename)
+    memcpy(filename, argument + 1, length - 1);
+    filename[length - 1] = '\0';
+    if (depth >= BATCH_MAX_NESTING) {
+        fprintf(stderr, "Response files nested too deeply: %s\n", filename);
+        free(filename);
+        return false;
+    }
+    SourceFile* response = SourceFile_open(filename);
+    if (response == NULL) {
+        fprintf(stderr, "Could not read response file: %s\n", filename);
+        free(filename);
+        return false;
+    }
+    free(filename);
+
+    /* arguments are separated by whitespace */
+    bool added = true;
+    const char* next = response->text;
+    while (added) {
+        while (isspace((unsigned char)*next)) {
+            next++;
+        }
+        if (*next == '\0') {
+            break;
+        }
+        const char* start = next;
+        while (*next != '\0' && !isspace((unsigned char)*next)) {
+            next++;
+        }
+        added = add_argument(batch, start, (size_t)(next - start), depth + 1);
+    }
+    SourceFile_free(response);
+    return added;
+}
+
+bool Batch_add (Batch* batch, const char* argument)
+{
+    return add_argument(batch, argument, strlen(argument), 0);
+}
+
+/**
+ * @brief Order files largest first, and otherwise in the order they were added
+ */
+static int compare_files (const void* a, const void* b)
+{
+    const BatchFile* left = (const BatchFile*)a;
+    const BatchFile* right = (const BatchFile*)b;
+    if (left->size != right->size) {
+        return (left->size > right->size ? -1 : 1);
+    }
+    return (left->position > right->position) - (left->position < right->position);
+}
+
+/**
+ * @brief Files of a batch being compiled, shared by the worker threads
+ */
+typedef struct BatchWork
+{
+    Batch* batch;           /**< @brief Batch being compiled */
+    BatchJob job;           /**< @brief Function that compiles one file */
+    void* data;             /**< @brief Data for @c job */
+    atomic_size_t next;     /**< @brief Index of the next file to hand out */
+} BatchWork;
+
+/**
+ * @brief Compile files until there are none left
+ */
+static void run_batch_work (BatchWork* work)
+{
+    while (true) {
+        size_t i = atomic_fetch_add_explicit(&work->next, 1, memory_order_relaxed);
+        if (i >= work->batch->count) {
+            break;
+        }
+        BatchFile* file = &work->batch->files[i];
+        file->succeeded = work->job(file->filename, work->data);
+    }
+}
+
+/**
+ * @brief Worker thread of a batch
+ */
+static void* batch_worker (void* arg)
+{
+    run_batch_work((BatchWork*)arg);
+
+    /* the thread is about to exit, so its traversal stack is no longer needed */
+    NodeVisitor_release_stack();
+    return NULL;
+}
+
+BatchStats Batch_run (Batch* batch, int workers, BatchJob job, void* data)
+{
+    BatchStats stats = { .files = batch->count };
+    double start = monotonic_seconds();
+
+    /* largest first, so that the last files to finish are short ones */
+    for (size_t i = 0; i < batch->count; i++) {
+        struct stat info;
+        BatchFile* file = &batch->files[i];
+        if (strcmp(file->filename, "-") != 0 && stat(file->filename, &info) == 0 && S_ISREG(info.st_mode)) {
+            file->size = (size_t)info.st_size;
+            stats.bytes += file->size;
+        }
+    }
+    qsort(batch->files, batch->count, sizeof(BatchFile), compare_files);
+
+    if (workers <= 0) {
+        workers = default_thread_count();
+    }
+    if ((size_t)workers > batch->count) {
+        workers = (batch->count > 0 ? (int)batch->count : 1);
+    }
+    BatchWork work = { .batch = batch, .job = job, .data = data };
+    atomic_init(&work.next, 0);
+    pthread_t* threads = (pthread_t*)calloc(workers, sizeof(pthread_t));
+    CHECK_MALLOC_PTR(threads)
+
+    /* the calling thread works too; if a thread cannot be started, the others take up the slack */
+    int started = 0;
+    while (started < workers - 1 && pthread_create(&threads[started], NULL, batch_worker, &work) == 0) {
+        started++;
+    }
+    run_batch_work(&work);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    for (size_t i = 0; i < batch->count; i++) {
+        stats.failed += !batch->files[i].succeeded;
+    }
+    stats.seconds = monotonic_seconds() - start;
+    return stats;
+}
+
+void Batch_free (Batch* batch)
+{
+    for (size_t i = 0; i < batch->count; i++) {
+        free(batch->files[i].filename);
+    }
+    free(batch->files);
+    free(batch);
+}
@@ -1,3 +1,8 @@
+#define _DEFAULT_SOURCE
+
+#include <time.h>
+#include <unistd.h>
+
 #include "common.h"
 
 const char* DecafType_to_string(DecafType type)
@@ -12,31 +17,101 @@ const char* DecafType_to_string(DecafType type)
     return "invalid";
 }
 
+char* copy_string(const char* string)
+{
+    size_t length = strlen(string);
+    char* copy = (char*)malloc(length + 1);
+    CHECK_MALLOC_PTR(copy)
+    memcpy(copy, string, length + 1);
+    return copy;
+}
+
+int default_thread_count (void)
+{
+    const char* setting = getenv("DECAF_THREADS");
+    if (setting != NULL && atoi(setting) > 0) {
+        return atoi(setting);
+    }
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return (online > 0 ? (int)online : 1);
+}
+
+double monotonic_seconds (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
 void print_escaped_string(const char* string, FILE* output)
 {
-    for (int i = 0; i < strlen(string); i++) {
+    while (true) {
+        /* copy everything up to the next special character in one go */
+        size_t run = strcspn(string, "\n\t\"\\");
+        fwrite(string, 1, run, output);
+        string += run;
+
         /* escape special characters */
-        switch (string[i]) {
-            case '\n':  fprintf(output, "\\n");  break;
-            case '\t':  fprintf(output, "\\t");  break;
-            case '\"':  fprintf(output, "\\\""); break;
-            case '\\':  fprintf(output, "\\\\"); break;
-            default:    fprintf(output, "%c", string[i]); break;
+        switch (*string) {
+            case '\n':  fputs("\\n", output);  break;
+            case '\t':  fputs("\\t", output);  break;
+            case '\"':  fputs("\\\"", output); break;
+            case '\\':  fputs("\\\\", output); break;
+            default:    return;
         }
+        string++;
     }
 }
 
 void print_doubly_escaped_string(const char* string, FILE* output)
 {
-    for (int i = 0; i < strlen(string); i++) {
+    while (true) {
+        /* copy everything up to the next special character in one go */
+        size_t run = strcspn(string, "\n\t\"\\");
+        fwrite(string, 1, run, output);
+        string += run;
+
         /* escape special characters */
-        switch (string[i]) {
-            case '\n':  fprintf(output, "\\\\n");  break;
-            case '\t':  fprintf(output, "\\\\t");  break;
-            case '\"':  fprintf(output, "\\\\\\\""); break;
-            case '\\':  fprintf(output, "\\\\\\\\"); break;
-            default:    fprintf(output, "%c", string[i]); break;
+        switch (*string) {
+            case '\n':  fputs("\\\\n", output);  break;
+            case '\t':  fputs("\\\\t", output);  break;
+            case '\"':  fputs("\\\\\\\"", output); break;
+            case '\\':  fputs("\\\\\\\\", output); break;
+            default:    return;
         }
+        string++;
     }
 }
 
+
+/**
+ * @brief Innermost exception handler installed on this thread
+ */
+static _Thread_local ErrorHandler* current_handler = NULL;
+
+void ErrorHandler_push (ErrorHandler* handler)
+{
+    handler->message[0] = '\0';
+    handler->previous = current_handler;
+    current_handler = handler;
+}
+
+void ErrorHandler_pop (ErrorHandler* handler)
+{
+    current_handler = handler->previous;
+}
+
+void Error_throw (const char* format, ...)
+{
+    ErrorHandler* handler = current_handler;
+    char message[MAX_ERROR_LEN];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(handler != NULL ? handler->message : message, MAX_ERROR_LEN, format, args);
+    va_end(args);
+
+    if (handler != NULL) {
+        longjmp(handler->target, 1);
+    }
+    Error_throw_printf("%s", message);
+}
@@ -0,0 +1,542 @@
+/**
+ * @file flatast.c
+ * @brief Flat, index-based AST representation
+ */
+
+#include "flatast.h"
+#include "visitor.h"
+
+/**
+ * @brief Subtree waiting to be flattened
+ */
+typedef struct FlatPending
+{
+    ASTNode* node;              /**< @brief Root of the subtree */
+    FlatIndex parent;           /**< @brief Index of the parent (@ref FLAT_NONE for the root) */
+    FlatIndex prev;             /**< @brief Index of the previous sibling (@ref FLAT_NONE for a first child) */
+    bool has_next;              /**< @brief True if the next sibling is waiting right below this entry */
+} FlatPending;
+
+/**
+ * @brief Flat tree under construction (the tree plus its array capacities)
+ */
+typedef struct FlatBuilder
+{
+    FlatAST* flat;              /**< @brief Tree being built */
+    uint32_t node_capacity;     /**< @brief Allocated length of @c nodes */
+    uint32_t vardecl_capacity;  /**< @brief Allocated length of @c vardecls */
+    uint32_t funcdecl_capacity; /**< @brief Allocated length of @c funcdecls */
+    uint32_t param_capacity;    /**< @brief Allocated length of @c params */
+    uint32_t string_capacity;   /**< @brief Allocated length of @c strings */
+    FlatPending* pending;       /**< @brief Stack of subtrees waiting to be flattened */
+    uint32_t pending_count;     /**< @brief Number of entries in @c pending */
+    uint32_t pending_capacity;  /**< @brief Allocated length of @c pending */
+} FlatBuilder;
+
+/**
+ * @brief Make room for one more element at the end of an array
+ */
+static void* reserve (void* array, uint32_t count, uint32_t* capacity, size_t size)
+{
+    if (count < *capacity) {
+        return array;
+    }
+    *capacity = (*capacity == 0 ? 16 : *capacity * 2);
+    array = realloc(array, *capacity * size);
+    CHECK_MALLOC_PTR(array)
+    return array;
+}
+
+/**
+ * @brief Append a node (with no children yet) and return its index
+ */
+static FlatIndex add_node (FlatBuilder* b, ASTNode* node)
+{
+    FlatAST* flat = b->flat;
+    flat->nodes = (FlatNode*)reserve(flat->nodes, flat->count, &b->node_capacity, sizeof(FlatNode));
+    FlatIndex index = flat->count++;
+    FlatNode* fn = &flat->nodes[index];
+    fn->type = node->type;
+    fn->literal_type = 0;
+    fn->source_line = node->source_line;
+    fn->first_child = FLAT_NONE;
+    fn->next_sibling = FLAT_NONE;
+    fn->payload = 0;
+    return index;
+}
+
+/**
+ * @brief Push a subtree onto the stack of subtrees waiting to be flattened
+ * (nothing is pushed for a missing optional child)
+ */
+static void push_pending (FlatBuilder* b, ASTNode* node)
+{
+    if (node == NULL) {
+        return;
+    }
+    b->pending = (FlatPending*)reserve(b->pending, b->pending_count, &b->pending_capacity, sizeof(FlatPending));
+    b->pending[b->pending_count++] = (FlatPending){ node, FLAT_NONE, FLAT_NONE, false };
+}
+
+/**
+ * @brief Store the side record of a variable declaration
+ */
+static uint32_t add_vardecl (FlatBuilder* b, ASTNode* node)
+{
+    FlatAST* flat = b->flat;
+    flat->vardecls = (FlatVarDecl*)reserve(flat->vardecls, flat->vardecl_count,
+                                           &b->vardecl_capacity, sizeof(FlatVarDecl));
+    FlatVarDecl* var = &flat->vardecls[flat->vardecl_count];
+    var->name = intern_id(node->vardecl.name);
+    var->type = node->vardecl.type;
+    var->is_array = node->vardecl.is_array;
+    var->array_length = node->vardecl.array_length;
+    return flat->vardecl_count++;
+}
+
+/**
+ * @brief Store the side records of a function declaration and its parameters
+ */
+static uint32_t add_funcdecl (FlatBuilder* b, ASTNode* node)
+{
+    FlatAST* flat = b->flat;
+    flat->funcdecls = (FlatFuncDecl*)reserve(flat->funcdecls, flat->funcdecl_count,
+                                             &b->funcdecl_capacity, sizeof(FlatFuncDecl));
+    FlatFuncDecl* func = &flat->funcdecls[flat->funcdecl_count];
+    func->name = intern_id(node->funcdecl.name);
+    func->return_type = node->funcdecl.return_type;
+    func->first_param = flat->param_count;
+    func->param_count = 0;
+    FOR_EACH(Parameter*, p, node->funcdecl.parameters) {
+        flat->params = (FlatParam*)reserve(flat->params, flat->param_count,
+                                           &b->param_capacity, sizeof(FlatParam));
+        flat->params[flat->param_count].name = intern_id(p->name);
+        flat->params[flat->param_count].type = p->type;
+        flat->param_count++;
+        func->param_count++;
+    }
+    return flat->funcdecl_count++;
+}
+
+/**
+ * @brief Store a copy of a string literal
+ */
+static uint32_t add_string (FlatBuilder* b, const char* value)
+{
+    FlatAST* flat = b->flat;
+    flat->strings = (const char**)reserve((void*)flat->strings, flat->string_count,
+                                          &b->string_capacity, sizeof(const char*));
+    flat->strings[flat->string_count] = Arena_strndup(flat->arena, value, strlen(value));
+    return flat->string_count++;
+}
+
+/**
+ * @brief Compute the payload of a node (see @ref FlatNode), storing its side
+ * records if it has any
+ */
+static uint32_t node_payload (FlatBuilder* b, FlatIndex index, ASTNode* node)
+{
+    switch (node->type)
+    {
+        case PROGRAM:       return node->program.variables->size;
+        case VARDECL:       return add_vardecl(b, node);
+        case FUNCDECL:      return add_funcdecl(b, node);
+        case BLOCK:         return node->block.variables->size;
+        case CONDITIONAL:   return node->conditional.else_block != NULL;
+        case BINARYOP:      return node->binaryop.operator;
+        case UNARYOP:       return node->unaryop.operator;
+        case LOCATION:      return intern_id(node->location.name);
+        case FUNCCALL:      return intern_id(node->funccall.name);
+        case LITERAL:
+            b->flat->nodes[index].literal_type = node->literal.type;
+            switch (node->literal.type) {
+                case INT:   return (uint32_t)node->literal.integer;
+                case BOOL:  return node->literal.boolean;
+                case STR:   return add_string(b, node->literal.string);
+                default:    return 0;
+            }
+        default:            return 0;
+    }
+}
+
+/**
+ * @brief Append a tree in pre-order
+ *
+ * Children are added in the order that @ref NodeVisitor_traverse visits them.
+ * Subtrees waiting to be added are kept on an explicit stack instead of the
+ * call stack, so there is no limit on the depth of the tree.
+ */
+static void flatten (FlatBuilder* b, ASTNode* root)
+{
+    push_pending(b, root);
+    while (b->pending_count > 0) {
+        FlatPending next = b->pending[--b->pending_count];
+        FlatIndex index = add_node(b, next.node);
+        FlatNode* nodes = b->flat->nodes;
+
+        /* link the node to its parent or previous sibling, and to its next sibling */
+        if (next.parent != FLAT_NONE) {
+            if (next.prev == FLAT_NONE) {
+                nodes[next.parent].first_child = index;
+            } else {
+                nodes[next.prev].next_sibling = index;
+            }
+        }
+        if (next.has_next) {
+            b->pending[b->pending_count - 1].prev = index;
+        }
+        nodes[index].payload = node_payload(b, index, next.node);
+
+        /* push the children, then reverse them so that the first one is on top */
+        uint32_t first = b->pending_count;
+#define AST_CHILD(FIELD)            push_pending(b, next.node->FIELD);
+#define AST_OPTIONAL_CHILD(FIELD)   push_pending(b, next.node->FIELD);
+#define AST_CHILD_LIST(FIELD)       FOR_EACH(ASTNode*, child, next.node->FIELD) { push_pending(b, child); }
+#define AST_INVISIT
+#define PUSH_CHILDREN(TYPE, name, label, CHILDREN) case TYPE: CHILDREN break;
+        switch (next.node->type) {
+            AST_NODE_KINDS(PUSH_CHILDREN)
+            default:
+                break;
+        }
+#undef PUSH_CHILDREN
+#undef AST_INVISIT
+#undef AST_CHILD_LIST
+#undef AST_OPTIONAL_CHILD
+#undef AST_CHILD
+        for (uint32_t i = first, j = b->pending_count; i + 1 < j; i++, j--) {
+            FlatPending swap = b->pending[i];
+            b->pending[i] = b->pending[j - 1];
+            b->pending[j - 1] = swap;
+        }
+        for (uint32_t i = first; i < b->pending_count; i++) {
+            b->pending[i].parent = index;
+            b->pending[i].has_next = (i > first);
+        }
+    }
+}
+
+/**
+ * @brief Find the end of the subtree of a child of the root
+ *
+ * @returns Index of the node after the last one in the subtree
+ */
+static FlatIndex subtree_end (FlatAST* flat, FlatIndex index)
+{
+    FlatIndex next = flat->nodes[index].next_sibling;
+    return (next == FLAT_NONE ? flat->count : next);
+}
+
+/**
+ * @brief Initialize the view of a flat node
+ */
+static void init_view (FlatAST* flat, ASTNode* node, FlatIndex index)
+{
+    ASTNode_init_view(node, flat->nodes[index].type, flat->nodes[index].source_line, flat->arena, index);
+}
+
+/**
+ * @brief Return the view of a node in the subtree currently in @c body_views
+ * (or @c NULL for a missing child)
+ */
+static ASTNode* body_view (FlatAST* flat, FlatIndex index)
+{
+    return (index == FLAT_NONE ? NULL : &flat->body_views[index - flat->body_base]);
+}
+
+/**
+ * @brief Take the next unused child list for a view in @c body_views
+ */
+static NodeList* body_list (FlatAST* flat, uint32_t* lists)
+{
+    NodeList* list = &flat->body_lists[(*lists)++];
+    *list = (NodeList){ NULL, NULL, 0 };
+    return list;
+}
+
+/**
+ * @brief Add the views of a run of siblings to a list
+ *
+ * @param count Number of siblings to add
+ * @returns Index of the sibling after the last one added
+ */
+static FlatIndex add_view_siblings (FlatAST* flat, NodeList* list, FlatIndex child, uint32_t count)
+{
+    for (uint32_t i = 0; i < count && child != FLAT_NONE; i++) {
+        NodeList_add(list, body_view(flat, child));
+        child = flat->nodes[child].next_sibling;
+    }
+    return child;
+}
+
+/**
+ * @brief Fill in the view of a variable declaration
+ */
+static void build_vardecl_view (FlatAST* flat, ASTNode* node, FlatIndex index)
+{
+    FlatVarDecl* var = &flat->vardecls[flat->nodes[index].payload];
+    node->vardecl.name = intern_name(var->name);
+    node->vardecl.type = var->type;
+    node->vardecl.is_array = var->is_array;
+    node->vardecl.array_length = var->array_length;
+}
+
+/**
+ * @brief Fill in the view of a function declaration (without its body)
+ */
+static void build_funcdecl_view (FlatAST* flat, ASTNode* node, FlatIndex index)
+{
+    FlatFuncDecl* func = &flat->funcdecls[flat->nodes[index].payload];
+    node->funcdecl.name = intern_name(func->name);
+    node->funcdecl.return_type = func->return_type;
+    node->funcdecl.parameters = (ParameterList*)Arena_calloc(flat->arena, sizeof(ParameterList));
+    for (uint32_t i = 0; i < func->param_count; i++) {
+        FlatParam* fp = &flat->params[func->first_param + i];
+        Parameter* p = (Parameter*)Arena_calloc(flat->arena, sizeof(Parameter));
+        p->name = intern_name(fp->name);
+        p->type = fp->type;
+        ParameterList_add(node->funcdecl.parameters, p);
+    }
+    node->funcdecl.body = NULL;
+}
+
+/**
+ * @brief Fill in the node-specific data of a view in @c body_views
+ *
+ * @param lists Number of entries of @c body_lists already in use (updated)
+ */
+static void build_body_view (FlatAST* flat, FlatIndex index, uint32_t* lists)
+{
+    FlatNode* fn = &flat->nodes[index];
+    ASTNode* node = body_view(flat, index);
+    FlatIndex c0 = fn->first_child;
+    FlatIndex c1 = (c0 == FLAT_NONE ? FLAT_NONE : flat->nodes[c0].next_sibling);
+    FlatIndex c2 = (c1 == FLAT_NONE ? FLAT_NONE : flat->nodes[c1].next_sibling);
+    switch (node->type)
+    {
+        case PROGRAM:
+        case FUNCDECL:
+            /* these only appear in top_views */
+            break;
+        case VARDECL:
+            build_vardecl_view(flat, node, index);
+            break;
+        case BLOCK:
+            node->block.variables = body_list(flat, lists);
+            node->block.statements = body_list(flat, lists);
+            c0 = add_view_siblings(flat, node->block.variables, c0, fn->payload);
+            add_view_siblings(flat, node->block.statements, c0, UINT32_MAX);
+            break;
+        case ASSIGNMENT:
+            node->assignment.location = body_view(flat, c0);
+            node->assignment.value = body_view(flat, c1);
+            break;
+        case CONDITIONAL:
+            node->conditional.condition = body_view(flat, c0);
+            node->conditional.if_block = body_view(flat, c1);
+            node->conditional.else_block = body_view(flat, c2);
+            break;
+        case WHILELOOP:
+            node->whileloop.condition = body_view(flat, c0);
+            node->whileloop.body = body_view(flat, c1);
+            break;
+        case RETURNSTMT:
+            node->funcreturn.value = body_view(flat, c0);
+            break;
+        case BREAKSTMT:
+        case CONTINUESTMT:
+            break;
+        case BINARYOP:
+            node->binaryop.operator = (BinaryOpType)fn->payload;
+            node->binaryop.left = body_view(flat, c0);
+            node->binaryop.right = body_view(flat, c1);
+            break;
+        case UNARYOP:
+            node->unaryop.operator = (UnaryOpType)fn->payload;
+            node->unaryop.child = body_view(flat, c0);
+            break;
+        case LOCATION:
+            node->location.name = intern_name(fn->payload);
+            node->location.index = body_view(flat, c0);
+            break;
+        case FUNCCALL:
+            node->funccall.name = intern_name(fn->payload);
+            node->funccall.arguments = body_list(flat, lists);
+            add_view_siblings(flat, node->funccall.arguments, c0, UINT32_MAX);
+            break;
+        case LITERAL:
+            node->literal.type = fn->literal_type;
+            switch (node->literal.type) {
+                case INT:   node->literal.integer = (int)fn->payload;  break;
+                case BOOL:  node->literal.boolean = fn->payload != 0;  break;
+                case STR:   node->literal.string = (char*)flat->strings[fn->payload]; break;
+                default:    node->literal.string = NULL; break;
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Build the views of a subtree in @c body_views (replacing whatever
+ * was there)
+ *
+ * @param start Root of the subtree
+ * @param end Index of the node after the last one in the subtree
+ * @returns View of the root of the subtree
+ */
+static ASTNode* build_body_views (FlatAST* flat, FlatIndex start, FlatIndex end)
+{
+    uint32_t lists = 0;
+    flat->body_base = start;
+    for (FlatIndex i = start; i < end; i++) {
+        init_view(flat, body_view(flat, i), i);
+    }
+    for (FlatIndex i = start; i < end; i++) {
+        build_body_view(flat, i, &lists);
+    }
+    return body_view(flat, start);
+}
+
+/**
+ * @brief Make room in @c body_views and @c body_lists for the views of a
+ * subtree
+ */
+static void reserve_body (FlatAST* flat, FlatIndex start, FlatIndex end)
+{
+    uint32_t lists = 0;
+    for (FlatIndex i = start; i < end; i++) {
+        lists += (flat->nodes[i].type == BLOCK ? 2 : flat->nodes[i].type == FUNCCALL);
+    }
+    flat->body_capacity = (end - start > flat->body_capacity ? end - start : flat->body_capacity);
+    flat->list_capacity = (lists > flat->list_capacity ? lists : flat->list_capacity);
+}
+
+/**
+ * @brief Build the views that last as long as the tree (those of a program
+ * node and its children) and allocate the reusable storage for the others
+ *
+ * The storage is sized for the largest subtree up front so that it never
+ * moves, which keeps a body's views at the same addresses every time they are
+ * rebuilt.
+ */
+static void prepare_views (FlatAST* flat)
+{
+    FlatNode* root = &flat->nodes[0];
+    if (root->type != PROGRAM) {
+        reserve_body(flat, 0, flat->count);
+    } else {
+        uint32_t children = 0;
+        for (FlatIndex c = root->first_child; c != FLAT_NONE; c = flat->nodes[c].next_sibling) {
+            children++;
+        }
+        flat->top_views = (ASTNode*)Arena_calloc(flat->arena, (children + 1) * sizeof(ASTNode));
+        ASTNode* program = &flat->top_views[0];
+        init_view(flat, program, 0);
+        program->program.variables = (NodeList*)Arena_calloc(flat->arena, sizeof(NodeList));
+        program->program.functions = (NodeList*)Arena_calloc(flat->arena, sizeof(NodeList));
+
+        uint32_t k = 1;
+        for (FlatIndex c = root->first_child; c != FLAT_NONE; c = flat->nodes[c].next_sibling, k++) {
+            ASTNode* view = &flat->top_views[k];
+            init_view(flat, view, c);
+            if (k <= root->payload) {
+                build_vardecl_view(flat, view, c);
+                NodeList_add(program->program.variables, view);
+            } else {
+                build_funcdecl_view(flat, view, c);
+                NodeList_add(program->program.functions, view);
+                if (flat->nodes[c].first_child != FLAT_NONE) {
+                    reserve_body(flat, flat->nodes[c].first_child, subtree_end(flat, c));
+                }
+            }
+        }
+    }
+    if (flat->body_capacity > 0) {
+        flat->body_views = (ASTNode*)calloc(flat->body_capacity, sizeof(ASTNode));
+        CHECK_MALLOC_PTR(flat->body_views)
+    }
+    if (flat->list_capacity > 0) {
+        flat->body_lists = (NodeList*)calloc(flat->list_capacity, sizeof(NodeList));
+        CHECK_MALLOC_PTR(flat->body_lists)
+    }
+}
+
+FlatAST* FlatAST_new (ASTNode* root)
+{
+    FlatAST* flat = (FlatAST*)calloc(1, sizeof(FlatAST));
+    CHECK_MALLOC_PTR(flat)
+    flat->arena = Arena_new();
+    FlatBuilder b = { .flat = flat };
+    flatten(&b, root);
+    free(b.pending);
+    prepare_views(flat);
+    return flat;
+}
+
+const char* FlatAST_name (FlatAST* flat, FlatIndex index)
+{
+    FlatNode* fn = &flat->nodes[index];
+    switch (fn->type) {
+        case VARDECL:   return intern_name(flat->vardecls[fn->payload].name);
+        case FUNCDECL:  return intern_name(flat->funcdecls[fn->payload].name);
+        default:        return intern_name(fn->payload);
+    }
+}
+
+/**
+ * @brief Invoke a program node hook of a visitor (or its default)
+ */
+static void visit_program (NodeVisitor* visitor, ASTNode* node, VisitorHook hook, VisitorHook fallback)
+{
+    (hook != NULL ? hook : fallback)(visitor, node);
+}
+
+void FlatAST_traverse (NodeVisitor* visitor, FlatAST* flat)
+{
+    if (flat->top_views == NULL) {
+        NodeVisitor_traverse(visitor, build_body_views(flat, 0, flat->count));
+        return;
+    }
+
+    /* same steps as NodeVisitor_traverse, with each body built just in time */
+    ASTNode* program = &flat->top_views[0];
+    visit_program(visitor, program, visitor->previsit_program, visitor->previsit_default);
+    if (visitor->control == TRAVERSE_STOP) {
+        visitor->control = TRAVERSE_CONTINUE;
+        return;
+    }
+    if (visitor->control != TRAVERSE_SKIP_CHILDREN) {
+        FOR_EACH(ASTNode*, var, program->program.variables) {
+            if (NodeVisitor_traverse(visitor, var)) {
+                return;
+            }
+        }
+        FOR_EACH(ASTNode*, func, program->program.functions) {
+            FlatIndex body = flat->nodes[func->id].first_child;
+            if (body != FLAT_NONE) {
+                func->funcdecl.body = build_body_views(flat, body, subtree_end(flat, func->id));
+            }
+            bool stopped = NodeVisitor_traverse(visitor, func);
+            func->funcdecl.body = NULL;
+            if (stopped) {
+                return;
+            }
+        }
+    }
+    visitor->control = TRAVERSE_CONTINUE;
+    visit_program(visitor, program, visitor->postvisit_program, visitor->postvisit_default);
+    visitor->control = TRAVERSE_CONTINUE;
+}
+
+void FlatAST_free (FlatAST* flat)
+{
+    Arena_free(flat->arena);
+    free(flat->nodes);
+    free(flat->vardecls);
+    free(flat->funcdecls);
+    free(flat->params);
+    free((void*)flat->strings);
+    free(flat->body_views);
+    free(flat->body_lists);
+    free(flat);
+}
@@ -0,0 +1,224 @@
+/**
+ * @file intern.c
+ * @brief Global identifier table
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "arena.h"
+#include "intern.h"
+
+/**
+ * @brief Stored name (the name's text follows the header directly)
+ */
+typedef struct InternEntry
+{
+    uint32_t id;        /**< @brief ID of the name */
+    uint32_t length;    /**< @brief Length of the name */
+    uint32_t hash;      /**< @brief Hash of the name */
+    char text[];        /**< @brief NUL-terminated text of the name */
+} InternEntry;
+
+/**
+ * @brief Hash table of entries (open addressing with linear probing)
+ */
+typedef struct InternSlots
+{
+    size_t capacity;                    /**< @brief Number of slots (a power of two) */
+    _Atomic(InternEntry*) entries[];    /**< @brief Slots (@c NULL marks an empty slot) */
+} InternSlots;
+
+/**
+ * @brief Initial number of hash table slots (must be a power of two)
+ */
+#define INTERN_INITIAL_SLOTS 1024
+
+/**
+ * @brief Identifier table state
+ *
+ * Entries live in an arena and keep their full hash, so most mismatches are
+ * rejected without touching the text. Any number of threads can intern at
+ * once: names that are already in the table are found without locking, and
+ * only adding a name takes the lock. An entry is filled in (and recorded in
+ * @c by_id) before it is published in its slot, and a grown hash table or ID
+ * array is filled in before it replaces the old one, so readers never see
+ * anything half-built. Replaced tables and arrays are allocated from the
+ * arena too and stay valid until @ref intern_free_all, because readers may
+ * still be probing them (a reader that misses in an old table looks again in
+ * the current one under the lock).
+ */
+static struct
+{
+    pthread_mutex_t lock;               /**< @brief Serializes additions */
+    Arena* arena;                       /**< @brief Storage for entries, tables, and ID arrays */
+    _Atomic(InternSlots*) slots;        /**< @brief Current hash table (@c NULL until the first name) */
+    _Atomic(InternEntry**) by_id;       /**< @brief Entries indexed by ID */
+    _Atomic size_t count;               /**< @brief Number of entries */
+    size_t id_capacity;                 /**< @brief Allocated length of @c by_id */
+} table = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Hash a name (32-bit FNV-1a)
+ */
+static uint32_t hash_text (const char* text, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Probe a hash table for a name
+ *
+ * @param slots Table to search
+ * @param text Text of the name
+ * @param length Length of the name
+ * @param hash Hash of the name
+ * @param[out] empty Index of the empty slot that ended the search
+ * @returns Entry for the name (or @c NULL if it is not in the table)
+ */
+static InternEntry* find_entry (InternSlots* slots, const char* text, size_t length,
+        uint32_t hash, size_t* empty)
+{
+    size_t mask = slots->capacity - 1;
+    size_t i = hash & mask;
+    InternEntry* entry;
+    while ((entry = atomic_load_explicit(&slots->entries[i], memory_order_acquire)) != NULL) {
+        if (entry->hash == hash && entry->length == length &&
+                (entry->text == text || memcmp(entry->text, text, length) == 0)) {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+    *empty = i;
+    return NULL;
+}
+
+/**
+ * @brief Replace the hash table with one twice the size holding the same
+ * entries (with the lock held)
+ */
+static InternSlots* grow_slots (InternSlots* old)
+{
+    size_t capacity = (old == NULL ? INTERN_INITIAL_SLOTS : old->capacity * 2);
+    InternSlots* slots = (InternSlots*)Arena_alloc(table.arena,
+            sizeof(InternSlots) + capacity * sizeof(slots->entries[0]));
+    slots->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&slots->entries[i], NULL);
+    }
+    for (size_t i = 0; old != NULL && i < old->capacity; i++) {
+        InternEntry* entry = atomic_load_explicit(&old->entries[i], memory_order_relaxed);
+        if (entry != NULL) {
+            size_t j = entry->hash & (capacity - 1);
+            while (atomic_load_explicit(&slots->entries[j], memory_order_relaxed) != NULL) {
+                j = (j + 1) & (capacity - 1);
+            }
+            atomic_store_explicit(&slots->entries[j], entry, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&table.slots, slots, memory_order_release);
+    return slots;
+}
+
+/**
+ * @brief Make room for one more entry in @c by_id (with the lock held)
+ */
+static InternEntry** reserve_id (size_t count)
+{
+    InternEntry** by_id = atomic_load_explicit(&table.by_id, memory_order_relaxed);
+    if (count == table.id_capacity) {
+        table.id_capacity = (table.id_capacity == 0 ? 256 : table.id_capacity * 2);
+        InternEntry** grown = (InternEntry**)Arena_alloc(table.arena,
+                table.id_capacity * sizeof(InternEntry*));
+        if (count > 0) {
+            memcpy(grown, by_id, count * sizeof(InternEntry*));
+        }
+        atomic_store_explicit(&table.by_id, grown, memory_order_release);
+        by_id = grown;
+    }
+    return by_id;
+}
+
+const char* intern (const char* text, size_t length)
+{
+    if (length > UINT32_MAX) {
+        Error_throw("Identifier too long\n");
+    }
+    uint32_t hash = hash_text(text, length);
+    size_t i;
+
+    /* most names are already in the table */
+    InternSlots* slots = atomic_load_explicit(&table.slots, memory_order_acquire);
+    if (slots != NULL) {
+        InternEntry* entry = find_entry(slots, text, length, hash, &i);
+        if (entry != NULL) {
+            return entry->text;
+        }
+    }
+
+    /* look again under the lock, since another thread may have just added it */
+    pthread_mutex_lock(&table.lock);
+    if (table.arena == NULL) {
+        table.arena = Arena_new();
+    }
+    size_t count = atomic_load_explicit(&table.count, memory_order_relaxed);
+    slots = atomic_load_explicit(&table.slots, memory_order_relaxed);
+    if (slots == NULL || count >= slots->capacity / 2) {
+        slots = grow_slots(slots);
+    }
+    InternEntry* entry = find_entry(slots, text, length, hash, &i);
+
+    /* new name: copy it into the arena and give it the next ID */
+    if (entry == NULL) {
+        InternEntry** by_id = reserve_id(count);
+        entry = (InternEntry*)Arena_alloc(table.arena, sizeof(InternEntry) + length + 1);
+        entry->id = (uint32_t)count;
+        entry->length = (uint32_t)length;
+        entry->hash = hash;
+        memcpy(entry->text, text, length);
+        entry->text[length] = '\0';
+        by_id[count] = entry;
+        atomic_store_explicit(&slots->entries[i], entry, memory_order_release);
+        atomic_store_explicit(&table.count, count + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&table.lock);
+    return entry->text;
+}
+
+const char* intern_string (const char* string)
+{
+    return intern(string, strlen(string));
+}
+
+uint32_t intern_id (const char* name)
+{
+    const InternEntry* entry = (const InternEntry*)(name - offsetof(InternEntry, text));
+    return entry->id;
+}
+
+const char* intern_name (uint32_t id)
+{
+    return atomic_load_explicit(&table.by_id, memory_order_acquire)[id]->text;
+}
+
+size_t intern_count (void)
+{
+    return atomic_load_explicit(&table.count, memory_order_acquire);
+}
+
+void intern_free_all (void)
+{
+    if (table.arena != NULL) {
+        Arena_free(table.arena);
+    }
+    table.arena = NULL;
+    atomic_store(&table.slots, NULL);
+    atomic_store(&table.by_id, NULL);
+    atomic_store(&table.count, 0);
+    table.id_capacity = 0;
+}
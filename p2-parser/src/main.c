@@ -3,8 +3,13 @@
  * @brief Compiler driver
  */
 
+#include <signal.h>
+
 #include "p1-lexer.h"
 #include "p2-parser.h"
+#include "source.h"
+#include "batch.h"
+#include "server.h"
 
 /**
  * @brief Error message buffer
@@ -35,104 +40,406 @@ void Error_throw_printf (const char* format, ...)
 }
 
 /**
- * @brief Read all text data from a file
+ * @brief Compile one source file
+ *
+ * The AST is printed to @p output. If the @c DECAF_GRAPH environment variable
+ * asks for it, the tree is also drawn, in the same traversal: "dot" writes a
+ * GraphViz file (@p graph_name with ".dot" appended), "svg" writes an image
+ * laid out here (".svg"), and "dot,svg" writes both.
  *
- * @param filename Name of file to read
- * @param text String buffer destination (must be #MAX_FILE_SIZE characters long)
- * @returns True if and only if the file read was successful.
+ * @param filename Name of the source file ("-" for standard input)
+ * @param output File stream for the AST output
+ * @param graph_name Name of the graph output files without the extension
+ * @param label Prefix for error messages (or @c NULL for none)
+ * @returns True if the compilation succeeded
  */
-bool read_file (const char* filename, char* text)
+static bool compile_file (const char* filename, FILE* output, const char* graph_name, const char* label)
 {
-    FILE* input = fopen(filename, "r");
-    if (input == NULL) {
+    /* map (or read) file */
+    SourceFile* source = SourceFile_open(filename);
+    if (source == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", filename);
         return false;
     }
-    size_t nchars = 0;
-    char* p = text;
-    int c;
-    while (nchars < MAX_FILE_SIZE && (c = fgetc(input)) != EOF) {
-        *p++ = (char)c;
-        nchars++;
+
+    /* FRONT END */
+
+    /*
+     * PROJECTS 1 and 2: lexer and parser (tokens are produced as the parser
+     * asks for them); fatal errors are possible here, and the context catches
+     * them
+     */
+    ParserContext context;
+    ParserContext_init(&context);
+    ASTNode* tree = ParserContext_parse_padded(&context, source->text);
+
+    /* clean up source text (no longer needed) */
+    SourceFile_free(source);
+    source = NULL;
+
+    /* handle fatal error: print message */
+    if (tree == NULL) {
+        if (label != NULL) {
+            fprintf(stderr, "%s: ", label);
+        }
+        fprintf(stderr, "%s", context.error.message);
+        return false;
     }
-    *p = '\0';
-    fclose(input);
-    return true;
+
+    /* 
+     * output (disable attribute printing in this phase (keeps AST output
+     * cleaner and the attributes aren't really important until the static
+     * analysis phase)
+     */
+    NodeVisitor* printer = CompositeVisitor_new();
+    CompositeVisitor_add(printer, PrintVisitor_new(output));
+
+    /* generate graphical AST (in the same traversal) only if asked to */
+    const char* graph = getenv("DECAF_GRAPH");
+    char graph_file[FILENAME_MAX];
+    FILE* dot_file = NULL;
+    FILE* svg_file = NULL;
+    if (graph != NULL && strstr(graph, "dot") != NULL) {
+        snprintf(graph_file, sizeof(graph_file), "%s.dot", graph_name);
+        dot_file = fopen(graph_file, "w");
+        if (dot_file != NULL) {
+            CompositeVisitor_add(printer, GenerateASTGraph_new(dot_file));
+        } else {
+            fprintf(stderr, "Could not write %s\n", graph_file);
+        }
+    }
+    if (graph != NULL && strstr(graph, "svg") != NULL) {
+        snprintf(graph_file, sizeof(graph_file), "%s.svg", graph_name);
+        svg_file = fopen(graph_file, "w");
+        if (svg_file != NULL) {
+            CompositeVisitor_add(printer, GenerateASTImage_new(svg_file));
+        } else {
+            fprintf(stderr, "Could not write %s\n", graph_file);
+        }
+    }
+
+    /*
+     * errors are still possible after parsing (e.g., a missing attribute), so
+     * catch them too; one bad file must not take down a batch
+     */
+    ErrorHandler handler;
+    volatile bool succeeded = false;
+    ErrorHandler_push(&handler);
+    if (setjmp(handler.target) == 0) {
+
+        /*
+         * the parser already set up parent links and node depths; the
+         * original passes only run to check them (set DECAF_VERIFY_TREE to
+         * enable)
+         */
+        if (getenv("DECAF_VERIFY_TREE") == NULL || verify_parent_and_depth(tree, stderr) == 0) {
+            NodeVisitor_traverse(printer, tree);
+            succeeded = true;
+        }
+
+    } else {
+
+        /* handle fatal error: print message (the traversal was abandoned) */
+        NodeVisitor_release_stack();
+        if (label != NULL) {
+            fprintf(stderr, "%s: ", label);
+        }
+        fprintf(stderr, "%s", handler.message);
+    }
+    ErrorHandler_pop(&handler);
+    NodeVisitor_free(printer);
+    if (dot_file != NULL) {
+        fclose(dot_file);
+    }
+    if (svg_file != NULL) {
+        fclose(svg_file);
+    }
+
+    /* clean up */
+    ASTNode_free(tree);
+    return succeeded;
 }
 
 /**
- * @brief Compiler entry point
+ * @brief Compile one file of a batch (see @ref BatchJob)
  *
- * @param argc Number of command-line arguments
- * @param argv Array of command-line argument strings
- * @returns @c EXIT_SUCCESS if the compilation succeeds and @c EXIT_FAILURE
- * otherwise
+ * The AST output for @c name.decaf goes to @c name.decaf.ast (removed again
+ * if the compilation fails, so a stale file is never mistaken for a result),
+ * and any graphs to @c name.decaf.dot and @c name.decaf.svg. A program read
+ * from standard input is printed to standard output instead.
  */
-int main(int argc, char** argv)
+static bool compile_batch_file (const char* filename, void* data)
 {
-    /* check for filename */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <decaf-filename>\n", argv[0]);
-        return EXIT_FAILURE;
+    if (strcmp(filename, "-") == 0) {
+        return compile_file(filename, stdout, "tree", filename);
     }
-    char* filename = argv[argc-1];
 
-    /* read file */
-    char text[MAX_FILE_SIZE];
-    if (!read_file(filename, text)) {
-        fprintf(stderr, "Could not read file: %s", filename);
-        exit(EXIT_FAILURE);
+    size_t length = strlen(filename);
+    char* output_name = (char*)malloc(length + sizeof(".ast"));
+    CHECK_MALLOC_PTR(output_name)
+    memcpy(output_name, filename, length);
+    memcpy(output_name + length, ".ast", sizeof(".ast"));
+    FILE* output = fopen(output_name, "w");
+    if (output == NULL) {
+        fprintf(stderr, "Could not write %s\n", output_name);
+        free(output_name);
+        return false;
     }
 
-    /* FRONT END */
+    bool succeeded = compile_file(filename, output, filename, filename);
+    if (fclose(output) != 0 || !succeeded) {
+        remove(output_name);
+        succeeded = false;
+    }
+    free(output_name);
+    return succeeded;
+}
+
+/**
+ * @brief Compile one source file on a compile server (see server.h)
+ *
+ * This is the thin client: it prints the same output and messages as @ref
+ * compile_file (with any graphs in @c tree.dot and @c tree.svg), but the
+ * server does the work, in a single request for every output. Nothing is
+ * printed unless the server produced every output.
+ *
+ * @param socket_path Path of the server's socket
+ * @param filename Name of the source file ("-" for standard input)
+ * @param report True to explain to @c stderr why the server could not be used
+ * @returns 1 if the compilation succeeded, 0 if it failed, and -1 if the
+ * server could not carry out the request
+ */
+static int compile_remotely (const char* socket_path, const char* filename, bool report)
+{
+    static const struct { ServerOutput output; const char* graph; } kinds[] = {
+        { SERVER_AST, NULL }, { SERVER_DOT, "dot" }, { SERVER_SVG, "svg" }
+    };
+
+    SourceFile* source = SourceFile_open(filename);
+    if (source == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", filename);
+        return 0;
+    }
+    if (source->size > SERVER_MAX_DATA) {
+        if (report) {
+            fprintf(stderr, "File too large for the compile server (%zu bytes, limit %u): %s\n",
+                    source->size, SERVER_MAX_DATA, filename);
+        }
+        SourceFile_free(source);
+        return -1;
+    }
+
+    /* the AST, and graphs only if DECAF_GRAPH asks for them */
+    const char* graph = getenv("DECAF_GRAPH");
+    ServerOutput outputs[SERVER_MAX_OUTPUTS];
+    const char* graphs[SERVER_MAX_OUTPUTS];
+    int count = 0;
+    for (int i = 0; i < SERVER_MAX_OUTPUTS; i++) {
+        if (kinds[i].graph == NULL || (graph != NULL && strstr(graph, kinds[i].graph) != NULL)) {
+            outputs[count] = kinds[i].output;
+            graphs[count++] = kinds[i].graph;
+        }
+    }
+    ServerReply replies[SERVER_MAX_OUTPUTS];
+    int result = 1;
+    if (!Server_request_outputs(socket_path, SERVER_TEXT, outputs, count, source->text, source->size, replies)) {
+        if (report) {
+            fprintf(stderr, "Could not reach compile server at %s\n", socket_path);
+        }
+        result = -1;
+    }
+    SourceFile_free(source);
+    for (int i = 0; i < count && result == 1; i++) {
+        if (replies[i].status == SERVER_ERROR) {
+            fputs(replies[i].text, stderr);
+            result = 0;
+        } else if (replies[i].status != SERVER_OK) {
+            if (report) {
+                fputs(replies[i].text, stderr);
+            }
+            result = -1;
+        }
+    }
 
-    TokenQueue* tokens = NULL;
-    ASTNode* tree = NULL;
+    for (int i = 0; i < count; i++) {
+        if (result == 1) {
+            if (graphs[i] == NULL) {
+                fwrite(replies[i].text, 1, replies[i].length, stdout);
+            } else {
+                char graph_file[16];
+                snprintf(graph_file, sizeof(graph_file), "tree.%s", graphs[i]);
+                FILE* output = fopen(graph_file, "w");
+                if (output != NULL) {
+                    fwrite(replies[i].text, 1, replies[i].length, output);
+                    fclose(output);
+                } else {
+                    fprintf(stderr, "Could not write %s\n", graph_file);
+                }
+            }
+        }
+        free(replies[i].text);
+    }
+    return result;
+}
 
-    /* fatal errors are possible in the front end, so check for them */
-    if (setjmp(decaf_error) == 0) {
+/**
+ * @brief Server being run by @ref serve (for the signal handler)
+ */
+static Server* running_server = NULL;
 
-        /* PROJECT 1: lexer */
-        tokens = lex(text);
+/**
+ * @brief Stop the running server when the process is interrupted or
+ * terminated
+ */
+static void stop_server (int signal)
+{
+    if (running_server != NULL) {
+        Server_stop(running_server);
+    }
+}
 
-        /* PROJECT 2: parser */
-        tree = parse(tokens);
+/**
+ * @brief Run a compile server until it is interrupted, terminated, or asked
+ * to shut down
+ *
+ * @param socket_path Path of the socket to listen on
+ * @param workers Number of worker threads (or zero for the default)
+ * @returns @c EXIT_SUCCESS if the server ran and @c EXIT_FAILURE otherwise
+ */
+static int serve (const char* socket_path, int workers)
+{
+    ServerOptions options = {
+        .workers = workers,
+        .queue_capacity = SERVER_QUEUE_CAPACITY,
+        .timeout_ms = SERVER_TIMEOUT_MS,
+        .connection_ms = SERVER_CONNECTION_MS,
+        .name_limit = SERVER_NAME_LIMIT
+    };
+    running_server = Server_open(socket_path, &options);
+    if (running_server == NULL) {
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    Server_run(running_server);
+    Server_free(running_server);
+    running_server = NULL;
+    intern_free_all();
+    return EXIT_SUCCESS;
+}
 
-    } else {
+/**
+ * @brief Print command-line usage
+ */
+static void print_usage (const char* program)
+{
+    fprintf(stderr, "Usage: %s [-j <threads>] <decaf-filename>...\n", program);
+    fprintf(stderr, "       %s --serve <socket> [-j <threads>]\n", program);
+    fprintf(stderr, "       %s --client <socket> <decaf-filename>\n", program);
+    fprintf(stderr, "  (use \"-\" to read the program from standard input, and \"@<file>\" to\n");
+    fprintf(stderr, "  read more arguments from a file)\n");
+}
 
-        /* handle fatal error: print message and clean up */
+/**
+ * @brief Compiler entry point
+ *
+ * A single source file is compiled with its AST printed to standard output
+ * (and any graphs written to @c tree.dot and @c tree.svg). Given several
+ * files, a response file, or a thread count, the driver compiles the files
+ * as a batch instead (see batch.h and @ref compile_batch_file) and reports
+ * the overall throughput.
+ *
+ * With @c --serve, the driver runs a compile server (see server.h) instead,
+ * and with @c --client, it has a server compile a single file. If the @c
+ * DECAF_SERVER environment variable names a server's socket, a single file
+ * is compiled there too (unless @c DECAF_VERIFY_TREE is set), so existing
+ * scripts can use a server without changes; if the server cannot be used,
+ * the file is compiled here as usual.
+ *
+ * @param argc Number of command-line arguments
+ * @param argv Array of command-line argument strings
+ * @returns @c EXIT_SUCCESS if the compilation succeeds (for every file) and
+ * @c EXIT_FAILURE otherwise
+ */
+int main(int argc, char** argv)
+{
+    /*
+     * compilations catch their own errors; anything thrown on this thread
+     * outside of them ends up here
+     */
+    if (setjmp(decaf_error) != 0) {
         fprintf(stderr, "%s", decaf_error_msg);
-        if (tokens   != NULL) TokenQueue_free(tokens);
-        if (tree     != NULL) ASTNode_free(tree);
-        exit(EXIT_FAILURE);
+        return EXIT_FAILURE;
     }
 
-    /* clean up tokens (no longer needed) */
-    TokenQueue_free(tokens);
-    tokens = NULL;
+    /* check for server or client mode */
+    int first = 1;
+    const char* serve_socket = NULL;
+    const char* client_socket = NULL;
+    if (first + 1 < argc && strcmp(argv[first], "--serve") == 0) {
+        serve_socket = argv[first + 1];
+        first += 2;
+    } else if (first + 1 < argc && strcmp(argv[first], "--client") == 0) {
+        client_socket = argv[first + 1];
+        first += 2;
+    }
 
-    /* set up parent links and calculate node depths */
-    NodeVisitor_traverse_and_free(SetParentVisitor_new(), tree);
-    NodeVisitor_traverse_and_free(CalcDepthVisitor_new(), tree);
+    /* check for thread count */
+    int workers = 0;
+    bool batch_mode = false;
+    if (first < argc && client_socket == NULL && strncmp(argv[first], "-j", 2) == 0) {
+        const char* count = (argv[first][2] != '\0' ? argv[first] + 2 : argv[++first]);
+        workers = (count != NULL ? atoi(count) : 0);
+        if (workers <= 0) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        batch_mode = true;
+        first++;
+    }
 
-    /* 
-     * output (disable attribute printing in this phase (keeps AST output
-     * cleaner and the attributes aren't really important until the static
-     * analysis phase)
-     */
-    NodeVisitor_traverse_and_free(PrintVisitor_new(stdout), tree);
-
-    /* generate graphical AST */
-    FILE* graph_file = fopen("tree.dot", "w");
-    if (graph_file != NULL) {
-        NodeVisitor_traverse_and_free(GenerateASTGraph_new(graph_file), tree);
-        fclose(graph_file);
-        if (system("dot -Tpng -o tree.png tree.dot") == -1) {
-            fprintf(stderr, "Could not generate AST image\n");
+    if (serve_socket != NULL) {
+        if (first < argc) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
         }
+        return serve(serve_socket, workers);
     }
 
-    /* clean up */
-    ASTNode_free(tree);
+    /* check for filenames */
+    if (first >= argc || (client_socket != NULL && (argc - first > 1 || argv[first][0] == '@'))) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    batch_mode = batch_mode || argc - first > 1 || argv[first][0] == '@';
 
-    return EXIT_SUCCESS;
+    if (!batch_mode) {
+        const char* server = (client_socket != NULL ? client_socket : getenv("DECAF_SERVER"));
+        if (server != NULL && (client_socket != NULL || getenv("DECAF_VERIFY_TREE") == NULL)) {
+            int result = compile_remotely(server, argv[first], client_socket != NULL);
+            if (result >= 0 || client_socket != NULL) {
+                return (result == 1 ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+        }
+        bool succeeded = compile_file(argv[first], stdout, "tree", NULL);
+        intern_free_all();
+        return (succeeded ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    /* BATCH: every file gets its own output, and every file is attempted */
+    Batch* batch = Batch_new();
+    bool complete = true;
+    for (int i = first; i < argc; i++) {
+        complete = Batch_add(batch, argv[i]) && complete;
+    }
+    BatchStats stats = Batch_run(batch, workers, compile_batch_file, NULL);
+    double megabytes = (double)stats.bytes / (1024 * 1024);
+    double seconds = (stats.seconds > 0 ? stats.seconds : 1e-9);
+    fprintf(stderr, "%zu files (%zu failed), %.2f MB in %.3f s: %.1f files/s, %.2f MB/s\n",
+            stats.files, stats.failed, megabytes, stats.seconds,
+            (double)stats.files / seconds, megabytes / seconds);
+    Batch_free(batch);
+    intern_free_all();
+
+    return (complete && stats.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
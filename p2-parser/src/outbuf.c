@@ -0,0 +1,162 @@
+/**
+ * @file outbuf.c
+ * @brief Buffered text output
+ */
+
+#include "outbuf.h"
+
+/**
+ * @brief Initial size of a buffer in bytes
+ */
+#define OUTPUT_BUFFER_INITIAL 4096
+
+/**
+ * @brief Spaces copied from when indenting
+ */
+static const char spaces[] =
+    "                                                                "
+    "                                                                ";
+
+OutputBuffer* OutputBuffer_new (FILE* output)
+{
+    OutputBuffer* buffer = (OutputBuffer*)calloc(1, sizeof(OutputBuffer));
+    CHECK_MALLOC_PTR(buffer)
+    buffer->output = output;
+    return buffer;
+}
+
+/**
+ * @brief Make room for more bytes, flushing the buffer instead of growing it
+ * past the limit if it has a stream
+ *
+ * @returns Position to write the bytes at
+ */
+static char* reserve (OutputBuffer* buffer, size_t more)
+{
+    if (buffer->capacity - buffer->length >= more) {
+        return buffer->text + buffer->length;
+    }
+    if (buffer->output != NULL && buffer->length + more > OUTPUT_BUFFER_LIMIT) {
+        OutputBuffer_flush(buffer);
+        if (buffer->capacity >= more) {
+            return buffer->text;
+        }
+    }
+    size_t capacity = (buffer->capacity == 0 ? OUTPUT_BUFFER_INITIAL : buffer->capacity * 2);
+    while (capacity - buffer->length < more) {
+        capacity *= 2;
+    }
+    buffer->text = (char*)realloc(buffer->text, capacity);
+    CHECK_MALLOC_PTR(buffer->text)
+    buffer->capacity = capacity;
+    return buffer->text + buffer->length;
+}
+
+void OutputBuffer_write (OutputBuffer* buffer, const char* text, size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+    memcpy(reserve(buffer, length), text, length);
+    buffer->length += length;
+}
+
+void OutputBuffer_puts (OutputBuffer* buffer, const char* text)
+{
+    OutputBuffer_write(buffer, text, strlen(text));
+}
+
+void OutputBuffer_putc (OutputBuffer* buffer, char c)
+{
+    *reserve(buffer, 1) = c;
+    buffer->length++;
+}
+
+void OutputBuffer_int (OutputBuffer* buffer, long value)
+{
+    /* generate the digits backwards from the end of a scratch buffer */
+    char digits[24];
+    char* start = digits + sizeof(digits);
+    unsigned long magnitude = (value < 0 ? 0UL - (unsigned long)value : (unsigned long)value);
+    do {
+        *--start = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--start = '-';
+    }
+    OutputBuffer_write(buffer, start, digits + sizeof(digits) - start);
+}
+
+void OutputBuffer_indent (OutputBuffer* buffer, long levels)
+{
+    size_t remaining = (levels > 0 ? (size_t)levels * 2 : 0);
+    while (remaining > 0) {
+        size_t chunk = (remaining < sizeof(spaces) - 1 ? remaining : sizeof(spaces) - 1);
+        OutputBuffer_write(buffer, spaces, chunk);
+        remaining -= chunk;
+    }
+}
+
+/**
+ * @brief Add a string, copying the runs between special characters in bulk
+ * and replacing each special character with its escape sequence
+ *
+ * @param buffer Buffer to add to
+ * @param string String to add
+ * @param specials Characters to escape
+ * @param escapes Escape sequence of each special character (in the same order)
+ */
+static void write_escaped (OutputBuffer* buffer, const char* string, const char* specials,
+                           const char* const escapes[])
+{
+    while (true) {
+        size_t run = strcspn(string, specials);
+        OutputBuffer_write(buffer, string, run);
+        string += run;
+        if (*string == '\0') {
+            return;
+        }
+        OutputBuffer_puts(buffer, escapes[strchr(specials, *string) - specials]);
+        string++;
+    }
+}
+
+void OutputBuffer_escaped (OutputBuffer* buffer, const char* string)
+{
+    static const char* const escapes[] = { "\\n", "\\t", "\\\"", "\\\\" };
+    write_escaped(buffer, string, "\n\t\"\\", escapes);
+}
+
+void OutputBuffer_doubly_escaped (OutputBuffer* buffer, const char* string)
+{
+    static const char* const escapes[] = { "\\\\n", "\\\\t", "\\\\\\\"", "\\\\\\\\" };
+    write_escaped(buffer, string, "\n\t\"\\", escapes);
+}
+
+void OutputBuffer_xml_escaped (OutputBuffer* buffer, const char* string)
+{
+    static const char* const escapes[] = { "&amp;", "&lt;", "&gt;", "&quot;", "&apos;" };
+    write_escaped(buffer, string, "&<>\"'", escapes);
+}
+
+void OutputBuffer_append (OutputBuffer* buffer, OutputBuffer* other)
+{
+    OutputBuffer_write(buffer, other->text, other->length);
+    other->length = 0;
+}
+
+void OutputBuffer_flush (OutputBuffer* buffer)
+{
+    if (buffer->output != NULL && buffer->length > 0) {
+        fwrite(buffer->text, 1, buffer->length, buffer->output);
+        buffer->length = 0;
+    }
+}
+
+void OutputBuffer_free (OutputBuffer* buffer)
+{
+    OutputBuffer_flush(buffer);
+    free(buffer->text);
+    free(buffer);
+}
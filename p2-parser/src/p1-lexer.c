@@ -0,0 +1,398 @@
+/**
+ * @file p1-lexer.c
+ * @brief Compiler phase 1: lexer
+ *
+ * This is a single-pass, table-driven DFA lexer. Every input byte is mapped to
+ * a character class, and the DFA walks a precomputed transition table over
+ * those classes using the usual maximal-munch rule (remember the last
+ * accepting state and fall back to it when the automaton dies). The token
+ * rules are the same as the original regex-based lexer:
+ *
+ * <table border="1">
+ * <tr><th>Rule</th><th>Pattern</th></tr>
+ * <tr><td>whitespace</td><td><tt>[ \\t\\r]</tt></td></tr>
+ * <tr><td>comment</td><td><tt>//[^\\n]*</tt></td></tr>
+ * <tr><td>identifier</td><td><tt>[a-zA-Z][a-zA-Z0-9_]*</tt></td></tr>
+ * <tr><td>hex literal</td><td><tt>0x(0|[1-9a-fA-F][0-9a-fA-F]*)</tt></td></tr>
+ * <tr><td>decimal literal</td><td><tt>0|[1-9][0-9]*</tt></td></tr>
+ * <tr><td>string literal</td><td><tt>"([^\\\\"\\r\\n]|\\\\[nt"\\\\])*"</tt></td></tr>
+ * <tr><td>symbol</td><td><tt>&lt;= &gt;= && || == != ( ) { } [ ] , ; = + - * / % ! &lt; &gt;</tt></td></tr>
+ * </table>
+ *
+ * Identifiers and symbols are classified with @ref TokenKind_lookup after
+ * they are recognized, so every keyword and symbol token carries its specific
+ * kind and reserved words are rejected.
+ *
+ * Whitespace between tokens and the self-looping "run" states of the DFA
+ * (identifier characters, digits, hex digits, string bodies, and comment
+ * text) are skipped with the scanning kernels from scan.h, which process many
+ * bytes per step. Since each kernel skips exactly the characters on which its
+ * state loops back to itself, the tables above remain the definition of the
+ * token rules.
+ */
+
+#include "p1-lexer.h"
+#include "scan.h"
+
+/**
+ * @brief Input character classes (columns of the transition table)
+ */
+typedef enum CharClass {
+    CC_OTHER,       /**< @brief Anything not listed below (always invalid outside strings/comments) */
+    CC_NUL,         /**< @brief End of input */
+    CC_BLANK,       /**< @brief Space or tab */
+    CC_CR,          /**< @brief Carriage return (whitespace, but not allowed in strings) */
+    CC_NEWLINE,     /**< @brief Line feed */
+    CC_ZERO,        /**< @brief @c 0 */
+    CC_DIGIT,       /**< @brief @c 1 through @c 9 */
+    CC_HEXALPHA,    /**< @brief @c a-f and @c A-F */
+    CC_X,           /**< @brief @c x (hex prefix) */
+    CC_ESCAPE,      /**< @brief @c n and @c t (valid escape letters) */
+    CC_ALPHA,       /**< @brief Any other letter */
+    CC_UNDERSCORE,  /**< @brief @c _ */
+    CC_QUOTE,       /**< @brief @c " */
+    CC_BACKSLASH,   /**< @brief @c \\ */
+    CC_SLASH,       /**< @brief @c / (division or start of comment) */
+    CC_LT,          /**< @brief @c < */
+    CC_GT,          /**< @brief @c > */
+    CC_EQ,          /**< @brief @c = */
+    CC_BANG,        /**< @brief @c ! */
+    CC_AMP,         /**< @brief @c & */
+    CC_PIPE,        /**< @brief @c | */
+    CC_SYM,         /**< @brief Single-character symbols that never start a longer token */
+    NUM_CHAR_CLASSES
+} CharClass;
+
+/**
+ * @brief DFA states (rows of the transition table)
+ *
+ * State zero is the dead state, so any transition that is not listed in the
+ * table is an implicit transition to @c ST_DEAD.
+ */
+typedef enum LexState {
+    ST_DEAD, ST_START,
+    ST_BLANK, ST_NEWLINE, ST_SLASH, ST_COMMENT,
+    ST_ID,
+    ST_ZERO, ST_DEC, ST_HEX_PREFIX, ST_HEX_ZERO, ST_HEX,
+    ST_STR, ST_STR_ESCAPE, ST_STR_END,
+    ST_LT, ST_GT, ST_EQ, ST_BANG, ST_AMP, ST_PIPE, ST_SYM1, ST_SYM2,
+    NUM_LEX_STATES
+} LexState;
+
+/**
+ * @brief What to do with the text consumed by an accepting state
+ */
+typedef enum LexAction {
+    ACT_NONE,       /**< @brief Not an accepting state */
+    ACT_SKIP,       /**< @brief Whitespace or comment (no token) */
+    ACT_NEWLINE,    /**< @brief Line feed (no token; bumps the line counter) */
+    ACT_ID,         /**< @brief Identifier, keyword, or reserved word */
+    ACT_DECLIT,     /**< @brief Decimal literal */
+    ACT_HEXLIT,     /**< @brief Hexadecimal literal */
+    ACT_STRLIT,     /**< @brief String literal */
+    ACT_SYM         /**< @brief Symbol */
+} LexAction;
+
+/**
+ * @brief Character class of every possible input byte
+ */
+static const uint8_t char_class[256] = {
+    ['\0'] = CC_NUL,
+    [' ']  = CC_BLANK,  ['\t'] = CC_BLANK,  ['\r'] = CC_CR,  ['\n'] = CC_NEWLINE,
+    ['0']  = CC_ZERO,
+    ['1']  = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT, ['5'] = CC_DIGIT,
+    ['6']  = CC_DIGIT, ['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+    ['a']  = CC_HEXALPHA, ['b'] = CC_HEXALPHA, ['c'] = CC_HEXALPHA,
+    ['d']  = CC_HEXALPHA, ['e'] = CC_HEXALPHA, ['f'] = CC_HEXALPHA,
+    ['A']  = CC_HEXALPHA, ['B'] = CC_HEXALPHA, ['C'] = CC_HEXALPHA,
+    ['D']  = CC_HEXALPHA, ['E'] = CC_HEXALPHA, ['F'] = CC_HEXALPHA,
+    ['x']  = CC_X,
+    ['n']  = CC_ESCAPE, ['t'] = CC_ESCAPE,
+    ['g']  = CC_ALPHA, ['h'] = CC_ALPHA, ['i'] = CC_ALPHA, ['j'] = CC_ALPHA, ['k'] = CC_ALPHA,
+    ['l']  = CC_ALPHA, ['m'] = CC_ALPHA, ['o'] = CC_ALPHA, ['p'] = CC_ALPHA, ['q'] = CC_ALPHA,
+    ['r']  = CC_ALPHA, ['s'] = CC_ALPHA, ['u'] = CC_ALPHA, ['v'] = CC_ALPHA, ['w'] = CC_ALPHA,
+    ['y']  = CC_ALPHA, ['z'] = CC_ALPHA,
+    ['G']  = CC_ALPHA, ['H'] = CC_ALPHA, ['I'] = CC_ALPHA, ['J'] = CC_ALPHA, ['K'] = CC_ALPHA,
+    ['L']  = CC_ALPHA, ['M'] = CC_ALPHA, ['N'] = CC_ALPHA, ['O'] = CC_ALPHA, ['P'] = CC_ALPHA,
+    ['Q']  = CC_ALPHA, ['R'] = CC_ALPHA, ['S'] = CC_ALPHA, ['T'] = CC_ALPHA, ['U'] = CC_ALPHA,
+    ['V']  = CC_ALPHA, ['W'] = CC_ALPHA, ['X'] = CC_ALPHA, ['Y'] = CC_ALPHA, ['Z'] = CC_ALPHA,
+    ['_']  = CC_UNDERSCORE,
+    ['"']  = CC_QUOTE,  ['\\'] = CC_BACKSLASH, ['/'] = CC_SLASH,
+    ['<']  = CC_LT,     ['>']  = CC_GT,        ['='] = CC_EQ,    ['!'] = CC_BANG,
+    ['&']  = CC_AMP,    ['|']  = CC_PIPE,
+    ['(']  = CC_SYM, [')'] = CC_SYM, ['{'] = CC_SYM, ['}'] = CC_SYM, ['['] = CC_SYM, [']'] = CC_SYM,
+    [',']  = CC_SYM, [';'] = CC_SYM, ['+'] = CC_SYM, ['-'] = CC_SYM, ['*'] = CC_SYM, ['%'] = CC_SYM,
+};
+
+/*
+ * Row fragments shared by several states (identifier characters, hex digits,
+ * and string literal body characters).
+ */
+#define ID_CHARS(NEXT) \
+    [CC_ZERO] = NEXT, [CC_DIGIT] = NEXT, [CC_HEXALPHA] = NEXT, [CC_X] = NEXT, \
+    [CC_ESCAPE] = NEXT, [CC_ALPHA] = NEXT, [CC_UNDERSCORE] = NEXT
+#define HEX_CHARS(NEXT) \
+    [CC_ZERO] = NEXT, [CC_DIGIT] = NEXT, [CC_HEXALPHA] = NEXT
+#define STR_CHARS(NEXT) \
+    [CC_OTHER] = NEXT, [CC_BLANK] = NEXT, [CC_ZERO] = NEXT, [CC_DIGIT] = NEXT, \
+    [CC_HEXALPHA] = NEXT, [CC_X] = NEXT, [CC_ESCAPE] = NEXT, [CC_ALPHA] = NEXT, \
+    [CC_UNDERSCORE] = NEXT, [CC_SLASH] = NEXT, [CC_LT] = NEXT, [CC_GT] = NEXT, \
+    [CC_EQ] = NEXT, [CC_BANG] = NEXT, [CC_AMP] = NEXT, [CC_PIPE] = NEXT, [CC_SYM] = NEXT
+
+/**
+ * @brief DFA transition table, indexed by [state][character class]
+ */
+static const uint8_t transitions[NUM_LEX_STATES][NUM_CHAR_CLASSES] = {
+    [ST_START] = {
+        [CC_BLANK] = ST_BLANK, [CC_CR] = ST_BLANK, [CC_NEWLINE] = ST_NEWLINE,
+        [CC_HEXALPHA] = ST_ID, [CC_X] = ST_ID, [CC_ESCAPE] = ST_ID, [CC_ALPHA] = ST_ID,
+        [CC_ZERO] = ST_ZERO, [CC_DIGIT] = ST_DEC,
+        [CC_QUOTE] = ST_STR, [CC_SLASH] = ST_SLASH,
+        [CC_LT] = ST_LT, [CC_GT] = ST_GT, [CC_EQ] = ST_EQ, [CC_BANG] = ST_BANG,
+        [CC_AMP] = ST_AMP, [CC_PIPE] = ST_PIPE, [CC_SYM] = ST_SYM1,
+    },
+    [ST_BLANK]      = { [CC_BLANK] = ST_BLANK, [CC_CR] = ST_BLANK },
+    [ST_SLASH]      = { [CC_SLASH] = ST_COMMENT },
+    [ST_COMMENT]    = { STR_CHARS(ST_COMMENT), [CC_CR] = ST_COMMENT,
+                        [CC_QUOTE] = ST_COMMENT, [CC_BACKSLASH] = ST_COMMENT },
+    [ST_ID]         = { ID_CHARS(ST_ID) },
+    [ST_ZERO]       = { [CC_X] = ST_HEX_PREFIX },
+    [ST_DEC]        = { [CC_ZERO] = ST_DEC, [CC_DIGIT] = ST_DEC },
+    [ST_HEX_PREFIX] = { [CC_ZERO] = ST_HEX_ZERO, [CC_DIGIT] = ST_HEX, [CC_HEXALPHA] = ST_HEX },
+    [ST_HEX]        = { HEX_CHARS(ST_HEX) },
+    [ST_STR]        = { STR_CHARS(ST_STR), [CC_QUOTE] = ST_STR_END, [CC_BACKSLASH] = ST_STR_ESCAPE },
+    [ST_STR_ESCAPE] = { [CC_ESCAPE] = ST_STR, [CC_QUOTE] = ST_STR, [CC_BACKSLASH] = ST_STR },
+    [ST_LT]         = { [CC_EQ] = ST_SYM2 },
+    [ST_GT]         = { [CC_EQ] = ST_SYM2 },
+    [ST_EQ]         = { [CC_EQ] = ST_SYM2 },
+    [ST_BANG]       = { [CC_EQ] = ST_SYM2 },
+    [ST_AMP]        = { [CC_AMP] = ST_SYM2 },
+    [ST_PIPE]       = { [CC_PIPE] = ST_SYM2 },
+};
+
+/**
+ * @brief Action associated with each state (@c ACT_NONE for non-accepting states)
+ */
+static const uint8_t accept_action[NUM_LEX_STATES] = {
+    [ST_BLANK]   = ACT_SKIP,    [ST_COMMENT] = ACT_SKIP,   [ST_NEWLINE] = ACT_NEWLINE,
+    [ST_ID]      = ACT_ID,
+    [ST_ZERO]    = ACT_DECLIT,  [ST_DEC]     = ACT_DECLIT,
+    [ST_HEX_ZERO] = ACT_HEXLIT, [ST_HEX]     = ACT_HEXLIT,
+    [ST_STR_END] = ACT_STRLIT,
+    [ST_SLASH]   = ACT_SYM,     [ST_LT]      = ACT_SYM,    [ST_GT] = ACT_SYM,
+    [ST_EQ]      = ACT_SYM,     [ST_BANG]    = ACT_SYM,    [ST_SYM1] = ACT_SYM,
+    [ST_SYM2]    = ACT_SYM,
+};
+
+/**
+ * @brief Scanning kernel used to skip the self-loop of a DFA state
+ */
+typedef enum LexRun {
+    RUN_NONE, RUN_IDENT, RUN_DIGITS, RUN_HEX, RUN_STRING, RUN_COMMENT
+} LexRun;
+
+/**
+ * @brief Kernel that skips the characters on which each state loops back to itself
+ */
+static const uint8_t state_run[NUM_LEX_STATES] = {
+    [ST_ID]  = RUN_IDENT,   [ST_DEC] = RUN_DIGITS,  [ST_HEX] = RUN_HEX,
+    [ST_STR] = RUN_STRING,  [ST_COMMENT] = RUN_COMMENT,
+};
+
+/**
+ * @brief Skip a run of characters using the given kernels
+ */
+static const char* skip_run (const ScanKernels* kernels, LexRun run, const char* p)
+{
+    switch (run) {
+        case RUN_IDENT:   return kernels->skip_ident(p);
+        case RUN_DIGITS:  return kernels->skip_digits(p);
+        case RUN_HEX:     return kernels->skip_hex(p);
+        case RUN_STRING:  return kernels->skip_string_body(p);
+        case RUN_COMMENT: return kernels->skip_comment(p);
+        default:          return p;
+    }
+}
+
+/**
+ * @brief Lexer state
+ *
+ * This is also the token source behind the queues returned by @ref lex_stream.
+ */
+typedef struct Lexer
+{
+    TokenSource base;           /**< @brief Token source callbacks (must come first) */
+    const char* text;           /**< @brief Start of the source text (tokens refer to it) */
+    const char* pos;            /**< @brief Next character to lex */
+    int line;                   /**< @brief Current source line */
+    const ScanKernels* kernels; /**< @brief Scanning kernels for whitespace and character runs */
+    TokenQueue* owned;          /**< @brief Queue to deallocate before throwing an error (if any) */
+} Lexer;
+
+/**
+ * @brief Report a lexing error at the given position
+ *
+ * The offending text is reported up to the next space or line break.
+ */
+static void invalid_token (Lexer* lexer, const char* start)
+{
+    size_t len = 0;
+    while (len < MAX_TOKEN_LEN - 1 && start[len] != '\0' && start[len] != ' ' &&
+           start[len] != '\n' && start[len] != '\r') {
+        len++;
+    }
+    if (lexer->owned != NULL) {
+        TokenQueue_free(lexer->owned);
+    }
+    Error_throw("Invalid token on line %d: \"%.*s\"\n", lexer->line, (int)len, start);
+}
+
+/**
+ * @brief Build a token from a span of source text and add it to the queue
+ *
+ * No text is copied; the token refers back to the source buffer.
+ */
+static void add_token (Lexer* lexer, TokenQueue* tokens, TokenType type, TokenKind kind, const char* start, size_t len)
+{
+    size_t offset = start - lexer->text;
+    if (offset + len > UINT32_MAX) {
+        if (lexer->owned != NULL) {
+            TokenQueue_free(lexer->owned);
+        }
+        Error_throw("Source text too large (over 4 GiB) on line %d\n", lexer->line);
+    }
+    TokenQueue_push(tokens, type, kind, (uint32_t)offset, (uint32_t)len, lexer->line);
+}
+
+/**
+ * @brief Lex the next token and add it to the queue
+ *
+ * @returns False if the end of the input was reached before another token
+ */
+static bool lex_next_token (Lexer* lexer, TokenQueue* tokens)
+{
+    const ScanKernels* kernels = lexer->kernels;
+    for (;;) {
+
+        /* whitespace between tokens never produces a token, so skip it in bulk */
+        const char* pos = kernels->skip_whitespace(lexer->pos, &lexer->line);
+        lexer->pos = pos;
+        if (*pos == '\0') {
+            return false;
+        }
+
+        /* run the DFA as far as it will go, remembering the last accepting state */
+        const char* start = pos;
+        const char* accept_end = NULL;
+        LexAction action = ACT_NONE;
+        uint8_t state = ST_START;
+        for (const char* p = pos; ; p++) {
+            state = transitions[state][char_class[(unsigned char)*p]];
+            if (state == ST_DEAD) {
+                break;
+            }
+            if (state_run[state] != RUN_NONE) {
+                p = skip_run(kernels, state_run[state], p + 1) - 1;
+            }
+            if (accept_action[state] != ACT_NONE) {
+                action = accept_action[state];
+                accept_end = p + 1;
+            }
+        }
+        if (action == ACT_NONE) {
+            invalid_token(lexer, start);
+        }
+        size_t len = accept_end - start;
+        lexer->pos = accept_end;
+        TokenKind kind;
+
+        switch (action) {
+            case ACT_SKIP:
+                continue;
+            case ACT_NEWLINE:
+                lexer->line++;
+                continue;
+            case ACT_ID:
+                kind = TokenKind_lookup(start, len);
+                if (kind == TK_RESERVED) {
+                    if (lexer->owned != NULL) {
+                        TokenQueue_free(lexer->owned);
+                    }
+                    Error_throw("Reserved word: \"%.*s\"\n", (int)len, start);
+                }
+                add_token(lexer, tokens, (kind == TK_NONE ? ID : KEY), kind, start, len);
+                return true;
+            case ACT_DECLIT: add_token(lexer, tokens, DECLIT, TK_NONE, start, len); return true;
+            case ACT_HEXLIT: add_token(lexer, tokens, HEXLIT, TK_NONE, start, len); return true;
+            case ACT_STRLIT: add_token(lexer, tokens, STRLIT, TK_NONE, start, len); return true;
+            case ACT_SYM:    add_token(lexer, tokens, SYM, TokenKind_lookup(start, len), start, len); return true;
+            default:
+                return true;
+        }
+    }
+}
+
+static bool Lexer_produce (TokenSource* source, TokenQueue* queue)
+{
+    return lex_next_token((Lexer*)source, queue);
+}
+
+static void Lexer_free (TokenSource* source)
+{
+    free(source);
+}
+
+TokenQueue* lex (const char* text)
+{
+    return lex_with_kernels(text, ScanKernels_scalar());
+}
+
+TokenQueue* lex_padded (const char* text)
+{
+    return lex_with_kernels(text, ScanKernels_select());
+}
+
+TokenQueue* lex_with_kernels (const char* text, const ScanKernels* kernels)
+{
+    if (text == NULL) {
+        Error_throw("Abort: NULL text pointer");
+    }
+
+    TokenQueue* tokens = TokenQueue_new_for_text(text);
+    Lexer lexer = { { NULL, NULL }, text, text, 1, kernels, tokens };
+    while (lex_next_token(&lexer, tokens)) {
+        /* keep going until the end of the input */
+    }
+    return tokens;
+}
+
+/**
+ * @brief Create a streaming queue that scans with the given kernels
+ */
+static TokenQueue* lex_stream_with_kernels (const char* text, const ScanKernels* kernels)
+{
+    if (text == NULL) {
+        Error_throw("Abort: NULL text pointer");
+    }
+
+    Lexer* lexer = (Lexer*)calloc(1, sizeof(Lexer));
+    CHECK_MALLOC_PTR(lexer)
+    lexer->base.produce = Lexer_produce;
+    lexer->base.free = Lexer_free;
+    lexer->text = text;
+    lexer->pos = text;
+    lexer->line = 1;
+    lexer->kernels = kernels;
+    lexer->owned = NULL;
+    return TokenQueue_new_streaming(text, &lexer->base);
+}
+
+TokenQueue* lex_stream (const char* text)
+{
+    return lex_stream_with_kernels(text, ScanKernels_scalar());
+}
+
+TokenQueue* lex_stream_padded (const char* text)
+{
+    return lex_stream_with_kernels(text, ScanKernels_select());
+}
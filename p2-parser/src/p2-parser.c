@@ -6,6 +6,7 @@
  * AI STATEMENT : we did not use AI for any part of this project.
  */
 
+#include "p1-lexer.h"
 #include "p2-parser.h"
 
 /*
@@ -21,32 +22,30 @@
 int get_next_token_line (TokenQueue* input)
 {
     if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
+        Error_throw("Unexpected end of input\n");
     }
-    return TokenQueue_peek(input)->line;
+    return TokenQueue_peek(input).line;
 }
 
 /**
- * @brief Check next token for a particular type and text and discard it
+ * @brief Check next token for a particular keyword or symbol and discard it
  * 
  * Throws an error if there are no more tokens or if the next token in the
- * queue does not match the given type or text.
+ * queue is not the given keyword or symbol.
  * 
  * @param input Token queue to modify
- * @param type Expected type of next token
- * @param text Expected text of next token
+ * @param kind Expected kind of next token
  */
-void match_and_discard_next_token (TokenQueue* input, TokenType type, const char* text)
+void match_and_discard_next_kind (TokenQueue* input, TokenKind kind)
 {
     if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input (expected \'%s\')\n", text);
+        Error_throw("Unexpected end of input (expected \'%s\')\n", TokenKind_to_string(kind));
     }
-    Token* token = TokenQueue_remove(input);
-    if (token->type != type || !token_str_eq(token->text, text)) {
-        Error_throw_printf("Expected \'%s\' but found '%s' on line %d\n",
-                text, token->text, get_next_token_line(input));
+    Token token = TokenQueue_remove(input);
+    if (token.kind != kind) {
+        Error_throw("Expected \'%s\' but found '%.*s' on line %d\n", TokenKind_to_string(kind),
+                (int)token.span.length, Token_text(&token), get_next_token_line(input));
     }
-    Token_free(token);
 }
 
 /**
@@ -59,9 +58,9 @@ void match_and_discard_next_token (TokenQueue* input, TokenType type, const char
 void discard_next_token (TokenQueue* input)
 {
     if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
+        Error_throw("Unexpected end of input\n");
     }
-    Token_free(TokenQueue_remove(input));
+    TokenQueue_remove(input);
 }
 
 /**
@@ -76,25 +75,63 @@ bool check_next_token_type (TokenQueue* input, TokenType type)
     if (TokenQueue_is_empty(input)) {
         return false;
     }
-    Token* token = TokenQueue_peek(input);
-    return (token->type == type);
+    Token token = TokenQueue_peek(input);
+    return (token.type == type);
 }
 
 /**
- * @brief Look ahead at the type and text of the next token
+ * @brief Look ahead at the keyword or symbol kind of the next token
  * 
  * @param input Token queue to examine
- * @param type Expected type of next token
- * @param text Expected text of next token
- * @returns True if the next token is of the expected type and text, false if not
+ * @param kind Expected kind of next token
+ * @returns True if the next token is of the expected kind, false if not
  */
-bool check_next_token (TokenQueue* input, TokenType type, const char* text)
+bool check_next_kind (TokenQueue* input, TokenKind kind)
 {
-    if (TokenQueue_is_empty(input)) {
-        return false;
-    }
-    Token* token = TokenQueue_peek(input);
-    return (token->type == type) && (token_str_eq(token->text, text));
+    return TokenQueue_peek(input).kind == kind;
+}
+
+/**
+ * @brief Look further ahead at the keyword or symbol kind of a token
+ *
+ * Only the tokens up to the one examined are pulled from a streaming queue.
+ *
+ * @param input Token queue to examine
+ * @param k Number of tokens to look past (zero is the same as
+ * @ref check_next_kind)
+ * @param kind Expected kind of the token
+ * @returns True if the token exists and is of the expected kind, false if not
+ */
+bool check_kind_ahead (TokenQueue* input, size_t k, TokenKind kind)
+{
+    return TokenQueue_peek_ahead(input, k).kind == kind;
+}
+
+/**
+ * @brief Check whether a token kind is one of the type keywords
+ *
+ * @param kind Kind to check
+ * @returns True if and only if the kind is @c int, @c bool, or @c void
+ */
+static bool is_type_kind (TokenKind kind)
+{
+    return kind == TK_INT || kind == TK_BOOL || kind == TK_VOID;
+}
+
+/**
+ * @brief Record a newly-built interior node as the parent of its children
+ *
+ * Children are always built before their parent, so construction is the
+ * point at which both ends of every link are known (see @ref
+ * ASTNode_set_child_parents).
+ *
+ * @param node Newly-built node
+ * @returns The same node
+ */
+static ASTNode* link_children (ASTNode* node)
+{
+    ASTNode_set_child_parents(node);
+    return node;
 }
 
 /**
@@ -106,44 +143,64 @@ bool check_next_token (TokenQueue* input, TokenType type, const char* text)
 DecafType parse_type (TokenQueue* input)
 {
     if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input (expected type)\n");
-    }
-    Token* token = TokenQueue_remove(input);
-    if (token->type != KEY) {
-        Error_throw_printf("Invalid type '%s' on line %d\n", token->text, get_next_token_line(input));
+        Error_throw("Unexpected end of input (expected type)\n");
     }
-    DecafType t = VOID;
-    if (token_str_eq("int", token->text)) {
-        t = INT;
-    } else if (token_str_eq("bool", token->text)) {
-        t = BOOL;
-    } else if (token_str_eq("void", token->text)) {
-        t = VOID;
-    } else {
-        Error_throw_printf("Invalid type '%s' on line %d\n", token->text, get_next_token_line(input));
+    Token token = TokenQueue_remove(input);
+    switch (token.kind) {
+        case TK_INT:    return INT;
+        case TK_BOOL:   return BOOL;
+        case TK_VOID:   return VOID;
+        default:
+            Error_throw("Invalid type '%.*s' on line %d\n",
+                    (int)token.span.length, Token_text(&token), get_next_token_line(input));
     }
-    Token_free(token);
-    return t;
+    return VOID;
 }
 
 /**
  * @brief Parse and return a Decaf identifier
  * 
  * @param input Token queue to modify
- * @param buffer String buffer for parsed identifier (should be at least
- * @c MAX_TOKEN_LEN characters long)
+ * @returns Interned identifier (see intern.h)
  */
-void parse_id (TokenQueue* input, char* buffer)
+const char* parse_id (TokenQueue* input)
 {
     if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input (expected identifier)\n");
+        Error_throw("Unexpected end of input (expected identifier)\n");
+    }
+    Token token = TokenQueue_remove(input);
+    if (token.type != ID) {
+        Error_throw("Invalid ID '%.*s' on line %d\n",
+                (int)token.span.length, Token_text(&token), get_next_token_line(input));
+    }
+    return intern(Token_text(&token), token.span.length);
+}
+
+/**
+ * @brief Convert an integer literal token to its value
+ *
+ * Token text is not NUL-terminated, so short literals are copied to a stack
+ * buffer (and longer ones to the heap) for @c strtol.
+ *
+ * @param token Token to convert
+ * @param base Numeric base (16 for hex literals, with or without the prefix)
+ * @returns Value of the literal
+ */
+static int token_to_int (const Token* token, int base)
+{
+    char buffer[32];
+    char* text = buffer;
+    if (token->span.length < sizeof(buffer)) {
+        memcpy(buffer, Token_text(token), token->span.length);
+        buffer[token->span.length] = '\0';
+    } else {
+        text = Token_text_dup(token);
     }
-    Token* token = TokenQueue_remove(input);
-    if (token->type != ID) {
-        Error_throw_printf("Invalid ID '%s' on line %d\n", token->text, get_next_token_line(input));
+    int value = (int)strtol(text, NULL, base);
+    if (text != buffer) {
+        free(text);
     }
-    snprintf(buffer, MAX_ID_LEN, "%s", token->text);
-    Token_free(token);
+    return value;
 }
 
 ASTNode* parse_expr(TokenQueue* input); // for use in location and args
@@ -152,43 +209,49 @@ ASTNode* parse_lit(TokenQueue* input)
 {
   int curline = get_next_token_line(input);
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
-  Token* t = TokenQueue_peek(input);
+  Token t = TokenQueue_peek(input);
   ASTNode* lit = NULL;
-  if (t->type == HEXLIT) { // TODO hex
-    int num = (int)strtol(t->text, NULL, 16);
+  if (t.type == HEXLIT) { // hex
+    int num = token_to_int(&t, 16);
     lit = LiteralNode_new_int(num, curline);
-  } else if (t->type == STRLIT) { // TODO string 
-    int i = 1;
-    int j = 0;
-    char text[MAX_TOKEN_LEN];
-    while (i < sizeof(t->text) && (t->text[i]) && (t->text[i] != '"')) {
-      if (t->text[i] == '\\') {
-        if (t->text[i + 1] == 'n') {
+  } else if (t.type == STRLIT) { // string (decoded from the token's source text)
+    const char* raw = Token_text(&t);
+    size_t len = t.span.length - 1; // closing quote
+    size_t i = 1;
+    size_t j = 0;
+    char* text = (char*)malloc(len);
+    CHECK_MALLOC_PTR(text)
+    while (i < len) {
+      if (raw[i] == '\\') {
+        if (raw[i + 1] == 'n') {
           text[j++] = '\n';
-        } else if (t->text[i + 1] == 't') {
+        } else if (raw[i + 1] == 't') {
           text[j++] = '\t';
-        } else if (t->text[i + 1] == 'r') {
+        } else if (raw[i + 1] == 'r') {
           text[j++] = '\r';
+        } else if (raw[i + 1] == '"' || raw[i + 1] == '\\') {
+          text[j++] = raw[i + 1];
         }
         i += 2;
       } else {
-        text[j++] = t->text[i];
+        text[j++] = raw[i];
         i += 1;
       }
     }
     text[j] = '\0';
     lit = LiteralNode_new_string(text, curline);
-  } else if (t->type == DECLIT) { // int
-    int num = atoi(t->text);
+    free(text);
+  } else if (t.type == DECLIT) { // int
+    int num = token_to_int(&t, 10);
     lit = LiteralNode_new_int(num, curline);
-  } else if (token_str_eq(t->text, "true")) { // true bool
+  } else if (t.kind == TK_TRUE) { // true bool
     lit = LiteralNode_new_bool(true, curline);
-  } else if (token_str_eq(t->text, "false")) { // false bool
+  } else if (t.kind == TK_FALSE) { // false bool
     lit = LiteralNode_new_bool(false, curline);
   } else {
-    Error_throw_printf("Unexpected literal\n");
+    Error_throw("Unexpected literal\n");
   }
   discard_next_token(input);
   return lit;
@@ -197,41 +260,40 @@ ASTNode* parse_lit(TokenQueue* input)
 ASTNode* parse_vardecl(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   int line = get_next_token_line(input);
   DecafType t = parse_type(input);
-  char NAME[MAX_TOKEN_LEN];
-  parse_id(input, NAME);
+  const char* name = parse_id(input);
   int arraylen = 1;
   bool isarray = false;
-  if (check_next_token(input, SYM, "[")) { // parse arrays
+  if (check_next_kind(input, TK_LBRACKET)) { // parse arrays
     isarray = true;
-    match_and_discard_next_token (input, SYM, "[");
-    while (!check_next_token (input, SYM, "]")) {
+    match_and_discard_next_kind(input, TK_LBRACKET);
+    while (!check_next_kind(input, TK_RBRACKET)) {
       discard_next_token(input);
       arraylen += 1;
     }
-    match_and_discard_next_token (input, SYM, "]");
+    match_and_discard_next_kind(input, TK_RBRACKET);
   }
-  match_and_discard_next_token(input, SYM, ";");
+  match_and_discard_next_kind(input, TK_SEMICOLON);
 
-  ASTNode* val = VarDeclNode_new(NAME, t, isarray, arraylen, line);
+  ASTNode* val = VarDeclNode_new(name, t, isarray, arraylen, line);
   return val;
 }
 
 NodeList* parse_args(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   NodeList* args = NodeList_new();
-  if (check_next_token(input, SYM, ")")) { // returns if no arguments
+  if (check_next_kind(input, TK_RPAREN)) { // returns if no arguments
     return args;
   }
   NodeList_add(args, parse_expr(input));
-  while (token_str_eq(TokenQueue_peek(input)->text, ",")) { // checks for multiple arguments
-    match_and_discard_next_token(input, SYM, ",");
+  while (check_next_kind(input, TK_COMMA)) { // checks for multiple arguments
+    match_and_discard_next_kind(input, TK_COMMA);
     NodeList_add(args, parse_expr(input));
   }
   return args; // returns node list
@@ -240,153 +302,156 @@ NodeList* parse_args(TokenQueue* input)
 ASTNode* parse_funccall(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   int curline = get_next_token_line(input);
-  char FUNCNAME[MAX_TOKEN_LEN];
-  parse_id(input, FUNCNAME);
-  match_and_discard_next_token(input, SYM, "(");
-  return FuncCallNode_new(FUNCNAME, parse_args(input), curline);
+  const char* funcname = parse_id(input);
+  match_and_discard_next_kind(input, TK_LPAREN);
+  NodeList* args = parse_args(input);
+  match_and_discard_next_kind(input, TK_RPAREN);
+  return link_children(FuncCallNode_new(funcname, args, curline));
 }
 
 ASTNode* parse_loc(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   int curline = get_next_token_line(input);
   ASTNode* array_expr = NULL;
-  char LOCNAME[MAX_TOKEN_LEN];
-  parse_id(input, LOCNAME);
-  if (check_next_token(input, SYM, "[")) { // parse arrays
-    match_and_discard_next_token(input, SYM, "[");
+  const char* locname = parse_id(input);
+  if (check_next_kind(input, TK_LBRACKET)) { // parse arrays
+    match_and_discard_next_kind(input, TK_LBRACKET);
     array_expr = parse_expr(input);
-    match_and_discard_next_token(input, SYM, "]");
+    match_and_discard_next_kind(input, TK_RBRACKET);
   }
-  return LocationNode_new(LOCNAME, array_expr, curline);
+  ASTNode* loc = link_children(LocationNode_new(locname, array_expr, curline));
+  return loc;
 }
 
 ASTNode* parse_baseexpr(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   ASTNode* base = NULL;
-  Token* t = TokenQueue_peek(input);
-  if (token_str_eq(t->text, "(")) { // looks for nexted expression
+  Token t = TokenQueue_peek(input);
+  if (t.kind == TK_LPAREN) { // looks for nexted expression
+    match_and_discard_next_kind(input, TK_LPAREN);
     base = parse_expr(input);
-  } else if (token_str_eq(t->next->text, "(")) { // checks if not nested expession for funccall
+    match_and_discard_next_kind(input, TK_RPAREN);
+  } else if (check_kind_ahead(input, 1, TK_LPAREN)) { // checks if not nested expession for funccall
     base = parse_funccall(input);
-  } else if (t->type == DECLIT || t->type == HEXLIT || t->type == STRLIT || token_str_eq(t->text, "true") || token_str_eq(t->text, "false")) {
+  } else if (t.type == DECLIT || t.type == HEXLIT || t.type == STRLIT || t.kind == TK_TRUE || t.kind == TK_FALSE) {
     base = parse_lit(input);
-  } else if (t->type == ID) { // checks if not funccall if ID it is a loc
+  } else if (t.type == ID) { // checks if not funccall if ID it is a loc
     base = parse_loc(input);
   } else {
-    Error_throw_printf("Unidentifiable base expression\n");
+    Error_throw("Unidentifiable base expression\n");
   }
   return base;
 }
 
-const UnaryOpType StringToUnaryOp(char* op)
+/**
+ * @brief How a token acts as an operator in an expression
+ */
+typedef struct OperatorInfo
 {
-  if (strcmp(op, "-") == 0) {
-    return NEGOP;
-  } else if (strcmp(op, "!") == 0) {
-    return NOTOP;
-  } else {
-    Error_throw_printf("Unidentifiable unary operator\n");
-  }
-  return NEGOP;
-}
+    uint8_t binary_power;       /**< @brief Binding power as a binary operator (zero if it
+                                            is not one, higher binds tighter) */
+    BinaryOpType binary;        /**< @brief Binary operator (if @c binary_power is not zero) */
+    bool is_unary;              /**< @brief True if the token is a prefix (unary) operator */
+    UnaryOpType unary;          /**< @brief Unary operator (if @c is_unary) */
+} OperatorInfo;
+
+/**
+ * @brief Operators indexed by token kind, from loosest to tightest binding
+ *
+ * All binary operators are left-associative, and the unary operators bind
+ * tighter than any of them. Tokens that are not binary operators have a
+ * binding power of zero, which ends an expression.
+ */
+static const OperatorInfo operators[NUM_TOKEN_KINDS] = {
+    [TK_OR]      = { 1, OROP  },
+    [TK_AND]     = { 2, ANDOP },
+    [TK_EQ]      = { 3, EQOP  },
+    [TK_NE]      = { 3, NEQOP },
+    [TK_LT]      = { 4, LTOP  },
+    [TK_LE]      = { 4, LEOP  },
+    [TK_GE]      = { 4, GEOP  },
+    [TK_GT]      = { 4, GTOP  },
+    [TK_PLUS]    = { 5, ADDOP },
+    [TK_MINUS]   = { 5, SUBOP, true, NEGOP },
+    [TK_STAR]    = { 6, MULOP },
+    [TK_SLASH]   = { 6, DIVOP },
+    [TK_PERCENT] = { 6, MODOP },
+    [TK_BANG]    = { 0, OROP,  true, NOTOP },
+};
 
-ASTNode* parse_unaryexpr(TokenQueue* input)
+/**
+ * @brief Parse an operand of a binary operator: a base expression, possibly
+ * after unary operators (which bind tighter than any binary one)
+ *
+ * @param input Token queue to modify
+ * @returns Parsed operand
+ */
+static ASTNode* parse_operand(TokenQueue* input)
 {
-  if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
-  }
   int curline = get_next_token_line(input);
-  UnaryOpType op;
-  bool opisnull = true;
-  char *unop[] = {"-", "!"};
-  for (int i = 0; i < sizeof(unop)/sizeof(unop[0]); i++) {
-    if (token_str_eq(unop[i], TokenQueue_peek(input)->text)) {
-      op = StringToUnaryOp(unop[i]);
-      discard_next_token(input);
-      opisnull = false;
-    }
-  }
-  ASTNode* child = parse_baseexpr(input);
-  if (opisnull) {
-    return child;
-  } else {
-    return UnaryOpNode_new(op, child, curline);
+  const OperatorInfo* prefix = &operators[TokenQueue_peek(input).kind];
+  if (!prefix->is_unary) {
+    return parse_baseexpr(input);
   }
+  discard_next_token(input); // unary operators nest (e.g., "- - x")
+  return link_children(UnaryOpNode_new(prefix->unary, parse_operand(input), curline));
 }
 
-const BinaryOpType StringToBinaryOp(char* op)
-{
-  if (strcmp(op, "||") == 0) {
-    return OROP;
-  } else if (strcmp(op, "&&") == 0) {
-    return ANDOP;
-  } else if (strcmp(op, "==") == 0) {
-    return EQOP;
-  } else if (strcmp(op, "!=") == 0) {
-    return NEQOP;
-  } else if (strcmp(op, "<") == 0) {
-    return LTOP;
-  } else if (strcmp(op, "<=") == 0) {
-    return LEOP;
-  } else if (strcmp(op, ">=") == 0) {
-    return GEOP;
-  } else if (strcmp(op, ">") == 0) {
-    return GTOP;
-  } else if (strcmp(op, "+") == 0) {
-    return ADDOP;
-  } else if (strcmp(op, "-") == 0) {
-    return SUBOP;
-  } else if (strcmp(op, "*") == 0) {
-    return MULOP;
-  } else if (strcmp(op, "/") == 0) {
-    return DIVOP;
-  } else if (strcmp(op, "%") == 0) {
-    return MODOP;
-  } else {
-    Error_throw_printf("Unidentifiable binary operator\n");
+/**
+ * @brief Extend an expression with the binary operators that follow it, as
+ * long as they bind tighter than a given power (precedence climbing)
+ *
+ * Operators of the same power are folded to the left in a loop; a nested
+ * call is needed only where the next operator binds tighter than the one
+ * before it, so apart from parentheses the nesting depth is bounded by the
+ * number of power levels.
+ *
+ * @param input Token queue to modify
+ * @param left Expression parsed so far
+ * @param min_power Binding power that an operator must exceed to take the
+ * expression as its left operand
+ * @param line Source line where the expression begins
+ * @returns Parsed expression
+ */
+static ASTNode* parse_operators(TokenQueue* input, ASTNode* left, int min_power, int line)
+{
+  for (;;) {
+    const OperatorInfo* infix = &operators[TokenQueue_peek(input).kind];
+    if (infix->binary_power <= min_power) {
+      return left;
+    }
+    discard_next_token(input);
+    int right_line = get_next_token_line(input);
+    ASTNode* right = parse_operand(input);
+    if (operators[TokenQueue_peek(input).kind].binary_power > infix->binary_power) {
+      right = parse_operators(input, right, infix->binary_power, right_line);
+    }
+    left = link_children(BinaryOpNode_new(infix->binary, left, right, line));
   }
-  return OROP;
 }
 
 ASTNode* parse_binexpr(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   int curline = get_next_token_line(input);
-  BinaryOpType op;
-  bool opisnull = true;
-  ASTNode* left = parse_unaryexpr(input);
-  ASTNode* right = NULL;
-  char *binop[] = {"||", "&&", "==", "!=", "<", "<=", ">=", ">", "+", "-", "*", "/", "%"};
-  for (int i = 0; i < sizeof(binop)/sizeof(binop[0]); i++) {
-    if (token_str_eq(binop[i], TokenQueue_peek(input)->text)) {
-      op = StringToBinaryOp(binop[i]);
-      opisnull = false;
-      discard_next_token(input);
-      right = parse_unaryexpr(input);
-    }
-  }
-  if (opisnull) {
-    return left;
-  } else {
-    return BinaryOpNode_new(op, left, right, curline);
-  }
+  return parse_operators(input, parse_operand(input), 0, curline);
 }
 
 ASTNode* parse_expr(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   return parse_binexpr(input);
 }
@@ -396,57 +461,76 @@ ASTNode* parse_block(TokenQueue* input); // declare so can be referenced by pars
 ASTNode* parse_stmt(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   int curline = get_next_token_line(input);
   ASTNode* stmt = NULL;
-  Token* token = TokenQueue_peek(input);
-  if (token_str_eq((token->next)->text, "=") || token_str_eq((token->next)->text, "[")) { // assignment or array assignment
-    ASTNode* lookup = parse_loc(input);
-    match_and_discard_next_token(input, SYM, "=");
-    ASTNode* expr = parse_expr(input);
-    stmt = AssignmentNode_new(lookup, expr, curline);
-    match_and_discard_next_token(input, SYM, ";");
-  } else if (token_str_eq(token->text, "if")) { // if condition
-    match_and_discard_next_token(input, KEY, "if");
-    match_and_discard_next_token(input, SYM, "(");
-    ASTNode* expr = parse_expr(input);
-    match_and_discard_next_token(input, SYM, ")");
-    ASTNode* body = parse_block(input);
-    ASTNode* body_else = NULL;
-    if (token_str_eq(TokenQueue_peek(input)->text, "else")) { // else condition
-      match_and_discard_next_token(input, KEY, "else");
-      body_else = parse_block(input);
+  Token token = TokenQueue_peek(input);
+  switch (token.kind) {
+    case TK_IF: { // if condition
+      match_and_discard_next_kind(input, TK_IF);
+      match_and_discard_next_kind(input, TK_LPAREN);
+      ASTNode* expr = parse_expr(input);
+      match_and_discard_next_kind(input, TK_RPAREN);
+      ASTNode* body = parse_block(input);
+      ASTNode* body_else = NULL;
+      if (check_next_kind(input, TK_ELSE)) { // else condition
+        match_and_discard_next_kind(input, TK_ELSE);
+        body_else = parse_block(input);
+      }
+      stmt = link_children(ConditionalNode_new(expr, body, body_else, curline));
+      break;
     }
-    stmt = ConditionalNode_new(expr, body, body_else, curline);
-  } else if (token_str_eq(token->text, "while")) { // while loop
-    match_and_discard_next_token(input, KEY, "while");
-    match_and_discard_next_token(input, SYM, "(");
-    ASTNode* expr = parse_expr(input);
-    match_and_discard_next_token(input, SYM, ")");
-    ASTNode* body = parse_block(input);
-    stmt = WhileLoopNode_new(expr, body, curline);
-  } else if (token_str_eq(token->text, "return")) { // return
-    ASTNode* type = NULL;
-    match_and_discard_next_token(input, KEY, "return");
-    if (!check_next_token(input, SYM, ";")) {
-      type = parse_expr(input);
+    case TK_WHILE: { // while loop
+      match_and_discard_next_kind(input, TK_WHILE);
+      match_and_discard_next_kind(input, TK_LPAREN);
+      ASTNode* expr = parse_expr(input);
+      match_and_discard_next_kind(input, TK_RPAREN);
+      ASTNode* body = parse_block(input);
+      stmt = link_children(WhileLoopNode_new(expr, body, curline));
+      break;
     }
-    stmt = ReturnNode_new(type, curline);
-    match_and_discard_next_token(input, SYM, ";");
-  } else if (token_str_eq(token->text, "break")) { // break
-    stmt = BreakNode_new(curline);
-    match_and_discard_next_token(input, KEY, "break");
-    match_and_discard_next_token(input, SYM, ";");
-  } else if (token_str_eq(token->text, "continue")) { // continue
-    stmt = ContinueNode_new(curline);
-    match_and_discard_next_token(input, KEY, "continue");
-    match_and_discard_next_token(input, SYM, ";");
-  } else if (token_str_eq((token->next)->text, "(")) { // checks if function name
-    stmt = parse_funccall(input);
-    match_and_discard_next_token(input, SYM, ";");
-  } else {
-    Error_throw_printf("Unexpected token in block\n");
+    case TK_RETURN: { // return
+      ASTNode* type = NULL;
+      match_and_discard_next_kind(input, TK_RETURN);
+      if (!check_next_kind(input, TK_SEMICOLON)) {
+        type = parse_expr(input);
+      }
+      stmt = link_children(ReturnNode_new(type, curline));
+      match_and_discard_next_kind(input, TK_SEMICOLON);
+      break;
+    }
+    case TK_BREAK: // break
+      stmt = BreakNode_new(curline);
+      match_and_discard_next_kind(input, TK_BREAK);
+      match_and_discard_next_kind(input, TK_SEMICOLON);
+      break;
+    case TK_CONTINUE: // continue
+      stmt = ContinueNode_new(curline);
+      match_and_discard_next_kind(input, TK_CONTINUE);
+      match_and_discard_next_kind(input, TK_SEMICOLON);
+      break;
+    default:
+      if (token.type != ID) {
+        Error_throw("Unexpected token in block\n");
+      }
+      switch (TokenQueue_peek_ahead(input, 1).kind) {
+        case TK_ASSIGN:
+        case TK_LBRACKET: { // assignment or array assignment
+          ASTNode* lookup = parse_loc(input);
+          match_and_discard_next_kind(input, TK_ASSIGN);
+          ASTNode* expr = parse_expr(input);
+          stmt = link_children(AssignmentNode_new(lookup, expr, curline));
+          match_and_discard_next_kind(input, TK_SEMICOLON);
+          break;
+        }
+        case TK_LPAREN: // function call
+          stmt = parse_funccall(input);
+          match_and_discard_next_kind(input, TK_SEMICOLON);
+          break;
+        default:
+          Error_throw("Unexpected token in block\n");
+      }
   }
   return stmt;
 }
@@ -454,41 +538,40 @@ ASTNode* parse_stmt(TokenQueue* input)
 ASTNode* parse_block(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   int curline = get_next_token_line(input);
-  match_and_discard_next_token(input, SYM, "{");
+  match_and_discard_next_kind(input, TK_LBRACE);
   NodeList* vars = NodeList_new();
   NodeList* stmts = NodeList_new();
   ASTNode* val = NULL;
-  if (check_next_token(input, SYM, "}")) { // checks for empty block
-    match_and_discard_next_token(input, SYM, "}");
+  if (check_next_kind(input, TK_RBRACE)) { // checks for empty block
+    match_and_discard_next_kind(input, TK_RBRACE);
     return val;
   }
-  while (check_next_token(input, KEY, "int") || check_next_token(input, KEY, "bool") || check_next_token(input, KEY, "void")) {
+  while (is_type_kind(TokenQueue_peek(input).kind)) {
     NodeList_add(vars, parse_vardecl(input)); // checks for variables and adds them to a node list
   }
   while (check_next_token_type(input, KEY) || check_next_token_type(input, ID)) { // checks for lookups and statments
     NodeList_add(stmts, parse_stmt(input)); // checks for variables and adds them to a node list
   }
-  val = BlockNode_new(vars, stmts, curline);
-  match_and_discard_next_token(input, SYM, "}");
+  val = link_children(BlockNode_new(vars, stmts, curline));
+  match_and_discard_next_kind(input, TK_RBRACE);
   return val;
 }
 
 ParameterList* parse_param(TokenQueue* input)
 {
   ParameterList* params = ParameterList_new();
-  while (!check_next_token(input, SYM, ")")) {
-    if (!check_next_token(input, KEY, "int") && !check_next_token(input, KEY, "bool") && !check_next_token(input, KEY, "void")) {
-      Error_throw_printf("invalid parameter type\n");
+  while (!check_next_kind(input, TK_RPAREN)) {
+    if (!is_type_kind(TokenQueue_peek(input).kind)) {
+      Error_throw("invalid parameter type\n");
     }
     DecafType paramt = parse_type(input);
-    char NAME[MAX_TOKEN_LEN];
-    parse_id(input, NAME);
-    ParameterList_add_new(params, NAME, paramt);
-    if (!check_next_token(input, SYM, ")")) { // check if not last param
-      match_and_discard_next_token(input, SYM, ",");
+    const char* name = parse_id(input);
+    ParameterList_add_new(params, name, paramt);
+      if (!check_next_kind(input, TK_RPAREN)) { // check if not last param
+      match_and_discard_next_kind(input, TK_COMMA);
     }
   }
   return params;
@@ -497,21 +580,20 @@ ParameterList* parse_param(TokenQueue* input)
 ASTNode* parse_funcdecl(TokenQueue* input)
 {
   if (TokenQueue_is_empty(input)) {
-    Error_throw_printf("Unexpected end of input (expected identifier)\n");
+    Error_throw("Unexpected end of input (expected identifier)\n");
   }
   ParameterList* params = ParameterList_new();
   int line = get_next_token_line(input);
   discard_next_token(input); // discard def
   DecafType t = parse_type(input); // return type
-  char FUNCNAME[MAX_TOKEN_LEN];
-  parse_id(input, FUNCNAME);
-  match_and_discard_next_token(input, SYM, "("); // start of params
-  if (!check_next_token(input, SYM, ")")) { // check if not empty
+  const char* funcname = parse_id(input);
+  match_and_discard_next_kind(input, TK_LPAREN); // start of params
+  if (!check_next_kind(input, TK_RPAREN)) { // check if not empty
     params = parse_param(input);
   }
-  match_and_discard_next_token(input, SYM, ")");
+  match_and_discard_next_kind(input, TK_RPAREN);
   ASTNode* block = parse_block(input);
-  ASTNode* val = FuncDeclNode_new(FUNCNAME, t, params, block, line);
+  ASTNode* val = link_children(FuncDeclNode_new(funcname, t, params, block, line));
   return val;
 }
 
@@ -525,26 +607,547 @@ ASTNode* parse_program (TokenQueue* input) // reject invalid programs and func p
     NodeList* funcs = NodeList_new();
 
     if (input == NULL) {
-      Error_throw_printf("NULL token queue\n");
+      Error_throw("NULL token queue\n");
       ASTNode* error = NULL;
       return error;
     }
     
     while (!TokenQueue_is_empty(input)) {
-      Token* start = TokenQueue_peek(input);
-      if (strcmp(start->text, "int") == 0 || strcmp(start->text, "bool") == 0 || strcmp(start->text, "void") == 0) {
-        NodeList_add(vars, parse_vardecl(input));
-      } else if (strcmp(start->text, "def") == 0) {
-        NodeList_add(funcs, parse_funcdecl(input));
-      } else {
-        Error_throw_printf("Unexpected input (expected Variable or Function)\n");
+      switch (TokenQueue_peek(input).kind) {
+        case TK_INT:
+        case TK_BOOL:
+        case TK_VOID:
+          NodeList_add(vars, parse_vardecl(input));
+          break;
+        case TK_DEF:
+          NodeList_add(funcs, parse_funcdecl(input));
+          break;
+        default:
+          Error_throw("Unexpected input (expected Variable or Function)\n");
+      }
+    }
+
+    return link_children(ProgramNode_new(vars, funcs));
+}
+
+/*
+ * explicit-stack parsing (see PARSER_STACK)
+ */
+
+/**
+ * @brief Point at which a frame of the explicit-stack parser resumes
+ *
+ * Each group of states stands for one of the recursive parsing functions
+ * above: the first state of a group is its entry point, and the others are
+ * where it continues after a nested construct has been parsed (its value is
+ * then in the machine's result register).
+ */
+typedef enum ParseState
+{
+    PS_PROGRAM, PS_PROGRAM_FUNCTION,
+    PS_FUNCDECL, PS_FUNCDECL_BODY,
+    PS_BLOCK, PS_BLOCK_STATEMENTS, PS_BLOCK_STATEMENT,
+    PS_STMT, PS_IF_CONDITION, PS_IF_BODY, PS_IF_ELSE, PS_WHILE_CONDITION, PS_WHILE_BODY,
+    PS_RETURN_VALUE, PS_ASSIGN_LOCATION, PS_ASSIGN_VALUE, PS_CALL_STMT,
+    PS_LOCATION, PS_LOCATION_INDEX,
+    PS_FUNCCALL, PS_FUNCCALL_ARG, PS_FUNCCALL_END,
+    PS_EXPR, PS_EXPR_OPERAND,
+    PS_OPERAND, PS_OPERAND_UNARY,
+    PS_BASEEXPR, PS_BASEEXPR_PAREN,
+    PS_OPERATORS, PS_OPERATORS_RIGHT, PS_OPERATORS_COMBINE
+} ParseState;
+
+/**
+ * @brief Activation record of the explicit-stack parser (the local variables
+ * of the recursive function that it stands for)
+ */
+typedef struct ParseFrame
+{
+    ParseState state;           /**< @brief Where to resume */
+    int line;                   /**< @brief Source line of the construct */
+    int right_line;             /**< @brief Source line of a binary operator's right operand */
+    int min_power;              /**< @brief Binding power that operators must exceed */
+    const OperatorInfo* op;     /**< @brief Operator being parsed */
+    ASTNode* left;              /**< @brief Left operand, condition, or location so far */
+    ASTNode* body;              /**< @brief Body of a conditional */
+    NodeList* first;            /**< @brief Variables (or arguments) collected so far */
+    NodeList* second;           /**< @brief Statements (or functions) collected so far */
+    const char* name;           /**< @brief Name of a function or location */
+    ParameterList* params;      /**< @brief Parameters of a function */
+    DecafType type;             /**< @brief Return type of a function */
+} ParseFrame;
+
+/**
+ * @brief Frames of the explicit-stack parser
+ *
+ * Each thread keeps one stack; @ref parse releases its storage when a parse
+ * finishes or fails.
+ */
+typedef struct ParseStack
+{
+    ParseFrame* frames;         /**< @brief Active frames (innermost last) */
+    size_t count;               /**< @brief Number of active frames */
+    size_t capacity;            /**< @brief Allocated length of @c frames */
+} ParseStack;
+
+static _Thread_local ParseStack parse_stack;
+
+/**
+ * @brief Push a frame that starts parsing a construct
+ *
+ * Pushing may move the stack, so pointers to other frames must not be used
+ * afterwards.
+ *
+ * @param state Entry state of the construct
+ * @returns New frame
+ */
+static ParseFrame* push_frame(ParseState state)
+{
+  ParseStack* stack = &parse_stack;
+  if (stack->count == stack->capacity) {
+    stack->capacity = (stack->capacity == 0 ? 64 : stack->capacity * 2);
+    stack->frames = (ParseFrame*)realloc(stack->frames, stack->capacity * sizeof(ParseFrame));
+    CHECK_MALLOC_PTR(stack->frames)
+  }
+  ParseFrame* frame = &stack->frames[stack->count++];
+  frame->state = state;
+  return frame;
+}
+
+/**
+ * @brief Release the explicit-stack parser's storage
+ */
+static void free_parse_stack(void)
+{
+  free(parse_stack.frames);
+  parse_stack.frames = NULL;
+  parse_stack.count = parse_stack.capacity = 0;
+}
+
+/**
+ * @brief Continue the current frame at state @c NEXT once a nested construct
+ * starting at state @c START has been parsed
+ */
+#define CALL(NEXT, START) { frame->state = (NEXT); push_frame(START); break; }
+
+/**
+ * @brief Finish the current frame with a value
+ */
+#define RETURN(VALUE) { result = (VALUE); parse_stack.count--; break; }
+
+/**
+ * @brief Parse a program with an explicit stack instead of recursion
+ *
+ * Every state performs the same steps, in the same order, as the matching
+ * part of the recursive functions, so the two produce identical trees and
+ * report the same errors.
+ *
+ * @param input Token queue to modify
+ * @returns Program node
+ */
+static ASTNode* parse_program_with_stack(TokenQueue* input)
+{
+  ASTNode* result = NULL;
+  parse_stack.count = 0;
+
+  if (input == NULL) {
+    Error_throw("NULL token queue\n");
+  }
+  ParseFrame* frame = push_frame(PS_PROGRAM);
+  frame->first = NodeList_new();
+  frame->second = NodeList_new();
+
+  while (parse_stack.count > 0) {
+    frame = &parse_stack.frames[parse_stack.count - 1];
+    switch (frame->state) {
+
+      /* parse_program */
+      case PS_PROGRAM:
+        if (TokenQueue_is_empty(input)) {
+          RETURN(link_children(ProgramNode_new(frame->first, frame->second)))
+        }
+        switch (TokenQueue_peek(input).kind) {
+          case TK_INT:
+          case TK_BOOL:
+          case TK_VOID:
+            NodeList_add(frame->first, parse_vardecl(input));
+            break;
+          case TK_DEF:
+            CALL(PS_PROGRAM_FUNCTION, PS_FUNCDECL)
+          default:
+            Error_throw("Unexpected input (expected Variable or Function)\n");
+        }
+        break;
+      case PS_PROGRAM_FUNCTION:
+        NodeList_add(frame->second, result);
+        frame->state = PS_PROGRAM;
+        break;
+
+      /* parse_funcdecl */
+      case PS_FUNCDECL:
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        frame->params = ParameterList_new();
+        frame->line = get_next_token_line(input);
+        discard_next_token(input); // discard def
+        frame->type = parse_type(input);
+        frame->name = parse_id(input);
+        match_and_discard_next_kind(input, TK_LPAREN);
+        if (!check_next_kind(input, TK_RPAREN)) {
+          frame->params = parse_param(input);
+        }
+        match_and_discard_next_kind(input, TK_RPAREN);
+        CALL(PS_FUNCDECL_BODY, PS_BLOCK)
+      case PS_FUNCDECL_BODY:
+        RETURN(link_children(FuncDeclNode_new(frame->name, frame->type, frame->params, result, frame->line)))
+
+      /* parse_block */
+      case PS_BLOCK:
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        frame->line = get_next_token_line(input);
+        match_and_discard_next_kind(input, TK_LBRACE);
+        frame->first = NodeList_new();
+        frame->second = NodeList_new();
+        if (check_next_kind(input, TK_RBRACE)) { // empty block
+          match_and_discard_next_kind(input, TK_RBRACE);
+          RETURN(NULL)
+        }
+        while (is_type_kind(TokenQueue_peek(input).kind)) {
+          NodeList_add(frame->first, parse_vardecl(input));
+        }
+        frame->state = PS_BLOCK_STATEMENTS;
+        break;
+      case PS_BLOCK_STATEMENTS:
+        if (check_next_token_type(input, KEY) || check_next_token_type(input, ID)) {
+          CALL(PS_BLOCK_STATEMENT, PS_STMT)
+        }
+        result = link_children(BlockNode_new(frame->first, frame->second, frame->line));
+        match_and_discard_next_kind(input, TK_RBRACE);
+        parse_stack.count--;
+        break;
+      case PS_BLOCK_STATEMENT:
+        NodeList_add(frame->second, result);
+        frame->state = PS_BLOCK_STATEMENTS;
+        break;
+
+      /* parse_stmt */
+      case PS_STMT: {
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        frame->line = get_next_token_line(input);
+        Token token = TokenQueue_peek(input);
+        switch (token.kind) {
+          case TK_IF:
+            match_and_discard_next_kind(input, TK_IF);
+            match_and_discard_next_kind(input, TK_LPAREN);
+            CALL(PS_IF_CONDITION, PS_EXPR)
+          case TK_WHILE:
+            match_and_discard_next_kind(input, TK_WHILE);
+            match_and_discard_next_kind(input, TK_LPAREN);
+            CALL(PS_WHILE_CONDITION, PS_EXPR)
+          case TK_RETURN:
+            match_and_discard_next_kind(input, TK_RETURN);
+            if (!check_next_kind(input, TK_SEMICOLON)) {
+              CALL(PS_RETURN_VALUE, PS_EXPR)
+            }
+            result = NULL;
+            frame->state = PS_RETURN_VALUE;
+            break;
+          case TK_BREAK:
+            result = BreakNode_new(frame->line);
+            match_and_discard_next_kind(input, TK_BREAK);
+            match_and_discard_next_kind(input, TK_SEMICOLON);
+            parse_stack.count--;
+            break;
+          case TK_CONTINUE:
+            result = ContinueNode_new(frame->line);
+            match_and_discard_next_kind(input, TK_CONTINUE);
+            match_and_discard_next_kind(input, TK_SEMICOLON);
+            parse_stack.count--;
+            break;
+          default:
+            if (token.type != ID) {
+              Error_throw("Unexpected token in block\n");
+            }
+            switch (TokenQueue_peek_ahead(input, 1).kind) {
+              case TK_ASSIGN:
+              case TK_LBRACKET:
+                CALL(PS_ASSIGN_LOCATION, PS_LOCATION)
+              case TK_LPAREN:
+                CALL(PS_CALL_STMT, PS_FUNCCALL)
+              default:
+                Error_throw("Unexpected token in block\n");
+            }
+        }
+        break;
+      }
+      case PS_IF_CONDITION:
+        frame->left = result;
+        match_and_discard_next_kind(input, TK_RPAREN);
+        CALL(PS_IF_BODY, PS_BLOCK)
+      case PS_IF_BODY:
+        frame->body = result;
+        if (check_next_kind(input, TK_ELSE)) {
+          match_and_discard_next_kind(input, TK_ELSE);
+          CALL(PS_IF_ELSE, PS_BLOCK)
+        }
+        RETURN(link_children(ConditionalNode_new(frame->left, frame->body, NULL, frame->line)))
+      case PS_IF_ELSE:
+        RETURN(link_children(ConditionalNode_new(frame->left, frame->body, result, frame->line)))
+      case PS_WHILE_CONDITION:
+        frame->left = result;
+        match_and_discard_next_kind(input, TK_RPAREN);
+        CALL(PS_WHILE_BODY, PS_BLOCK)
+      case PS_WHILE_BODY:
+        RETURN(link_children(WhileLoopNode_new(frame->left, result, frame->line)))
+      case PS_RETURN_VALUE:
+        result = link_children(ReturnNode_new(result, frame->line));
+        match_and_discard_next_kind(input, TK_SEMICOLON);
+        parse_stack.count--;
+        break;
+      case PS_ASSIGN_LOCATION:
+        frame->left = result;
+        match_and_discard_next_kind(input, TK_ASSIGN);
+        CALL(PS_ASSIGN_VALUE, PS_EXPR)
+      case PS_ASSIGN_VALUE:
+        result = link_children(AssignmentNode_new(frame->left, result, frame->line));
+        match_and_discard_next_kind(input, TK_SEMICOLON);
+        parse_stack.count--;
+        break;
+      case PS_CALL_STMT:
+        match_and_discard_next_kind(input, TK_SEMICOLON);
+        parse_stack.count--;
+        break;
+
+      /* parse_loc */
+      case PS_LOCATION:
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        frame->line = get_next_token_line(input);
+        frame->name = parse_id(input);
+        if (check_next_kind(input, TK_LBRACKET)) {
+          match_and_discard_next_kind(input, TK_LBRACKET);
+          CALL(PS_LOCATION_INDEX, PS_EXPR)
+        }
+        RETURN(link_children(LocationNode_new(frame->name, NULL, frame->line)))
+      case PS_LOCATION_INDEX:
+        match_and_discard_next_kind(input, TK_RBRACKET);
+        RETURN(link_children(LocationNode_new(frame->name, result, frame->line)))
+
+      /* parse_funccall and parse_args */
+      case PS_FUNCCALL:
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        frame->line = get_next_token_line(input);
+        frame->name = parse_id(input);
+        match_and_discard_next_kind(input, TK_LPAREN);
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        frame->first = NodeList_new();
+        if (check_next_kind(input, TK_RPAREN)) {
+          frame->state = PS_FUNCCALL_END;
+          break;
+        }
+        CALL(PS_FUNCCALL_ARG, PS_EXPR)
+      case PS_FUNCCALL_ARG:
+        NodeList_add(frame->first, result);
+        if (check_next_kind(input, TK_COMMA)) {
+          match_and_discard_next_kind(input, TK_COMMA);
+          CALL(PS_FUNCCALL_ARG, PS_EXPR)
+        }
+        frame->state = PS_FUNCCALL_END;
+        break;
+      case PS_FUNCCALL_END:
+        match_and_discard_next_kind(input, TK_RPAREN);
+        RETURN(link_children(FuncCallNode_new(frame->name, frame->first, frame->line)))
+
+      /* parse_expr and parse_binexpr */
+      case PS_EXPR:
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        frame->line = get_next_token_line(input);
+        CALL(PS_EXPR_OPERAND, PS_OPERAND)
+      case PS_EXPR_OPERAND:
+        frame->left = result;
+        frame->min_power = 0;
+        frame->state = PS_OPERATORS;
+        break;
+
+      /* parse_operand */
+      case PS_OPERAND:
+        frame->line = get_next_token_line(input);
+        frame->op = &operators[TokenQueue_peek(input).kind];
+        if (!frame->op->is_unary) {
+          frame->state = PS_BASEEXPR;
+          break;
+        }
+        discard_next_token(input);
+        CALL(PS_OPERAND_UNARY, PS_OPERAND)
+      case PS_OPERAND_UNARY:
+        RETURN(link_children(UnaryOpNode_new(frame->op->unary, result, frame->line)))
+
+      /* parse_baseexpr */
+      case PS_BASEEXPR: {
+        if (TokenQueue_is_empty(input)) {
+          Error_throw("Unexpected end of input (expected identifier)\n");
+        }
+        Token t = TokenQueue_peek(input);
+        if (t.kind == TK_LPAREN) {
+          match_and_discard_next_kind(input, TK_LPAREN);
+          CALL(PS_BASEEXPR_PAREN, PS_EXPR)
+        } else if (check_kind_ahead(input, 1, TK_LPAREN)) {
+          frame->state = PS_FUNCCALL;
+        } else if (t.type == DECLIT || t.type == HEXLIT || t.type == STRLIT || t.kind == TK_TRUE || t.kind == TK_FALSE) {
+          RETURN(parse_lit(input))
+        } else if (t.type == ID) {
+          frame->state = PS_LOCATION;
+        } else {
+          Error_throw("Unidentifiable base expression\n");
+        }
+        break;
       }
+      case PS_BASEEXPR_PAREN:
+        match_and_discard_next_kind(input, TK_RPAREN);
+        parse_stack.count--;
+        break;
+
+      /* parse_operators */
+      case PS_OPERATORS:
+        frame->op = &operators[TokenQueue_peek(input).kind];
+        if (frame->op->binary_power <= frame->min_power) {
+          RETURN(frame->left)
+        }
+        discard_next_token(input);
+        frame->right_line = get_next_token_line(input);
+        CALL(PS_OPERATORS_RIGHT, PS_OPERAND)
+      case PS_OPERATORS_RIGHT:
+        if (operators[TokenQueue_peek(input).kind].binary_power > frame->op->binary_power) {
+          int power = frame->op->binary_power;
+          int line = frame->right_line;
+          frame->state = PS_OPERATORS_COMBINE;
+          ParseFrame* nested = push_frame(PS_OPERATORS);
+          nested->left = result;
+          nested->min_power = power;
+          nested->line = line;
+          break;
+        }
+        frame->state = PS_OPERATORS_COMBINE;
+        break;
+      case PS_OPERATORS_COMBINE:
+        frame->left = link_children(BinaryOpNode_new(frame->op->binary, frame->left, result, frame->line));
+        frame->state = PS_OPERATORS;
+        break;
+    }
+  }
+  return result;
+}
+
+#undef CALL
+#undef RETURN
+
+/**
+ * @brief Look up the parser mode to use by default
+ *
+ * The @c DECAF_PARSER environment variable selects a mode by name ("stack" or
+ * "recursive"); the recursive parser is used otherwise.
+ */
+static ParserMode default_parser_mode (void)
+{
+    const char* setting = getenv("DECAF_PARSER");
+    return (setting != NULL && strcmp(setting, "stack") == 0 ? PARSER_STACK : PARSER_RECURSIVE);
+}
+
+void ParserContext_init (ParserContext* context)
+{
+    context->error.message[0] = '\0';
+    context->error.previous = NULL;
+    context->arena = NULL;
+    context->mode = default_parser_mode();
+}
+
+ASTNode* ParserContext_parse (ParserContext* context, TokenQueue* input)
+{
+    /* the whole tree is allocated from one arena owned by the program node */
+    context->arena = Arena_new();
+    Arena* previous = ASTNode_use_arena(context->arena);
+
+    /* catch errors so a failed parse releases everything it allocated */
+    ErrorHandler_push(&context->error);
+    if (setjmp(context->error.target) != 0) {
+        ErrorHandler_pop(&context->error);
+        ASTNode_use_arena(previous);
+        Arena_free(context->arena);
+        context->arena = NULL;
+        free_parse_stack();
+        return NULL;
     }
 
-    return ProgramNode_new(vars, funcs);
+    ASTNode* tree = NULL;
+    if (context->mode == PARSER_STACK) {
+        tree = parse_program_with_stack(input);
+        free_parse_stack();
+    } else {
+        tree = parse_program(input);
+    }
+    ASTNode_set_tree_depths(tree);
+
+    ErrorHandler_pop(&context->error);
+    ASTNode_use_arena(previous);
+    context->arena = NULL;
+    return tree;
+}
+
+/**
+ * @brief Lex and parse a program using a parser context and the given
+ * streaming lexer (@ref lex_stream or @ref lex_stream_padded)
+ */
+static ASTNode* parse_text_with (ParserContext* context, const char* text,
+        TokenQueue* (*lexer) (const char*))
+{
+    ErrorHandler_push(&context->error);
+    if (setjmp(context->error.target) != 0) {
+        ErrorHandler_pop(&context->error);
+        return NULL;
+    }
+    TokenQueue* tokens = lexer(text);
+    ErrorHandler_pop(&context->error);
+
+    ASTNode* tree = ParserContext_parse(context, tokens);
+    TokenQueue_free(tokens);
+    return tree;
+}
+
+ASTNode* ParserContext_parse_text (ParserContext* context, const char* text)
+{
+    return parse_text_with(context, text, lex_stream);
+}
+
+ASTNode* ParserContext_parse_padded (ParserContext* context, const char* text)
+{
+    return parse_text_with(context, text, lex_stream_padded);
 }
 
 ASTNode* parse (TokenQueue* input)
 {
-  return parse_program(input);
+    return parse_with_mode(input, default_parser_mode());
+}
+
+ASTNode* parse_with_mode (TokenQueue* input, ParserMode mode)
+{
+    ParserContext context;
+    ParserContext_init(&context);
+    context.mode = mode;
+    ASTNode* tree = ParserContext_parse(&context, input);
+    if (tree == NULL) {
+        Error_throw("%s", context.error.message);
+    }
+    return tree;
 }
@@ -0,0 +1,271 @@
+/**
+ * @file scan.c
+ * @brief Character-run scanning kernels (scalar, SSE2, and AVX2)
+ */
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+
+/*
+ * PADDED BUFFERS
+ */
+
+char* scan_buffer_alloc (size_t length)
+{
+    /* aligned_alloc needs a size that is a multiple of the alignment */
+    size_t size = (length + SCAN_PADDING + SCAN_PADDING - 1) / SCAN_PADDING * SCAN_PADDING;
+    char* buffer = (char*)aligned_alloc(SCAN_PADDING, size);
+    CHECK_MALLOC_PTR(buffer)
+    memset(buffer + length, 0, size - length);
+    return buffer;
+}
+
+
+/*
+ * SCALAR KERNELS
+ */
+
+static const char* scalar_skip_whitespace (const char* p, int* lines)
+{
+    for (;; p++) {
+        switch (*p) {
+            case '\n': (*lines)++; break;
+            case ' ': case '\t': case '\r': break;
+            default: return p;
+        }
+    }
+}
+
+static bool is_ident_char (char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool is_hex_char (char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static const char* scalar_skip_ident (const char* p)
+{
+    while (is_ident_char(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* scalar_skip_digits (const char* p)
+{
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p;
+}
+
+static const char* scalar_skip_hex (const char* p)
+{
+    while (is_hex_char(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* scalar_skip_string_body (const char* p)
+{
+    while (*p != '"' && *p != '\\' && *p != '\n' && *p != '\r' && *p != '\0') {
+        p++;
+    }
+    return p;
+}
+
+static const char* scalar_skip_comment (const char* p)
+{
+    while (*p != '\n' && *p != '\0') {
+        p++;
+    }
+    return p;
+}
+
+static const ScanKernels scalar_kernels = {
+    "scalar",
+    scalar_skip_whitespace, scalar_skip_ident, scalar_skip_digits,
+    scalar_skip_hex, scalar_skip_string_body, scalar_skip_comment
+};
+
+const ScanKernels* ScanKernels_scalar (void)
+{
+    return &scalar_kernels;
+}
+
+
+#ifdef SCAN_X86
+
+/*
+ * VECTOR KERNELS
+ *
+ * Each kernel is written once as a macro over a vector width and
+ * instantiated for SSE2 (16 bytes) and AVX2 (32 bytes). A kernel computes a
+ * bitmask of the bytes that end the run in each aligned block; bytes before
+ * the start pointer are shifted out of the first block.
+ */
+
+/* byte-wise character class tests (all ranges are ASCII, so signed compares work) */
+#define SSE2_EQ(V, C)       _mm_cmpeq_epi8((V), _mm_set1_epi8(C))
+#define SSE2_IN(V, LO, HI)  _mm_and_si128(_mm_cmpgt_epi8((V), _mm_set1_epi8((LO) - 1)), \
+                                          _mm_cmpgt_epi8(_mm_set1_epi8((HI) + 1), (V)))
+#define AVX2_EQ(V, C)       _mm256_cmpeq_epi8((V), _mm256_set1_epi8(C))
+#define AVX2_IN(V, LO, HI)  _mm256_and_si256(_mm256_cmpgt_epi8((V), _mm256_set1_epi8((LO) - 1)), \
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8((HI) + 1), (V)))
+
+/**
+ * @brief Define a vector kernel that stops at the first byte whose bit is set
+ * in the mask computed by @c STOPMASK(block)
+ */
+#define DEF_VECTOR_KERNEL(ATTR, NAME, WIDTH, VEC, LOAD, STOPMASK) \
+    ATTR static const char* NAME (const char* p) \
+    { \
+        const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)(WIDTH - 1)); \
+        uint32_t mask = STOPMASK(LOAD((const VEC*)block)) >> (p - block); \
+        if (mask != 0) { \
+            return p + __builtin_ctz(mask); \
+        } \
+        for (;;) { \
+            block += WIDTH; \
+            mask = STOPMASK(LOAD((const VEC*)block)); \
+            if (mask != 0) { \
+                return block + __builtin_ctz(mask); \
+            } \
+        } \
+    }
+
+/**
+ * @brief Define a whitespace-skipping vector kernel that also counts line feeds
+ */
+#define DEF_VECTOR_WHITESPACE(ATTR, NAME, WIDTH, VEC, LOAD, STOPMASK, NLMASK) \
+    ATTR static const char* NAME (const char* p, int* lines) \
+    { \
+        const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)(WIDTH - 1)); \
+        VEC v = LOAD((const VEC*)block); \
+        uint32_t stop = STOPMASK(v) >> (p - block); \
+        uint32_t nl = NLMASK(v) >> (p - block); \
+        for (;;) { \
+            if (stop != 0) { \
+                uint32_t before = (uint32_t)(((uint64_t)1 << __builtin_ctz(stop)) - 1); \
+                *lines += __builtin_popcount(nl & before); \
+                return p + __builtin_ctz(stop); \
+            } \
+            *lines += __builtin_popcount(nl); \
+            block += WIDTH; \
+            p = block; \
+            v = LOAD((const VEC*)block); \
+            stop = STOPMASK(v); \
+            nl = NLMASK(v); \
+        } \
+    }
+
+/* SSE2 stop masks */
+#define SSE2_MASK(V)            ((uint32_t)_mm_movemask_epi8(V))
+#define SSE2_NOT_MASK(V)        ((~(uint32_t)_mm_movemask_epi8(V)) & 0xFFFFu)
+#define SSE2_WS(V)              _mm_or_si128(_mm_or_si128(SSE2_EQ(V, ' '), SSE2_EQ(V, '\t')), \
+                                             _mm_or_si128(SSE2_EQ(V, '\r'), SSE2_EQ(V, '\n')))
+#define SSE2_STOP_WS(V)         SSE2_NOT_MASK(SSE2_WS(V))
+#define SSE2_NL(V)              SSE2_MASK(SSE2_EQ(V, '\n'))
+#define SSE2_ALPHA(V)           SSE2_IN(_mm_or_si128((V), _mm_set1_epi8(0x20)), 'a', 'z')
+#define SSE2_STOP_IDENT(V)      SSE2_NOT_MASK(_mm_or_si128(_mm_or_si128(SSE2_ALPHA(V), SSE2_IN(V, '0', '9')), \
+                                                           SSE2_EQ(V, '_')))
+#define SSE2_STOP_DIGITS(V)     SSE2_NOT_MASK(SSE2_IN(V, '0', '9'))
+#define SSE2_STOP_HEX(V)        SSE2_NOT_MASK(_mm_or_si128(SSE2_IN(V, '0', '9'), \
+                                              SSE2_IN(_mm_or_si128((V), _mm_set1_epi8(0x20)), 'a', 'f')))
+#define SSE2_STOP_STRING(V)     SSE2_MASK(_mm_or_si128(_mm_or_si128(SSE2_EQ(V, '"'), SSE2_EQ(V, '\\')), \
+                                          _mm_or_si128(_mm_or_si128(SSE2_EQ(V, '\r'), SSE2_EQ(V, '\n')), \
+                                                       SSE2_EQ(V, '\0'))))
+#define SSE2_STOP_COMMENT(V)    SSE2_MASK(_mm_or_si128(SSE2_EQ(V, '\n'), SSE2_EQ(V, '\0')))
+
+#define SSE2_ATTR __attribute__((target("sse2")))
+DEF_VECTOR_WHITESPACE(SSE2_ATTR, sse2_skip_whitespace, 16, __m128i, _mm_load_si128, SSE2_STOP_WS, SSE2_NL)
+DEF_VECTOR_KERNEL(SSE2_ATTR, sse2_skip_ident,       16, __m128i, _mm_load_si128, SSE2_STOP_IDENT)
+DEF_VECTOR_KERNEL(SSE2_ATTR, sse2_skip_digits,      16, __m128i, _mm_load_si128, SSE2_STOP_DIGITS)
+DEF_VECTOR_KERNEL(SSE2_ATTR, sse2_skip_hex,         16, __m128i, _mm_load_si128, SSE2_STOP_HEX)
+DEF_VECTOR_KERNEL(SSE2_ATTR, sse2_skip_string_body, 16, __m128i, _mm_load_si128, SSE2_STOP_STRING)
+DEF_VECTOR_KERNEL(SSE2_ATTR, sse2_skip_comment,     16, __m128i, _mm_load_si128, SSE2_STOP_COMMENT)
+
+/* AVX2 stop masks */
+#define AVX2_MASK(V)            ((uint32_t)_mm256_movemask_epi8(V))
+#define AVX2_NOT_MASK(V)        (~(uint32_t)_mm256_movemask_epi8(V))
+#define AVX2_WS(V)              _mm256_or_si256(_mm256_or_si256(AVX2_EQ(V, ' '), AVX2_EQ(V, '\t')), \
+                                                _mm256_or_si256(AVX2_EQ(V, '\r'), AVX2_EQ(V, '\n')))
+#define AVX2_STOP_WS(V)         AVX2_NOT_MASK(AVX2_WS(V))
+#define AVX2_NL(V)              AVX2_MASK(AVX2_EQ(V, '\n'))
+#define AVX2_ALPHA(V)           AVX2_IN(_mm256_or_si256((V), _mm256_set1_epi8(0x20)), 'a', 'z')
+#define AVX2_STOP_IDENT(V)      AVX2_NOT_MASK(_mm256_or_si256(_mm256_or_si256(AVX2_ALPHA(V), AVX2_IN(V, '0', '9')), \
+                                                              AVX2_EQ(V, '_')))
+#define AVX2_STOP_DIGITS(V)     AVX2_NOT_MASK(AVX2_IN(V, '0', '9'))
+#define AVX2_STOP_HEX(V)        AVX2_NOT_MASK(_mm256_or_si256(AVX2_IN(V, '0', '9'), \
+                                              AVX2_IN(_mm256_or_si256((V), _mm256_set1_epi8(0x20)), 'a', 'f')))
+#define AVX2_STOP_STRING(V)     AVX2_MASK(_mm256_or_si256(_mm256_or_si256(AVX2_EQ(V, '"'), AVX2_EQ(V, '\\')), \
+                                          _mm256_or_si256(_mm256_or_si256(AVX2_EQ(V, '\r'), AVX2_EQ(V, '\n')), \
+                                                          AVX2_EQ(V, '\0'))))
+#define AVX2_STOP_COMMENT(V)    AVX2_MASK(_mm256_or_si256(AVX2_EQ(V, '\n'), AVX2_EQ(V, '\0')))
+
+#define AVX2_ATTR __attribute__((target("avx2")))
+DEF_VECTOR_WHITESPACE(AVX2_ATTR, avx2_skip_whitespace, 32, __m256i, _mm256_load_si256, AVX2_STOP_WS, AVX2_NL)
+DEF_VECTOR_KERNEL(AVX2_ATTR, avx2_skip_ident,       32, __m256i, _mm256_load_si256, AVX2_STOP_IDENT)
+DEF_VECTOR_KERNEL(AVX2_ATTR, avx2_skip_digits,      32, __m256i, _mm256_load_si256, AVX2_STOP_DIGITS)
+DEF_VECTOR_KERNEL(AVX2_ATTR, avx2_skip_hex,         32, __m256i, _mm256_load_si256, AVX2_STOP_HEX)
+DEF_VECTOR_KERNEL(AVX2_ATTR, avx2_skip_string_body, 32, __m256i, _mm256_load_si256, AVX2_STOP_STRING)
+DEF_VECTOR_KERNEL(AVX2_ATTR, avx2_skip_comment,     32, __m256i, _mm256_load_si256, AVX2_STOP_COMMENT)
+
+static const ScanKernels sse2_kernels = {
+    "sse2",
+    sse2_skip_whitespace, sse2_skip_ident, sse2_skip_digits,
+    sse2_skip_hex, sse2_skip_string_body, sse2_skip_comment
+};
+
+static const ScanKernels avx2_kernels = {
+    "avx2",
+    avx2_skip_whitespace, avx2_skip_ident, avx2_skip_digits,
+    avx2_skip_hex, avx2_skip_string_body, avx2_skip_comment
+};
+
+const ScanKernels* ScanKernels_sse2 (void)
+{
+    return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+}
+
+const ScanKernels* ScanKernels_avx2 (void)
+{
+    return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+}
+
+#else
+
+const ScanKernels* ScanKernels_sse2 (void)
+{
+    return NULL;
+}
+
+const ScanKernels* ScanKernels_avx2 (void)
+{
+    return NULL;
+}
+
+#endif
+
+const ScanKernels* ScanKernels_select (void)
+{
+    const char* choice = getenv("DECAF_SCAN");
+    const ScanKernels* kernels = NULL;
+    if (choice != NULL && strcmp(choice, "scalar") == 0) {
+        return ScanKernels_scalar();
+    } else if (choice != NULL && strcmp(choice, "sse2") == 0) {
+        kernels = ScanKernels_sse2();
+    } else if ((kernels = ScanKernels_avx2()) == NULL) {
+        kernels = ScanKernels_sse2();
+    }
+    return (kernels != NULL ? kernels : ScanKernels_scalar());
+}
@@ -0,0 +1,671 @@
+/**
+ * @file server.c
+ * @brief Compile server
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "intern.h"
+#include "p2-parser.h"
+#include "scan.h"
+#include "source.h"
+
+/**
+ * @brief How often (in milliseconds) a running server checks whether it has
+ * been stopped
+ */
+#define SERVER_POLL_MS 100
+
+/**
+ * @brief Connection waiting for a worker
+ */
+typedef struct QueuedConnection
+{
+    int socket;         /**< @brief Connected socket */
+    double accepted;    /**< @brief Time the connection was accepted (see @ref monotonic_seconds) */
+} QueuedConnection;
+
+/**
+ * @brief Compile server state
+ *
+ * Accepted connections go into a ring buffer that the workers take them from;
+ * @c lock protects the buffer and @c closed, and @c ready is signaled when
+ * either changes.
+ */
+struct Server
+{
+    char* socket_path;              /**< @brief Path of the listening socket */
+    int listener;                   /**< @brief Listening socket */
+    ServerOptions options;          /**< @brief Settings */
+    atomic_bool stopping;           /**< @brief True once the server has been stopped */
+    pthread_rwlock_t compiling;     /**< @brief Held for reading while a request is compiled, and for writing while the identifier table is emptied */
+
+    pthread_mutex_t lock;           /**< @brief Protects the queue */
+    pthread_cond_t ready;           /**< @brief Signaled when a connection is queued or the queue closes */
+    QueuedConnection* queue;        /**< @brief Waiting connections (ring buffer) */
+    int head;                       /**< @brief Index of the oldest waiting connection */
+    int count;                      /**< @brief Number of waiting connections */
+    bool closed;                    /**< @brief True once no more connections will be queued */
+};
+
+/**
+ * @brief Compute the deadline for reading a request or writing a reply that
+ * starts now
+ *
+ * The deadline covers the whole message, so a client that trickles data (or
+ * reads its reply slowly) cannot hold on to a worker for long.
+ */
+static double deadline_after (const ServerOptions* options)
+{
+    return monotonic_seconds() + options->timeout_ms / 1000.0;
+}
+
+
+/*
+ * FRAMES
+ */
+
+/**
+ * @brief Wait until a socket is ready or a deadline passes
+ *
+ * @param socket Socket to wait for
+ * @param events Events to wait for (@c POLLIN or @c POLLOUT)
+ * @param deadline Time to give up (see @ref monotonic_seconds), or zero to wait indefinitely
+ * @returns False if the deadline passed first
+ */
+static bool wait_for (int socket, short events, double deadline)
+{
+    while (true) {
+        int timeout = -1;
+        if (deadline > 0) {
+            double remaining = deadline - monotonic_seconds();
+            if (remaining <= 0) {
+                return false;
+            }
+            timeout = (int)(remaining * 1000) + 1;
+        }
+        struct pollfd ready = { .fd = socket, .events = events };
+        int result = poll(&ready, 1, timeout);
+        if (result > 0) {
+            return true;
+        }
+        if (result < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Read exactly @p length bytes from a socket
+ *
+ * @returns False at the end of the stream, at the deadline (see @ref
+ * wait_for), or on an error
+ */
+static bool read_fully (int socket, void* data, size_t length, double deadline)
+{
+    char* next = (char*)data;
+    while (length > 0) {
+        if (!wait_for(socket, POLLIN, deadline)) {
+            return false;
+        }
+        ssize_t got = recv(socket, next, length, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        next += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+/**
+ * @brief Write exactly @p length bytes to a socket
+ *
+ * @returns False at the deadline (see @ref wait_for) or on an error
+ * (including a closed connection)
+ */
+static bool write_fully (int socket, const void* data, size_t length, double deadline)
+{
+    const char* next = (const char*)data;
+    while (length > 0) {
+        if (!wait_for(socket, POLLOUT, deadline)) {
+            return false;
+        }
+        ssize_t sent = send(socket, next, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        next += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+/**
+ * @brief Write a frame whose body is a short header followed by data
+ */
+static bool write_frame (int socket, const char* header, size_t header_length,
+        const char* data, size_t length, double deadline)
+{
+    uint32_t size = htonl((uint32_t)(header_length + length));
+    return write_fully(socket, &size, sizeof(size), deadline) &&
+           write_fully(socket, header, header_length, deadline) &&
+           write_fully(socket, data, length, deadline);
+}
+
+/**
+ * @brief Read a frame
+ *
+ * @param socket Socket to read from
+ * @param limit Largest body to accept
+ * @param deadline Time to give up (see @ref wait_for)
+ * @param[out] length Length of the body
+ * @returns Body of the frame in a padded buffer (see @ref scan_buffer_alloc;
+ * caller must free), or @c NULL if no complete frame could be read
+ */
+static char* read_frame (int socket, size_t limit, double deadline, size_t* length)
+{
+    uint32_t size;
+    if (!read_fully(socket, &size, sizeof(size), deadline)) {
+        return NULL;
+    }
+    *length = ntohl(size);
+    if (*length > limit) {
+        return NULL;
+    }
+    char* body = scan_buffer_alloc(*length);
+    if (!read_fully(socket, body, *length, deadline)) {
+        free(body);
+        return NULL;
+    }
+    return body;
+}
+
+/**
+ * @brief Send a reply, giving up at a deadline (see @ref wait_for)
+ */
+static bool send_reply (int socket, ServerStatus status, const char* text, size_t length, double deadline)
+{
+    char header = (char)status;
+    return write_frame(socket, &header, 1, text, length, deadline);
+}
+
+/**
+ * @brief Connect to the socket at a path
+ *
+ * @returns Connected socket, or -1 if the connection failed
+ */
+static int connect_to (const char* socket_path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+
+/*
+ * REQUESTS
+ */
+
+/**
+ * @brief Write a message into a reply
+ */
+static void set_reply (ServerReply* reply, ServerStatus status, const char* message)
+{
+    reply->status = status;
+    reply->text = copy_string(message);
+    reply->length = strlen(message);
+}
+
+/**
+ * @brief Produce one output of a compiled program
+ *
+ * @param tree Compiled program
+ * @param output Output to produce
+ * @param[out] reply Output or error message
+ */
+static void produce_output (ASTNode* tree, ServerOutput output, ServerReply* reply)
+{
+    char* text = NULL;
+    size_t length = 0;
+    FILE* stream = open_memstream(&text, &length);
+    CHECK_MALLOC_PTR(stream)
+    NodeVisitor* visitor = NULL;
+    switch (output) {
+        case SERVER_DOT: visitor = GenerateASTGraph_new(stream); break;
+        case SERVER_SVG: visitor = GenerateASTImage_new(stream); break;
+        default:         visitor = PrintVisitor_new(stream);     break;
+    }
+
+    /* errors are still possible while producing the output */
+    ErrorHandler handler;
+    bool failed = false;
+    ErrorHandler_push(&handler);
+    if (setjmp(handler.target) == 0) {
+        NodeVisitor_traverse(visitor, tree);
+    } else {
+        NodeVisitor_release_stack();
+        failed = true;
+    }
+    ErrorHandler_pop(&handler);
+    NodeVisitor_free(visitor);
+    fclose(stream);
+    if (failed) {
+        /* the message replaces any partial output */
+        free(text);
+        set_reply(reply, SERVER_ERROR, handler.message);
+    } else {
+        reply->status = SERVER_OK;
+        reply->text = text;
+        reply->length = length;
+    }
+}
+
+/**
+ * @brief Compile a program once and produce each of the requested outputs
+ *
+ * The server's parser always uses an explicit stack (see @ref PARSER_STACK),
+ * since a deeply nested program must not overflow a worker's stack and bring
+ * down the whole server.
+ *
+ * @param text Source text, in a padded buffer (see @ref SCAN_PADDING)
+ * @param outputs Outputs to produce
+ * @param count Number of outputs
+ * @param[out] replies Output or error message for each output, up to and
+ * including the first one that is not @c SERVER_OK
+ * @returns Number of replies
+ */
+static int compile_request (const char* text, const ServerOutput* outputs, int count, ServerReply* replies)
+{
+    ParserContext context;
+    ParserContext_init(&context);
+    context.mode = PARSER_STACK;
+    ASTNode* tree = ParserContext_parse_padded(&context, text);
+    if (tree == NULL) {
+        set_reply(&replies[0], SERVER_ERROR, context.error.message);
+        return 1;
+    }
+
+    int produced = 0;
+    while (produced < count && (produced == 0 || replies[produced - 1].status == SERVER_OK)) {
+        produce_output(tree, outputs[produced], &replies[produced]);
+        produced++;
+    }
+    ASTNode_free(tree);
+    return produced;
+}
+
+/**
+ * @brief Empty the identifier table if it holds too many names and no
+ * request is being compiled
+ *
+ * A request's names are only in use while it is compiled (its tree is freed
+ * before the reply is sent). If another worker is compiling, the table is
+ * left alone; the last worker to finish will empty it instead.
+ */
+static void trim_names (Server* server)
+{
+    if (intern_count() > server->options.name_limit &&
+            pthread_rwlock_trywrlock(&server->compiling) == 0) {
+        if (intern_count() > server->options.name_limit) {
+            intern_free_all();
+        }
+        pthread_rwlock_unlock(&server->compiling);
+    }
+}
+
+/**
+ * @brief Carry out one request and reply to it
+ *
+ * @returns False if the replies could not be sent
+ */
+static bool handle_request (Server* server, int socket, const char* body, size_t length)
+{
+    /* the header is the source byte, the number of outputs, and the outputs */
+    int count = (length >= 2 ? body[1] - '0' : 0);
+    bool valid = (count >= 1 && count <= SERVER_MAX_OUTPUTS && length >= 2 + (size_t)count);
+    ServerOutput outputs[SERVER_MAX_OUTPUTS];
+    for (int i = 0; valid && i < count; i++) {
+        outputs[i] = (ServerOutput)body[2 + i];
+        valid = (outputs[i] == SERVER_AST || outputs[i] == SERVER_DOT || outputs[i] == SERVER_SVG);
+    }
+    if (!valid) {
+        static const char message[] = "Invalid request\n";
+        return send_reply(socket, SERVER_FAILED, message, sizeof(message) - 1,
+                deadline_after(&server->options));
+    }
+    const char* data = body + 2 + count;
+
+    ServerReply replies[SERVER_MAX_OUTPUTS];
+    int produced = 1;
+    switch (body[0]) {
+        case SERVER_TEXT:
+            pthread_rwlock_rdlock(&server->compiling);
+            produced = compile_request(data, outputs, count, replies);
+            pthread_rwlock_unlock(&server->compiling);
+            break;
+
+        case SERVER_PATH: {
+            /* read, don't map: a mapped file truncated while it is parsed would crash the server */
+            SourceFile* source = SourceFile_read(data);
+            if (source != NULL) {
+                pthread_rwlock_rdlock(&server->compiling);
+                produced = compile_request(source->text, outputs, count, replies);
+                pthread_rwlock_unlock(&server->compiling);
+                SourceFile_free(source);
+            } else {
+                char message[MAX_ERROR_LEN];
+                snprintf(message, sizeof(message), "Could not read file: %s\n", data);
+                set_reply(&replies[0], SERVER_FAILED, message);
+            }
+            break;
+        }
+
+        case SERVER_SHUTDOWN:
+            Server_stop(server);
+            set_reply(&replies[0], SERVER_OK, "");
+            break;
+
+        default: {
+            static const char message[] = "Invalid request\n";
+            return send_reply(socket, SERVER_FAILED, message, sizeof(message) - 1,
+                deadline_after(&server->options));
+        }
+    }
+
+    trim_names(server);
+    bool sent = true;
+    for (int i = 0; i < produced; i++) {
+        sent = sent && send_reply(socket, replies[i].status, replies[i].text, replies[i].length,
+                deadline_after(&server->options));
+        free(replies[i].text);
+    }
+    return sent;
+}
+
+/**
+ * @brief Serve the requests on a connection until the client is done, stalls,
+ * or has had the connection for as long as it may keep it
+ */
+static void serve_connection (Server* server, int socket)
+{
+    /* the per-message deadline restarts with every request, but this one does not */
+    double closing = monotonic_seconds() + server->options.connection_ms / 1000.0;
+    size_t length;
+    char* body;
+    while (true) {
+        double deadline = deadline_after(&server->options);
+        body = read_frame(socket, SERVER_MAX_REQUEST, (deadline < closing ? deadline : closing), &length);
+        if (body == NULL) {
+            break;
+        }
+        bool sent = handle_request(server, socket, body, length);
+        free(body);
+        if (!sent) {
+            break;
+        }
+    }
+}
+
+
+/*
+ * CONNECTION QUEUE
+ */
+
+/**
+ * @brief Queue a connection for the workers
+ *
+ * @returns False if the queue is full
+ */
+static bool enqueue_connection (Server* server, int socket)
+{
+    pthread_mutex_lock(&server->lock);
+    bool queued = (server->count < server->options.queue_capacity);
+    if (queued) {
+        int tail = (server->head + server->count) % server->options.queue_capacity;
+        server->queue[tail].socket = socket;
+        server->queue[tail].accepted = monotonic_seconds();
+        server->count++;
+        pthread_cond_signal(&server->ready);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return queued;
+}
+
+/**
+ * @brief Wait for a queued connection
+ *
+ * @returns False if the queue is closed and empty
+ */
+static bool dequeue_connection (Server* server, QueuedConnection* connection)
+{
+    pthread_mutex_lock(&server->lock);
+    while (server->count == 0 && !server->closed) {
+        pthread_cond_wait(&server->ready, &server->lock);
+    }
+    bool dequeued = (server->count > 0);
+    if (dequeued) {
+        *connection = server->queue[server->head];
+        server->head = (server->head + 1) % server->options.queue_capacity;
+        server->count--;
+    }
+    pthread_mutex_unlock(&server->lock);
+    return dequeued;
+}
+
+/**
+ * @brief Worker thread of a server
+ */
+static void* server_worker (void* arg)
+{
+    Server* server = (Server*)arg;
+    QueuedConnection connection;
+    while (dequeue_connection(server, &connection)) {
+        if ((monotonic_seconds() - connection.accepted) * 1000 > server->options.timeout_ms) {
+            static const char message[] = "Request timed out\n";
+            send_reply(connection.socket, SERVER_FAILED, message, sizeof(message) - 1,
+                    deadline_after(&server->options));
+        } else {
+            serve_connection(server, connection.socket);
+        }
+        close(connection.socket);
+    }
+
+    /* the thread is about to exit, so its traversal stack is no longer needed */
+    NodeVisitor_release_stack();
+    return NULL;
+}
+
+
+/*
+ * SERVER
+ */
+
+Server* Server_open (const char* socket_path, const ServerOptions* options)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return NULL;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    /* replace a stale socket, but not a live one */
+    int existing = connect_to(socket_path);
+    if (existing >= 0) {
+        close(existing);
+        fprintf(stderr, "A server is already listening on %s\n", socket_path);
+        return NULL;
+    }
+    unlink(socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+        if (listener >= 0) {
+            close(listener);
+        }
+        return NULL;
+    }
+
+    Server* server = (Server*)calloc(1, sizeof(Server));
+    CHECK_MALLOC_PTR(server)
+    server->socket_path = copy_string(socket_path);
+    server->listener = listener;
+    server->options.workers = 0;
+    server->options.queue_capacity = SERVER_QUEUE_CAPACITY;
+    server->options.timeout_ms = SERVER_TIMEOUT_MS;
+    if (options != NULL) {
+        server->options = *options;
+    }
+    if (server->options.workers <= 0) {
+        server->options.workers = default_thread_count();
+    }
+    if (server->options.queue_capacity <= 0) {
+        server->options.queue_capacity = 1;
+    }
+    if (server->options.name_limit == 0) {
+        server->options.name_limit = SERVER_NAME_LIMIT;
+    }
+    if (server->options.connection_ms <= 0) {
+        server->options.connection_ms = SERVER_CONNECTION_MS;
+    }
+    atomic_init(&server->stopping, false);
+    pthread_rwlock_init(&server->compiling, NULL);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->ready, NULL);
+    server->queue = (QueuedConnection*)calloc(server->options.queue_capacity, sizeof(QueuedConnection));
+    CHECK_MALLOC_PTR(server->queue)
+    return server;
+}
+
+void Server_run (Server* server)
+{
+    int workers = server->options.workers;
+    pthread_t* threads = (pthread_t*)calloc(workers, sizeof(pthread_t));
+    CHECK_MALLOC_PTR(threads)
+    int started = 0;
+    while (started < workers && pthread_create(&threads[started], NULL, server_worker, server) == 0) {
+        started++;
+    }
+
+    while (started > 0 && !atomic_load(&server->stopping)) {
+        struct pollfd listening = { .fd = server->listener, .events = POLLIN };
+        if (poll(&listening, 1, SERVER_POLL_MS) <= 0) {
+            continue;
+        }
+        int client = accept(server->listener, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        if (!enqueue_connection(server, client)) {
+            static const char message[] = "Server busy\n";
+            send_reply(client, SERVER_FAILED, message, sizeof(message) - 1,
+                    deadline_after(&server->options));
+            close(client);
+        }
+    }
+
+    /* finish the connections already accepted */
+    pthread_mutex_lock(&server->lock);
+    server->closed = true;
+    pthread_cond_broadcast(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+void Server_stop (Server* server)
+{
+    atomic_store(&server->stopping, true);
+}
+
+void Server_free (Server* server)
+{
+    close(server->listener);
+    unlink(server->socket_path);
+    free(server->socket_path);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->ready);
+    pthread_rwlock_destroy(&server->compiling);
+    free(server->queue);
+    free(server);
+}
+
+
+/*
+ * CLIENT
+ */
+
+bool Server_request (const char* socket_path, ServerSource source, ServerOutput output,
+        const char* data, size_t length, ServerReply* reply)
+{
+    return Server_request_outputs(socket_path, source, &output, 1, data, length, reply);
+}
+
+bool Server_request_outputs (const char* socket_path, ServerSource source, const ServerOutput* outputs,
+        int count, const char* data, size_t length, ServerReply* replies)
+{
+    for (int i = 0; i < count; i++) {
+        replies[i] = (ServerReply){ SERVER_FAILED, NULL, 0 };
+    }
+    if (count < 1 || count > SERVER_MAX_OUTPUTS || length > SERVER_MAX_DATA) {
+        return false;
+    }
+    int socket = connect_to(socket_path);
+    if (socket < 0) {
+        return false;
+    }
+    char header[2 + SERVER_MAX_OUTPUTS] = { (char)source, (char)('0' + count) };
+    for (int i = 0; i < count; i++) {
+        header[2 + i] = (char)outputs[i];
+    }
+
+    /* a busy server replies without reading the request, so the write may fail */
+    write_frame(socket, header, 2 + count, data, length, 0);
+    bool complete = false;
+    for (int i = 0; i < count && !complete; i++) {
+        size_t reply_length = 0;
+        char* body = read_frame(socket, SIZE_MAX - 1, 0, &reply_length);
+        if (body == NULL || reply_length == 0) {
+            free(body);
+            break;
+        }
+
+        /* drop the status byte */
+        replies[i].status = (ServerStatus)body[0];
+        replies[i].length = reply_length - 1;
+        memmove(body, body + 1, reply_length);
+        replies[i].text = body;
+        complete = (i == count - 1 || replies[i].status != SERVER_OK);
+    }
+    close(socket);
+    return complete;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file source.c
+ * @brief Decaf source file input
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scan.h"
+#include "source.h"
+
+/**
+ * @brief Map a regular file read-only, followed by the zero padding that the
+ * vector scanning kernels need (see @ref SCAN_PADDING)
+ *
+ * A mapping is zero-filled past the end of the file only up to the end of the
+ * last page, so an address range @ref SCAN_PADDING bytes longer than the file
+ * (rounded up to whole pages) is reserved with an anonymous zero mapping first
+ * and the file is then mapped over the start of it. The mapping starts on a
+ * page boundary, so it is aligned as well.
+ *
+ * @returns Start of the mapping, or @c NULL if it failed
+ */
+static char* map_file (int fd, size_t size, size_t* mapped_size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = (size + SCAN_PADDING + page - 1) / page * page;
+    char* base = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, length);
+        return NULL;
+    }
+    *mapped_size = length;
+    return base;
+}
+
+/**
+ * @brief Read everything from a file descriptor into a padded heap buffer (see
+ * @ref scan_buffer_alloc)
+ *
+ * @param size_hint Expected size (e.g., from @c fstat), or zero if unknown
+ * @returns NUL-terminated buffer, or @c NULL on a read error
+ */
+static char* read_all (int fd, size_t size_hint, size_t* size)
+{
+    /* read one byte past the expected size to detect the end without another call */
+    size_t capacity = (size_hint > 0 ? size_hint + 1 : 65536);
+    size_t length = 0;
+    char* buffer = scan_buffer_alloc(capacity);
+    for (;;) {
+        if (length == capacity) {
+            /* there is no aligned realloc, so move the text to a bigger buffer */
+            char* bigger = scan_buffer_alloc(capacity * 2);
+            memcpy(bigger, buffer, length);
+            free(buffer);
+            buffer = bigger;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, buffer + length, capacity - length);
+        if (n == 0) {
+            break;
+        } else if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(buffer);
+            return NULL;
+        }
+        length += (size_t)n;
+    }
+    memset(buffer + length, 0, capacity - length);
+    *size = length;
+    return buffer;
+}
+
+/**
+ * @brief Load a source file (see @ref SourceFile_open), mapping it only if
+ * @p map is true
+ */
+static SourceFile* load_source_file (const char* filename, bool map)
+{
+    bool use_stdin = (strcmp(filename, "-") == 0);
+    int fd = (use_stdin ? STDIN_FILENO : open(filename, O_RDONLY));
+    if (fd < 0) {
+        return NULL;
+    }
+
+    SourceFile* source = (SourceFile*)calloc(1, sizeof(SourceFile));
+    CHECK_MALLOC_PTR(source)
+
+    /* map regular, non-empty files; read everything else */
+    struct stat info;
+    bool regular = (fstat(fd, &info) == 0 && S_ISREG(info.st_mode));
+    char* text = NULL;
+    if (map && regular && info.st_size > 0) {
+        source->size = (size_t)info.st_size;
+        text = map_file(fd, source->size, &source->mapped_size);
+    }
+    if (text == NULL) {
+        text = read_all(fd, regular ? (size_t)info.st_size : 0, &source->size);
+    }
+
+    int saved_errno = errno;
+    if (!use_stdin) {
+        close(fd);
+    }
+    if (text == NULL) {
+        free(source);
+        errno = saved_errno;
+        return NULL;
+    }
+    source->text = text;
+    return source;
+}
+
+SourceFile* SourceFile_open (const char* filename)
+{
+    return load_source_file(filename, true);
+}
+
+SourceFile* SourceFile_read (const char* filename)
+{
+    return load_source_file(filename, false);
+}
+
+void SourceFile_free (SourceFile* source)
+{
+    if (source->mapped_size > 0) {
+        munmap((void*)source->text, source->mapped_size);
+    } else {
+        free((void*)source->text);
+    }
+    free(source);
+}
@@ -41,22 +41,172 @@ const char* TokenType_to_string (TokenType type)
     return "INVALID";
 }
 
-bool token_str_eq (const char* str1, const char* str2)
+/**
+ * @brief Entry in the keyword and symbol hash table
+ */
+typedef struct KindEntry
 {
-    return strncmp(str1, str2, MAX_TOKEN_LEN) == 0;
+    const char* text;   /**< @brief Keyword or symbol text (or @c NULL for an empty slot) */
+    TokenKind kind;     /**< @brief Kind of the keyword or symbol */
+} KindEntry;
+
+/**
+ * @brief Size of the keyword and symbol hash table (must be a power of two)
+ */
+#define KIND_TABLE_SIZE 128
+
+/**
+ * @brief Hash a keyword or symbol for @ref kind_table
+ *
+ * The multipliers were chosen so that every keyword, reserved word, and
+ * symbol lands in its own slot.
+ */
+#define KIND_HASH(TEXT, LEN) \
+    (((unsigned char)(TEXT)[0] + 14u * (unsigned char)(TEXT)[(LEN) - 1] + 11u * (LEN)) & (KIND_TABLE_SIZE - 1))
+
+/**
+ * @brief Perfect hash table of keywords, reserved words, and symbols
+ */
+static const KindEntry kind_table[KIND_TABLE_SIZE] = {
+    [  0] = { ";",           TK_SEMICOLON },
+    [  1] = { "*",           TK_STAR },
+    [  2] = { "null",        TK_RESERVED },
+    [  8] = { "callout",     TK_RESERVED },
+    [ 13] = { "!=",          TK_NE },
+    [ 15] = { "<",           TK_LT },
+    [ 16] = { "+",           TK_PLUS },
+    [ 17] = { "new",         TK_RESERVED },
+    [ 19] = { "if",          TK_IF },
+    [ 23] = { "else",        TK_ELSE },
+    [ 25] = { "def",         TK_DEF },
+    [ 26] = { "void",        TK_VOID },
+    [ 30] = { "=",           TK_ASSIGN },
+    [ 31] = { ",",           TK_COMMA },
+    [ 33] = { "implements",  TK_RESERVED },
+    [ 35] = { "false",       TK_FALSE },
+    [ 38] = { "true",        TK_TRUE },
+    [ 40] = { "<=",          TK_LE },
+    [ 41] = { "==",          TK_EQ },
+    [ 42] = { ">=",          TK_GE },
+    [ 44] = { "double",      TK_RESERVED },
+    [ 45] = { ">",           TK_GT },
+    [ 46] = { "-",           TK_MINUS },
+    [ 52] = { "while",       TK_WHILE },
+    [ 54] = { "%",           TK_PERCENT },
+    [ 56] = { "return",      TK_RETURN },
+    [ 64] = { "{",           TK_LBRACE },
+    [ 65] = { "continue",    TK_CONTINUE },
+    [ 67] = { "for",         TK_RESERVED },
+    [ 76] = { "/",           TK_SLASH },
+    [ 80] = { "&&",          TK_AND },
+    [ 82] = { "interface",   TK_RESERVED },
+    [ 87] = { "string",      TK_RESERVED },
+    [ 90] = { "||",          TK_OR },
+    [ 94] = { "}",           TK_RBRACE },
+    [ 96] = { "[",           TK_LBRACKET },
+    [ 98] = { "int",         TK_INT },
+    [ 99] = { "(",           TK_LPAREN },
+    [100] = { "class",       TK_RESERVED },
+    [106] = { "this",        TK_RESERVED },
+    [114] = { ")",           TK_RPAREN },
+    [115] = { "break",       TK_BREAK },
+    [117] = { "float",       TK_RESERVED },
+    [118] = { "bool",        TK_BOOL },
+    [122] = { "!",           TK_BANG },
+    [124] = { "extends",     TK_RESERVED },
+    [126] = { "]",           TK_RBRACKET },
+};
+
+TokenKind TokenKind_lookup (const char* text, size_t length)
+{
+    if (length == 0) {
+        return TK_NONE;
+    }
+    const KindEntry* entry = &kind_table[KIND_HASH(text, length)];
+    if (entry->text != NULL && strncmp(entry->text, text, length) == 0 && entry->text[length] == '\0') {
+        return entry->kind;
+    }
+    return TK_NONE;
+}
+
+const char* TokenKind_to_string (TokenKind kind)
+{
+    static const char* const spellings[NUM_TOKEN_KINDS] = {
+        [TK_NONE] = "", [TK_RESERVED] = "",
+        [TK_DEF] = "def", [TK_IF] = "if", [TK_ELSE] = "else", [TK_WHILE] = "while",
+        [TK_RETURN] = "return", [TK_BREAK] = "break", [TK_CONTINUE] = "continue",
+        [TK_INT] = "int", [TK_BOOL] = "bool", [TK_VOID] = "void",
+        [TK_TRUE] = "true", [TK_FALSE] = "false",
+        [TK_LPAREN] = "(", [TK_RPAREN] = ")", [TK_LBRACE] = "{", [TK_RBRACE] = "}",
+        [TK_LBRACKET] = "[", [TK_RBRACKET] = "]", [TK_COMMA] = ",", [TK_SEMICOLON] = ";",
+        [TK_ASSIGN] = "=", [TK_OR] = "||", [TK_AND] = "&&", [TK_EQ] = "==", [TK_NE] = "!=",
+        [TK_LT] = "<", [TK_LE] = "<=", [TK_GE] = ">=", [TK_GT] = ">",
+        [TK_PLUS] = "+", [TK_MINUS] = "-", [TK_STAR] = "*", [TK_SLASH] = "/",
+        [TK_PERCENT] = "%", [TK_BANG] = "!"
+    };
+    if ((unsigned)kind >= NUM_TOKEN_KINDS) {
+        return "INVALID";
+    }
+    return spellings[kind];
+}
+
+/**
+ * @brief Look up the kind of a token with the given type and text
+ */
+static TokenKind classify (TokenType type, const char* text, size_t length)
+{
+    return (type == KEY || type == SYM) ? TokenKind_lookup(text, length) : TK_NONE;
 }
 
 Token* Token_new (TokenType type, const char* text, int line)
 {
-    Token* token = (Token*)calloc(1, sizeof(Token));
+    /* the text lives right after the token, in the same allocation */
+    size_t length = strlen(text);
+    Token* token = (Token*)calloc(1, sizeof(Token) + length + 1);
+    CHECK_MALLOC_PTR(token)
+    char* copy = (char*)(token + 1);
+    memcpy(copy, text, length);
+    token->type = type;
+    token->kind = classify(type, copy, length);
+    token->line = line;
+    token->source = copy;
+    token->span.offset = 0;
+    token->span.length = (uint32_t)length;
+    return token;
+}
+
+Token* Token_new_span (TokenType type, const char* source, uint32_t offset, uint32_t length, int line)
+{
+    Token* token = (Token*)malloc(sizeof(Token));
     CHECK_MALLOC_PTR(token)
     token->type = type;
-    snprintf(token->text, MAX_TOKEN_LEN, "%s", text);
+    token->kind = classify(type, source + offset, length);
     token->line = line;
-    token->next = NULL;
+    token->source = source;
+    token->span.offset = offset;
+    token->span.length = length;
     return token;
 }
 
+const char* Token_text (const Token* token)
+{
+    return token->source + token->span.offset;
+}
+
+bool Token_text_eq (const Token* token, const char* str)
+{
+    return strncmp(Token_text(token), str, token->span.length) == 0 && str[token->span.length] == '\0';
+}
+
+char* Token_text_dup (const Token* token)
+{
+    char* text = (char*)malloc(token->span.length + 1);
+    CHECK_MALLOC_PTR(text)
+    memcpy(text, Token_text(token), token->span.length);
+    text[token->span.length] = '\0';
+    return text;
+}
+
 void Token_free (Token* token)
 {
     free(token);
@@ -66,71 +216,170 @@ TokenQueue* TokenQueue_new (void)
 {
     TokenQueue* queue = calloc(1, sizeof(TokenQueue));
     CHECK_MALLOC_PTR(queue)
+    queue->text = "";
+    return queue;
+}
+
+TokenQueue* TokenQueue_new_for_text (const char* text)
+{
+    TokenQueue* queue = TokenQueue_new();
+    queue->text = text;
+    return queue;
+}
+
+TokenQueue* TokenQueue_new_streaming (const char* text, TokenSource* source)
+{
+    TokenQueue* queue = TokenQueue_new_for_text(text);
+    queue->source = source;
     return queue;
 }
 
+/**
+ * @brief Pull tokens from the queue's source until it holds more than @c k
+ * tokens
+ *
+ * @returns True if and only if the queue now holds more than @c k tokens
+ */
+static bool TokenQueue_fill (TokenQueue* queue, size_t k)
+{
+    while (queue->count - queue->head <= k) {
+        if (queue->source == NULL) {
+            return false;
+        }
+        if (!queue->source->produce(queue->source, queue)) {
+            /* end of input: nothing more will be produced */
+            queue->source->free(queue->source);
+            queue->source = NULL;
+        }
+    }
+    return true;
+}
+
+void TokenQueue_push (TokenQueue* queue, TokenType type, TokenKind kind, uint32_t offset, uint32_t length, int line)
+{
+    if (queue->count == queue->capacity) {
+        size_t pending = queue->count - queue->head;
+        if (queue->head > 0 && pending <= queue->capacity / 2) {
+            /* most of the buffer has already been consumed: slide the rest down */
+            memmove(queue->types, queue->types + queue->head, pending * sizeof(uint8_t));
+            memmove(queue->kinds, queue->kinds + queue->head, pending * sizeof(uint8_t));
+            memmove(queue->lines, queue->lines + queue->head, pending * sizeof(int));
+            memmove(queue->spans, queue->spans + queue->head, pending * sizeof(TokenSpan));
+            queue->head = 0;
+            queue->count = pending;
+        } else {
+            queue->capacity = (queue->capacity == 0 ? 64 : queue->capacity * 2);
+            queue->types = (uint8_t*)realloc(queue->types, queue->capacity * sizeof(uint8_t));
+            CHECK_MALLOC_PTR(queue->types)
+            queue->kinds = (uint8_t*)realloc(queue->kinds, queue->capacity * sizeof(uint8_t));
+            CHECK_MALLOC_PTR(queue->kinds)
+            queue->lines = (int*)realloc(queue->lines, queue->capacity * sizeof(int));
+            CHECK_MALLOC_PTR(queue->lines)
+            queue->spans = (TokenSpan*)realloc(queue->spans, queue->capacity * sizeof(TokenSpan));
+            CHECK_MALLOC_PTR(queue->spans)
+        }
+    }
+    queue->types[queue->count] = (uint8_t)type;
+    queue->kinds[queue->count] = (uint8_t)kind;
+    queue->lines[queue->count] = line;
+    queue->spans[queue->count].offset = offset;
+    queue->spans[queue->count].length = length;
+    queue->count++;
+}
+
 void TokenQueue_add (TokenQueue* queue, Token* token)
 {
-    if (queue->head == NULL) {
-        /* empty list: new token is both head and tail */
-        queue->head = token;
-        queue->tail = token;
-    } else {
-        /* non-empty list: append to tail */
-        queue->tail->next = token;
-        queue->tail = token;
+    /* copy the text to the end of the queue's own buffer */
+    size_t length = token->span.length;
+    if (queue->owned_length + length + 1 > queue->owned_capacity) {
+        queue->owned_capacity = (queue->owned_length + length + 1) * 2;
+        queue->owned_text = (char*)realloc(queue->owned_text, queue->owned_capacity);
+        CHECK_MALLOC_PTR(queue->owned_text)
+    }
+    memcpy(queue->owned_text + queue->owned_length, Token_text(token), length);
+    queue->owned_text[queue->owned_length + length] = '\0';
+    queue->text = queue->owned_text;
+
+    TokenQueue_push(queue, token->type, token->kind, (uint32_t)queue->owned_length, (uint32_t)length, token->line);
+    queue->owned_length += length + 1;
+    Token_free(token);
+}
+
+/**
+ * @brief Build a token value for the token at the given absolute index (or
+ * an empty token if @c index is past the end)
+ */
+static Token TokenQueue_get (TokenQueue* queue, size_t index)
+{
+    Token token = { ID, TK_NONE, 0, "", { 0, 0 } };
+    if (index < queue->count) {
+        token.type = (TokenType)queue->types[index];
+        token.kind = (TokenKind)queue->kinds[index];
+        token.line = queue->lines[index];
+        token.source = queue->text;
+        token.span = queue->spans[index];
     }
+    return token;
 }
 
-Token* TokenQueue_peek (TokenQueue* queue)
+Token TokenQueue_peek (TokenQueue* queue)
 {
-    return queue->head;
+    TokenQueue_fill(queue, 0);
+    return TokenQueue_get(queue, queue->head);
 }
 
-Token* TokenQueue_remove (TokenQueue* queue)
+Token TokenQueue_peek_ahead (TokenQueue* queue, size_t k)
 {
-    if (queue->head == NULL) {
-        /* queue is empty: return NULL */
-        return NULL;
-    } else {
-        /* queue is non-empty: remove a token from head and return it */
-        Token* tmp = queue->head;
-        queue->head = queue->head->next;
-        if (queue->head == NULL) {
-            queue->tail = NULL;    /* just removed the last item */
-        }
-        return tmp;
+    TokenQueue_fill(queue, k);
+    return TokenQueue_get(queue, queue->head + k);
+}
+
+bool TokenQueue_has_ahead (TokenQueue* queue, size_t k)
+{
+    return TokenQueue_fill(queue, k);
+}
+
+Token TokenQueue_remove (TokenQueue* queue)
+{
+    TokenQueue_fill(queue, 0);
+    Token token = TokenQueue_get(queue, queue->head);
+    if (queue->head < queue->count) {
+        queue->head++;
     }
+    return token;
 }
 
 bool TokenQueue_is_empty (TokenQueue* queue)
 {
-    return queue->head == NULL;
+    return !TokenQueue_fill(queue, 0);
 }
 
 size_t TokenQueue_size (TokenQueue* queue)
 {
-    size_t size = 0;
-    for (Token* cur = queue->head; cur != NULL; cur = cur->next) {
-        size++;
-    }
-    return size;
+    TokenQueue_fill(queue, SIZE_MAX - 1);
+    return queue->count - queue->head;
 }
 
 void TokenQueue_print (TokenQueue* queue, FILE* out)
 {
-    for (Token* t = queue->head; t != NULL; t = t->next) {
-        fprintf(out, "%-8s [line %03d]  %s\n",
-                TokenType_to_string(t->type),
-                t->line, t->text);
+    TokenQueue_fill(queue, SIZE_MAX - 1);
+    for (size_t i = queue->head; i < queue->count; i++) {
+        Token t = TokenQueue_get(queue, i);
+        fprintf(out, "%-8s [line %03d]  %.*s\n",
+                TokenType_to_string(t.type),
+                t.line, (int)t.span.length, Token_text(&t));
     }
 }
 
 void TokenQueue_free (TokenQueue* queue)
 {
-    /* clean up any remaining tokens */
-    while (!TokenQueue_is_empty(queue)) {
-        Token_free(TokenQueue_remove(queue));
+    if (queue->source != NULL) {
+        queue->source->free(queue->source);
     }
+    free(queue->types);
+    free(queue->kinds);
+    free(queue->lines);
+    free(queue->spans);
+    free(queue->owned_text);
     free(queue);
 }
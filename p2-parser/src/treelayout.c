@@ -0,0 +1,240 @@
+/**
+ * @file treelayout.c
+ * @brief Tidy tree layout
+ *
+ * The names follow Buchheim, Jünger, and Leipert, "Improving Walker's
+ * Algorithm to Run in Linear Time" (Graph Drawing 2002). Their recursive
+ * first walk becomes a post-order loop over the sibling links, and the
+ * second walk a pass over the nodes in the order they were added.
+ */
+
+#include "treelayout.h"
+
+TreeLayout* TreeLayout_new (double gap)
+{
+    TreeLayout* layout = (TreeLayout*)calloc(1, sizeof(TreeLayout));
+    CHECK_MALLOC_PTR(layout)
+    layout->gap = gap;
+    return layout;
+}
+
+LayoutIndex TreeLayout_add (TreeLayout* layout, LayoutIndex parent, double width)
+{
+    if (layout->count == layout->capacity) {
+        layout->capacity = (layout->capacity == 0 ? 256 : layout->capacity * 2);
+        layout->nodes = (LayoutNode*)realloc(layout->nodes, layout->capacity * sizeof(LayoutNode));
+        CHECK_MALLOC_PTR(layout->nodes)
+    }
+    LayoutIndex index = layout->count++;
+    LayoutNode* node = &layout->nodes[index];
+    node->parent = parent;
+    node->first_child = node->last_child = LAYOUT_NONE;
+    node->prev_sibling = node->next_sibling = LAYOUT_NONE;
+    node->number = 0;
+    node->level = 0;
+    node->thread = LAYOUT_NONE;
+    node->ancestor = index;
+    node->default_ancestor = LAYOUT_NONE;
+    node->width = width;
+    node->prelim = node->mod = node->shift = node->change = node->x = 0.0;
+
+    if (parent != LAYOUT_NONE) {
+        LayoutNode* up = &layout->nodes[parent];
+        node->level = up->level + 1;
+        if (up->last_child == LAYOUT_NONE) {
+            up->first_child = index;
+        } else {
+            node->prev_sibling = up->last_child;
+            node->number = layout->nodes[up->last_child].number + 1;
+            layout->nodes[up->last_child].next_sibling = index;
+        }
+        up->last_child = index;
+    }
+    return index;
+}
+
+/**
+ * @brief Minimum distance between the centres of two neighbouring nodes
+ */
+static double distance (TreeLayout* layout, LayoutIndex left, LayoutIndex right)
+{
+    return (layout->nodes[left].width + layout->nodes[right].width) / 2 + layout->gap;
+}
+
+/**
+ * @brief Next node on the left contour of a subtree (or @ref LAYOUT_NONE)
+ */
+static LayoutIndex next_left (LayoutNode* nodes, LayoutIndex v)
+{
+    return (nodes[v].first_child != LAYOUT_NONE ? nodes[v].first_child : nodes[v].thread);
+}
+
+/**
+ * @brief Next node on the right contour of a subtree (or @ref LAYOUT_NONE)
+ */
+static LayoutIndex next_right (LayoutNode* nodes, LayoutIndex v)
+{
+    return (nodes[v].last_child != LAYOUT_NONE ? nodes[v].last_child : nodes[v].thread);
+}
+
+/**
+ * @brief Shift the subtree of @c right, and record the shift to spread over
+ * the siblings between @c left and @c right
+ */
+static void move_subtree (LayoutNode* nodes, LayoutIndex left, LayoutIndex right, double shift)
+{
+    double subtrees = (double)(nodes[right].number - nodes[left].number);
+    nodes[right].change -= shift / subtrees;
+    nodes[right].shift += shift;
+    nodes[left].change += shift / subtrees;
+    nodes[right].prelim += shift;
+    nodes[right].mod += shift;
+}
+
+/**
+ * @brief Apply the shifts recorded for the children of a node
+ */
+static void execute_shifts (LayoutNode* nodes, LayoutIndex v)
+{
+    double shift = 0.0, change = 0.0;
+    for (LayoutIndex w = nodes[v].last_child; w != LAYOUT_NONE; w = nodes[w].prev_sibling) {
+        nodes[w].prelim += shift;
+        nodes[w].mod += shift;
+        change += nodes[w].change;
+        shift += nodes[w].shift + change;
+    }
+}
+
+/**
+ * @brief Push the subtree of a node away from the subtrees of its left
+ * siblings far enough that they do not overlap on any level
+ */
+static void apportion (TreeLayout* layout, LayoutIndex v)
+{
+    LayoutNode* nodes = layout->nodes;
+    LayoutNode* parent = &nodes[nodes[v].parent];
+    LayoutIndex w = nodes[v].prev_sibling;
+    if (w == LAYOUT_NONE) {
+        parent->default_ancestor = v;
+        return;
+    }
+
+    /* walk down the inner and outer contours of both sides together */
+    LayoutIndex vir = v, vor = v, vil = w, vol = parent->first_child;
+    double sir = nodes[vir].mod, sor = nodes[vor].mod;
+    double sil = nodes[vil].mod, sol = nodes[vol].mod;
+    while (next_right(nodes, vil) != LAYOUT_NONE && next_left(nodes, vir) != LAYOUT_NONE) {
+        vil = next_right(nodes, vil);
+        vir = next_left(nodes, vir);
+        vol = next_left(nodes, vol);
+        vor = next_right(nodes, vor);
+        nodes[vor].ancestor = v;
+        double shift = (nodes[vil].prelim + sil) - (nodes[vir].prelim + sir) + distance(layout, vil, vir);
+        if (shift > 0) {
+            LayoutIndex ancestor = nodes[vil].ancestor;
+            if (nodes[ancestor].parent != nodes[v].parent) {
+                ancestor = parent->default_ancestor;
+            }
+            move_subtree(nodes, ancestor, v, shift);
+            sir += shift;
+            sor += shift;
+        }
+        sil += nodes[vil].mod;
+        sir += nodes[vir].mod;
+        sol += nodes[vol].mod;
+        sor += nodes[vor].mod;
+    }
+
+    /* thread the shorter contour onto the longer one */
+    if (next_right(nodes, vil) != LAYOUT_NONE && next_right(nodes, vor) == LAYOUT_NONE) {
+        nodes[vor].thread = next_right(nodes, vil);
+        nodes[vor].mod += sil - sor;
+    }
+    if (next_left(nodes, vir) != LAYOUT_NONE && next_left(nodes, vol) == LAYOUT_NONE) {
+        nodes[vol].thread = next_left(nodes, vir);
+        nodes[vol].mod += sir - sol;
+        parent->default_ancestor = v;
+    }
+}
+
+/**
+ * @brief Place a node relative to its left siblings once its subtree has been
+ * laid out (the rest of the first walk for that node)
+ */
+static void finish_subtree (TreeLayout* layout, LayoutIndex v)
+{
+    LayoutNode* nodes = layout->nodes;
+    LayoutNode* node = &nodes[v];
+    LayoutIndex w = node->prev_sibling;
+    if (node->first_child == LAYOUT_NONE) {
+        node->prelim = (w != LAYOUT_NONE ? nodes[w].prelim + distance(layout, w, v) : 0.0);
+    } else {
+        execute_shifts(nodes, v);
+        double midpoint = (nodes[node->first_child].prelim + nodes[node->last_child].prelim) / 2;
+        if (w != LAYOUT_NONE) {
+            node->prelim = nodes[w].prelim + distance(layout, w, v);
+            node->mod = node->prelim - midpoint;
+        } else {
+            node->prelim = midpoint;
+        }
+    }
+    if (node->parent != LAYOUT_NONE) {
+        apportion(layout, v);
+    }
+}
+
+void TreeLayout_compute (TreeLayout* layout)
+{
+    LayoutNode* nodes = layout->nodes;
+
+    /* first walk: visit the nodes in post-order, following the sibling links */
+    LayoutIndex v = 0;
+    while (v != LAYOUT_NONE) {
+        while (nodes[v].first_child != LAYOUT_NONE) {
+            v = nodes[v].first_child;
+        }
+        finish_subtree(layout, v);
+        while (nodes[v].next_sibling == LAYOUT_NONE && nodes[v].parent != LAYOUT_NONE) {
+            v = nodes[v].parent;
+            finish_subtree(layout, v);
+        }
+        v = nodes[v].next_sibling;
+    }
+
+    /*
+     * second walk: parents come before their children, so each node's
+     * position follows from its parent's (the sum of the modifiers above a
+     * node is its parent's position minus the parent's preliminary position,
+     * plus the parent's modifier)
+     */
+    double left = 0.0, right = 0.0;
+    layout->levels = 0;
+    for (LayoutIndex i = 0; i < layout->count; i++) {
+        LayoutNode* node = &nodes[i];
+        if (node->parent == LAYOUT_NONE) {
+            node->x = node->prelim;
+        } else {
+            LayoutNode* parent = &nodes[node->parent];
+            node->x = node->prelim + (parent->x - parent->prelim) + parent->mod;
+        }
+        if (i == 0 || node->x - node->width / 2 < left) {
+            left = node->x - node->width / 2;
+        }
+        if (i == 0 || node->x + node->width / 2 > right) {
+            right = node->x + node->width / 2;
+        }
+        if (node->level + 1 > layout->levels) {
+            layout->levels = node->level + 1;
+        }
+    }
+    for (LayoutIndex i = 0; i < layout->count; i++) {
+        nodes[i].x -= left;
+    }
+    layout->extent = right - left;
+}
+
+void TreeLayout_free (TreeLayout* layout)
+{
+    free(layout->nodes);
+    free(layout);
+}
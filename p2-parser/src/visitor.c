@@ -1,4 +1,9 @@
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "visitor.h"
+#include "outbuf.h"
+#include "treelayout.h"
 
 
 /*
@@ -16,167 +21,285 @@ NodeVisitor* NodeVisitor_new(void)
     CHECK_MALLOC_PTR(v)
     v->data = NULL;
     v->dtor = NULL;
-    v->previsit_default      = do_nothing;
-    v->postvisit_default     = do_nothing;
-    v->previsit_program      = NULL;
-    v->postvisit_program     = NULL;
-    v->previsit_vardecl      = NULL;
-    v->postvisit_vardecl     = NULL;
-    v->previsit_funcdecl     = NULL;
-    v->postvisit_funcdecl    = NULL;
-    v->previsit_block        = NULL;
-    v->postvisit_block       = NULL;
-    v->previsit_assignment   = NULL;
-    v->postvisit_assignment  = NULL;
-    v->previsit_conditional  = NULL;
-    v->postvisit_conditional = NULL;
-    v->previsit_whileloop    = NULL;
-    v->postvisit_whileloop   = NULL;
-    v->previsit_return       = NULL;
-    v->postvisit_return      = NULL;
-    v->previsit_break        = NULL;
-    v->postvisit_break       = NULL;
-    v->previsit_continue     = NULL;
-    v->postvisit_continue    = NULL;
-    v->previsit_binaryop     = NULL;
-    v->invisit_binaryop      = NULL;
-    v->postvisit_binaryop    = NULL;
-    v->previsit_unaryop      = NULL;
-    v->postvisit_unaryop     = NULL;
-    v->previsit_location     = NULL;
-    v->postvisit_location    = NULL;
-    v->previsit_funccall     = NULL;
-    v->postvisit_funccall    = NULL;
-    v->previsit_literal      = NULL;
-    v->postvisit_literal     = NULL;
+    v->control = TRAVERSE_CONTINUE;
+    v->fork = NULL;
+    v->join = NULL;
+    v->previsit_default  = do_nothing;
+    v->postvisit_default = do_nothing;
+#define CLEAR_HOOKS(TYPE, name, label, CHILDREN) \
+    v->previsit_ ## name  = NULL; \
+    v->postvisit_ ## name = NULL;
+    AST_NODE_KINDS(CLEAR_HOOKS)
+#undef CLEAR_HOOKS
+    v->invisit_binaryop  = NULL;
     return v;
 }
 
-#define PREVISIT(TYPE)  if (visitor->previsit_ ## TYPE != NULL)  { visitor->previsit_ ## TYPE (visitor, node); } \
-                                                           else  { visitor->previsit_default  (visitor, node); }
-#define POSTVISIT(TYPE) if (visitor->postvisit_ ## TYPE != NULL) { visitor->postvisit_ ## TYPE(visitor, node); } \
-                                                           else  { visitor->postvisit_default (visitor, node); }
-
-void NodeVisitor_traverse (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Callbacks of a visitor indexed by node type, with the defaults filled
+ * in (so that invoking a callback never needs a @c NULL test)
+ */
+typedef struct VisitorDispatch
 {
-    switch (node->type)
-    {
-        case PROGRAM:
-            PREVISIT(program)
-            FOR_EACH(ASTNode*, var, node->program.variables) {
-                NodeVisitor_traverse(visitor, var);
-            }
-            FOR_EACH(ASTNode*, func, node->program.functions) {
-                NodeVisitor_traverse(visitor, func);
-            }
-            POSTVISIT(program)
-            break;
+    VisitorHook previsit[NUM_NODE_TYPES];   /**< @brief Previsit callbacks */
+    VisitorHook postvisit[NUM_NODE_TYPES];  /**< @brief Postvisit callbacks */
+    VisitorHook invisit_binaryop;           /**< @brief In-visit callback (or @c NULL) */
+} VisitorDispatch;
 
-        case VARDECL:
-            PREVISIT(vardecl)
-            POSTVISIT(vardecl)
-            break;
-
-        case FUNCDECL:
-            PREVISIT(funcdecl)
-            NodeVisitor_traverse(visitor, node->funcdecl.body);
-            POSTVISIT(funcdecl)
-            break;
+/**
+ * @brief Look up the callbacks of a visitor
+ */
+static void resolve_dispatch (NodeVisitor* visitor, VisitorDispatch* dispatch)
+{
+#define RESOLVE_HOOKS(TYPE, name, label, CHILDREN) \
+    dispatch->previsit[TYPE]  = (visitor->previsit_ ## name != NULL ? visitor->previsit_ ## name \
+                                                                    : visitor->previsit_default); \
+    dispatch->postvisit[TYPE] = (visitor->postvisit_ ## name != NULL ? visitor->postvisit_ ## name \
+                                                                     : visitor->postvisit_default);
+    AST_NODE_KINDS(RESOLVE_HOOKS)
+#undef RESOLVE_HOOKS
+    dispatch->invisit_binaryop = visitor->invisit_binaryop;
+}
 
-        case BLOCK:
-            PREVISIT(block)
-            FOR_EACH (ASTNode*, var, node->block.variables) {
-                NodeVisitor_traverse(visitor, var);
-            }
-            FOR_EACH (ASTNode*, stmt, node->block.statements) {
-                NodeVisitor_traverse(visitor, stmt);
-            }
-            POSTVISIT(block)
-            break;
+/**
+ * @brief Step of an iterative traversal
+ */
+typedef enum TraversalPhase
+{
+    VISIT_PRE,      /**< @brief Traverse the node */
+    VISIT_LIST,     /**< @brief Traverse the node and the rest of its list */
+    VISIT_NEXT,     /**< @brief Traverse the rest of the list after the node */
+    VISIT_IN,       /**< @brief Invoke the in-visit hook (binary operations only) */
+    VISIT_POST      /**< @brief Invoke the post-visit hook */
+} TraversalPhase;
+
+/**
+ * @brief Pending step of an iterative traversal
+ */
+typedef struct TraversalStep
+{
+    ASTNode* node;          /**< @brief Node to visit */
+    TraversalPhase phase;   /**< @brief Hook to invoke */
+} TraversalStep;
+
+/**
+ * @brief Explicit traversal stack (pending steps, last one on top)
+ *
+ * Each thread keeps one stack and reuses its storage for every traversal.
+ * Traversals started from inside a visitor hook push above the steps of the
+ * enclosing traversal, so entries are always addressed by index.
+ */
+typedef struct TraversalStack
+{
+    TraversalStep* steps;   /**< @brief Pending steps */
+    size_t count;           /**< @brief Number of pending steps */
+    size_t capacity;        /**< @brief Allocated length of @c steps */
+} TraversalStack;
 
-        case ASSIGNMENT:
-            PREVISIT(assignment)
-            NodeVisitor_traverse(visitor, node->assignment.location);
-            NodeVisitor_traverse(visitor, node->assignment.value);
-            POSTVISIT(assignment)
-            break;
+static _Thread_local TraversalStack traversal_stack;
 
-        case CONDITIONAL:
-            PREVISIT(conditional)
-            NodeVisitor_traverse(visitor, node->conditional.condition);
-            NodeVisitor_traverse(visitor, node->conditional.if_block);
-            if (node->conditional.else_block != NULL) {
-                NodeVisitor_traverse(visitor, node->conditional.else_block);
-            }
-            POSTVISIT(conditional)
-            break;
+/**
+ * @brief Make room for more steps on the traversal stack
+ */
+static void grow_traversal_stack (void)
+{
+    TraversalStack* stack = &traversal_stack;
+    stack->capacity = (stack->capacity == 0 ? 256 : stack->capacity * 2);
+    stack->steps = (TraversalStep*)realloc(stack->steps, stack->capacity * sizeof(TraversalStep));
+    CHECK_MALLOC_PTR(stack->steps)
+}
 
-        case WHILELOOP:
-            PREVISIT(whileloop)
-            NodeVisitor_traverse(visitor, node->whileloop.condition);
-            NodeVisitor_traverse(visitor, node->whileloop.body);
-            POSTVISIT(whileloop)
-            break;
+/**
+ * @brief Push a step onto the traversal stack
+ */
+static inline void push_step (ASTNode* node, TraversalPhase phase)
+{
+    TraversalStack* stack = &traversal_stack;
+    if (stack->count == stack->capacity) {
+        grow_traversal_stack();
+    }
+    stack->steps[stack->count].node = node;
+    stack->steps[stack->count].phase = phase;
+    stack->count++;
+}
 
-        case RETURNSTMT:
-            PREVISIT(return)
-            if (node->funcreturn.value != NULL) {
-                NodeVisitor_traverse(visitor, node->funcreturn.value);
-            }
-            POSTVISIT(return)
-            break;
+/**
+ * @brief Push a step that traverses every node in a list
+ *
+ * Each node's successor is looked up only after the node has been traversed,
+ * as with @ref FOR_EACH, so the list is walked once and in step with the
+ * traversal.
+ */
+static void push_list (NodeList* list)
+{
+    if (list->head != NULL) {
+        push_step(list->head, VISIT_LIST);
+    }
+}
 
-        case BREAKSTMT:
-            PREVISIT(break)
-            POSTVISIT(break)
-            break;
+/**
+ * @brief Push a pre-visit step for a child that may be missing
+ */
+static void push_optional (ASTNode* child)
+{
+    if (child != NULL) {
+        push_step(child, VISIT_PRE);
+    }
+}
 
-        case CONTINUESTMT:
-            PREVISIT(continue)
-            POSTVISIT(continue)
-            break;
+/**
+ * @brief Handle a traversal control request made by a previsit callback
+ *
+ * If the callback asked to skip the node's children, the node is post-visited
+ * right away; if it asked to stop, the traversal loop notices the request.
+ *
+ * @returns Node to pre-visit next (always @c NULL)
+ */
+static ASTNode* previsit_pruned (NodeVisitor* visitor, const VisitorDispatch* dispatch, ASTNode* node)
+{
+    if (visitor->control == TRAVERSE_SKIP_CHILDREN) {
+        visitor->control = TRAVERSE_CONTINUE;
+        dispatch->postvisit[node->type](visitor, node);
+    }
+    return NULL;
+}
 
-        case BINARYOP:
-            PREVISIT(binaryop)
-            NodeVisitor_traverse(visitor, node->binaryop.left);
-            if (visitor->invisit_binaryop != NULL) {
-                visitor->invisit_binaryop(visitor, node);
-            }
-            NodeVisitor_traverse(visitor, node->binaryop.right);
-            POSTVISIT(binaryop)
-            break;
+/**
+ * @brief Invoke the pre-visit callback of a node and schedule the rest of its
+ * visit
+ *
+ * The post-visit is pushed first, unless it would do nothing, and then the
+ * children (with the in-visit of a binary operation between its operands) in
+ * reverse order, so that the first child ends up on top. To save a push and a
+ * pop, the first child is returned instead of being left on the stack, and
+ * nodes without children are post-visited right away.
+ *
+ * @returns Node to pre-visit next (or @c NULL to continue with the top of the
+ * stack)
+ */
+static ASTNode* previsit_node (NodeVisitor* visitor, const VisitorDispatch* dispatch, ASTNode* node)
+{
+    if ((unsigned)node->type >= NUM_NODE_TYPES) {
+        Error_throw("ERROR: Unhandled node traversal\n");
+    }
+    dispatch->previsit[node->type](visitor, node);
+    if (visitor->control != TRAVERSE_CONTINUE) {
+        return previsit_pruned(visitor, dispatch, node);
+    }
 
-        case UNARYOP:
-            PREVISIT(unaryop)
-            NodeVisitor_traverse(visitor, node->unaryop.child);
-            POSTVISIT(unaryop)
-            break;
+    VisitorHook postvisit = dispatch->postvisit[node->type];
+    if (postvisit != do_nothing) {
+        push_step(node, VISIT_POST);
+    }
+    size_t first = traversal_stack.count;
+#define AST_CHILD(FIELD)            push_step(node->FIELD, VISIT_PRE);
+#define AST_OPTIONAL_CHILD(FIELD)   push_optional(node->FIELD);
+#define AST_CHILD_LIST(FIELD)       push_list(node->FIELD);
+#define AST_INVISIT                 if (dispatch->invisit_binaryop != NULL) { push_step(node, VISIT_IN); }
+#define SCHEDULE_CHILDREN(TYPE, name, label, CHILDREN) case TYPE: CHILDREN break;
+    switch (node->type) {
+        AST_NODE_KINDS(SCHEDULE_CHILDREN)
+    }
+#undef SCHEDULE_CHILDREN
+#undef AST_INVISIT
+#undef AST_CHILD_LIST
+#undef AST_OPTIONAL_CHILD
+#undef AST_CHILD
+
+    TraversalStep* steps = traversal_stack.steps;
+    size_t count = traversal_stack.count;
+    if (count == first) {
+        if (postvisit != do_nothing) {
+            traversal_stack.count--;
+            postvisit(visitor, node);
+        }
+        return NULL;
+    }
+    for (size_t lo = first, hi = count - 1; lo < hi; lo++, hi--) {
+        TraversalStep tmp = steps[lo];
+        steps[lo] = steps[hi];
+        steps[hi] = tmp;
+    }
+    if (steps[count - 1].phase == VISIT_PRE) {
+        traversal_stack.count--;
+        return steps[count - 1].node;
+    }
+    return NULL;
+}
 
-        case LOCATION:
-            PREVISIT(location)
-            if (node->location.index != NULL) {
-                NodeVisitor_traverse(visitor, node->location.index);
-            }
-            POSTVISIT(location)
-            break;
+/**
+ * @brief Traverse a tree with a visitor whose callbacks have been looked up
+ *
+ * @returns True if a callback stopped the traversal
+ */
+static bool traverse_tree (NodeVisitor* visitor, const VisitorDispatch* dispatch, ASTNode* node)
+{
+    /* steps below this one belong to an enclosing traversal (if any) */
+    size_t base = traversal_stack.count;
+    bool stopped = false;
 
-        case FUNCCALL:
-            PREVISIT(funccall)
-            FOR_EACH (ASTNode*, arg, node->funccall.arguments) {
-                NodeVisitor_traverse(visitor, arg);
+    while (true) {
+        while (node != NULL) {
+            node = previsit_node(visitor, dispatch, node);
+        }
+        if (visitor->control != TRAVERSE_CONTINUE) {
+            /* skipping children only means something to previsit callbacks */
+            if (visitor->control == TRAVERSE_STOP) {
+                traversal_stack.count = base;
+                stopped = true;
+                break;
             }
-            POSTVISIT(funccall)
+            visitor->control = TRAVERSE_CONTINUE;
+        }
+        if (traversal_stack.count == base) {
             break;
+        }
 
-        case LITERAL:
-            PREVISIT(literal)
-            POSTVISIT(literal)
-            break;
+        /* list cursors stay on the stack and advance in place */
+        TraversalStep* top = &traversal_stack.steps[traversal_stack.count - 1];
+        if (top->phase == VISIT_LIST) {
+            top->phase = VISIT_NEXT;
+            node = top->node;
+            continue;
+        }
+        if (top->phase == VISIT_NEXT && top->node->next != NULL) {
+            top->node = top->node->next;
+            node = top->node;
+            continue;
+        }
 
-        default:
-            Error_throw_printf("ERROR: Unhandled node traversal\n");
-            break;
+        TraversalStep step = traversal_stack.steps[--traversal_stack.count];
+        switch (step.phase) {
+            case VISIT_PRE:
+                node = step.node;
+                break;
+            case VISIT_LIST:
+            case VISIT_NEXT:
+                break;
+            case VISIT_IN:
+                dispatch->invisit_binaryop(visitor, step.node);
+                break;
+            case VISIT_POST:
+                dispatch->postvisit[step.node->type](visitor, step.node);
+                break;
+        }
     }
+    visitor->control = TRAVERSE_CONTINUE;
+    return stopped;
+}
+
+bool NodeVisitor_traverse (NodeVisitor* visitor, ASTNode* node)
+{
+    VisitorDispatch dispatch;
+    resolve_dispatch(visitor, &dispatch);
+    return traverse_tree(visitor, &dispatch, node);
+}
+
+void NodeVisitor_release_stack (void)
+{
+    free(traversal_stack.steps);
+    traversal_stack.steps = NULL;
+    traversal_stack.count = traversal_stack.capacity = 0;
 }
 
 void NodeVisitor_traverse_and_free (NodeVisitor* visitor, ASTNode* node)
@@ -195,111 +318,371 @@ void NodeVisitor_free (NodeVisitor* visitor)
 }
 
 
+/*
+ * COMPOSITE VISITOR
+ */
+
+/**
+ * @brief Member of a composite visitor
+ */
+typedef struct CompositeMember
+{
+    NodeVisitor* visitor;       /**< @brief Member visitor */
+    VisitorDispatch dispatch;   /**< @brief Callbacks of the member */
+    ASTNode* skipping;          /**< @brief Node whose children the member skips (or @c NULL) */
+    bool stopped;               /**< @brief True if the member has stopped */
+} CompositeMember;
+
+/**
+ * @brief Members of a composite visitor (visitor data)
+ */
+typedef struct CompositeVisitorData
+{
+    CompositeMember* members;   /**< @brief Members in the order they were added */
+    int count;                  /**< @brief Number of members */
+    int capacity;               /**< @brief Allocated length of @c members */
+    int running;                /**< @brief Number of members that have not stopped */
+    int skipping;               /**< @brief Number of running members that are skipping children */
+} CompositeVisitorData;
+
+#define MEMBERS ((CompositeVisitorData*)visitor->data)
+
+/**
+ * @brief Record the traversal control request (if any) made by a member's
+ * callback
+ *
+ * @param composite Composite visitor data
+ * @param member Member whose callback just returned
+ * @param node Node that was visited
+ * @param phase Kind of callback
+ */
+static void CompositeVisitor_record_control (CompositeVisitorData* composite, CompositeMember* member,
+                                             ASTNode* node, TraversalPhase phase)
+{
+    TraversalControl control = member->visitor->control;
+    member->visitor->control = TRAVERSE_CONTINUE;
+    if (control == TRAVERSE_STOP) {
+        if (member->skipping != NULL) {
+            member->skipping = NULL;
+            composite->skipping--;
+        }
+        member->stopped = true;
+        composite->running--;
+    } else if (control == TRAVERSE_SKIP_CHILDREN && phase == VISIT_PRE) {
+        member->skipping = node;
+        composite->skipping++;
+    }
+}
+
+/**
+ * @brief Pass the combined control requests of the members on to the
+ * traversal of the composite
+ */
+static void CompositeVisitor_update_control (NodeVisitor* visitor, TraversalPhase phase)
+{
+    if (MEMBERS->running == 0) {
+        visitor->control = TRAVERSE_STOP;
+    } else if (phase == VISIT_PRE && MEMBERS->skipping == MEMBERS->running) {
+        visitor->control = TRAVERSE_SKIP_CHILDREN;
+    }
+}
+
+/**
+ * @brief Invoke the previsit callback of every member
+ *
+ * Members that have stopped are left out, and so are members that are skipping
+ * the children of another node.
+ */
+static void CompositeVisitor_previsit (NodeVisitor* visitor, ASTNode* node)
+{
+    for (int i = 0; i < MEMBERS->count; i++) {
+        CompositeMember* entry = &MEMBERS->members[i];
+        if (entry->stopped || entry->skipping != NULL) {
+            continue;
+        }
+        entry->dispatch.previsit[node->type](entry->visitor, node);
+        CompositeVisitor_record_control(MEMBERS, entry, node, VISIT_PRE);
+    }
+    CompositeVisitor_update_control(visitor, VISIT_PRE);
+}
+
+/**
+ * @brief Invoke the in-visit callback of every member that has one
+ */
+static void CompositeVisitor_invisit_binaryop (NodeVisitor* visitor, ASTNode* node)
+{
+    for (int i = 0; i < MEMBERS->count; i++) {
+        CompositeMember* entry = &MEMBERS->members[i];
+        if (entry->stopped || entry->skipping != NULL || entry->dispatch.invisit_binaryop == NULL) {
+            continue;
+        }
+        entry->dispatch.invisit_binaryop(entry->visitor, node);
+        CompositeVisitor_record_control(MEMBERS, entry, node, VISIT_IN);
+    }
+    CompositeVisitor_update_control(visitor, VISIT_IN);
+}
+
+/**
+ * @brief Invoke the postvisit callback of every member
+ *
+ * A member skipping the children of this node resumes here.
+ */
+static void CompositeVisitor_postvisit (NodeVisitor* visitor, ASTNode* node)
+{
+    for (int i = 0; i < MEMBERS->count; i++) {
+        CompositeMember* entry = &MEMBERS->members[i];
+        if (entry->stopped) {
+            continue;
+        }
+        if (entry->skipping != NULL) {
+            if (entry->skipping != node) {
+                continue;
+            }
+            entry->skipping = NULL;
+            MEMBERS->skipping--;
+        }
+        entry->dispatch.postvisit[node->type](entry->visitor, node);
+        CompositeVisitor_record_control(MEMBERS, entry, node, VISIT_POST);
+    }
+    CompositeVisitor_update_control(visitor, VISIT_POST);
+}
+
+/**
+ * @brief Deallocate the members of a composite visitor (data destructor)
+ */
+static void CompositeVisitor_free_members (void* data)
+{
+    CompositeVisitorData* composite = (CompositeVisitorData*)data;
+    for (int i = 0; i < composite->count; i++) {
+        NodeVisitor_free(composite->members[i].visitor);
+    }
+    free(composite->members);
+    free(composite);
+}
+
+/**
+ * @brief Create a worker copy of a composite visitor (fork callback)
+ *
+ * @returns Composite holding a copy of every member (or @c NULL if a member
+ * cannot run in parallel)
+ */
+static NodeVisitor* CompositeVisitor_fork (NodeVisitor* visitor)
+{
+    NodeVisitor* part = CompositeVisitor_new();
+    CompositeVisitorData* parts = (CompositeVisitorData*)part->data;
+    for (int i = 0; i < MEMBERS->count; i++) {
+        NodeVisitor* member = MEMBERS->members[i].visitor;
+        NodeVisitor* copy = (member->fork != NULL ? member->fork(member) : NULL);
+        if (copy == NULL) {
+            NodeVisitor_free(part);
+            return NULL;
+        }
+        CompositeVisitor_add(part, copy);
+        if (MEMBERS->members[i].stopped) {
+            parts->members[i].stopped = true;
+            parts->running--;
+        }
+    }
+    return part;
+}
+
+/**
+ * @brief Merge a worker copy of a composite visitor into it (join callback)
+ *
+ * Each member that is still running joins its copy; a member whose copy
+ * stopped stops too, and so does the composite once every member has.
+ */
+static void CompositeVisitor_join (NodeVisitor* visitor, NodeVisitor* part)
+{
+    CompositeVisitorData* parts = (CompositeVisitorData*)part->data;
+    for (int i = 0; i < MEMBERS->count; i++) {
+        CompositeMember* entry = &MEMBERS->members[i];
+        if (entry->stopped) {
+            continue;
+        }
+        if (entry->visitor->join != NULL) {
+            entry->visitor->join(entry->visitor, parts->members[i].visitor);
+        }
+        if (parts->members[i].stopped) {
+            entry->stopped = true;
+            MEMBERS->running--;
+        }
+    }
+    CompositeVisitor_update_control(visitor, VISIT_POST);
+}
+
+NodeVisitor* CompositeVisitor_new (void)
+{
+    NodeVisitor* v = NodeVisitor_new();
+    v->data = calloc(1, sizeof(CompositeVisitorData));
+    CHECK_MALLOC_PTR(v->data)
+    v->dtor = CompositeVisitor_free_members;
+    v->fork = CompositeVisitor_fork;
+    v->join = CompositeVisitor_join;
+    v->previsit_default  = CompositeVisitor_previsit;
+    v->postvisit_default = CompositeVisitor_postvisit;
+    return v;
+}
+
+void CompositeVisitor_add (NodeVisitor* visitor, NodeVisitor* member)
+{
+    if (MEMBERS->count == MEMBERS->capacity) {
+        MEMBERS->capacity = (MEMBERS->capacity == 0 ? 4 : MEMBERS->capacity * 2);
+        MEMBERS->members = (CompositeMember*)realloc(MEMBERS->members, MEMBERS->capacity * sizeof(CompositeMember));
+        CHECK_MALLOC_PTR(MEMBERS->members)
+    }
+    MEMBERS->members[MEMBERS->count].visitor = member;
+    resolve_dispatch(member, &MEMBERS->members[MEMBERS->count].dispatch);
+    MEMBERS->members[MEMBERS->count].skipping = NULL;
+    MEMBERS->members[MEMBERS->count].stopped = false;
+    MEMBERS->count++;
+    MEMBERS->running++;
+    if (member->invisit_binaryop != NULL) {
+        visitor->invisit_binaryop = CompositeVisitor_invisit_binaryop;
+    }
+}
+
+
 /*
  * AST VISITOR: PRETTY PRINTING
  */
 
-#define OUTFILE ((FILE*)visitor->data)
+#define OUTPUT ((OutputBuffer*)visitor->data)
+
+#define PRINT_INDENT    OutputBuffer_indent(OUTPUT, (long)ASTNode_get_keyed_attribute(node, ATTR_DEPTH));
+
+/**
+ * @brief Finish a line of output with the node's source line number
+ */
+static void PrintVisitor_end_line (OutputBuffer* output, ASTNode* node)
+{
+    OutputBuffer_write(output, " [line ", 7);
+    OutputBuffer_int(output, node->source_line);
+    OutputBuffer_write(output, "]\n", 2);
+}
+
+/**
+ * @brief Print a line for a node that is described by its label alone
+ */
+static void PrintVisitor_print_label (NodeVisitor* visitor, ASTNode* node, const char* label)
+{
+    PRINT_INDENT
+    OutputBuffer_puts(OUTPUT, label);
+    PrintVisitor_end_line(OUTPUT, node);
+}
 
-#define PRINT_INDENT    long depth = (long)ASTNode_get_attribute(node, "depth"); \
-                        for (long i = 0; i < depth; i++) { \
-                            fprintf(OUTFILE, "  "); \
-                        }
+/**
+ * @brief Print a line for a node that is described by its label and one quoted
+ * property
+ */
+static void PrintVisitor_print_property (NodeVisitor* visitor, ASTNode* node, const char* label,
+                                         const char* value)
+{
+    PRINT_INDENT
+    OutputBuffer_puts(OUTPUT, label);
+    OutputBuffer_puts(OUTPUT, value);
+    OutputBuffer_putc(OUTPUT, '"');
+    PrintVisitor_end_line(OUTPUT, node);
+}
 
 void PrintVisitor_visit_program (NodeVisitor* visitor, ASTNode* node)
 {
-    fprintf(OUTFILE, "Program [line %d]\n", node->source_line);
+    OutputBuffer_puts(OUTPUT, "Program");
+    PrintVisitor_end_line(OUTPUT, node);
+}
+
+void PrintVisitor_finish_program (NodeVisitor* visitor, ASTNode* node)
+{
+    OutputBuffer_flush(OUTPUT);
 }
 
 void PrintVisitor_visit_vardecl (NodeVisitor* visitor, ASTNode* node)
 {
     PRINT_INDENT
-    fprintf(OUTFILE, "VarDecl name=\"%s\" type=%s is_array=%s array_length=%d [line %d]\n",
-            node->vardecl.name,
-            DecafType_to_string(node->vardecl.type),
-            (node->vardecl.is_array ? "yes" : "no"),
-            node->vardecl.array_length,
-            node->source_line);
+    OutputBuffer_puts(OUTPUT, "VarDecl name=\"");
+    OutputBuffer_puts(OUTPUT, node->vardecl.name);
+    OutputBuffer_puts(OUTPUT, "\" type=");
+    OutputBuffer_puts(OUTPUT, DecafType_to_string(node->vardecl.type));
+    OutputBuffer_puts(OUTPUT, (node->vardecl.is_array ? " is_array=yes array_length=" : " is_array=no array_length="));
+    OutputBuffer_int(OUTPUT, node->vardecl.array_length);
+    PrintVisitor_end_line(OUTPUT, node);
 }
 
 void PrintVisitor_visit_funcdecl (NodeVisitor* visitor, ASTNode* node)
 {
     PRINT_INDENT
-    fprintf(OUTFILE, "FuncDecl name=\"%s\" return_type=%s parameters={",
-            node->funcdecl.name,
-            DecafType_to_string(node->funcdecl.return_type));
+    OutputBuffer_puts(OUTPUT, "FuncDecl name=\"");
+    OutputBuffer_puts(OUTPUT, node->funcdecl.name);
+    OutputBuffer_puts(OUTPUT, "\" return_type=");
+    OutputBuffer_puts(OUTPUT, DecafType_to_string(node->funcdecl.return_type));
+    OutputBuffer_puts(OUTPUT, " parameters={");
     bool first = true;
     FOR_EACH (Parameter*, param, node->funcdecl.parameters) {
-        fprintf(OUTFILE, "%s%s:%s", (first ? "" : ","), param->name, DecafType_to_string(param->type));
+        if (!first) {
+            OutputBuffer_putc(OUTPUT, ',');
+        }
+        OutputBuffer_puts(OUTPUT, param->name);
+        OutputBuffer_putc(OUTPUT, ':');
+        OutputBuffer_puts(OUTPUT, DecafType_to_string(param->type));
         first = false;
     }
-    fprintf(OUTFILE, "} [line %d]\n", node->source_line);
+    OutputBuffer_putc(OUTPUT, '}');
+    PrintVisitor_end_line(OUTPUT, node);
 }
 
 void PrintVisitor_visit_assignment (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Assignment [line %d]\n", node->source_line);
+    PrintVisitor_print_label(visitor, node, "Assignment");
 }
 
 void PrintVisitor_visit_conditional (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Conditional [line %d]\n", node->source_line);
+    PrintVisitor_print_label(visitor, node, "Conditional");
 }
 
 void PrintVisitor_visit_whileloop (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Whileloop [line %d]\n", node->source_line);
+    PrintVisitor_print_label(visitor, node, "Whileloop");
 }
 
 void PrintVisitor_visit_return (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Return [line %d]\n", node->source_line);
+    PrintVisitor_print_label(visitor, node, "Return");
 }
 
 void PrintVisitor_visit_block (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Block [line %d]\n", node->source_line);
+    PrintVisitor_print_label(visitor, node, "Block");
 }
 
 void PrintVisitor_visit_break (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Break [line %d]\n", node->source_line);
+    PrintVisitor_print_label(visitor, node, "Break");
 }
 
 void PrintVisitor_visit_continue (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Continue [line %d]\n", node->source_line);
+    PrintVisitor_print_label(visitor, node, "Continue");
 }
 
 void PrintVisitor_visit_binaryop (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Binaryop op=\"%s\" [line %d]\n", BinaryOpToString(node->binaryop.operator), node->source_line);
+    PrintVisitor_print_property(visitor, node, "Binaryop op=\"", BinaryOpToString(node->binaryop.operator));
 }
 
 void PrintVisitor_visit_unaryop (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Unaryop op=\"%s\" [line %d]\n", UnaryOpToString(node->unaryop.operator), node->source_line);
+    PrintVisitor_print_property(visitor, node, "Unaryop op=\"", UnaryOpToString(node->unaryop.operator));
 }
 
 void PrintVisitor_visit_location (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "Location name=\"%s\" [line %d]\n", node->location.name, node->source_line);
+    PrintVisitor_print_property(visitor, node, "Location name=\"", node->location.name);
 }
 
 void PrintVisitor_visit_funccall (NodeVisitor* visitor, ASTNode* node)
 {
-    PRINT_INDENT
-    fprintf(OUTFILE, "FuncCall name=\"%s\" [line %d]\n", node->funccall.name, node->source_line);
+    PrintVisitor_print_property(visitor, node, "FuncCall name=\"", node->funccall.name);
 }
 
 void PrintVisitor_visit_literal (NodeVisitor* visitor, ASTNode* node)
@@ -307,30 +690,68 @@ void PrintVisitor_visit_literal (NodeVisitor* visitor, ASTNode* node)
     PRINT_INDENT
     switch (node->literal.type) {
         case INT:
-            fprintf(OUTFILE, "Literal type=int value=%d [line %d]", node->literal.integer, node->source_line);
-            break;
+            OutputBuffer_puts(OUTPUT, "Literal type=int value=");
+            OutputBuffer_int(OUTPUT, node->literal.integer);
+            PrintVisitor_end_line(OUTPUT, node);
+            return;
         case BOOL:
-            fprintf(OUTFILE, "Literal type=bool value=%s [line %d]", (node->literal.boolean ? "true" : "false"), node->source_line);
-            break;
+            OutputBuffer_puts(OUTPUT, (node->literal.boolean ? "Literal type=bool value=true"
+                                                             : "Literal type=bool value=false"));
+            PrintVisitor_end_line(OUTPUT, node);
+            return;
         case STR:
-            fprintf(OUTFILE, "Literal type=string value=\"");
-            print_escaped_string(node->literal.string, stdout);
-            fprintf(OUTFILE, "\" [line %d]", node->source_line);
-            break;
+            OutputBuffer_puts(OUTPUT, "Literal type=string value=\"");
+            OutputBuffer_escaped(OUTPUT, node->literal.string);
+            OutputBuffer_putc(OUTPUT, '"');
+            PrintVisitor_end_line(OUTPUT, node);
+            return;
         case VOID:
-            fprintf(OUTFILE, "Literal type=void");
+            OutputBuffer_puts(OUTPUT, "Literal type=void");
             break;
         default: /* UNKNOWN shouldn't be possible as it is an inferred type */
             break;
     }
-    fprintf(OUTFILE, "\n");
+    OutputBuffer_putc(OUTPUT, '\n');
+}
+
+/**
+ * @brief Deallocate the output buffer of a print or graph visitor (data
+ * destructor)
+ */
+static void free_output_buffer (void* data)
+{
+    OutputBuffer_free((OutputBuffer*)data);
+}
+
+/**
+ * @brief Create a worker copy of a print visitor that prints into a buffer of
+ * its own (fork callback)
+ */
+static NodeVisitor* PrintVisitor_fork (NodeVisitor* visitor)
+{
+    NodeVisitor* part = NodeVisitor_fork_shared(visitor);
+    part->data = OutputBuffer_new(NULL);
+    part->dtor = free_output_buffer;
+    return part;
+}
+
+/**
+ * @brief Add the output of a worker copy to a print visitor's output (join
+ * callback)
+ */
+static void PrintVisitor_join (NodeVisitor* visitor, NodeVisitor* part)
+{
+    OutputBuffer_append(OUTPUT, (OutputBuffer*)part->data);
 }
 
 NodeVisitor* PrintVisitor_new (FILE* output)
 {
     NodeVisitor* v = NodeVisitor_new();
-    /* use "data" field to store FILE* output pointer */
-    v->data = (void*)output;
+    /* use "data" field to store the output buffer */
+    v->data = OutputBuffer_new(output);
+    v->dtor = free_output_buffer;
+    v->fork = PrintVisitor_fork;
+    v->join = PrintVisitor_join;
     v->previsit_program     = PrintVisitor_visit_program;
     v->previsit_vardecl     = PrintVisitor_visit_vardecl;
     v->previsit_funcdecl    = PrintVisitor_visit_funcdecl;
@@ -346,6 +767,7 @@ NodeVisitor* PrintVisitor_new (FILE* output)
     v->previsit_location    = PrintVisitor_visit_location;
     v->previsit_funccall    = PrintVisitor_visit_funccall;
     v->previsit_literal     = PrintVisitor_visit_literal;
+    v->postvisit_program    = PrintVisitor_finish_program;
     return v;
 }
 
@@ -354,54 +776,113 @@ NodeVisitor* PrintVisitor_new (FILE* output)
  * AST VISITOR: GRAPH OUTPUT (requires 'dot' utility in GraphViz)
  */
 
+/**
+ * @brief Next node ID in the graph being generated on this thread (every graph
+ * numbers its nodes from zero)
+ */
+static _Thread_local int next_dotid = 0;
+
 void GenerateASTGraph_assign_dotid (NodeVisitor* visitor, ASTNode* node)
 {
-    static int next_id = 0;
-    ASTNode_set_attribute(node, "dotid", (void*)(long)next_id, dummy_free);
-    next_id++;
+    ASTNode_set_keyed_attribute(node, ATTR_DOTID, (void*)(long)next_dotid, dummy_print, dummy_free);
+    next_dotid++;
 }
 
-#define GET_ID(NODE) ((int)(long)ASTNode_get_attribute(NODE, "dotid"))
-#define GEN_LINK(PARENT,CHILD) fprintf(OUTFILE, "%d -> %d;\n", GET_ID(PARENT), GET_ID(CHILD))
+#define GET_ID(NODE) ((long)ASTNode_get_keyed_attribute(NODE, ATTR_DOTID))
+#define GEN_LINK(PARENT,CHILD) GenerateASTGraph_link(OUTPUT, GET_ID(PARENT), GET_ID(CHILD))
 
-void GenerateASTGraph_generate_dot (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Print an edge of the graph
+ */
+static void GenerateASTGraph_link (OutputBuffer* output, long parent, long child)
 {
-    /*
-     * This is a bit of an anti-pattern here; rather than properly use the
-     * visitor functions, we just have a generic print function. That's ok here
-     * because we have to handle every kind of node anyway and not much of what
-     * we do is type-specific.
-     */
+    OutputBuffer_int(output, parent);
+    OutputBuffer_write(output, " -> ", 4);
+    OutputBuffer_int(output, child);
+    OutputBuffer_write(output, ";\n", 2);
+}
 
-    /* generate label */
-    int id = GET_ID(node);
-    fprintf(OUTFILE, "%d [shape=box, label=\"%s", id, NodeType_to_string(node->type));
+/**
+ * @brief Add a quoted property to a node's label
+ */
+static void GenerateASTGraph_property (OutputBuffer* output, const char* label, const char* value)
+{
+    OutputBuffer_puts(output, label);
+    OutputBuffer_puts(output, value);
+    OutputBuffer_putc(output, '\'');
+}
+
+/**
+ * @brief Add the label of a node (its type and main property) to a buffer
+ *
+ * @param output Buffer to add to
+ * @param node Node to describe
+ * @param write_string Function that adds the value of a string literal (with
+ * the escaping that the output format needs)
+ */
+static void GenerateASTGraph_label (OutputBuffer* output, ASTNode* node,
+        void (*write_string)(OutputBuffer*, const char*))
+{
+    OutputBuffer_puts(output, NodeType_to_string(node->type));
     switch (node->type) {
-        case VARDECL:  fprintf(OUTFILE, " name='%s'", node->vardecl.name);  break;
-        case FUNCDECL: fprintf(OUTFILE, " name='%s'", node->funcdecl.name); break;
-        case FUNCCALL: fprintf(OUTFILE, " name='%s'", node->funccall.name); break;
-        case BINARYOP: fprintf(OUTFILE, " op='%s'",   BinaryOpToString(node->binaryop.operator)); break;
-        case UNARYOP:  fprintf(OUTFILE, " op='%s'",   UnaryOpToString (node->unaryop.operator));  break;
-        case LOCATION: fprintf(OUTFILE, " name='%s'", node->location.name); break;
+        case VARDECL:  GenerateASTGraph_property(output, " name='", node->vardecl.name);  break;
+        case FUNCDECL: GenerateASTGraph_property(output, " name='", node->funcdecl.name); break;
+        case FUNCCALL: GenerateASTGraph_property(output, " name='", node->funccall.name); break;
+        case BINARYOP: GenerateASTGraph_property(output, " op='",   BinaryOpToString(node->binaryop.operator)); break;
+        case UNARYOP:  GenerateASTGraph_property(output, " op='",   UnaryOpToString (node->unaryop.operator));  break;
+        case LOCATION: GenerateASTGraph_property(output, " name='", node->location.name); break;
         case LITERAL: {
             switch (node->literal.type) {
-                case INT:  fprintf(OUTFILE, " value=%d", node->literal.integer); break;
-                case BOOL: fprintf(OUTFILE, " value=%s", (node->literal.boolean ? "true" : "false")); break;
-                case STR:  fprintf(OUTFILE, " value='"); print_doubly_escaped_string(node->literal.string, OUTFILE); fprintf(OUTFILE, "'"); break;
+                case INT:  OutputBuffer_puts(output, " value="); OutputBuffer_int(output, node->literal.integer); break;
+                case BOOL: OutputBuffer_puts(output, (node->literal.boolean ? " value=true" : " value=false")); break;
+                case STR:  OutputBuffer_puts(output, " value='"); write_string(output, node->literal.string);
+                           OutputBuffer_putc(output, '\''); break;
                 default:   break;
             } break;
         }
         default: break;
     }
-    for (Attribute* attr = node->attributes; attr != NULL; attr = attr->next) {
-        if (strncmp(attr->key, "dotid", 10) != 0 &&
-            strncmp(attr->key, "depth", 10) != 0 &&
-            strncmp(attr->key, "parent", 10) != 0) {
-            fprintf(OUTFILE, "\\n%s: ", attr->key);
-            attr->dot_printer(attr->value, OUTFILE);
+}
+
+/**
+ * @brief Add an attribute to a node's label (skipping the structural ones)
+ *
+ * The standard printers are formatted directly into the buffer; any others
+ * print to the stream after the buffer has been flushed.
+ */
+static void GenerateASTGraph_print_attribute (Attribute* attr, void* data)
+{
+    OutputBuffer* output = (OutputBuffer*)data;
+    if (attr->key != ATTR_DOTID && attr->key != ATTR_DEPTH && attr->key != ATTR_PARENT) {
+        OutputBuffer_write(output, "\\n", 2);
+        OutputBuffer_puts(output, AttributeKey_name(attr->key));
+        OutputBuffer_write(output, ": ", 2);
+        if (attr->dot_printer == int_attr_print) {
+            OutputBuffer_int(output, (long)attr->value);
+        } else if (attr->dot_printer == dummy_print) {
+            OutputBuffer_write(output, "(...)", 5);
+        } else if (attr->dot_printer != NULL) {
+            OutputBuffer_flush(output);
+            attr->dot_printer(attr->value, output->output);
         }
     }
-    fprintf(OUTFILE, "\"];\n");
+}
+
+void GenerateASTGraph_generate_dot (NodeVisitor* visitor, ASTNode* node)
+{
+    /*
+     * This is a bit of an anti-pattern here; rather than properly use the
+     * visitor functions, we just have a generic print function. That's ok here
+     * because we have to handle every kind of node anyway and not much of what
+     * we do is type-specific.
+     */
+
+    /* generate label */
+    OutputBuffer_int(OUTPUT, GET_ID(node));
+    OutputBuffer_puts(OUTPUT, " [shape=box, label=\"");
+    GenerateASTGraph_label(OUTPUT, node, OutputBuffer_doubly_escaped);
+    ASTNode_for_each_attribute(node, GenerateASTGraph_print_attribute, OUTPUT);
+    OutputBuffer_write(OUTPUT, "\"];\n", 4);
 
     /* create any edges */
     switch (node->type)
@@ -442,21 +923,24 @@ void GenerateASTGraph_generate_dot (NodeVisitor* visitor, ASTNode* node)
 
 void GenerateASTGraph_initialize (NodeVisitor* visitor, ASTNode* node)
 {
-    fprintf(OUTFILE, "digraph AST {\n");
+    OutputBuffer_puts(OUTPUT, "digraph AST {\n");
+    next_dotid = 0;
     GenerateASTGraph_assign_dotid(visitor, node);
 }
 
 void GenerateASTGraph_finalize (NodeVisitor* visitor, ASTNode* node)
 {
     GenerateASTGraph_generate_dot(visitor, node);
-    fprintf(OUTFILE, "}\n");
+    OutputBuffer_puts(OUTPUT, "}\n");
+    OutputBuffer_flush(OUTPUT);
 }
 
 NodeVisitor* GenerateASTGraph_new (FILE* output)
 {
     NodeVisitor* v = NodeVisitor_new();
-    /* use "data" field to store FILE* output pointer */
-    v->data = (void*)output;
+    /* use "data" field to store the output buffer */
+    v->data = OutputBuffer_new(output);
+    v->dtor = free_output_buffer;
     v->previsit_default      = GenerateASTGraph_assign_dotid;
     v->postvisit_default     = GenerateASTGraph_generate_dot;
     v->previsit_program      = GenerateASTGraph_initialize;
@@ -466,101 +950,480 @@ NodeVisitor* GenerateASTGraph_new (FILE* output)
 
 
 /*
- * AST VISITOR: PARENT POINTER SETUP
+ * AST VISITOR: IMAGE OUTPUT (SVG)
+ */
+
+/**
+ * @brief Horizontal space that one character of a label takes up (for the
+ * monospace font at @ref IMAGE_FONT_SIZE)
+ */
+#define IMAGE_CHAR_WIDTH 7.2
+
+/**
+ * @brief Font size of the labels
  */
+#define IMAGE_FONT_SIZE 12
 
-void SetParentVisitor_visit_program (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Space between a label and the sides of its box
+ */
+#define IMAGE_PADDING 8
+
+/**
+ * @brief Height of a node's box
+ */
+#define IMAGE_BOX_HEIGHT 20
+
+/**
+ * @brief Vertical distance between the tops of two levels of boxes
+ */
+#define IMAGE_LEVEL_HEIGHT 50
+
+/**
+ * @brief Minimum horizontal space between two boxes on the same level
+ */
+#define IMAGE_GAP 10
+
+/**
+ * @brief Space around the tree
+ */
+#define IMAGE_MARGIN 10
+
+/**
+ * @brief State of an image output visitor
+ */
+typedef struct ImageOutput
+{
+    OutputBuffer* output;       /**< @brief Buffer for the SVG text */
+    TreeLayout* layout;         /**< @brief Layout of the nodes visited so far */
+    OutputBuffer* labels;       /**< @brief Labels of the nodes (each NUL-terminated) */
+    size_t* label_starts;       /**< @brief Offset of each node's label in @c labels */
+    LayoutIndex* open;          /**< @brief Nodes whose subtrees are being visited */
+    size_t open_count;          /**< @brief Number of entries in @c open */
+    size_t capacity;            /**< @brief Allocated length of @c label_starts and @c open */
+} ImageOutput;
+
+#define IMAGE ((ImageOutput*)visitor->data)
+
+/**
+ * @brief Add a node to the layout, with its parent being the innermost open
+ * node (pre-visit callback)
+ */
+static void GenerateASTImage_add_node (NodeVisitor* visitor, ASTNode* node)
+{
+    ImageOutput* image = IMAGE;
+    if (image->layout->count == image->capacity) {
+        image->capacity = (image->capacity == 0 ? 256 : image->capacity * 2);
+        image->label_starts = (size_t*)realloc(image->label_starts, image->capacity * sizeof(size_t));
+        CHECK_MALLOC_PTR(image->label_starts)
+        image->open = (LayoutIndex*)realloc(image->open, image->capacity * sizeof(LayoutIndex));
+        CHECK_MALLOC_PTR(image->open)
+    }
+
+    size_t start = image->labels->length;
+    GenerateASTGraph_label(image->labels, node, OutputBuffer_escaped);
+    double width = (double)(image->labels->length - start) * IMAGE_CHAR_WIDTH + 2 * IMAGE_PADDING;
+    OutputBuffer_putc(image->labels, '\0');
+
+    LayoutIndex parent = (image->open_count == 0 ? LAYOUT_NONE : image->open[image->open_count-1]);
+    LayoutIndex index = TreeLayout_add(image->layout, parent, width);
+    image->label_starts[index] = start;
+    image->open[image->open_count++] = index;
+}
+
+/**
+ * @brief Add a decimal number (rounded to one place) to a buffer
+ */
+static void GenerateASTImage_number (OutputBuffer* output, double value)
 {
-    FOR_EACH(ASTNode*, var, node->program.variables) {
-        ASTNode_set_attribute(var, "parent", (void*)node, NULL);
+    long tenths = (long)(value * 10 + (value < 0 ? -0.5 : 0.5));
+    if (tenths < 0) {
+        OutputBuffer_putc(output, '-');
+        tenths = -tenths;
     }
-    FOR_EACH(ASTNode*, func, node->program.functions) {
-        ASTNode_set_attribute(func, "parent", (void*)node, NULL);
+    OutputBuffer_int(output, tenths / 10);
+    if (tenths % 10 != 0) {
+        OutputBuffer_putc(output, '.');
+        OutputBuffer_putc(output, (char)('0' + tenths % 10));
     }
 }
 
-void SetParentVisitor_visit_funcdecl (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Add an attribute with a numeric value to an SVG element
+ */
+static void GenerateASTImage_attribute (OutputBuffer* output, const char* name, double value)
 {
-    ASTNode_set_attribute(node->funcdecl.body, "parent", (void*)node, NULL);
+    OutputBuffer_puts(output, name);
+    OutputBuffer_putc(output, '"');
+    GenerateASTImage_number(output, value);
+    OutputBuffer_putc(output, '"');
 }
 
-void SetParentVisitor_visit_block (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Top edge of the boxes on a level of the tree
+ */
+static double GenerateASTImage_top (uint32_t level)
 {
-    FOR_EACH(ASTNode*, var, node->block.variables) {
-        ASTNode_set_attribute(var, "parent", (void*)node, NULL);
+    return IMAGE_MARGIN + (double)level * IMAGE_LEVEL_HEIGHT;
+}
+
+/**
+ * @brief Lay out the tree and write the SVG document
+ */
+static void GenerateASTImage_write (ImageOutput* image)
+{
+    OutputBuffer* output = image->output;
+    TreeLayout* layout = image->layout;
+    LayoutNode* nodes = layout->nodes;
+    TreeLayout_compute(layout);
+
+    OutputBuffer_puts(output, "<svg xmlns=\"http://www.w3.org/2000/svg\"");
+    GenerateASTImage_attribute(output, " width=", layout->extent + 2 * IMAGE_MARGIN);
+    GenerateASTImage_attribute(output, " height=", GenerateASTImage_top(layout->levels) - IMAGE_LEVEL_HEIGHT
+                                                   + IMAGE_BOX_HEIGHT + IMAGE_MARGIN);
+    OutputBuffer_puts(output, " font-family=\"monospace\" font-size=\"");
+    OutputBuffer_int(output, IMAGE_FONT_SIZE);
+    OutputBuffer_puts(output, "\">\n");
+
+    /* edges go first so that the boxes are drawn over their ends */
+    OutputBuffer_puts(output, "<g stroke=\"black\">\n");
+    for (LayoutIndex i = 1; i < layout->count; i++) {
+        LayoutNode* parent = &nodes[nodes[i].parent];
+        OutputBuffer_puts(output, "<line");
+        GenerateASTImage_attribute(output, " x1=", IMAGE_MARGIN + parent->x);
+        GenerateASTImage_attribute(output, " y1=", GenerateASTImage_top(parent->level) + IMAGE_BOX_HEIGHT);
+        GenerateASTImage_attribute(output, " x2=", IMAGE_MARGIN + nodes[i].x);
+        GenerateASTImage_attribute(output, " y2=", GenerateASTImage_top(nodes[i].level));
+        OutputBuffer_puts(output, "/>\n");
+    }
+    OutputBuffer_puts(output, "</g>\n<g fill=\"white\" stroke=\"black\">\n");
+    for (LayoutIndex i = 0; i < layout->count; i++) {
+        OutputBuffer_puts(output, "<rect");
+        GenerateASTImage_attribute(output, " x=", IMAGE_MARGIN + nodes[i].x - nodes[i].width / 2);
+        GenerateASTImage_attribute(output, " y=", GenerateASTImage_top(nodes[i].level));
+        GenerateASTImage_attribute(output, " width=", nodes[i].width);
+        GenerateASTImage_attribute(output, " height=", IMAGE_BOX_HEIGHT);
+        OutputBuffer_puts(output, "/>\n");
     }
-    FOR_EACH(ASTNode*, stmt, node->block.statements) {
-        ASTNode_set_attribute(stmt, "parent", (void*)node, NULL);
+
+    /* labels go last so that they are drawn over the boxes */
+    OutputBuffer_puts(output, "</g>\n<g text-anchor=\"middle\">\n");
+    for (LayoutIndex i = 0; i < layout->count; i++) {
+        OutputBuffer_puts(output, "<text");
+        GenerateASTImage_attribute(output, " x=", IMAGE_MARGIN + nodes[i].x);
+        GenerateASTImage_attribute(output, " y=", GenerateASTImage_top(nodes[i].level)
+                                                  + IMAGE_BOX_HEIGHT / 2 + IMAGE_FONT_SIZE / 3.0);
+        OutputBuffer_putc(output, '>');
+        OutputBuffer_xml_escaped(output, image->labels->text + image->label_starts[i]);
+        OutputBuffer_puts(output, "</text>\n");
     }
+    OutputBuffer_puts(output, "</g>\n</svg>\n");
+    OutputBuffer_flush(output);
 }
 
-void SetParentVisitor_visit_assignment (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Close a node, and write the image once the root is closed
+ * (post-visit callback)
+ */
+static void GenerateASTImage_close_node (NodeVisitor* visitor, ASTNode* node)
 {
-    ASTNode_set_attribute(node->assignment.location, "parent", (void*)node, NULL);
-    ASTNode_set_attribute(node->assignment.value, "parent", (void*)node, NULL);
+    ImageOutput* image = IMAGE;
+    if (--image->open_count == 0) {
+        GenerateASTImage_write(image);
+    }
 }
 
-void SetParentVisitor_visit_conditional (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Deallocate the state of an image output visitor (destructor)
+ */
+static void free_image_output (void* data)
 {
-    ASTNode_set_attribute(node->conditional.condition, "parent", (void*)node, NULL);
-    ASTNode_set_attribute(node->conditional.if_block, "parent", (void*)node, NULL);
-    if (node->conditional.else_block != NULL) {
-        ASTNode_set_attribute(node->conditional.else_block, "parent", (void*)node, NULL);
-    }
+    ImageOutput* image = (ImageOutput*)data;
+    OutputBuffer_free(image->output);
+    OutputBuffer_free(image->labels);
+    TreeLayout_free(image->layout);
+    free(image->label_starts);
+    free(image->open);
+    free(image);
 }
 
-void SetParentVisitor_visit_whileloop (NodeVisitor* visitor, ASTNode* node)
+NodeVisitor* GenerateASTImage_new (FILE* output)
 {
-    ASTNode_set_attribute(node->whileloop.condition, "parent", (void*)node, NULL);
-    ASTNode_set_attribute(node->whileloop.body, "parent", (void*)node, NULL);
+    ImageOutput* image = (ImageOutput*)calloc(1, sizeof(ImageOutput));
+    CHECK_MALLOC_PTR(image)
+    image->output = OutputBuffer_new(output);
+    image->layout = TreeLayout_new(IMAGE_GAP);
+    image->labels = OutputBuffer_new(NULL);
+
+    NodeVisitor* v = NodeVisitor_new();
+    /* use "data" field to store the layout and output state */
+    v->data = image;
+    v->dtor = free_image_output;
+    v->previsit_default  = GenerateASTImage_add_node;
+    v->postvisit_default = GenerateASTImage_close_node;
+    return v;
 }
 
-void SetParentVisitor_visit_return (NodeVisitor* visitor, ASTNode* node)
+/*
+ * PARALLEL TRAVERSAL
+ */
+
+/**
+ * @brief Number of runs of functions per worker thread (more runs even out
+ * the load, fewer save copies of the visitor)
+ */
+#define RUNS_PER_WORKER 8
+
+/**
+ * @brief Functions of a program being traversed in parallel (shared by the
+ * worker threads)
+ *
+ * The functions are split into runs of consecutive functions, and each run is
+ * traversed by its own copy of the visitor.
+ */
+typedef struct ParallelWork
+{
+    ASTNode** functions;        /**< @brief Function declarations in program order */
+    int* starts;                /**< @brief Index of the first function of each run (and the
+                                            number of functions, after the last run) */
+    NodeVisitor** parts;        /**< @brief Worker copy of the visitor for each run */
+    bool* stopped;              /**< @brief True for each run whose traversal was stopped (or
+                                            raised an error) */
+    int count;                  /**< @brief Number of runs */
+    atomic_int next;            /**< @brief Index of the next run to hand out */
+    atomic_int first_stop;      /**< @brief Lowest index of a stopped run (or @c count) */
+    pthread_mutex_t lock;       /**< @brief Lock for @c failed and @c message */
+    int failed;                 /**< @brief Lowest index of a run that raised an error (or @c count) */
+    char message[MAX_ERROR_LEN];    /**< @brief Message of the error raised by run @c failed */
+} ParallelWork;
+
+/**
+ * @brief Traverse one run of functions, catching any error raised by a
+ * callback (see @ref Error_throw)
+ *
+ * Only the error of the earliest run in program order is kept, since that is
+ * the one a serial traversal would have raised.
+ */
+static void traverse_run (ParallelWork* work, int i)
 {
-    if (node->funcreturn.value != NULL) {
-        ASTNode_set_attribute(node->funcreturn.value, "parent", (void*)node, NULL);
+    VisitorDispatch dispatch;
+    resolve_dispatch(work->parts[i], &dispatch);
+
+    /* steps below this one belong to an enclosing traversal (if any) */
+    size_t base = traversal_stack.count;
+    ErrorHandler handler;
+    ErrorHandler_push(&handler);
+    if (setjmp(handler.target) == 0) {
+        for (int f = work->starts[i]; f < work->starts[i + 1]; f++) {
+            if (traverse_tree(work->parts[i], &dispatch, work->functions[f])) {
+                work->stopped[i] = true;
+                break;
+            }
+        }
+        ErrorHandler_pop(&handler);
+    } else {
+        ErrorHandler_pop(&handler);
+        traversal_stack.count = base;
+        work->stopped[i] = true;
+        pthread_mutex_lock(&work->lock);
+        if (i < work->failed) {
+            work->failed = i;
+            memcpy(work->message, handler.message, MAX_ERROR_LEN);
+        }
+        pthread_mutex_unlock(&work->lock);
     }
 }
 
-void SetParentVisitor_visit_binaryop (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Traverse runs of functions until there are none left
+ */
+static void run_parallel_work (ParallelWork* work)
 {
-    ASTNode_set_attribute(node->binaryop.left, "parent", (void*)node, NULL);
-    ASTNode_set_attribute(node->binaryop.right, "parent", (void*)node, NULL);
+    while (true) {
+        int i = atomic_fetch_add_explicit(&work->next, 1, memory_order_relaxed);
+        if (i >= work->count) {
+            break;
+        }
+
+        /* the results for runs after a stopped one are discarded anyway */
+        if (i > atomic_load_explicit(&work->first_stop, memory_order_relaxed)) {
+            continue;
+        }
+        traverse_run(work, i);
+        if (work->stopped[i]) {
+            int first = atomic_load_explicit(&work->first_stop, memory_order_relaxed);
+            while (i < first && !atomic_compare_exchange_weak(&work->first_stop, &first, i)) { }
+        }
+    }
 }
 
-void SetParentVisitor_visit_unaryop (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Worker thread of a parallel traversal
+ */
+static void* parallel_worker (void* arg)
 {
-    ASTNode_set_attribute(node->unaryop.child, "parent", (void*)node, NULL);
+    run_parallel_work((ParallelWork*)arg);
+
+    /* the thread is about to exit, so its traversal stack is no longer needed */
+    NodeVisitor_release_stack();
+    return NULL;
 }
 
-void SetParentVisitor_visit_location (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Traverse the functions of a program with worker copies of the
+ * visitor, and join the copies in program order
+ *
+ * @returns True if the traversal was stopped
+ */
+static bool traverse_functions (NodeVisitor* visitor, const VisitorDispatch* dispatch,
+                                ASTNode* tree, int workers)
 {
-    if (node->location.index != NULL) {
-        ASTNode_set_attribute(node->location.index, "parent", (void*)node, NULL);
+    int functions = tree->program.functions->size;
+    if (workers > functions) {
+        workers = functions;
+    }
+    ParallelWork work;
+    work.count = (functions / RUNS_PER_WORKER < workers ? functions : workers * RUNS_PER_WORKER);
+    work.functions = (ASTNode**)calloc(functions, sizeof(ASTNode*));
+    work.starts = (int*)calloc(work.count + 1, sizeof(int));
+    work.parts = (NodeVisitor**)calloc(work.count, sizeof(NodeVisitor*));
+    work.stopped = (bool*)calloc(work.count, sizeof(bool));
+    CHECK_MALLOC_PTR(work.functions)
+    CHECK_MALLOC_PTR(work.starts)
+    CHECK_MALLOC_PTR(work.parts)
+    CHECK_MALLOC_PTR(work.stopped)
+    atomic_init(&work.next, 0);
+    atomic_init(&work.first_stop, work.count);
+    pthread_mutex_init(&work.lock, NULL);
+    work.failed = work.count;
+
+    int f = 0;
+    FOR_EACH(ASTNode*, func, tree->program.functions) {
+        work.functions[f++] = func;
     }
+    for (int i = 0; i <= work.count; i++) {
+        work.starts[i] = (int)((long)functions * i / work.count);
+    }
+
+    bool stopped = false, failed = false;
+    int forked = 0;
+    while (forked < work.count && (work.parts[forked] = visitor->fork(visitor)) != NULL) {
+        forked++;
+    }
+
+    if (forked < work.count) {
+        /* the visitor declined to fork, so visit the functions serially */
+        for (int i = 0; i < forked; i++) {
+            NodeVisitor_free(work.parts[i]);
+        }
+        for (f = 0; f < functions && !stopped; f++) {
+            stopped = traverse_tree(visitor, dispatch, work.functions[f]);
+        }
+    } else {
+        pthread_t* threads = (pthread_t*)calloc(workers, sizeof(pthread_t));
+        CHECK_MALLOC_PTR(threads)
+        ASTNode_share_attributes(tree, true);
+
+        /* the calling thread works too; if a thread cannot be started, the others take up the slack */
+        int started = 0;
+        while (started < workers - 1 && pthread_create(&threads[started], NULL, parallel_worker, &work) == 0) {
+            started++;
+        }
+        run_parallel_work(&work);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        ASTNode_share_attributes(tree, false);
+        free(threads);
+
+        /* a run that raised an error is not joined, and neither is anything after it */
+        for (int i = 0; i < work.count; i++) {
+            if (i == work.failed && !stopped) {
+                failed = true;
+                stopped = true;
+            }
+            if (!stopped && visitor->join != NULL) {
+                visitor->join(visitor, work.parts[i]);
+            }
+            if (work.stopped[i] || visitor->control == TRAVERSE_STOP) {
+                stopped = true;
+            }
+            NodeVisitor_free(work.parts[i]);
+        }
+        visitor->control = TRAVERSE_CONTINUE;
+    }
+
+    free(work.functions);
+    free(work.starts);
+    free(work.parts);
+    free(work.stopped);
+    pthread_mutex_destroy(&work.lock);
+    if (failed) {
+        Error_throw("%s", work.message);
+    }
+    return stopped;
 }
 
-void SetParentVisitor_visit_funccall (NodeVisitor* visitor, ASTNode* node)
+void NodeVisitor_traverse_parallel (NodeVisitor* visitor, ASTNode* tree, int workers)
 {
-    FOR_EACH(ASTNode*, arg, node->funccall.arguments) {
-        ASTNode_set_attribute(arg, "parent", (void*)node, NULL);
+    if (workers <= 0) {
+        workers = default_thread_count();
     }
+    if (visitor->fork == NULL || workers < 2 || tree->type != PROGRAM || tree->arena == NULL ||
+            tree->program.functions->size < 2) {
+        NodeVisitor_traverse(visitor, tree);
+        return;
+    }
+
+    VisitorDispatch dispatch;
+    resolve_dispatch(visitor, &dispatch);
+
+    /* the program node and the global variables are visited serially as usual */
+    dispatch.previsit[PROGRAM](visitor, tree);
+    if (visitor->control == TRAVERSE_STOP) {
+        visitor->control = TRAVERSE_CONTINUE;
+        return;
+    }
+    if (visitor->control != TRAVERSE_SKIP_CHILDREN) {
+        FOR_EACH(ASTNode*, var, tree->program.variables) {
+            if (traverse_tree(visitor, &dispatch, var)) {
+                return;
+            }
+        }
+        if (traverse_functions(visitor, &dispatch, tree, workers)) {
+            return;
+        }
+    }
+    visitor->control = TRAVERSE_CONTINUE;
+    dispatch.postvisit[PROGRAM](visitor, tree);
+    visitor->control = TRAVERSE_CONTINUE;
+}
+
+NodeVisitor* NodeVisitor_fork_shared (NodeVisitor* visitor)
+{
+    NodeVisitor* part = (NodeVisitor*)malloc(sizeof(NodeVisitor));
+    CHECK_MALLOC_PTR(part)
+    *part = *visitor;
+    part->dtor = NULL;      /* the data still belongs to the original */
+    part->control = TRAVERSE_CONTINUE;
+    return part;
+}
+
+
+/*
+ * AST VISITOR: PARENT POINTER SETUP
+ */
+
+void SetParentVisitor_visit (NodeVisitor* visitor, ASTNode* node)
+{
+    ASTNode_set_child_parents(node);
 }
 
 NodeVisitor* SetParentVisitor_new(void)
 {
     NodeVisitor* v = NodeVisitor_new();
-    v->previsit_program = SetParentVisitor_visit_program;
-    v->previsit_funcdecl = SetParentVisitor_visit_funcdecl;
-    v->previsit_block = SetParentVisitor_visit_block;
-    v->previsit_assignment = SetParentVisitor_visit_assignment;
-    v->previsit_conditional = SetParentVisitor_visit_conditional;
-    v->previsit_whileloop = SetParentVisitor_visit_whileloop;
-    v->previsit_return = SetParentVisitor_visit_return;
-    v->previsit_binaryop = SetParentVisitor_visit_binaryop;
-    v->previsit_unaryop = SetParentVisitor_visit_unaryop;
-    v->previsit_location = SetParentVisitor_visit_location;
-    v->previsit_funccall = SetParentVisitor_visit_funccall;
+    v->previsit_default = SetParentVisitor_visit;
+    v->fork = NodeVisitor_fork_shared;
     return v;
 }
 
@@ -571,14 +1434,14 @@ NodeVisitor* SetParentVisitor_new(void)
 
 void CalcDepthVisitor_visit_program (NodeVisitor* visitor, ASTNode* node)
 {
-    ASTNode_set_int_attribute(node, "depth", 0);
+    ASTNode_set_keyed_attribute(node, ATTR_DEPTH, (void*)0L, int_attr_print, NULL);
 }
 
 void CalcDepthVisitor_visit_nonprogram (NodeVisitor* visitor, ASTNode* node)
 {
-    ASTNode* parent = (ASTNode*)ASTNode_get_attribute(node, "parent");
-    long pdepth = (long)ASTNode_get_int_attribute(parent, "depth");
-    ASTNode_set_int_attribute(node, "depth", pdepth + 1);
+    ASTNode* parent = (ASTNode*)ASTNode_get_keyed_attribute(node, ATTR_PARENT);
+    long pdepth = (long)ASTNode_get_keyed_attribute(parent, ATTR_DEPTH);
+    ASTNode_set_keyed_attribute(node, ATTR_DEPTH, (void*)(pdepth + 1), int_attr_print, NULL);
 }
 
 NodeVisitor* CalcDepthVisitor_new (void)
@@ -586,5 +1449,100 @@ NodeVisitor* CalcDepthVisitor_new (void)
     NodeVisitor* v = NodeVisitor_new();
     v->previsit_program  = CalcDepthVisitor_visit_program;
     v->previsit_default  = CalcDepthVisitor_visit_nonprogram;
+    v->fork = NodeVisitor_fork_shared;
     return v;
 }
+
+
+/*
+ * PARENT/DEPTH VERIFICATION
+ */
+
+/**
+ * @brief Parent and depth of every node in traversal order (visitor data)
+ */
+typedef struct ParentDepthRecord
+{
+    ASTNode** parents;      /**< @brief Recorded parents (@c NULL for none) */
+    long* depths;           /**< @brief Recorded depths (-1 for none) */
+    size_t count;           /**< @brief Number of nodes recorded (or compared so far) */
+    size_t capacity;        /**< @brief Allocated length of the arrays */
+    int mismatches;         /**< @brief Number of nodes that differ */
+    FILE* report;           /**< @brief Stream for mismatch reports */
+} ParentDepthRecord;
+
+#define RECORD ((ParentDepthRecord*)visitor->data)
+
+/**
+ * @brief Look up a node's parent attribute (or @c NULL if it has none)
+ */
+static ASTNode* recorded_parent (ASTNode* node)
+{
+    return ASTNode_has_keyed_attribute(node, ATTR_PARENT) ?
+        (ASTNode*)ASTNode_get_keyed_attribute(node, ATTR_PARENT) : NULL;
+}
+
+/**
+ * @brief Look up a node's depth attribute (or -1 if it has none)
+ */
+static long recorded_depth (ASTNode* node)
+{
+    return ASTNode_has_keyed_attribute(node, ATTR_DEPTH) ?
+        (long)ASTNode_get_keyed_attribute(node, ATTR_DEPTH) : -1;
+}
+
+void VerifyTree_record (NodeVisitor* visitor, ASTNode* node)
+{
+    if (RECORD->count == RECORD->capacity) {
+        RECORD->capacity = (RECORD->capacity == 0 ? 256 : RECORD->capacity * 2);
+        RECORD->parents = (ASTNode**)realloc(RECORD->parents, RECORD->capacity * sizeof(ASTNode*));
+        RECORD->depths = (long*)realloc(RECORD->depths, RECORD->capacity * sizeof(long));
+        CHECK_MALLOC_PTR(RECORD->parents)
+        CHECK_MALLOC_PTR(RECORD->depths)
+    }
+    RECORD->parents[RECORD->count] = recorded_parent(node);
+    RECORD->depths[RECORD->count] = recorded_depth(node);
+    RECORD->count++;
+}
+
+void VerifyTree_compare (NodeVisitor* visitor, ASTNode* node)
+{
+    size_t i = RECORD->count++;
+    ASTNode* parent = recorded_parent(node);
+    long depth = recorded_depth(node);
+    if (parent != RECORD->parents[i] || depth != RECORD->depths[i]) {
+        fprintf(RECORD->report, "%s node on line %d: parser recorded depth %ld (parent %s), "
+                "passes computed depth %ld (parent %s)\n", NodeType_to_string(node->type),
+                node->source_line, RECORD->depths[i],
+                (RECORD->parents[i] ? NodeType_to_string(RECORD->parents[i]->type) : "none"),
+                depth, (parent ? NodeType_to_string(parent->type) : "none"));
+        RECORD->mismatches++;
+    }
+}
+
+int verify_parent_and_depth (ASTNode* tree, FILE* report)
+{
+    ParentDepthRecord record = { .report = report };
+    NodeVisitor* recorder = NodeVisitor_new();
+    recorder->data = &record;
+    recorder->previsit_default = VerifyTree_record;
+    NodeVisitor_traverse_and_free(recorder, tree);
+
+    /*
+     * recomputing and comparing can share a traversal: a node's parent is set
+     * while visiting its parent and its depth just before it is compared
+     */
+    record.count = 0;
+    NodeVisitor* checker = NodeVisitor_new();
+    checker->data = &record;
+    checker->previsit_default = VerifyTree_compare;
+    NodeVisitor* passes = CompositeVisitor_new();
+    CompositeVisitor_add(passes, SetParentVisitor_new());
+    CompositeVisitor_add(passes, CalcDepthVisitor_new());
+    CompositeVisitor_add(passes, checker);
+    NodeVisitor_traverse_and_free(passes, tree);
+
+    free(record.parents);
+    free(record.depths);
+    return record.mismatches;
+}
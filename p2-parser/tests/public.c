@@ -5,7 +5,18 @@
  * This file provides a few basic sanity test cases and a location to add new tests.
  */
 
+#define _DEFAULT_SOURCE
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "testsuite.h"
+#include "batch.h"
+#include "server.h"
 
 #ifndef SKIP_IN_DOXYGEN
 
@@ -55,6 +66,9 @@ TEST_VALID_MAIN(C_return_val, "return 0;")
 TEST_VALID(B_param_func, "def int foo(int a, bool b) { }")
 TEST_VALID_MAIN(B_conditional, "if (true) { }")
 TEST_VALID_MAIN(B_whileloop, "while (false) { }")
+TEST_VALID_MAIN(B_funccall_stmt, "print_int(1); print_str(\"x\");")
+TEST_VALID_MAIN(B_funccall_expr, "int a; a = f(1, a) + g();")
+TEST_INVALID_MAIN(B_funccall_unclosed, "print_int(1;")
 TEST_VALID_EXPR(B_add_expr, "3+7")
 TEST_VALID_EXPR(B_add_expr_bool, "true && false")
 TEST_VALID_EXPR(B_neg_expr, "-2")
@@ -73,6 +87,334 @@ TEST_INVALID(D_invalid_braces, "{}")
 TEST_INVALID(D_invalid_broken_assign, "b=")
 TEST_INVALID_MAIN(C_invalid_return_break, "return break;")
 TEST_INVALID_EXPR(B_invalid_add, "3++8")
+TEST_INVALID_MAIN(B_funccall_extra_paren, "print_int(1));")
+
+/*
+ * A function call consumes its closing parenthesis, so whatever follows the
+ * call is parsed as usual.
+ */
+START_TEST(B_funccall_tree)
+{
+    ASTNode* ast = run_parser("def int main() { f(1, 2); return g(a) + 3; }");
+    ck_assert_ptr_ne(ast, NULL);
+    ASTNode* call = ast->program.functions->head->funcdecl.body->block.statements->head;
+    ck_assert(call->type == FUNCCALL);
+    ck_assert_str_eq(call->funccall.name, "f");
+    ck_assert_int_eq(call->funccall.arguments->size, 2);
+    ASTNode* value = call->next->funcreturn.value;
+    ck_assert(value->type == BINARYOP && value->binaryop.operator == ADDOP);
+    ck_assert(value->binaryop.left->type == FUNCCALL);
+    ck_assert_str_eq(value->binaryop.left->funccall.name, "g");
+    ck_assert_int_eq(value->binaryop.left->funccall.arguments->size, 1);
+    ck_assert(value->binaryop.right->type == LITERAL);
+    ASTNode_free(ast);
+}
+END_TEST
+
+/*
+ * Test the lexer's token stream directly.
+ */
+
+START_TEST(D_lex_tokens)
+{
+    TokenQueue* tokens = lex("def int main() {\n  return 0x1F; // done\n}");
+    ck_assert_int_eq(TokenQueue_size(tokens), 10);
+    Token t = TokenQueue_remove(tokens);
+    ck_assert(t.type == KEY);    ck_assert(Token_text_eq(&t, "def"));  t = TokenQueue_remove(tokens);
+    ck_assert(t.type == KEY);    ck_assert(Token_text_eq(&t, "int"));  t = TokenQueue_remove(tokens);
+    ck_assert(t.type == ID);     ck_assert(Token_text_eq(&t, "main")); t = TokenQueue_remove(tokens);
+    ck_assert(t.type == SYM);    ck_assert(Token_text_eq(&t, "("));    t = TokenQueue_remove(tokens);
+    ck_assert(t.type == SYM);    ck_assert(Token_text_eq(&t, ")"));    t = TokenQueue_remove(tokens);
+    ck_assert(t.type == SYM);    ck_assert(Token_text_eq(&t, "{"));    t = TokenQueue_remove(tokens);
+    ck_assert(t.type == KEY);    ck_assert(Token_text_eq(&t, "return"));
+    ck_assert_int_eq(t.line, 2); t = TokenQueue_remove(tokens);
+    ck_assert(t.type == HEXLIT); ck_assert(Token_text_eq(&t, "0x1F")); t = TokenQueue_remove(tokens);
+    ck_assert(t.type == SYM);    ck_assert(Token_text_eq(&t, ";"));    t = TokenQueue_remove(tokens);
+    ck_assert(t.type == SYM);    ck_assert(Token_text_eq(&t, "}"));
+    ck_assert_int_eq(t.line, 3);
+    ck_assert(TokenQueue_is_empty(tokens));
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+START_TEST(C_lex_longest_match)
+{
+    TokenQueue* tokens = lex("0123 0xg a<=b!c \"x\\\"y\"");
+    const char* expected[] = { "0", "123", "0", "xg", "a", "<=", "b", "!", "c", "\"x\\\"y\"" };
+    TokenType types[] = { DECLIT, DECLIT, DECLIT, ID, ID, SYM, ID, SYM, ID, STRLIT };
+    ck_assert_int_eq(TokenQueue_size(tokens), 10);
+    for (size_t i = 0; i < TokenQueue_size(tokens); i++) {
+        Token t = TokenQueue_peek_ahead(tokens, i);
+        ck_assert(t.type == types[i]);
+        ck_assert(Token_text_eq(&t, expected[i]));
+    }
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+START_TEST(C_lex_token_kinds)
+{
+    for (int k = TK_DEF; k < NUM_TOKEN_KINDS; k++) {
+        if (k != TK_RESERVED) {
+            const char* text = TokenKind_to_string((TokenKind)k);
+            ck_assert_int_eq(TokenKind_lookup(text, strlen(text)), k);
+        }
+    }
+    ck_assert_int_eq(TokenKind_lookup("class", 5), TK_RESERVED);
+    ck_assert_int_eq(TokenKind_lookup("ifx", 3), TK_NONE);
+    ck_assert_int_eq(TokenKind_lookup("in", 2), TK_NONE);
+
+    TokenQueue* tokens = lex("while (x <= 10) x = -y;");
+    TokenKind kinds[] = { TK_WHILE, TK_LPAREN, TK_NONE, TK_LE, TK_NONE, TK_RPAREN,
+                          TK_NONE, TK_ASSIGN, TK_MINUS, TK_NONE, TK_SEMICOLON };
+    ck_assert_int_eq(TokenQueue_size(tokens), 11);
+    for (size_t i = 0; i < TokenQueue_size(tokens); i++) {
+        ck_assert_int_eq(TokenQueue_peek_ahead(tokens, i).kind, kinds[i]);
+    }
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+TEST_INVALID(C_lex_reserved_word, "int class;")
+TEST_INVALID(C_lex_invalid_char, "int a@;")
+TEST_INVALID(B_lex_unterminated_string, "def int main() { print_str(\"abc); }")
+
+/*
+ * Test the streaming token queue: it yields the same tokens as the eager
+ * lexer while holding only the lookahead window in memory.
+ */
+
+START_TEST(C_lex_stream_matches)
+{
+    const char* text = "def int main() {\n  int a;\n  a = f(1, 0x2) + 3;\n  return a;\n}\n";
+    TokenQueue* expected = lex(text);
+    TokenQueue* stream = lex_stream(text);
+    ck_assert_int_eq(stream->count - stream->head, 0);
+    Token main_id = TokenQueue_peek_ahead(stream, 2);
+    ck_assert(Token_text_eq(&main_id, "main"));
+    ck_assert_int_eq(stream->count - stream->head, 3);
+    while (!TokenQueue_is_empty(expected)) {
+        ck_assert(!TokenQueue_is_empty(stream));
+        Token e = TokenQueue_remove(expected);
+        Token a = TokenQueue_remove(stream);
+        ck_assert(a.type == e.type);
+        ck_assert_int_eq(a.line, e.line);
+        ck_assert_int_eq(a.span.offset, e.span.offset);
+        ck_assert_int_eq(a.span.length, e.span.length);
+        ck_assert_int_le(stream->count - stream->head, 2);
+    }
+    ck_assert(TokenQueue_is_empty(stream));
+    ck_assert(!TokenQueue_has_ahead(stream, 0));
+    ck_assert_int_le(stream->capacity, 64);
+    TokenQueue_free(expected);
+    TokenQueue_free(stream);
+}
+END_TEST
+
+/*
+ * Test the token buffer cursor: peeking any distance and removing tokens are
+ * constant-time index operations, and stand-alone tokens keep their text.
+ */
+
+START_TEST(C_token_queue_cursor)
+{
+    TokenQueue* queue = TokenQueue_new();
+    for (int i = 0; i < 1000; i++) {
+        char text[16];
+        snprintf(text, sizeof(text), "v%d", i);
+        TokenQueue_add(queue, Token_new(ID, text, i + 1));
+    }
+    ck_assert_int_eq(TokenQueue_size(queue), 1000);
+    Token far = TokenQueue_peek_ahead(queue, 999);
+    ck_assert(Token_text_eq(&far, "v999"));
+    ck_assert(!TokenQueue_has_ahead(queue, 1000));
+    for (int i = 0; i < 500; i++) {
+        TokenQueue_remove(queue);
+    }
+    ck_assert_int_eq(TokenQueue_size(queue), 500);
+    Token next = TokenQueue_peek(queue);
+    ck_assert(Token_text_eq(&next, "v500"));
+    ck_assert_int_eq(next.line, 501);
+    TokenQueue_free(queue);
+}
+END_TEST
+
+START_TEST(B_parse_stream)
+{
+    TokenQueue* tokens = NULL;
+    if (setjmp(decaf_error) == 0) {
+        tokens = lex_stream("int g; def int main() { int a; a = 4 + 5; if (a < 10) { return a; } return 0; }");
+        ASTNode* ast = parse(tokens);
+        ck_assert_int_eq(ast->program.variables->size, 1);
+        ck_assert_int_eq(ast->program.functions->size, 1);
+        ck_assert(TokenQueue_is_empty(tokens));
+        ASTNode_free(ast);
+    } else {
+        ck_abort_msg("unexpected error");
+    }
+    TokenQueue_free(tokens);
+
+    /* lexing errors surface while parsing, and the queue is left to the caller */
+    tokens = lex_stream("int a; int b@;");
+    if (setjmp(decaf_error) == 0) {
+        parse(tokens);
+        ck_abort_msg("expected a lexing error");
+    }
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+/*
+ * Differential tests: the vector scanning kernels must agree with the scalar
+ * ones at every starting offset, and so must the token streams built on them.
+ */
+
+static void check_kernels_match (const ScanKernels* fast, const char* text)
+{
+    const ScanKernels* scalar = ScanKernels_scalar();
+    for (const char* p = text; *p != '\0'; p++) {
+        int lines_scalar = 0, lines_fast = 0;
+        ck_assert_ptr_eq(fast->skip_whitespace(p, &lines_fast), scalar->skip_whitespace(p, &lines_scalar));
+        ck_assert_int_eq(lines_fast, lines_scalar);
+        ck_assert_ptr_eq(fast->skip_ident(p),       scalar->skip_ident(p));
+        ck_assert_ptr_eq(fast->skip_digits(p),      scalar->skip_digits(p));
+        ck_assert_ptr_eq(fast->skip_hex(p),         scalar->skip_hex(p));
+        ck_assert_ptr_eq(fast->skip_string_body(p), scalar->skip_string_body(p));
+        ck_assert_ptr_eq(fast->skip_comment(p),     scalar->skip_comment(p));
+    }
+}
+
+START_TEST(B_scan_kernels_match)
+{
+    /* long runs of each character class, separated by run-ending characters */
+    static const char* const pieces[] = {
+        " ", "\t", "\r", "\n", "a", "Z", "_", "0", "9", "f", "G", "x",
+        "\"", "\\", "/", "@", "\x80", "\xff", "`", "{", "[", "g"
+    };
+    const size_t npieces = sizeof(pieces) / sizeof(pieces[0]);
+    const size_t size = 1024;
+    char* text = scan_buffer_alloc(size);
+    srand(1234);
+    for (int trial = 0; trial < 200; trial++) {
+        /* vary the length so the terminator lands at every offset within a block */
+        size_t limit = size - (size_t)(trial % SCAN_PADDING);
+        size_t len = 0;
+        while (len < limit) {
+            const char* piece = pieces[rand() % npieces];
+            int repeat = 1 + rand() % 40;
+            for (int i = 0; i < repeat && len < limit; i++) {
+                text[len++] = piece[0];
+            }
+        }
+        memset(text + len, 0, size - len);
+        if (ScanKernels_sse2() != NULL) {
+            check_kernels_match(ScanKernels_sse2(), text);
+        }
+        if (ScanKernels_avx2() != NULL) {
+            check_kernels_match(ScanKernels_avx2(), text);
+        }
+    }
+    free(text);
+}
+END_TEST
+
+START_TEST(B_lex_kernels_match)
+{
+    const char* program =
+        "// a comment long enough to span several vector blocks ..............\n"
+        "int a_very_long_identifier_name_that_spans_more_than_one_block;\n"
+        "def int main() {\n  \t\r\n    \n"
+        "  return 12345678901234567890123456789012345 + 0x0123456789abcdefABCDEF0123456789\n"
+        "    + f(\"a string body that keeps going and going \\n with \\\" escapes \\t\");\n"
+        "}\n";
+
+    /* the vector kernels may only scan padded buffers */
+    char* text = scan_buffer_alloc(strlen(program));
+    strcpy(text, program);
+    TokenQueue* expected = lex_with_kernels(text, ScanKernels_scalar());
+    const ScanKernels* kernels[] = { ScanKernels_sse2(), ScanKernels_avx2(), ScanKernels_select() };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (kernels[k] == NULL) {
+            continue;
+        }
+        TokenQueue* actual = lex_with_kernels(text, kernels[k]);
+        ck_assert_int_eq(TokenQueue_size(actual), TokenQueue_size(expected));
+        for (size_t i = 0; i < TokenQueue_size(expected); i++) {
+            Token a = TokenQueue_peek_ahead(actual, i);
+            Token e = TokenQueue_peek_ahead(expected, i);
+            ck_assert(a.type == e.type);
+            ck_assert_int_eq(a.line, e.line);
+            ck_assert_int_eq(a.span.offset, e.span.offset);
+            ck_assert_int_eq(a.span.length, e.span.length);
+        }
+        TokenQueue_free(actual);
+    }
+    TokenQueue_free(expected);
+    free(text);
+}
+END_TEST
+
+/*
+ * Test source file input: files of any size (including exact multiples of the
+ * page size, where the mapping has no slack for a terminator) load completely
+ * and padded, whether they are mapped or read.
+ */
+
+static void check_source_padding (const SourceFile* source)
+{
+    ck_assert_int_eq((uintptr_t)source->text % SCAN_PADDING, 0);
+    for (size_t i = 0; i < SCAN_PADDING; i++) {
+        ck_assert_int_eq(source->text[source->size + i], '\0');
+    }
+}
+
+static void check_source_file (size_t size)
+{
+    const char* filename = "source_test.decaf";
+    FILE* out = fopen(filename, "w");
+    ck_assert_ptr_ne(out, NULL);
+    size_t ndecls = size / 8;
+    for (size_t i = 0; i < ndecls; i++) {
+        fputs("int a;\n ", out);
+    }
+    for (size_t i = ndecls * 8; i < size; i++) {
+        fputc(' ', out);
+    }
+    fclose(out);
+
+    SourceFile* source = SourceFile_open(filename);
+    SourceFile* copy = SourceFile_read(filename);
+    remove(filename);
+    ck_assert_ptr_ne(source, NULL);
+    ck_assert_int_eq(source->size, size);
+    ck_assert_int_eq(strlen(source->text), size);
+    check_source_padding(source);
+    ck_assert_ptr_ne(copy, NULL);
+    ck_assert_int_eq(copy->mapped_size, 0);
+    ck_assert_int_eq(copy->size, size);
+    ck_assert(memcmp(copy->text, source->text, size) == 0);
+    check_source_padding(copy);
+    SourceFile_free(copy);
+
+    ASTNode* ast = run_parser((char*)source->text);
+    SourceFile_free(source);
+    ck_assert_ptr_ne(ast, NULL);
+    ck_assert_int_eq(ast->program.variables->size, ndecls);
+    ASTNode_free(ast);
+}
+
+START_TEST(C_source_page_multiple)
+{
+    check_source_file(4096);
+    check_source_file(64 * 1024);
+}
+END_TEST
+
+START_TEST(B_source_large)
+{
+    check_source_file(3 * 1024 * 1024 + 7);
+}
+END_TEST
 
 /*
  * Test some integer and string literals for proper handling.
@@ -82,6 +424,1537 @@ TEST_INT_LITERAL(C_declit, "42", 42)
 TEST_INT_LITERAL(C_hexlit, "0x10", 16)
 TEST_STR_LITERAL(C_strlit, "\"abc\"", "abc")
 TEST_STR_LITERAL(A_newline, "\"ab\\nc\"", "ab\nc")
+TEST_STR_LITERAL(B_strlit_escapes, "\"a\\\"b\\\\c\"", "a\"b\\c")
+TEST_STR_LITERAL(B_strlit_escaped_quotes, "\"\\\"q\\\"\"", "\"q\"")
+TEST_STR_LITERAL(B_strlit_escaped_backslash, "\"\\\\n\\\\\"", "\\n\\")
+TEST_STR_LITERAL(B_strlit_escapes_adjacent, "\"\\\\\\\"\\t\\\"\\\\\"", "\\\"\t\"\\")
+
+/*
+ * Identifiers and literals are no longer limited to 255 characters.
+ */
+START_TEST(C_long_identifier)
+{
+    char text[1024] = "int ";
+    memset(text + 4, 'v', 600);
+    strcpy(text + 604, ";");
+    ASTNode* ast = run_parser(text);
+    ck_assert_ptr_ne(ast, NULL);
+    ck_assert_int_eq(strlen(ast->program.variables->head->vardecl.name), 600);
+    ASTNode_free(ast);
+}
+END_TEST
+
+/*
+ * Every occurrence of a name in the AST refers to the same interned string.
+ */
+START_TEST(C_interned_names)
+{
+    ASTNode* ast = run_parser("int count; def int main() { count = 1; return count; }");
+    ck_assert_ptr_ne(ast, NULL);
+    const char* decl = ast->program.variables->head->vardecl.name;
+    NodeList* stmts = ast->program.functions->head->funcdecl.body->block.statements;
+    ck_assert_ptr_eq(stmts->head->assignment.location->location.name, decl);
+    ck_assert_ptr_eq(stmts->tail->funcreturn.value->location.name, decl);
+    ck_assert_ptr_eq(intern_string("count"), decl);
+    ck_assert_ptr_eq(intern("counter", 5), decl);
+    ck_assert_ptr_eq(intern_name(intern_id(decl)), decl);
+    ck_assert_ptr_ne(intern_string("Count"), decl);
+    ASTNode_free(ast);
+}
+END_TEST
+
+/*
+ * Parsed trees live in an arena that is released with the program node;
+ * attribute destructors still run when it is.
+ */
+static int released_attributes = 0;
+
+static void count_release (void* value)
+{
+    released_attributes++;
+    free(value);
+}
+
+START_TEST(B_ast_arena)
+{
+    ASTNode* ast = run_parser("int a; def int main() { a = 1; return a; }");
+    ck_assert_ptr_ne(ast, NULL);
+    ck_assert_ptr_ne(ast->arena, NULL);
+    ASTNode* func = ast->program.functions->head;
+    ck_assert_ptr_eq(func->arena, ast->arena);
+    ASTNode_set_attribute(func, "scratch", malloc(16), count_release);
+    ASTNode_set_int_attribute(func, "depth", 1);
+    ASTNode_free(func->funcdecl.body);  /* no effect on an arena-backed subtree */
+    ck_assert_int_eq(func->funcdecl.body->block.statements->size, 2);
+    released_attributes = 0;
+    ASTNode_free(ast);
+    ck_assert_int_eq(released_attributes, 1);
+}
+END_TEST
+
+/*
+ * test that a flat copy of the AST is laid out in pre-order and that visitors
+ * walking it see the same tree
+ */
+static void print_tree_to (FILE* out, ASTNode* tree, FlatAST* flat)
+{
+    NodeVisitor* passes[] = { SetParentVisitor_new(), CalcDepthVisitor_new(), PrintVisitor_new(out) };
+    for (int i = 0; i < 3; i++) {
+        if (flat != NULL) {
+            FlatAST_traverse(passes[i], flat);
+        } else {
+            NodeVisitor_traverse(passes[i], tree);
+        }
+        NodeVisitor_free(passes[i]);
+    }
+    rewind(out);
+}
+
+/*
+ * check that a function's body views are in place while it is visited, and
+ * free the program view (which must leave the flat tree intact)
+ */
+static void check_flat_funcdecl (NodeVisitor* visitor, ASTNode* node)
+{
+    FlatAST* flat = (FlatAST*)visitor->data;
+    ck_assert_ptr_eq(node->funcdecl.body, flat->body_views);
+    ck_assert_int_eq(node->funcdecl.body->id, flat->nodes[node->id].first_child);
+}
+
+static void free_flat_program (NodeVisitor* visitor, ASTNode* node)
+{
+    ASTNode_free(node);
+}
+
+#define DEEP_NESTING 100000
+
+START_TEST(C_flat_ast)
+{
+    ASTNode* ast = run_parser("int g[4]; bool b; "
+                              "def int f(int x, bool y) { int t; if (y) { t = x; } else { return -x; } "
+                              "while (!y) { break; } g[1] = f(t, y) * 2; return t; } "
+                              "def void main() { continue; }");
+    ck_assert_ptr_ne(ast, NULL);
+    FlatAST* flat = FlatAST_new(ast);
+    ck_assert_int_eq(flat->nodes[0].type, PROGRAM);
+    ck_assert_int_eq(flat->nodes[0].payload, 2);
+    ck_assert_int_eq(flat->nodes[0].first_child, 1);
+    ck_assert_int_eq(flat->nodes[1].next_sibling, 2);
+    ck_assert_str_eq(FlatAST_name(flat, 3), "f");
+    ck_assert_int_eq(flat->funcdecls[flat->nodes[3].payload].param_count, 2);
+    ck_assert_int_eq(flat->nodes[3].first_child, 4);
+    for (FlatIndex i = 0; i < flat->count; i++) {
+        if (flat->nodes[i].first_child != FLAT_NONE) {
+            ck_assert_int_eq(flat->nodes[i].first_child, i + 1);
+        }
+        if (flat->nodes[i].next_sibling != FLAT_NONE) {
+            ck_assert_int_gt(flat->nodes[i].next_sibling, i);
+        }
+    }
+
+    FILE* expected = tmpfile();
+    FILE* actual = tmpfile();
+    print_tree_to(expected, ast, NULL);
+    print_tree_to(actual, NULL, flat);
+    int a, b;
+    do {
+        a = fgetc(expected);
+        b = fgetc(actual);
+        ck_assert_int_eq(a, b);
+    } while (a != EOF);
+    ck_assert_int_gt(ftell(expected), 0);
+    fclose(expected);
+    fclose(actual);
+
+    /* only the largest function body has views at any one time */
+    ck_assert_int_eq(flat->body_capacity, flat->nodes[3].next_sibling - 4);
+    ck_assert_int_lt(flat->body_capacity, flat->count);
+    ck_assert_int_eq(flat->top_views[3].id, 3);
+    ck_assert_ptr_eq(flat->top_views[3].funcdecl.body, NULL);
+    NodeVisitor* checker = NodeVisitor_new();
+    checker->data = flat;
+    checker->previsit_funcdecl = check_flat_funcdecl;
+    checker->postvisit_program = free_flat_program;
+    FlatAST_traverse(checker, flat);
+    NodeVisitor_free(checker);
+    actual = tmpfile();
+    print_tree_to(actual, NULL, flat);
+    ck_assert_int_ne(fgetc(actual), EOF);
+    fclose(actual);
+
+    FlatAST_free(flat);
+    ASTNode_free(ast);
+
+    /* (((0 + 1) + 2) + 3) ..., nested DEEP_NESTING levels deep: the operators
+     * come first (outermost first), then the 0, then the right operands */
+    ASTNode* expr = LiteralNode_new_int(0, 1);
+    for (int k = 0; k < DEEP_NESTING; k++) {
+        expr = BinaryOpNode_new(ADDOP, expr, LiteralNode_new_int(k + 1, 1), 1);
+    }
+    flat = FlatAST_new(expr);
+    ck_assert_int_eq(flat->count, 2 * DEEP_NESTING + 1);
+    int mismatches = 0;
+    for (FlatIndex i = 0; i < DEEP_NESTING; i++) {
+        FlatNode* op = &flat->nodes[i];
+        FlatIndex right = 2 * DEEP_NESTING - i;
+        mismatches += (op->type != BINARYOP || op->first_child != i + 1 ||
+                       flat->nodes[i + 1].next_sibling != right ||
+                       flat->nodes[right].payload != DEEP_NESTING - i);
+    }
+    ck_assert_int_eq(mismatches, 0);
+    ck_assert_int_eq(flat->nodes[DEEP_NESTING].type, LITERAL);
+    ck_assert_int_eq(flat->nodes[DEEP_NESTING].payload, 0);
+    ck_assert_int_eq(flat->body_capacity, flat->count);
+    FlatAST_free(flat);
+    ASTNode_free(expr);
+}
+END_TEST
+
+/*
+ * test attribute keys: dense and per-node attributes, name and key access
+ */
+#define HEAP_THREADS 4
+
+typedef struct HeapHandoff {
+    ASTNode* node;
+    int wrong;
+} HeapHandoff;
+
+static void* use_heap_nodes (void* arg)
+{
+    HeapHandoff* handoff = (HeapHandoff*)arg;
+    int index = ASTNode_get_int_attribute(handoff->node, "depth");
+    ASTNode_set_int_attribute(handoff->node, "scratch", index + 1);
+    for (int round = 0; round < 200; round++) {
+        ASTNode* nodes[16];
+        for (int i = 0; i < 16; i++) {
+            nodes[i] = LiteralNode_new_int(i, 1);
+            ASTNode_set_int_attribute(nodes[i], "depth", index * 100 + i);
+        }
+        for (int i = 0; i < 16; i++) {
+            handoff->wrong += (ASTNode_get_int_attribute(nodes[i], "depth") != index * 100 + i);
+            ASTNode_free(nodes[i]);
+        }
+    }
+    return NULL;
+}
+
+START_TEST(C_attribute_keys)
+{
+    ASTNode* ast = run_parser("int a; def int main() { a = 1; return a; }");
+    ck_assert_ptr_ne(ast, NULL);
+    ASTNode* func = ast->program.functions->head;
+    ck_assert_int_eq(AttributeKey_lookup("depth"), ATTR_DEPTH);
+    AttributeKey scratch = AttributeKey_lookup("scratch");
+    ck_assert_int_eq(AttributeKey_lookup("scratch"), scratch);
+    ck_assert_str_eq(AttributeKey_name(scratch), "scratch");
+
+    ck_assert(!ASTNode_has_keyed_attribute(func, scratch));
+    ASTNode_set_int_attribute(func, "depth", 1);
+    ASTNode_set_keyed_attribute(func, ATTR_PARENT, ast, dummy_print, NULL);
+    ASTNode_set_keyed_attribute(func, scratch, malloc(16), dummy_print, count_release);
+    ASTNode_set_int_attribute(ast, "depth", 0);
+    ck_assert_int_eq(ASTNode_get_int_attribute(func, "depth"), 1);
+    ck_assert_ptr_eq(ASTNode_get_attribute(func, "parent"), ast);
+    ck_assert(ASTNode_has_attribute(func, "scratch"));
+    ck_assert_int_eq((long)ASTNode_get_keyed_attribute(ast, ATTR_DEPTH), 0);
+
+    released_attributes = 0;
+    ASTNode_set_keyed_attribute(func, scratch, malloc(16), dummy_print, count_release);
+    ck_assert_int_eq(released_attributes, 1);
+    ASTNode_free(ast);
+    ck_assert_int_eq(released_attributes, 2);
+
+    /* IDs of freed heap nodes are reused without their attributes */
+    ASTNode* lit = LiteralNode_new_int(1, 1);
+    ASTNode_set_int_attribute(lit, "depth", 3);
+    uint32_t id = lit->id;
+    ASTNode_free(lit);
+    lit = LiteralNode_new_int(2, 1);
+    ck_assert_int_eq(lit->id, id);
+    ck_assert(!ASTNode_has_attribute(lit, "depth"));
+    ASTNode_free(lit);
+
+    /* heap nodes can be handed to other threads, and threads can use their own at once */
+    HeapHandoff handoffs[HEAP_THREADS];
+    pthread_t threads[HEAP_THREADS];
+    for (int i = 0; i < HEAP_THREADS; i++) {
+        handoffs[i].node = LiteralNode_new_int(i, 1);
+        ASTNode_set_int_attribute(handoffs[i].node, "depth", i);
+        handoffs[i].wrong = 0;
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, use_heap_nodes, &handoffs[i]), 0);
+    }
+    for (int i = 0; i < HEAP_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ck_assert_int_eq(handoffs[i].wrong, 0);
+        ck_assert_int_eq(ASTNode_get_int_attribute(handoffs[i].node, "scratch"), i + 1);
+        ASTNode_free(handoffs[i].node);
+    }
+}
+END_TEST
+
+/*
+ * test that the parser records parent links and depths that match the ones
+ * computed by the original passes
+ */
+START_TEST(B_parent_depth)
+{
+    ASTNode* ast = run_parser("int g; def int f(int x) { if (x < 1) { return -x + g; } "
+                              "while (x > 0) { x = x - f(x); } return x; }");
+    ck_assert_ptr_ne(ast, NULL);
+    ck_assert(!ASTNode_has_attribute(ast, "parent"));
+    ck_assert_int_eq(ASTNode_get_int_attribute(ast, "depth"), 0);
+    ASTNode* func = ast->program.functions->head;
+    ck_assert_ptr_eq(ASTNode_get_attribute(func, "parent"), ast);
+    ASTNode* cond = func->funcdecl.body->block.statements->head;
+    ck_assert_ptr_eq(ASTNode_get_attribute(cond, "parent"), func->funcdecl.body);
+    ck_assert_int_eq(ASTNode_get_int_attribute(cond, "depth"), 3);
+    ck_assert_int_eq(ASTNode_get_int_attribute(cond->conditional.condition->binaryop.left, "depth"), 5);
+    ck_assert_int_eq(verify_parent_and_depth(ast, stderr), 0);
+    ASTNode_free(ast);
+}
+END_TEST
+
+/*
+ * test that a composite visitor runs its members' callbacks in the order they
+ * were added, so later members see what earlier ones did for the same node
+ */
+static char visit_log[64];
+
+static void log_visit (NodeVisitor* visitor, ASTNode* node)
+{
+    strncat(visit_log, (const char*)visitor->data, sizeof(visit_log) - strlen(visit_log) - 1);
+}
+
+static void mark_node (NodeVisitor* visitor, ASTNode* node)
+{
+    ASTNode_set_int_attribute(node, "mark", node->type);
+}
+
+static void check_mark (NodeVisitor* visitor, ASTNode* node)
+{
+    ck_assert_int_eq(ASTNode_get_int_attribute(node, "mark"), node->type);
+}
+
+START_TEST(C_composite_visitor)
+{
+    ASTNode* ast = run_parser("def int main() { return 1 + 2; }");
+    ck_assert_ptr_ne(ast, NULL);
+    ASTNode* expr = ast->program.functions->head->funcdecl.body->block.statements->head->funcreturn.value;
+
+    NodeVisitor* first = NodeVisitor_new();
+    first->data = "a";
+    first->previsit_default = log_visit;
+    first->invisit_binaryop = log_visit;
+    NodeVisitor* second = NodeVisitor_new();
+    second->data = "b";
+    second->previsit_default = log_visit;
+    second->postvisit_default = log_visit;
+    NodeVisitor* composite = CompositeVisitor_new();
+    CompositeVisitor_add(composite, first);
+    CompositeVisitor_add(composite, second);
+    visit_log[0] = '\0';
+    NodeVisitor_traverse_and_free(composite, expr);
+    ck_assert_str_eq(visit_log, "ababbaabbb");
+
+    NodeVisitor* marker = NodeVisitor_new();
+    marker->previsit_default = mark_node;
+    NodeVisitor* checker = NodeVisitor_new();
+    checker->previsit_default = check_mark;
+    composite = CompositeVisitor_new();
+    CompositeVisitor_add(composite, marker);
+    CompositeVisitor_add(composite, checker);
+    NodeVisitor_traverse_and_free(composite, ast);
+    ASTNode_free(ast);
+}
+END_TEST
+
+
+/**
+ * @brief Hook invocation recorded by the deep traversal test
+ */
+typedef struct DeepEvent {
+    ASTNode* node;
+    char hook;
+} DeepEvent;
+
+static DeepEvent* deep_events;
+static size_t deep_event_count;
+
+static void log_deep (ASTNode* node, char hook)
+{
+    deep_events[deep_event_count].node = node;
+    deep_events[deep_event_count].hook = hook;
+    deep_event_count++;
+}
+
+static void deep_pre  (NodeVisitor* visitor, ASTNode* node) { log_deep(node, 'p'); }
+static void deep_in   (NodeVisitor* visitor, ASTNode* node) { log_deep(node, 'i'); }
+static void deep_post (NodeVisitor* visitor, ASTNode* node) { log_deep(node, 'q'); }
+
+static int deep_mismatches (size_t* pos, ASTNode* node, char hook)
+{
+    DeepEvent event = deep_events[(*pos)++];
+    return (event.node != node || event.hook != hook);
+}
+
+START_TEST(C_deep_traversal)
+{
+    /* def int main() { return ((((0 + -1) + -2) + -3) ...); }, with the
+     * expression nested DEEP_NESTING levels deep */
+    ASTNode** ops = (ASTNode**)malloc(DEEP_NESTING * sizeof(ASTNode*));
+    ASTNode* leaf = LiteralNode_new_int(0, 1);
+    ASTNode* expr = leaf;
+    for (int k = 0; k < DEEP_NESTING; k++) {
+        ASTNode* right = UnaryOpNode_new(NEGOP, LiteralNode_new_int(k + 1, 1), 1);
+        expr = ops[k] = BinaryOpNode_new(ADDOP, expr, right, 1);
+    }
+    NodeList* stmts = NodeList_new();
+    NodeList_add(stmts, ReturnNode_new(expr, 1));
+    NodeList* funcs = NodeList_new();
+    NodeList_add(funcs, FuncDeclNode_new("main", INT, ParameterList_new(),
+                                         BlockNode_new(NodeList_new(), stmts, 1), 1));
+    ASTNode* ast = ProgramNode_new(NodeList_new(), funcs);
+
+    NodeVisitor* logger = NodeVisitor_new();
+    logger->previsit_default = deep_pre;
+    logger->invisit_binaryop = deep_in;
+    logger->postvisit_default = deep_post;
+    deep_events = (DeepEvent*)malloc((7 * DEEP_NESTING + 2) * sizeof(DeepEvent));
+    deep_event_count = 0;
+    NodeVisitor_traverse_and_free(logger, expr);
+    ck_assert_int_eq(deep_event_count, 7 * DEEP_NESTING + 2);
+
+    size_t pos = 0;
+    int mismatches = 0;
+    for (int k = DEEP_NESTING - 1; k >= 0; k--) {
+        mismatches += deep_mismatches(&pos, ops[k], 'p');
+    }
+    mismatches += deep_mismatches(&pos, leaf, 'p');
+    mismatches += deep_mismatches(&pos, leaf, 'q');
+    for (int k = 0; k < DEEP_NESTING; k++) {
+        ASTNode* neg = ops[k]->binaryop.right;
+        mismatches += deep_mismatches(&pos, ops[k], 'i');
+        mismatches += deep_mismatches(&pos, neg, 'p');
+        mismatches += deep_mismatches(&pos, neg->unaryop.child, 'p');
+        mismatches += deep_mismatches(&pos, neg->unaryop.child, 'q');
+        mismatches += deep_mismatches(&pos, neg, 'q');
+        mismatches += deep_mismatches(&pos, ops[k], 'q');
+    }
+    ck_assert_int_eq(mismatches, 0);
+    free(deep_events);
+
+    /* program, function, block, and return statement come first */
+    NodeVisitor_traverse_and_free(SetParentVisitor_new(), ast);
+    NodeVisitor_traverse_and_free(CalcDepthVisitor_new(), ast);
+    ck_assert_int_eq(ASTNode_get_int_attribute(leaf, "depth"), DEEP_NESTING + 4);
+    ck_assert_int_eq(ASTNode_get_int_attribute(ops[0]->binaryop.right->unaryop.child, "depth"), DEEP_NESTING + 5);
+
+    ASTNode_free(ast);
+    free(ops);
+}
+END_TEST
+
+
+static void count_call (NodeVisitor* visitor, ASTNode* node)
+{
+    (*(int*)visitor->data)++;
+}
+
+static void skip_funcdecl (NodeVisitor* visitor, ASTNode* node)
+{
+    count_call(visitor, node);
+    visitor->control = TRAVERSE_SKIP_CHILDREN;
+}
+
+static void stop_at_funccall (NodeVisitor* visitor, ASTNode* node)
+{
+    count_call(visitor, node);
+    visitor->control = TRAVERSE_STOP;
+}
+
+static NodeVisitor* counting_visitor (int* count)
+{
+    NodeVisitor* visitor = NodeVisitor_new();
+    visitor->data = count;
+    visitor->previsit_default = count_call;
+    return visitor;
+}
+
+START_TEST(C_traversal_control)
+{
+    ASTNode* ast = run_parser("def int f(int x) { return g(x) + 1; } def int g(int y) { return y; }");
+    ck_assert_ptr_ne(ast, NULL);
+
+    /* stop at the first function call (the sixth node in pre-order) */
+    int stopper_count = 0;
+    NodeVisitor* stopper = counting_visitor(&stopper_count);
+    stopper->previsit_funccall = stop_at_funccall;
+    stopper->postvisit_default = count_call;
+    NodeVisitor_traverse(stopper, ast);
+    ck_assert_int_eq(stopper_count, 6);
+    NodeVisitor_traverse_and_free(stopper, ast);
+    ck_assert_int_eq(stopper_count, 12);
+
+    /* skip function bodies but still post-visit the functions */
+    int skipper_count = 0;
+    NodeVisitor* skipper = counting_visitor(&skipper_count);
+    skipper->previsit_funcdecl = skip_funcdecl;
+    skipper->postvisit_funcdecl = count_call;
+    NodeVisitor_traverse_and_free(skipper, ast);
+    ck_assert_int_eq(skipper_count, 5);
+
+    /* requests made by one member of a composite do not affect the others */
+    int all_count = 0;
+    stopper_count = 0;
+    skipper_count = 0;
+    stopper = counting_visitor(&stopper_count);
+    stopper->previsit_funccall = stop_at_funccall;
+    skipper = counting_visitor(&skipper_count);
+    skipper->previsit_funcdecl = skip_funcdecl;
+    skipper->postvisit_funcdecl = count_call;
+    NodeVisitor* composite = CompositeVisitor_new();
+    CompositeVisitor_add(composite, skipper);
+    CompositeVisitor_add(composite, stopper);
+    CompositeVisitor_add(composite, counting_visitor(&all_count));
+    NodeVisitor_traverse_and_free(composite, ast);
+    ck_assert_int_eq(skipper_count, 5);
+    ck_assert_int_eq(stopper_count, 6);
+    ck_assert_int_eq(all_count, 12);
+
+    ASTNode_free(ast);
+}
+END_TEST
+
+
+#define PARALLEL_FUNCTIONS 40
+
+/**
+ * @brief Results of the parallel traversal test visitor (visitor data)
+ */
+typedef struct ParallelLog {
+    char names[PARALLEL_FUNCTIONS * 8];
+    int nodes;
+    bool finished;
+    const char* stop_at;
+    int throw_from;
+} ParallelLog;
+
+static void parallel_count (NodeVisitor* visitor, ASTNode* node)
+{
+    ((ParallelLog*)visitor->data)->nodes++;
+    ASTNode_set_int_attribute(node, "visit", (int)node->id);
+}
+
+static void parallel_funcdecl (NodeVisitor* visitor, ASTNode* node)
+{
+    ParallelLog* log = (ParallelLog*)visitor->data;
+    parallel_count(visitor, node);
+    strcat(log->names, node->funcdecl.name);
+    strcat(log->names, ",");
+    if (log->stop_at != NULL && strcmp(node->funcdecl.name, log->stop_at) == 0) {
+        visitor->control = TRAVERSE_STOP;
+    }
+    if (log->throw_from > 0 && atoi(node->funcdecl.name + 1) >= log->throw_from) {
+        Error_throw("ERROR: %s failed\n", node->funcdecl.name);
+    }
+}
+
+static void parallel_finish (NodeVisitor* visitor, ASTNode* node)
+{
+    ((ParallelLog*)visitor->data)->finished = true;
+}
+
+static NodeVisitor* parallel_visitor (const char* stop_at);
+
+static NodeVisitor* parallel_fork (NodeVisitor* visitor)
+{
+    NodeVisitor* part = parallel_visitor(((ParallelLog*)visitor->data)->stop_at);
+    ((ParallelLog*)part->data)->throw_from = ((ParallelLog*)visitor->data)->throw_from;
+    return part;
+}
+
+static void parallel_join (NodeVisitor* visitor, NodeVisitor* part)
+{
+    ParallelLog* log = (ParallelLog*)visitor->data;
+    ParallelLog* more = (ParallelLog*)part->data;
+    strcat(log->names, more->names);
+    log->nodes += more->nodes;
+}
+
+static NodeVisitor* parallel_visitor (const char* stop_at)
+{
+    NodeVisitor* visitor = NodeVisitor_new();
+    ParallelLog* log = (ParallelLog*)calloc(1, sizeof(ParallelLog));
+    log->stop_at = stop_at;
+    visitor->data = log;
+    visitor->dtor = free;
+    visitor->previsit_default = parallel_count;
+    visitor->previsit_funcdecl = parallel_funcdecl;
+    visitor->postvisit_program = parallel_finish;
+    visitor->fork = parallel_fork;
+    visitor->join = parallel_join;
+    return visitor;
+}
+
+static void check_visit (NodeVisitor* visitor, ASTNode* node)
+{
+    if (ASTNode_get_int_attribute(node, "visit") != (int)node->id) {
+        (*(int*)visitor->data)++;
+    }
+}
+
+START_TEST(C_parallel_traversal)
+{
+    char source[PARALLEL_FUNCTIONS * 128] = "int g;";
+    for (int i = 0; i < PARALLEL_FUNCTIONS; i++) {
+        sprintf(source + strlen(source), " def int f%d(int x) { if (x > %d) { return f%d(x - 1); } return g; }",
+                i, i, i);
+    }
+    ASTNode* ast = run_parser(source);
+    ck_assert_ptr_ne(ast, NULL);
+
+    /* the merged results match a serial traversal */
+    NodeVisitor* serial = parallel_visitor(NULL);
+    NodeVisitor_traverse(serial, ast);
+    NodeVisitor* parallel = parallel_visitor(NULL);
+    NodeVisitor_traverse_parallel(parallel, ast, 4);
+    ParallelLog* expected = (ParallelLog*)serial->data;
+    ParallelLog* actual = (ParallelLog*)parallel->data;
+    ck_assert_str_eq(actual->names, expected->names);
+    ck_assert_int_eq(actual->nodes, expected->nodes);
+    ck_assert(actual->finished);
+    NodeVisitor_free(serial);
+    NodeVisitor_free(parallel);
+
+    /* every node got its own attribute */
+    int wrong = 0;
+    NodeVisitor* checker = counting_visitor(&wrong);
+    checker->previsit_default = check_visit;
+    NodeVisitor_traverse_and_free(checker, ast);
+    ck_assert_int_eq(wrong, 0);
+
+    /* stopping in one function discards the functions after it */
+    NodeVisitor* stopper = parallel_visitor("f7");
+    NodeVisitor_traverse_parallel(stopper, ast, 4);
+    ck_assert_str_eq(((ParallelLog*)stopper->data)->names, "f0,f1,f2,f3,f4,f5,f6,f7,");
+    ck_assert(!((ParallelLog*)stopper->data)->finished);
+    NodeVisitor_free(stopper);
+
+    /* an error in a worker reaches the caller's handler, and the earliest one wins */
+    for (int i = 0; i < 3; i++) {
+        NodeVisitor* thrower = parallel_visitor(NULL);
+        ((ParallelLog*)thrower->data)->throw_from = 13;
+        ErrorHandler handler;
+        volatile bool thrown = false;
+        ErrorHandler_push(&handler);
+        if (setjmp(handler.target) == 0) {
+            NodeVisitor_traverse_parallel(thrower, ast, 4);
+        } else {
+            NodeVisitor_release_stack();
+            thrown = true;
+        }
+        ErrorHandler_pop(&handler);
+        ck_assert(thrown);
+        ck_assert_str_eq(handler.message, "ERROR: f13 failed\n");
+        ck_assert(strstr(((ParallelLog*)thrower->data)->names, "f13") == NULL);
+        ck_assert(!((ParallelLog*)thrower->data)->finished);
+        NodeVisitor_free(thrower);
+    }
+
+    /* the standard passes can run in parallel */
+    NodeVisitor* passes = CompositeVisitor_new();
+    CompositeVisitor_add(passes, SetParentVisitor_new());
+    CompositeVisitor_add(passes, CalcDepthVisitor_new());
+    NodeVisitor_traverse_parallel(passes, ast, 4);
+    NodeVisitor_free(passes);
+    ck_assert_int_eq(verify_parent_and_depth(ast, stdout), 0);
+
+    ASTNode_free(ast);
+}
+END_TEST
+
+
+/*
+ * test that the print visitor writes everything (string literals included) to
+ * its own stream, also when printing in parallel, and the buffer formatting
+ */
+static void read_back (FILE* out, char* text, size_t size)
+{
+    rewind(out);
+    size_t length = fread(text, 1, size - 1, out);
+    text[length] = '\0';
+    fclose(out);
+}
+
+START_TEST(C_buffered_print)
+{
+    ASTNode* ast = run_parser("def void f() { print_str(\"a\\tb\\\"c\"); } def int g() { return -12; }");
+    ck_assert_ptr_ne(ast, NULL);
+    const char* expected =
+        "Program [line 1]\n"
+        "  FuncDecl name=\"f\" return_type=void parameters={} [line 1]\n"
+        "    Block [line 1]\n"
+        "      FuncCall name=\"print_str\" [line 1]\n"
+        "        Literal type=string value=\"a\\tb\\\"c\" [line 1]\n"
+        "  FuncDecl name=\"g\" return_type=int parameters={} [line 1]\n"
+        "    Block [line 1]\n"
+        "      Return [line 1]\n"
+        "        Unaryop op=\"-\" [line 1]\n"
+        "          Literal type=int value=12 [line 1]\n";
+    char text[1024];
+    FILE* out = tmpfile();
+    NodeVisitor_traverse_and_free(PrintVisitor_new(out), ast);
+    read_back(out, text, sizeof(text));
+    ck_assert_str_eq(text, expected);
+
+    out = tmpfile();
+    NodeVisitor* printer = PrintVisitor_new(out);
+    NodeVisitor_traverse_parallel(printer, ast, 2);
+    NodeVisitor_free(printer);
+    read_back(out, text, sizeof(text));
+    ck_assert_str_eq(text, expected);
+    ASTNode_free(ast);
+
+    OutputBuffer* buffer = OutputBuffer_new(NULL);
+    OutputBuffer_int(buffer, 0);
+    OutputBuffer_putc(buffer, ' ');
+    OutputBuffer_int(buffer, -907);
+    OutputBuffer_putc(buffer, ' ');
+    OutputBuffer_int(buffer, INT64_MIN);
+    OutputBuffer_indent(buffer, 70);
+    OutputBuffer_escaped(buffer, "\\\"x\n");
+    OutputBuffer_doubly_escaped(buffer, "\t");
+    const char* prefix = "0 -907 -9223372036854775808";
+    ck_assert_int_eq(buffer->length, strlen(prefix) + 140 + 7 + 3);
+    ck_assert(memcmp(buffer->text, prefix, strlen(prefix)) == 0);
+    ck_assert(buffer->text[strlen(prefix)] == ' ' && buffer->text[strlen(prefix) + 139] == ' ');
+    ck_assert(memcmp(buffer->text + strlen(prefix) + 140, "\\\\\\\"x\\n\\\\t", 10) == 0);
+    OutputBuffer_free(buffer);
+}
+END_TEST
+
+START_TEST(C_tree_layout)
+{
+    /* root over three leaves */
+    TreeLayout* layout = TreeLayout_new(10);
+    LayoutIndex root = TreeLayout_add(layout, LAYOUT_NONE, 10);
+    for (int i = 0; i < 3; i++) {
+        TreeLayout_add(layout, root, 10);
+    }
+    TreeLayout_compute(layout);
+    ck_assert(layout->nodes[1].x == 5 && layout->nodes[2].x == 25 && layout->nodes[3].x == 45);
+    ck_assert(layout->nodes[0].x == 25);
+    ck_assert(layout->extent == 50 && layout->levels == 2);
+    TreeLayout_free(layout);
+
+    /* pseudo-random tree: no overlaps on any level, parents centred */
+    layout = TreeLayout_new(4);
+    TreeLayout_add(layout, LAYOUT_NONE, 30);
+    uint32_t seed = 12345;
+    for (int i = 1; i < 400; i++) {
+        seed = seed * 1103515245 + 12345;
+        TreeLayout_add(layout, (seed >> 8) % (uint32_t)i, 10 + (double)((seed >> 20) % 50));
+    }
+    TreeLayout_compute(layout);
+    LayoutNode* nodes = layout->nodes;
+    for (LayoutIndex a = 0; a < layout->count; a++) {
+        ck_assert(nodes[a].x - nodes[a].width / 2 >= -1e-6);
+        ck_assert(nodes[a].x + nodes[a].width / 2 <= layout->extent + 1e-6);
+        for (LayoutIndex b = a + 1; b < layout->count; b++) {
+            if (nodes[a].level == nodes[b].level) {
+                double apart = (nodes[a].x > nodes[b].x ? nodes[a].x - nodes[b].x : nodes[b].x - nodes[a].x);
+                ck_assert(apart >= (nodes[a].width + nodes[b].width) / 2 + 4 - 1e-6);
+            }
+        }
+        if (nodes[a].first_child != LAYOUT_NONE) {
+            double middle = (nodes[nodes[a].first_child].x + nodes[nodes[a].last_child].x) / 2;
+            ck_assert(nodes[a].x - middle < 1e-6 && middle - nodes[a].x < 1e-6);
+        }
+    }
+    TreeLayout_free(layout);
+
+    /* a long chain is laid out without recursion */
+    layout = TreeLayout_new(10);
+    LayoutIndex last = TreeLayout_add(layout, LAYOUT_NONE, 20);
+    for (int i = 0; i < 200000; i++) {
+        last = TreeLayout_add(layout, last, 20);
+    }
+    TreeLayout_compute(layout);
+    ck_assert(layout->nodes[last].x == 10 && layout->levels == 200001);
+    TreeLayout_free(layout);
+
+    /* SVG output: one box per node, with the labels escaped */
+    ASTNode* ast = run_parser("def bool f() { return 1 < 2; }");
+    ck_assert_ptr_ne(ast, NULL);
+    FILE* out = tmpfile();
+    NodeVisitor* image = GenerateASTImage_new(out);
+    NodeVisitor_traverse(image, ast);
+    NodeVisitor_free(image);
+    char text[4096];
+    read_back(out, text, sizeof(text));
+    ck_assert(strncmp(text, "<svg ", 5) == 0);
+    int boxes = 0;
+    for (char* box = strstr(text, "<rect "); box != NULL; box = strstr(box + 1, "<rect ")) {
+        boxes++;
+    }
+    ck_assert_int_eq(boxes, 7);
+    ck_assert_ptr_ne(strstr(text, ">BinaryOp op=&apos;&lt;&apos;</text>"), NULL);
+    ck_assert_ptr_ne(strstr(text, "</svg>\n"), NULL);
+    ASTNode_free(ast);
+}
+END_TEST
+
+/**
+ * @brief Parse an expression and write its tree in prefix form, e.g.
+ * "(+ 1 (* 2 3))"
+ */
+static void render_expr (const char* expr, char* text, size_t size)
+{
+    char program[256];
+    snprintf(program, sizeof(program), "def int main() { return %s; }", expr);
+    ASTNode* ast = run_parser(program);
+    ck_assert_ptr_ne(ast, NULL);
+    ASTNode* value = ast->program.functions->head->funcdecl.body->block.statements->head->funcreturn.value;
+    text[0] = '\0';
+
+    /* pre-order walk with an explicit stack; ")" entries close an operator */
+    ASTNode* stack[64];
+    int depth = 0;
+    stack[depth++] = value;
+    while (depth > 0) {
+        ASTNode* node = stack[--depth];
+        size_t length = strlen(text);
+        if (node == NULL) {
+            snprintf(text + length, size - length, ")");
+            continue;
+        }
+        const char* space = (length > 0 && text[length-1] != '(' ? " " : "");
+        switch (node->type) {
+            case BINARYOP:
+                snprintf(text + length, size - length, "%s(%s", space, BinaryOpToString(node->binaryop.operator));
+                stack[depth++] = NULL;
+                stack[depth++] = node->binaryop.right;
+                stack[depth++] = node->binaryop.left;
+                break;
+            case UNARYOP:
+                snprintf(text + length, size - length, "%s(%s", space, UnaryOpToString(node->unaryop.operator));
+                stack[depth++] = NULL;
+                stack[depth++] = node->unaryop.child;
+                break;
+            case LITERAL:
+                snprintf(text + length, size - length, "%s%d", space, node->literal.integer);
+                break;
+            default:
+                snprintf(text + length, size - length, "%s%s", space, node->location.name);
+                break;
+        }
+    }
+    ASTNode_free(ast);
+}
+
+#define CHECK_EXPR(EXPR, TREE) render_expr(EXPR, text, sizeof(text)); ck_assert_str_eq(text, TREE);
+
+START_TEST(C_expr_precedence)
+{
+    char text[256];
+    CHECK_EXPR("1 - 2 - 3",           "(- (- 1 2) 3)");
+    CHECK_EXPR("1 + 2 * 3",           "(+ 1 (* 2 3))");
+    CHECK_EXPR("1 * 2 + 3 % 4 / 5",   "(+ (* 1 2) (/ (% 3 4) 5))");
+    CHECK_EXPR("(1 + 2) * 3",         "(* (+ 1 2) 3)");
+    CHECK_EXPR("((a))",               "a");
+    CHECK_EXPR("- a * - - b",         "(* (- a) (- (- b)))");
+    CHECK_EXPR("-(a - b)",            "(- (- a b))");
+    CHECK_EXPR("a < b == c >= d",     "(== (< a b) (>= c d))");
+    CHECK_EXPR("a != b <= c + 1",     "(!= a (<= b (+ c 1)))");
+    CHECK_EXPR("!a || b && c > d",    "(|| (! a) (&& b (> c d)))");
+    CHECK_EXPR("a || b || c && d",    "(|| (|| a b) (&& c d))");
+    CHECK_EXPR("f(1 + 2) * x[3 - 4]", "(* f x)");
+
+    /* long chains fold into left-deep trees without nesting calls */
+    const int terms = 20000;
+    char* program = (char*)malloc((size_t)terms * 4 + 64);
+    char* end = program + sprintf(program, "def int main() { return 1");
+    for (int i = 1; i < terms; i++) {
+        end += sprintf(end, "%s1", (i % 2 ? " - " : " + "));
+    }
+    strcpy(end, "; }");
+    ASTNode* ast = run_parser(program);
+    ck_assert_ptr_ne(ast, NULL);
+    ASTNode* node = ast->program.functions->head->funcdecl.body->block.statements->head->funcreturn.value;
+    int operators = 0;
+    while (node->type == BINARYOP) {
+        ck_assert(node->binaryop.right->type == LITERAL);
+        ck_assert(node->binaryop.operator == ((terms - 1 - operators) % 2 ? SUBOP : ADDOP));
+        node = node->binaryop.left;
+        operators++;
+    }
+    ck_assert_int_eq(operators, terms - 1);
+    ASTNode_free(ast);
+    free(program);
+}
+END_TEST
+
+/*
+ * parenthesized expressions consume their "(" (they used to recurse forever)
+ * and must be balanced
+ */
+TEST_INVALID_EXPR(B_paren_unclosed, "(1 + 2")
+TEST_INVALID_EXPR(B_paren_unopened, "1 + 2)")
+TEST_INVALID_EXPR(B_paren_empty, "()")
+
+START_TEST(B_paren_expr)
+{
+    char text[256];
+    CHECK_EXPR("(7)",                 "7");
+    CHECK_EXPR("(a) - (b)",           "(- a b)");
+    CHECK_EXPR("a - (b - c)",         "(- a (- b c))");
+    CHECK_EXPR("!(a && b)",           "(! (&& a b))");
+    CHECK_EXPR("f((1), (x[(2)]))",    "f");
+
+    /* nesting depth only costs stack in the recursive parser */
+    const int depth = 200;
+    char* program = (char*)malloc((size_t)depth * 2 + 64);
+    char* end = program + sprintf(program, "def int main() { return ");
+    memset(end, '(', depth);
+    end[depth] = 'a';
+    memset(end + depth + 1, ')', depth);
+    strcpy(end + depth * 2 + 1, "; }");
+    ASTNode* ast = run_parser(program);
+    ck_assert_ptr_ne(ast, NULL);
+    ASTNode* value = ast->program.functions->head->funcdecl.body->block.statements->head->funcreturn.value;
+    ck_assert(value->type == LOCATION);
+    ck_assert_str_eq(value->location.name, "a");
+    ASTNode_free(ast);
+    free(program);
+}
+END_TEST
+
+/*
+ * differential test of the two parser modes on generated programs (and
+ * truncated copies of them, which must fail or succeed the same way)
+ */
+
+/**
+ * @brief Generated program text (with a simple, deterministic generator so
+ * that failures can be reproduced)
+ */
+typedef struct GenText {
+    char text[16384];
+    size_t length;
+    uint32_t seed;
+} GenText;
+
+static uint32_t gen_next (GenText* gen, uint32_t range)
+{
+    gen->seed = gen->seed * 1103515245 + 12345;
+    return (gen->seed >> 8) % range;
+}
+
+static void gen_put (GenText* gen, const char* text)
+{
+    size_t length = strlen(text);
+    ck_assert(gen->length + length < sizeof(gen->text));
+    memcpy(gen->text + gen->length, text, length + 1);
+    gen->length += length;
+}
+
+static void gen_expr (GenText* gen, int depth)
+{
+    static const char* const binops[] = { " + ", " - ", " * ", " / ", " % ", " < ", " <= ", " >= ",
+                                          " > ", " == ", " != ", " && ", " || " };
+    int terms = 1 + gen_next(gen, depth > 0 ? 4 : 1);
+    for (int i = 0; i < terms; i++) {
+        if (i > 0) {
+            gen_put(gen, binops[gen_next(gen, 13)]);
+        }
+        switch (gen_next(gen, depth > 0 ? 9 : 4)) {
+            case 0:  gen_put(gen, "42"); break;
+            case 1:  gen_put(gen, (gen_next(gen, 2) ? "true" : "0x1F")); break;
+            case 2:  gen_put(gen, "\"s\\t\""); break;
+            case 3:  gen_put(gen, "x"); break;
+            case 4:  gen_put(gen, "a["); gen_expr(gen, depth - 1); gen_put(gen, "]"); break;
+            case 5:  gen_put(gen, "(");  gen_expr(gen, depth - 1); gen_put(gen, ")"); break;
+            case 6:  gen_put(gen, (gen_next(gen, 2) ? "-" : "!")); gen_expr(gen, 0); break;
+            case 7:  gen_put(gen, "-(!"); gen_expr(gen, depth - 1); gen_put(gen, ")"); break;
+            default:
+                gen_put(gen, "f(");
+                for (int arg = gen_next(gen, 3); arg > 0; arg--) {
+                    gen_expr(gen, depth - 1);
+                    gen_put(gen, (arg > 1 ? ", " : ""));
+                }
+                gen_put(gen, ")");
+                break;
+        }
+    }
+}
+
+static void gen_block (GenText* gen, int depth)
+{
+    gen_put(gen, "{ ");
+    for (int vars = gen_next(gen, 3); vars > 0; vars--) {
+        gen_put(gen, (gen_next(gen, 2) ? "int x; " : "bool a[3]; "));
+    }
+    for (int stmts = gen_next(gen, 4); stmts > 0; stmts--) {
+        switch (gen_next(gen, depth > 0 ? 9 : 6)) {
+            case 0:  gen_put(gen, "x = "); gen_expr(gen, 2); gen_put(gen, "; "); break;
+            case 1:  gen_put(gen, "a["); gen_expr(gen, 1); gen_put(gen, "] = "); gen_expr(gen, 2); gen_put(gen, ";\n"); break;
+            case 2:  gen_put(gen, "f("); gen_expr(gen, 1); gen_put(gen, "); "); break;
+            case 3:  gen_put(gen, "return; "); break;
+            case 4:  gen_put(gen, "return "); gen_expr(gen, 2); gen_put(gen, ";\n"); break;
+            case 5:  gen_put(gen, (gen_next(gen, 2) ? "break; " : "continue; ")); break;
+            case 6:  gen_put(gen, "while ("); gen_expr(gen, 2); gen_put(gen, ") "); gen_block(gen, depth - 1); break;
+            default:
+                gen_put(gen, "if ("); gen_expr(gen, 2); gen_put(gen, ")\n");
+                gen_block(gen, depth - 1);
+                if (gen_next(gen, 2)) {
+                    gen_put(gen, " else ");
+                    gen_block(gen, depth - 1);
+                }
+                break;
+        }
+    }
+    gen_put(gen, "}\n");
+}
+
+static void gen_program (GenText* gen, uint32_t seed)
+{
+    gen->length = 0;
+    gen->text[0] = '\0';
+    gen->seed = seed;
+    for (int globals = gen_next(gen, 3); globals > 0; globals--) {
+        gen_put(gen, (gen_next(gen, 2) ? "int g;\n" : "bool h[10];\n"));
+    }
+    for (int funcs = 1 + gen_next(gen, 3); funcs > 0; funcs--) {
+        gen_put(gen, (gen_next(gen, 2) ? "def int f(int x, bool y) " : "def void main() "));
+        gen_block(gen, 3);
+    }
+}
+
+/**
+ * @brief Parse a program in one of the parser modes and print the tree (or
+ * "error") to a string
+ */
+static void parse_and_print (const char* text, ParserMode mode, char* output, size_t size)
+{
+    FILE* out = tmpfile();
+    TokenQueue* volatile tokens = NULL;
+    if (setjmp(decaf_error) == 0) {
+        tokens = lex((char*)text);
+        ASTNode* tree = parse_with_mode(tokens, mode);
+        NodeVisitor_traverse_and_free(PrintVisitor_new(out), tree);
+        ASTNode_free(tree);
+    } else {
+        fputs("error", out);
+    }
+    if (tokens != NULL) {
+        TokenQueue_free(tokens);
+    }
+    read_back(out, output, size);
+}
+
+START_TEST(B_stack_parser_matches)
+{
+    static GenText gen;
+    static char recursive[1 << 17], stack[1 << 17];
+    int valid = 0, invalid = 0;
+    for (uint32_t seed = 1; seed <= 200; seed++) {
+        gen_program(&gen, seed);
+        parse_and_print(gen.text, PARSER_RECURSIVE, recursive, sizeof(recursive));
+        parse_and_print(gen.text, PARSER_STACK, stack, sizeof(stack));
+        ck_assert_msg(strcmp(recursive, "error") != 0, "generated program %u is invalid", seed);
+        ck_assert_msg(strcmp(recursive, stack) == 0, "parser modes differ on program %u", seed);
+        valid++;
+
+        /* cut the program short at a few places */
+        for (int cut = 1; cut <= 4; cut++) {
+            char saved = gen.text[gen.length * cut / 5];
+            gen.text[gen.length * cut / 5] = '\0';
+            parse_and_print(gen.text, PARSER_RECURSIVE, recursive, sizeof(recursive));
+            parse_and_print(gen.text, PARSER_STACK, stack, sizeof(stack));
+            ck_assert_msg(strcmp(recursive, stack) == 0, "parser modes differ on program %u cut at %d/5", seed, cut);
+            invalid += (strcmp(recursive, "error") == 0);
+            gen.text[gen.length * cut / 5] = saved;
+        }
+    }
+    ck_assert_int_eq(valid, 200);
+    ck_assert(invalid > 600);
+
+    /* nesting far deeper than the recursive parser could handle */
+    const int levels = 100000;
+    char* text = (char*)malloc((size_t)levels * 24 + 64);
+    char* end = text + sprintf(text, "def void main() ");
+    for (int i = 0; i < levels; i++) {
+        end += sprintf(end, "{ if (x) ");
+    }
+    end += sprintf(end, "{ if (");
+    for (int i = 0; i < levels; i++) {
+        end += sprintf(end, "a[(-");
+    }
+    end += sprintf(end, "1");
+    for (int i = 0; i < levels; i++) {
+        end += sprintf(end, ")]");
+    }
+    end += sprintf(end, ") { } }");
+    for (int i = 0; i < levels; i++) {
+        end += sprintf(end, " }");
+    }
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = NULL;
+    if (setjmp(decaf_error) == 0) {
+        tree = parse_with_mode(tokens, PARSER_STACK);
+    }
+    ck_assert_ptr_ne(tree, NULL);
+    ASTNode* node = tree->program.functions->head->funcdecl.body;
+    for (int i = 0; i < levels; i++) {
+        node = node->block.statements->head;
+        ck_assert(node->type == CONDITIONAL && node->conditional.condition->type == LOCATION);
+        node = node->conditional.if_block;
+    }
+    node = node->block.statements->head->conditional.condition;
+    for (int i = 0; i < levels; i++) {
+        ck_assert(node->type == LOCATION && node->location.index->type == UNARYOP);
+        node = node->location.index->unaryop.child;
+    }
+    ck_assert(node->type == LITERAL);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+    free(text);
+}
+END_TEST
+
+
+/*
+ * many parses at once on separate threads, each with its own parser context;
+ * every result (tree or error message) must match a parse done alone (with
+ * the scalar kernels; the threads use the selected ones on padded copies),
+ * and the identifier table must stay consistent while the threads add names
+ */
+#define CONCURRENT_THREADS  8
+#define CONCURRENT_ROUNDS   40
+#define CONCURRENT_TEXTS    64
+#define CONCURRENT_OUTPUT   (1 << 17)
+
+static char* concurrent_texts[CONCURRENT_TEXTS];
+static char* concurrent_expected[CONCURRENT_TEXTS];
+
+typedef struct ConcurrentWorker {
+    pthread_t thread;
+    int index;
+    int parses;
+    int failures;
+} ConcurrentWorker;
+
+/**
+ * @brief Parse a program with a parser context and print the tree (or the
+ * error message) to a string
+ *
+ * If @p padded is true, the text must be in a padded buffer.
+ */
+static void parse_with_context (ParserContext* context, const char* text, bool padded, char* output, size_t size)
+{
+    FILE* out = tmpfile();
+    ASTNode* tree = (padded ? ParserContext_parse_padded(context, text) : ParserContext_parse_text(context, text));
+    if (tree != NULL) {
+        NodeVisitor_traverse_and_free(PrintVisitor_new(out), tree);
+        ASTNode_free(tree);
+    } else {
+        fprintf(out, "error: %s", context->error.message);
+    }
+    read_back(out, output, size);
+}
+
+static void throw_at_literal (NodeVisitor* visitor, ASTNode* node)
+{
+    Error_throw("ERROR: literal on line %d\n", node->source_line);
+}
+
+static void* concurrent_worker (void* arg)
+{
+    ConcurrentWorker* worker = (ConcurrentWorker*)arg;
+    char* output = (char*)malloc(CONCURRENT_OUTPUT);
+    ParserContext context;
+    ParserContext_init(&context);
+    for (int round = 0; round < CONCURRENT_ROUNDS; round++) {
+        int which = (worker->index * 11 + round * 3) % CONCURRENT_TEXTS;
+        context.mode = ((worker->index + round) % 2 ? PARSER_STACK : PARSER_RECURSIVE);
+        parse_with_context(&context, concurrent_texts[which], true, output, CONCURRENT_OUTPUT);
+        worker->failures += (strcmp(output, concurrent_expected[which]) != 0);
+        worker->parses++;
+
+        /* names that no other parse uses (so the threads add names together) */
+        char text[512], name[32];
+        size_t length = 0;
+        for (int v = 0; v < 8; v++) {
+            length += sprintf(text + length, "int t%d_%d_%d; ", worker->index, round, v);
+        }
+        ASTNode* tree = ParserContext_parse_text(&context, text);
+        worker->parses++;
+        if (tree == NULL) {
+            worker->failures++;
+            continue;
+        }
+        int v = 0;
+        FOR_EACH(ASTNode*, var, tree->program.variables) {
+            sprintf(name, "t%d_%d_%d", worker->index, round, v++);
+            worker->failures += (strcmp(var->vardecl.name, name) != 0 ||
+                                 intern_string(name) != var->vardecl.name ||
+                                 intern_name(intern_id(var->vardecl.name)) != var->vardecl.name);
+        }
+        worker->failures += (v != 8);
+        ASTNode_free(tree);
+    }
+    free(output);
+    return NULL;
+}
+
+START_TEST(C_concurrent_parses)
+{
+    /* valid programs, truncated ones, and a lexer error; expected results come from parsing alone */
+    static GenText gen;
+    char* output = (char*)malloc(CONCURRENT_OUTPUT);
+    ParserContext context;
+    ParserContext_init(&context);
+    for (int i = 0; i < CONCURRENT_TEXTS; i++) {
+        const char* text = "int x;\ndef void main() { x = 1 $ 2; }";
+        if (i < CONCURRENT_TEXTS - 1) {
+            gen_program(&gen, 1000 + i / 2);
+            if (i % 2 != 0) {
+                gen.text[gen.length * 2 / 3] = '\0';
+            }
+            text = gen.text;
+        }
+        concurrent_texts[i] = scan_buffer_alloc(strlen(text));
+        strcpy(concurrent_texts[i], text);
+        context.mode = PARSER_RECURSIVE;
+        parse_with_context(&context, concurrent_texts[i], false, output, CONCURRENT_OUTPUT);
+        concurrent_expected[i] = copy_string(output);
+    }
+    ck_assert(strncmp(concurrent_expected[0], "error: ", 7) != 0);
+    ck_assert_str_eq(concurrent_expected[CONCURRENT_TEXTS - 1], "error: Invalid token on line 2: \"$\"\n");
+
+    /* a context catches its own errors; without one, they still reach decaf_error */
+    ck_assert_ptr_eq(ParserContext_parse_text(&context, "int"), NULL);
+    ck_assert(strlen(context.error.message) > 0);
+    TokenQueue* tokens = lex("int");
+    volatile bool caught = false;
+    if (setjmp(decaf_error) == 0) {
+        parse(tokens);
+    } else {
+        caught = true;
+    }
+    ck_assert(caught);
+    TokenQueue_free(tokens);
+
+    /* errors thrown during a traversal reach the innermost handler too, and the
+     * abandoned traversal does not get in the way of the next one */
+    ASTNode* tree = ParserContext_parse_text(&context, "int a; def int main() { return a + 1; }");
+    ck_assert_ptr_ne(tree, NULL);
+    NodeVisitor* thrower = NodeVisitor_new();
+    thrower->previsit_literal = throw_at_literal;
+    ErrorHandler handler;
+    volatile bool thrown = false;
+    ErrorHandler_push(&handler);
+    if (setjmp(handler.target) == 0) {
+        NodeVisitor_traverse(thrower, tree);
+    } else {
+        NodeVisitor_release_stack();
+        thrown = true;
+    }
+    ErrorHandler_pop(&handler);
+    ck_assert(thrown);
+    ck_assert_str_eq(handler.message, "ERROR: literal on line 1\n");
+    NodeVisitor_free(thrower);
+    int visited = 0;
+    NodeVisitor* counter = NodeVisitor_new();
+    counter->data = &visited;
+    counter->previsit_default = count_call;
+    NodeVisitor_traverse_and_free(counter, tree);
+    ck_assert_int_eq(visited, 8);
+    ASTNode_free(tree);
+
+    ConcurrentWorker workers[CONCURRENT_THREADS];
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        workers[i] = (ConcurrentWorker){ .index = i };
+        ck_assert_int_eq(pthread_create(&workers[i].thread, NULL, concurrent_worker, &workers[i]), 0);
+    }
+    int parses = 0, failures = 0;
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+        parses += workers[i].parses;
+        failures += workers[i].failures;
+    }
+    ck_assert_int_eq(parses, CONCURRENT_THREADS * CONCURRENT_ROUNDS * 2);
+    ck_assert_int_eq(failures, 0);
+
+    for (int i = 0; i < CONCURRENT_TEXTS; i++) {
+        free(concurrent_texts[i]);
+        free(concurrent_expected[i]);
+    }
+    free(output);
+}
+END_TEST
+
+
+/*
+ * batch compilation: response files, largest-first order, and results
+ */
+#define BATCH_FILES 6
+
+typedef struct BatchLog {
+    char order[BATCH_FILES * 2];
+    int runs[BATCH_FILES];
+    int count;
+} BatchLog;
+
+static bool log_batch_file (const char* filename, void* data)
+{
+    BatchLog* log = (BatchLog*)data;
+    int index = filename[strlen(filename) - 1] - '0';
+    log->runs[index]++;
+    log->order[log->count++] = (char)('0' + index);
+    return (index != 3);
+}
+
+START_TEST(C_batch_schedule)
+{
+    /* file i is 100 * sizes[i] bytes; file 5 is missing */
+    static const int sizes[BATCH_FILES - 1] = { 2, 5, 1, 5, 3 };
+    char filename[32];
+    for (int i = 0; i < BATCH_FILES - 1; i++) {
+        sprintf(filename, "batch_test.%d", i);
+        FILE* file = fopen(filename, "w");
+        for (int b = 0; b < sizes[i] * 100; b++) {
+            fputc(' ', file);
+        }
+        fclose(file);
+    }
+    FILE* inner = fopen("batch_test.inner", "w");
+    fputs("  batch_test.3\n\tbatch_test.0 ", inner);
+    fclose(inner);
+    FILE* outer = fopen("batch_test.outer", "w");
+    fputs("batch_test.2\n@batch_test.inner batch_test.5\nbatch_test.1", outer);
+    fclose(outer);
+
+    Batch* batch = Batch_new();
+    ck_assert(Batch_add(batch, "batch_test.4"));
+    ck_assert(Batch_add(batch, "@batch_test.outer"));
+    ck_assert(!Batch_add(batch, "@batch_test.none"));
+    ck_assert_int_eq(batch->count, BATCH_FILES);
+
+    /* one thread: largest first, ties in the order given */
+    BatchLog log = { .count = 0 };
+    BatchStats stats = Batch_run(batch, 1, log_batch_file, &log);
+    ck_assert_str_eq(log.order, "314025");
+    ck_assert_int_eq(stats.files, BATCH_FILES);
+    ck_assert_int_eq(stats.failed, 1);
+    ck_assert_int_eq(stats.bytes, 1600);
+    ck_assert(!batch->files[0].succeeded && batch->files[1].succeeded);
+
+    /* several threads: every file exactly once */
+    memset(&log, 0, sizeof(log));
+    stats = Batch_run(batch, 4, log_batch_file, &log);
+    ck_assert_int_eq(log.count, BATCH_FILES);
+    for (int i = 0; i < BATCH_FILES; i++) {
+        ck_assert_int_eq(log.runs[i], 1);
+    }
+    ck_assert_int_eq(stats.failed, 1);
+    Batch_free(batch);
+
+    for (int i = 0; i < BATCH_FILES - 1; i++) {
+        sprintf(filename, "batch_test.%d", i);
+        remove(filename);
+    }
+    remove("batch_test.inner");
+    remove("batch_test.outer");
+}
+END_TEST
+
+
+/*
+ * compile server: replies match compiling in-process, errors and bad requests
+ * are reported, several clients at once are served, and a shutdown request
+ * stops the server
+ */
+#define SERVER_CLIENTS 4
+
+static const char* server_test_socket = "server_test.sock";
+
+static void* run_test_server (void* server)
+{
+    Server_run((Server*)server);
+    return NULL;
+}
+
+static void* server_client (void* arg)
+{
+    int* failures = (int*)arg;
+    GenText* gen = (GenText*)malloc(sizeof(GenText));
+    char* expected = (char*)malloc(CONCURRENT_OUTPUT);
+    ParserContext context;
+    ParserContext_init(&context);
+    for (uint32_t seed = 1; seed <= 10; seed++) {
+        gen_program(gen, 2000 + seed);
+        parse_with_context(&context, gen->text, false, expected, CONCURRENT_OUTPUT);
+        ServerReply reply;
+        if (!Server_request(server_test_socket, SERVER_TEXT, SERVER_AST, gen->text, gen->length, &reply)) {
+            (*failures)++;
+            continue;
+        }
+        *failures += (reply.status != SERVER_OK || strcmp(reply.text, expected) != 0);
+        free(reply.text);
+    }
+    free(expected);
+    free(gen);
+    return NULL;
+}
+
+/**
+ * @brief Keep one connection busy with requests until the server closes it
+ *
+ * @returns Number of requests answered
+ */
+static int hold_connection (const char* socket_path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strcpy(address.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return 0;
+    }
+    static const char request[] = "T1Aint x;";
+    uint32_t size = htonl(sizeof(request) - 1);
+    char reply[4096];
+    int answered = 0;
+    while (answered < 100) {
+        if (send(fd, &size, sizeof(size), MSG_NOSIGNAL) != sizeof(size) ||
+                send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) != sizeof(request) - 1) {
+            break;
+        }
+        uint32_t length;
+        if (recv(fd, &length, sizeof(length), MSG_WAITALL) != sizeof(length) ||
+                ntohl(length) > sizeof(reply) ||
+                recv(fd, reply, ntohl(length), MSG_WAITALL) != (ssize_t)ntohl(length)) {
+            break;
+        }
+        answered++;
+        nanosleep(&(struct timespec){ .tv_nsec = 50 * 1000 * 1000 }, NULL);
+    }
+    close(fd);
+    return answered;
+}
+
+START_TEST(C_compile_server)
+{
+    ServerOptions options = { .workers = 2, .queue_capacity = 8, .timeout_ms = 2000, .connection_ms = 500 };
+    Server* server = Server_open(server_test_socket, &options);
+    ck_assert_ptr_ne(server, NULL);
+    ck_assert_ptr_eq(Server_open(server_test_socket, &options), NULL);
+    pthread_t thread;
+    ck_assert_int_eq(pthread_create(&thread, NULL, run_test_server, server), 0);
+
+    /* AST and graph output, from text and from a file */
+    ServerReply reply;
+    const char* program = "int a;\ndef int main() { return a * 2; }\n";
+    ck_assert(Server_request(server_test_socket, SERVER_TEXT, SERVER_AST, program, strlen(program), &reply));
+    ck_assert_int_eq(reply.status, SERVER_OK);
+    ck_assert_int_eq(reply.length, strlen(reply.text));
+    ck_assert(strncmp(reply.text, "Program [line 1]\n  VarDecl name=\"a\"", 35) == 0);
+    free(reply.text);
+    ck_assert(Server_request(server_test_socket, SERVER_TEXT, SERVER_DOT, program, strlen(program), &reply));
+    ck_assert_int_eq(reply.status, SERVER_OK);
+    ck_assert(strncmp(reply.text, "digraph AST {\n", 14) == 0);
+    free(reply.text);
+    FILE* file = fopen("server_test.decaf", "w");
+    fputs(program, file);
+    fclose(file);
+    ck_assert(Server_request(server_test_socket, SERVER_PATH, SERVER_SVG, "server_test.decaf", 17, &reply));
+    ck_assert_int_eq(reply.status, SERVER_OK);
+    ck_assert(strstr(reply.text, "<svg") != NULL);
+    free(reply.text);
+    remove("server_test.decaf");
+
+    /* several outputs of one program in a single request */
+    ServerOutput outputs[] = { SERVER_AST, SERVER_DOT, SERVER_SVG };
+    ServerReply replies[3];
+    ck_assert(Server_request_outputs(server_test_socket, SERVER_TEXT, outputs, 3, program, strlen(program), replies));
+    for (int i = 0; i < 3; i++) {
+        ck_assert_int_eq(replies[i].status, SERVER_OK);
+        ck_assert(Server_request(server_test_socket, SERVER_TEXT, outputs[i], program, strlen(program), &reply));
+        ck_assert_str_eq(replies[i].text, reply.text);
+        free(reply.text);
+        free(replies[i].text);
+    }
+    ck_assert(Server_request_outputs(server_test_socket, SERVER_TEXT, outputs, 3, "int $;", 6, replies));
+    ck_assert_int_eq(replies[0].status, SERVER_ERROR);
+    ck_assert_ptr_eq(replies[1].text, NULL);
+    ck_assert_ptr_eq(replies[2].text, NULL);
+    free(replies[0].text);
+    ck_assert(!Server_request_outputs(server_test_socket, SERVER_TEXT, outputs, 0, program, strlen(program), replies));
+
+    /* errors in the program, unreadable files, and invalid requests */
+    ck_assert(Server_request(server_test_socket, SERVER_TEXT, SERVER_AST, "int x;\nint $;", 13, &reply));
+    ck_assert_int_eq(reply.status, SERVER_ERROR);
+    ck_assert_str_eq(reply.text, "Invalid token on line 2: \"$;\"\n");
+    free(reply.text);
+    ck_assert(Server_request(server_test_socket, SERVER_PATH, SERVER_AST, "server_test.none", 16, &reply));
+    ck_assert_int_eq(reply.status, SERVER_FAILED);
+    free(reply.text);
+    ck_assert(Server_request(server_test_socket, SERVER_TEXT, (ServerOutput)'X', "int x;", 6, &reply));
+    ck_assert_int_eq(reply.status, SERVER_FAILED);
+    ck_assert_str_eq(reply.text, "Invalid request\n");
+    free(reply.text);
+
+    /* a client that keeps sending requests is still cut off after a while */
+    int answered = hold_connection(server_test_socket);
+    ck_assert_int_ge(answered, 2);
+    ck_assert_int_lt(answered, 100);
+
+    /* several clients at once */
+    pthread_t clients[SERVER_CLIENTS];
+    int failures[SERVER_CLIENTS] = { 0 };
+    for (int i = 0; i < SERVER_CLIENTS; i++) {
+        ck_assert_int_eq(pthread_create(&clients[i], NULL, server_client, &failures[i]), 0);
+    }
+    for (int i = 0; i < SERVER_CLIENTS; i++) {
+        pthread_join(clients[i], NULL);
+        ck_assert_int_eq(failures[i], 0);
+    }
+
+    ck_assert(Server_request(server_test_socket, SERVER_SHUTDOWN, SERVER_AST, "", 0, &reply));
+    ck_assert_int_eq(reply.status, SERVER_OK);
+    free(reply.text);
+    pthread_join(thread, NULL);
+    Server_free(server);
+    ck_assert(!Server_request(server_test_socket, SERVER_TEXT, SERVER_AST, program, strlen(program), &reply));
+    ck_assert_ptr_eq(fopen(server_test_socket, "r"), NULL);
+
+    /* the identifier table is emptied between requests once it holds too many names */
+    options.name_limit = 100;
+    server = Server_open(server_test_socket, &options);
+    ck_assert_ptr_ne(server, NULL);
+    ck_assert_int_eq(pthread_create(&thread, NULL, run_test_server, server), 0);
+    char names[2048];
+    size_t length = 0;
+    for (int v = 0; v < 150; v++) {
+        length += sprintf(names + length, "int n%d; ", v);
+    }
+    ck_assert(Server_request(server_test_socket, SERVER_TEXT, SERVER_AST, names, length, &reply));
+    ck_assert_int_eq(reply.status, SERVER_OK);
+    ck_assert(strstr(reply.text, "VarDecl name=\"n149\"") != NULL);
+    free(reply.text);
+    ck_assert_int_le(intern_count(), 100);
+    ck_assert(Server_request(server_test_socket, SERVER_TEXT, SERVER_AST, program, strlen(program), &reply));
+    ck_assert_int_eq(reply.status, SERVER_OK);
+    ck_assert(strncmp(reply.text, "Program [line 1]\n  VarDecl name=\"a\"", 35) == 0);
+    free(reply.text);
+    ck_assert(Server_request(server_test_socket, SERVER_SHUTDOWN, SERVER_AST, "", 0, &reply));
+    free(reply.text);
+    pthread_join(thread, NULL);
+    Server_free(server);
+}
+END_TEST
 
 #endif
 
@@ -98,6 +1971,7 @@ void public_tests (Suite *s)
     TEST(D_trivial);
     TEST(D_int_var);
     TEST(D_bool_var);
+    TEST(D_lex_tokens);
 
     TEST(D_invalid_vardecl_no_type);
     TEST(D_invalid_vardecl_no_semicolon);
@@ -113,6 +1987,10 @@ void public_tests (Suite *s)
     TEST(C_return);
     TEST(C_return_val);
     TEST(C_invalid_return_break);
+    TEST(C_lex_longest_match);
+    TEST(C_lex_reserved_word);
+    TEST(C_lex_token_kinds);
+    TEST(C_lex_invalid_char);
     TEST(C_declit);
     TEST(C_hexlit);
     TEST(C_strlit);
@@ -123,13 +2001,51 @@ void public_tests (Suite *s)
     TEST(B_param_func);
     TEST(B_conditional);
     TEST(B_whileloop);
+    TEST(B_funccall_stmt);
+    TEST(B_funccall_expr);
+    TEST(B_funccall_unclosed);
+    TEST(B_funccall_extra_paren);
+    TEST(B_funccall_tree);
     TEST(B_add_expr);
     TEST(B_add_expr_bool);
     TEST(B_neg_expr);
     TEST(B_invalid_add);
+    TEST(B_lex_unterminated_string);
+    TEST(C_lex_stream_matches);
+    TEST(C_token_queue_cursor);
+    TEST(B_parse_stream);
+    TEST(B_scan_kernels_match);
+    TEST(B_lex_kernels_match);
+    TEST(C_source_page_multiple);
+    TEST(B_source_large);
 
     TEST(A_arrays);
     TEST(A_newline);
+    TEST(B_strlit_escapes);
+    TEST(B_strlit_escaped_quotes);
+    TEST(B_strlit_escaped_backslash);
+    TEST(B_strlit_escapes_adjacent);
+    TEST(C_long_identifier);
+    TEST(C_interned_names);
+    TEST(B_ast_arena);
+    TEST(C_flat_ast);
+    TEST(C_attribute_keys);
+    TEST(B_parent_depth);
+    TEST(C_composite_visitor);
+    TEST(C_deep_traversal);
+    TEST(C_traversal_control);
+    TEST(C_parallel_traversal);
+    TEST(C_buffered_print);
+    TEST(C_tree_layout);
+    TEST(C_expr_precedence);
+    TEST(B_paren_unclosed);
+    TEST(B_paren_unopened);
+    TEST(B_paren_empty);
+    TEST(B_paren_expr);
+    TEST(B_stack_parser_matches);
+    TEST(C_concurrent_parses);
+    TEST(C_batch_schedule);
+    TEST(C_compile_server);
 
     suite_add_tcase (s, tc);
 }
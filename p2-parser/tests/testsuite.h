@@ -14,6 +14,11 @@
 
 #include "p1-lexer.h"
 #include "p2-parser.h"
+#include "source.h"
+#include "flatast.h"
+#include "outbuf.h"
+#include "treelayout.h"
+#include "visitor.h"
 
 /**
  * @brief Define a test case with a valid program
@@ -80,6 +85,11 @@ END_TEST
  */
 #define TEST(NAME) tcase_add_test (tc, NAME)
 
+/**
+ * @brief Exception handler target (defined in testsuite.c)
+ */
+extern jmp_buf decaf_error;
+
 /**
  * @brief Run lexer and parser on given text
  *